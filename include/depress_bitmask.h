@@ -0,0 +1,82 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEPRESS_BITMASK_H
+#define DEPRESS_BITMASK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// 1-bit image, rows are packed as in PBM: first pixel of the row is the most significant bit
+// of its first byte, 1 is black. Rows start at 8 byte boundary, so most operations work with
+// 64-bit words. Bits after width in the row are always 0.
+typedef struct {
+	unsigned int width;
+	unsigned int height;
+	size_t stride; // Bytes in row, multiple of 8
+	uint64_t *words;
+} depress_bitmask_type;
+
+// Run of set pixels [x0, x1) in row y
+typedef struct {
+	unsigned int y;
+	unsigned int x0;
+	unsigned int x1;
+} depress_bitmask_run_type;
+
+// Connected component: bounding box [x0, x1) x [y0, y1) and its runs
+typedef struct {
+	unsigned int x0;
+	unsigned int y0;
+	unsigned int x1;
+	unsigned int y1;
+	size_t first_run;
+	size_t nof_runs;
+} depress_bitmask_component_type;
+
+#define depressBitmaskRow(mask, y) ((unsigned char *)(mask)->words+(size_t)(y)*(mask)->stride)
+
+extern bool depressBitmaskCreate(depress_bitmask_type *mask, unsigned int width, unsigned int height);
+extern void depressBitmaskDestroy(depress_bitmask_type *mask);
+extern void depressBitmaskInvert(depress_bitmask_type *mask);
+extern void depressBitmaskInvertRow(depress_bitmask_type *mask, unsigned int y);
+extern bool depressBitmaskReduce(const depress_bitmask_type *src, depress_bitmask_type *dst, bool all);
+extern void depressBitmaskReduceRow(const depress_bitmask_type *src, depress_bitmask_type *dst, unsigned int r, bool all, uint64_t *acc);
+extern void depressBitmaskFromGray(depress_bitmask_type *mask, const unsigned char *buf);
+extern bool depressBitmaskGetComponents(const depress_bitmask_type *mask, depress_bitmask_run_type **runs, depress_bitmask_component_type **components, size_t *nof_components);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
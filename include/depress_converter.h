@@ -50,6 +50,8 @@ enum {
 };
 
 extern int depressDjvuConvertPage(depress_flags_type flags, depress_load_image_type load_image, void *load_image_ctx, size_t load_image_id, wchar_t *tempfile, wchar_t *outputfile, depress_djvulibre_paths_type *djvulibre_paths);
+extern int depressDjvuConvertPageToPbm(const depress_flags_type flags, depress_load_image_type load_image, void *load_image_ctx, size_t load_image_id, wchar_t *pbmfile);
+extern int depressDjvuGetPageDpi(const depress_flags_type *flags);
 
 #ifdef __cplusplus
 }
@@ -56,6 +56,9 @@ typedef struct {
 	int page_title_type;
 	unsigned int page_title_type_flags;
 	depress_outline_type *outline;
+	unsigned int shared_palette_pages; // Number of pages sampled for document wide noteshrink palette, 0 to disable
+	unsigned int shared_dict_pages; // Number of BW pages encoded by minidjvu with one shared dictionary, 0 to disable
+	bool dedup; // Encode pages with the same data and flags only once
 	bool keep_data;
 } depress_document_flags_type;
 
@@ -72,6 +75,9 @@ typedef struct {
 	unsigned int threads_num;
 	// Document wide flags
 	depress_document_flags_type document_flags;
+	// Shared noteshrink palettes
+	float **shared_palettes;
+	size_t shared_palettes_num;
 	// Handles
 	depress_event_handle_t global_error_event;
 	// Converter
@@ -91,6 +97,8 @@ extern bool depressDocumentFinalize(depress_document_type *document);
 extern size_t depressDocumentGetPagesProcessed(depress_document_type *document);
 extern bool depressDocumentAddTask(depress_document_type *document, const depress_load_image_type load_image, void *load_image_ctx, const depress_flags_type flags);
 extern bool depressDocumentAddTaskFromImageFile(depress_document_type *document, const wchar_t *inputfile, const depress_flags_type flags);
+extern bool depressDocumentAddTasksFromTiffFile(depress_document_type *document, const wchar_t *inputfile, const depress_flags_type flags);
+extern bool depressDocumentAddTasksFromZipFile(depress_document_type *document, const wchar_t *inputfile, const depress_flags_type flags);
 extern bool depressDocumentCreateTasksFromTextFile(depress_document_type *document, const wchar_t *textfile, const wchar_t *textfilepath, depress_flags_type flags);
 extern void depressSetDefaultDocumentFlags(depress_document_flags_type *document_flags);
 extern void depressFreeDocumentFlags(depress_document_flags_type *document_flags);
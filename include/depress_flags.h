@@ -51,6 +51,11 @@ enum {
 	DEPRESS_PAGE_TYPE_BW_PARAM1_ADAPTIVE
 };
 
+enum {
+	DEPRESS_PAGE_TYPE_BW_PARAM2_FLOYDSTEINBERG,
+	DEPRESS_PAGE_TYPE_BW_PARAM2_STUCKI
+};
+
 enum {
 	DEPRESS_PAGE_TYPE_PALETTIZED_PARAM2_QUANT,
 	DEPRESS_PAGE_TYPE_PALETTIZED_PARAM2_NOTESHRINK
@@ -66,12 +71,20 @@ typedef struct {
 typedef struct {
 	depress_illustration_rect_type *illrects;
 	size_t nof_illrects;
+	bool detect_illrects; // Find illustration rectangles on BW pages without illrects
+	bool mmr; // Encode lossless bilevel data with built-in G4/MMR encoder instead of cjb2
+	bool bgjpeg; // Encode photo pages and backgrounds of compound pages with built-in JPEG encoder instead of c44
+	bool passthrough; // Put JPEG files of photo pages and G4 data of BW TIFF pages into pages as is
+	bool libdjvu; // Encode BW and photo pages with linked DjVuLibre instead of cjb2 and c44 (if built with it)
+	bool tiled; // Threshold layered pages by tiles, so working memory of thresholding is bounded by tile size
 	int type;
 	int param1;
 	int param2;
 	int quality; // 0..100
 	int dpi;
+	int resample_dpi; // Downsample pages from dpi to resample_dpi right after decode (0 - keep dpi)
 	wchar_t *page_title;
+	const float *shared_palette; // Document wide noteshrink palette, owned by document
 	bool keep_data;
 } depress_flags_type;
 
@@ -0,0 +1,66 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEPRESS_IFF_H
+#define DEPRESS_IFF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <wchar.h>
+
+// Chunk of IFF85 file (as used by DjVu), chunk owns its data
+typedef struct {
+	char id[4];
+	uint32_t size;
+	unsigned char *data;
+} depress_iff_chunk_type;
+
+// FORM with plain chunks. Nested FORMs are kept as chunks with id "FORM"
+typedef struct {
+	char form_id[4]; // Secondary id of the FORM, like "DJVU"
+	depress_iff_chunk_type *chunks;
+	size_t nof_chunks;
+} depress_iff_form_type;
+
+extern bool depressIffLoad(const wchar_t *filename, depress_iff_form_type *form);
+extern bool depressIffSave(const wchar_t *filename, const depress_iff_form_type *form);
+extern void depressIffFree(depress_iff_form_type *form);
+extern bool depressIffAddChunk(depress_iff_form_type *form, const char *id, const unsigned char *data, uint32_t size);
+extern bool depressIffCopyChunks(depress_iff_form_type *dst, const depress_iff_form_type *src, const char *id, const char *new_id, size_t *nof_copied);
+extern bool depressIffAddDjvuInfo(depress_iff_form_type *form, unsigned int width, unsigned int height, int dpi);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -42,21 +42,58 @@ typedef struct {
 	bool (* load_from_ctx)(void *ctx, size_t id, int *sizex, int *sizey, int *channels, unsigned char **buf, depress_flags_type flags);
 	void (* free_ctx)(void *ctx, size_t id);
 	wchar_t *(* get_name)(void *ctx, size_t id);
+	bool (* get_hash)(void *ctx, size_t id, uint64_t *hash); // Optional, hash of source data to find duplicate pages
+	bool (* load_data)(void *ctx, size_t id, unsigned char **data, size_t *size); // Optional, source data as is, to put already compressed images into pages and compare duplicates
 } depress_load_image_type;
 
+#define DEPRESS_HASH_INIT 14695981039346656037ULL
+
 extern bool depressImageLoadFromCtx(void *ctx, size_t id, int *sizex, int *sizey, int *channels, unsigned char **buf, depress_flags_type flags);
 extern void depressImageFreeCtx(void *ctx, size_t id);
 extern wchar_t *depressImageGetNameCtx(void *ctx, size_t id);
+extern bool depressImageGetHashCtx(void *ctx, size_t id, uint64_t *hash);
+extern bool depressImageLoadDataCtx(void *ctx, size_t id, unsigned char **data, size_t *size);
+
+// Source of pages of multi-page TIFF file, ids of pages go one by one from first_id
+extern void *depressImageTiffCreateCtx(const wchar_t *filename, size_t first_id, size_t *nof_pages);
+extern bool depressImageTiffLoadFromCtx(void *ctx, size_t id, int *sizex, int *sizey, int *channels, unsigned char **buf, depress_flags_type flags);
+extern void depressImageTiffFreeCtx(void *ctx, size_t id);
+extern wchar_t *depressImageTiffGetNameCtx(void *ctx, size_t id);
+extern bool depressImageTiffGetHashCtx(void *ctx, size_t id, uint64_t *hash);
+extern bool depressImageTiffLoadDataCtx(void *ctx, size_t id, unsigned char **data, size_t *size);
+
+// Source of pages of ZIP (CBZ) archive, ids of pages go one by one from first_id
+extern void *depressImageZipCreateCtx(const wchar_t *filename, size_t first_id, size_t *nof_pages);
+extern bool depressImageZipLoadFromCtx(void *ctx, size_t id, int *sizex, int *sizey, int *channels, unsigned char **buf, depress_flags_type flags);
+extern void depressImageZipFreeCtx(void *ctx, size_t id);
+extern wchar_t *depressImageZipGetNameCtx(void *ctx, size_t id);
+extern bool depressImageZipGetHashCtx(void *ctx, size_t id, uint64_t *hash);
+extern bool depressImageZipLoadDataCtx(void *ctx, size_t id, unsigned char **data, size_t *size);
+
+extern uint64_t depressHashData(uint64_t hash, const void *data, size_t size);
 
 extern bool depressLoadImageForPreview(wchar_t *filename, int *sizex, int *sizey, int *channels, unsigned char **buf, depress_flags_type flags);
 extern bool depressLoadImageFromFileAndApplyFlags(wchar_t *filename, int *sizex, int *sizey, int *channels, unsigned char **buf, depress_flags_type flags);
+extern bool depressImageDecodeMemory(const unsigned char *data, size_t size, int *sizex, int *sizey, int *channels, unsigned char **buf, int desired_channels);
+extern int depressImageGetDesiredChannels(depress_flags_type flags);
+extern bool depressImageConvertChannels(unsigned char **buf, int sizex, int sizey, int *channels, int desired_channels);
+extern bool depressImageApplyFlags(unsigned char **buf, int *sizex, int *sizey, int channels, depress_flags_type flags);
 extern unsigned char *depressLoadImage(FILE *f, int *sizex, int *sizey, int *channels, int desired_channels);
 extern int depressImageDetectType(int sizex, int sizey, int channels, const unsigned char *buf);
 extern void depressImageSimplyBinarize(unsigned char **buf, int sizex, int sizey, int channels);
-extern void depressImageApplyErrorDiffusion(unsigned char *buf, int sizex, int sizey);
+extern bool depressImageResample(unsigned char **buf, int *sizex, int *sizey, int channels, int from_dpi, int to_dpi);
+extern bool depressImageResampleBilevel(unsigned char **buf, int *sizex, int *sizey, int from_dpi, int to_dpi);
+extern int depressImageResampleSize(int size, int from_dpi, int to_dpi);
+extern bool depressImageIsNeutral(int sizex, int sizey, int channels, const unsigned char *buf);
+extern void depressImageConvertToGray(unsigned char **buf, int sizex, int sizey, int channels);
+extern bool depressImageApplyErrorDiffusion(unsigned char *buf, int sizex, int sizey, int kernel);
 extern bool depressImageApplyAdaptiveBinarization(unsigned char *buf, int sizex, int sizey);
 extern bool depressImageApplyQuantization(unsigned char *buf, int sizex, int sizey, int colors);
-extern bool depressImageApplyNoteshrink(unsigned char *buf, int sizex, int sizey, int colors);
+extern bool depressImageApplyNoteshrink(unsigned char *buf, int sizex, int sizey, int colors, const float *shared_palette);
+extern bool depressImageMakeIndexed(const unsigned char *buf, int sizex, int sizey, int max_colors, unsigned char *palette, int *colors, unsigned char **indices, int *bg_index);
+extern bool depressImageSampleNoteshrinkPixels(const unsigned char *buf, int sizex, int sizey, int channels, size_t nof_pages, unsigned char **samples, size_t *samples_num);
+extern float *depressImageCreateNoteshrinkPalette(unsigned char *samples, size_t samples_num, int colors);
+extern bool depressImageDetectIllrects(const unsigned char *buf, int sizex, int sizey, int channels, depress_illustration_rect_type **illrects, size_t *nof_illrects);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,50 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEPRESS_JPEG_H
+#define DEPRESS_JPEG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Encodes gray (channels is 1) or RGB (channels is 3) image with baseline JPEG (quality from 1 to 100).
+// Every row of MCUs is a restart interval, so rows are encoded in parallel. data is allocated with malloc.
+extern bool depressJpegEncode(unsigned int sizex, unsigned int sizey, int channels, const unsigned char *buf, int quality, unsigned char **data, size_t *size);
+// Reads size and number of channels from JPEG header. Returns false if data is not 8 bit
+// baseline or progressive JPEG with 1 or 3 channels (the ones DjVu viewers decode)
+extern bool depressJpegGetInfo(const unsigned char *data, size_t size, unsigned int *sizex, unsigned int *sizey, int *channels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -46,7 +46,9 @@ typedef struct {
 
 typedef struct {
 	int (* convert_ctx)(void *ctx, size_t id, depress_flags_type flags, depress_load_image_type load_image, void *load_image_ctx);
-	bool (* merge_ctx)(void* ctx, size_t id);
+	bool (* merge_ctx)(void* ctx, size_t id, depress_flags_type flags); // Called in order of pages, also for the first page
+	bool (* finish_merge_ctx)(void* ctx); // Called after the last page is merged
+	bool (* merge_duplicate_ctx)(void* ctx, size_t id, size_t original_id); // Optional, called instead of merge_ctx for copy of already merged page
 	void (* cleanup_ctx)(void *ctx, size_t id);
 	bool (* finalize_ctx)(void* ctx, depress_maker_finalize_type finalize);
 	void (* free_ctx)(void *ctx);
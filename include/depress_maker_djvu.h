@@ -38,10 +38,23 @@ typedef struct {
 	depress_djvulibre_paths_type djvulibre_paths;
 	wchar_t temp_path[32768];
 	const wchar_t *output_file;
+	// BW pages encoded together by minidjvu with shared dictionary
+	unsigned int shared_dict_pages; // Pages in one dictionary, 0 to encode every page with cjb2
+	size_t *pending_pages; // Pages saved as PBM and waiting for minidjvu
+	size_t nof_pending_pages;
+	int pending_dpi;
+	int pending_aggression; // minidjvu aggression, 0 for lossless
+	bool is_output_created;
+	// Page number (from 1) in the output file of every merged task, duplicates are copied from there
+	size_t *page_numbers;
+	size_t page_numbers_max;
+	size_t nof_pages;
 } depress_maker_djvu_ctx_type;
 
 extern int depressMakerDjvuConvertCtx(void *ctx, size_t id, depress_flags_type flags, depress_load_image_type load_image, void *load_image_ctx);
-extern bool depressMakerDjvuMergeCtx(void *ctx, size_t id);
+extern bool depressMakerDjvuMergeCtx(void *ctx, size_t id, depress_flags_type flags);
+extern bool depressMakerDjvuFinishMergeCtx(void *ctx);
+extern bool depressMakerDjvuMergeDuplicateCtx(void *ctx, size_t id, size_t original_id);
 extern void depressMakerDjvuCleanupCtx(void *ctx, size_t id);
 extern bool depressMakerDjvuFinalizeCtx(void *ctx, const depress_maker_finalize_type finalize);
 extern void depressMakerDjvuFreeCtx(void *ctx);
@@ -0,0 +1,54 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEPRESS_MMR_H
+#define DEPRESS_MMR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "depress_bitmask.h"
+
+// Encodes the mask with CCITT G4 (MMR) and makes data of DjVu Smmr chunk (allocated with malloc).
+// Mask is split into strips that are encoded independently, so they are encoded in parallel.
+extern bool depressMmrEncode(const depress_bitmask_type *mask, unsigned char **data, size_t *size);
+// Makes data of Smmr chunk from already encoded G4 strips of rows_per_strip rows (as in TIFF files).
+// Inverted data has black pixels coded as white runs.
+extern bool depressMmrMakeChunk(unsigned int width, unsigned int height, bool inverted, unsigned int rows_per_strip, const unsigned char * const *strips, const size_t *strip_sizes, size_t nof_strips, unsigned char **data, size_t *size);
+// Decodes G4 data of one strip into packed rows (the highest bit first, 1 is black run of G4 code)
+extern bool depressMmrDecode(const unsigned char *data, size_t size, unsigned int width, unsigned int rows, unsigned char *buf, size_t stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -45,6 +45,9 @@ typedef struct {
 	wchar_t djvused_path[32768];
 	wchar_t djvuextract_path[32768];
 	wchar_t djvumake_path[32768];
+	// minidjvu is separate program (not part of DjVuLibre), needed only for shared dictionaries.
+	// It's searched in DjVuLibre folder (on Windows) and in PATH, empty if it isn't found
+	wchar_t minidjvu_path[32768];
 } depress_djvulibre_paths_type;
 
 extern size_t depressGetFilenameToOpen(const wchar_t *inp_path, const wchar_t *inp_filename, const wchar_t *file_ext, size_t buflen, wchar_t *out_filename, wchar_t **out_filename_start);
@@ -58,6 +58,7 @@ typedef struct {
 	wchar_t outputfile[32768];
 	depress_event_handle_t finished;
 	depress_flags_type flags;
+	size_t original_id; // Earlier task with the same image and flags, encoded once, or own id
 	int process_status;
 	bool is_completed;
 } depress_task_type;
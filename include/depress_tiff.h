@@ -0,0 +1,97 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEPRESS_TIFF_H
+#define DEPRESS_TIFF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+enum {
+	DEPRESS_TIFF_COMPRESSION_NONE = 1,
+	DEPRESS_TIFF_COMPRESSION_CCITT_G4 = 4,
+	DEPRESS_TIFF_COMPRESSION_LZW = 5,
+	DEPRESS_TIFF_COMPRESSION_DEFLATE = 8,
+	DEPRESS_TIFF_COMPRESSION_PACKBITS = 32773,
+	DEPRESS_TIFF_COMPRESSION_DEFLATE_OLD = 32946
+};
+
+enum {
+	DEPRESS_TIFF_PHOTOMETRIC_WHITE_IS_ZERO,
+	DEPRESS_TIFF_PHOTOMETRIC_BLACK_IS_ZERO,
+	DEPRESS_TIFF_PHOTOMETRIC_RGB,
+	DEPRESS_TIFF_PHOTOMETRIC_PALETTE
+};
+
+// Image file directory (page) of TIFF file, strips point into file data
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	unsigned int bits_per_sample;
+	unsigned int samples_per_pixel;
+	unsigned int compression;
+	unsigned int photometric;
+	unsigned int fill_order; // 2 - the lowest bit of byte goes first
+	unsigned int orientation; // 1 - rows go from top, columns from left, up to 8 for other rotations and mirrors
+	unsigned int planar_config;
+	unsigned int predictor;
+	uint32_t t6_options;
+	uint32_t rows_per_strip;
+	const unsigned char **strips;
+	size_t *strip_sizes;
+	size_t nof_strips;
+	uint16_t *colormap; // All red values, then green and blue, 0 if there is no palette
+	size_t nof_colormap;
+	bool big_endian; // Byte order of 16 bit samples
+} depress_tiff_page_type;
+
+/*
+	Pages are addressed by offsets of their directories in file data,
+	so every page is read without going through the previous ones
+*/
+extern bool depressTiffIsTiff(const unsigned char *data, size_t size);
+extern bool depressTiffGetPages(const unsigned char *data, size_t size, size_t **ifds, size_t *nof_pages);
+extern size_t depressTiffGetFirstPage(const unsigned char *data, size_t size);
+extern bool depressTiffReadPage(const unsigned char *data, size_t size, size_t ifd, depress_tiff_page_type *page);
+extern void depressTiffFreePage(depress_tiff_page_type *page);
+// Decodes page into 8 bit gray (channels is 1) or RGB (channels is 3) image, buf is allocated with malloc.
+// Page is turned by its orientation tag
+extern bool depressTiffDecodePage(const unsigned char *data, size_t size, size_t ifd, int *sizex, int *sizey, int *channels, unsigned char **buf);
+// Makes single page TIFF file with the same byte order from the page, strips are copied as is
+extern bool depressTiffExtractPage(const unsigned char *data, size_t size, size_t ifd, unsigned char **page_data, size_t *page_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
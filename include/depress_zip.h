@@ -0,0 +1,62 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEPRESS_ZIP_H
+#define DEPRESS_ZIP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <wchar.h>
+
+// File in ZIP archive, found in central directory
+typedef struct {
+	wchar_t *name; // Path inside archive with '/' as separator
+	unsigned int method; // 0 - stored, 8 - deflated
+	unsigned int flags;
+	uint32_t crc32; // CRC-32 of unpacked file, checked after unpacking
+	uint32_t compressed_size;
+	uint32_t size;
+	size_t local_header;
+} depress_zip_entry_type;
+
+extern bool depressZipIsZip(const unsigned char *data, size_t size);
+extern bool depressZipGetEntries(const unsigned char *data, size_t size, depress_zip_entry_type **entries, size_t *nof_entries);
+extern void depressZipFreeEntries(depress_zip_entry_type *entries, size_t nof_entries);
+// Unpacks file from archive and checks its CRC-32, entry_data is allocated with malloc
+extern bool depressZipReadEntry(const unsigned char *data, size_t size, const depress_zip_entry_type *entry, unsigned char **entry_data, size_t *entry_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -38,6 +38,8 @@ extern "C" {
 
 extern bool ppmSave(unsigned int sizex, unsigned int sizey, unsigned int channels, unsigned char *buf, FILE *f);
 extern bool pbmSave(unsigned int sizex, unsigned int sizey, unsigned char *buf, FILE *f);
+extern bool pbmSavePacked(unsigned int sizex, unsigned int sizey, size_t stride, unsigned char *buf, FILE *f);
+extern bool ppmRleSave(unsigned int sizex, unsigned int sizey, unsigned char *indices, unsigned char *palette, unsigned int colors, unsigned int transparent, FILE *f);
 
 #ifdef __cplusplus
 }
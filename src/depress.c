@@ -54,19 +54,30 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define DEPRESS_ARG_PAGETYPE_BW L"-bw"
 #define DEPRESS_ARG_PAGETYPE_BW_PARAM1_ERRDIFF L"-errdiff"
 #define DEPRESS_ARG_PAGETYPE_BW_PARAM1_ADAPTIVE L"-adaptive"
+#define DEPRESS_ARG_PAGETYPE_BW_PARAM2_STUCKI L"-stucki"
+#define DEPRESS_ARG_PAGETYPE_BW_DETECTILLRECTS L"-illdetect"
+#define DEPRESS_ARG_MMR L"-mmr"
+#define DEPRESS_ARG_BGJPEG L"-bgjpeg"
+#define DEPRESS_ARG_PASSTHROUGH L"-passthrough"
+#define DEPRESS_ARG_LIBDJVU L"-libdjvu"
 #define DEPRESS_ARG_PAGETYPE_LAYERED L"-layered"
 #define DEPRESS_ARG_PAGETYPE_LAYERED_PARAM1_DOWNSAMPLEALL L"-laydownall"
 #define DEPRESS_ARG_PAGETYPE_LAYERED_PARAM2_DOWNSAMPLEFG L"-laydownfg"
+#define DEPRESS_ARG_PAGETYPE_LAYERED_TILED L"-laytiled"
 #define DEPRESS_ARG_PAGETYPE_PALETTIZED L"-palettized"
 #define DEPRESS_ARG_PAGETYPE_PALETTIZED_PARAM1_PALCOLORS L"-palcolors"
 #define DEPRESS_ARG_PAGETYPE_PALETTIZED_PARAM2_QUANT L"-quant"
 #define DEPRESS_ARG_PAGETYPE_PALETTIZED_PARAM2_NOTESHRINK L"-noteshrink"
+#define DEPRESS_ARG_SHAREDPALETTE L"-sharedpal"
+#define DEPRESS_ARG_SHAREDDICT L"-shareddict"
+#define DEPRESS_ARG_DEDUP L"-dedup"
 #define DEPRESS_ARG_PAGETYPE_AUTO L"-auto"
 #define DEPRESS_ARG_PAGETITLEAUTO L"-pta"
 #define DEPRESS_ARG_PAGETITLEAUTO_SHORTNAME L"-shortfntitle"
 #define DEPRESS_ARG_TEMP L"-temp"
 #define DEPRESS_ARG_QUALITY L"-quality"
 #define DEPRESS_ARG_DPI L"-dpi"
+#define DEPRESS_ARG_RESAMPLE L"-resample"
 #define DEPRESS_ARG_OUTLINE L"-outline"
 
 #if !defined(_WIN32)
@@ -109,6 +120,7 @@ int wmain(int argc, wchar_t **argv)
 		if(!wcscmp(*argsp, DEPRESS_ARG_PAGETYPE_BW)) {
 			flags.type = DEPRESS_PAGE_TYPE_BW;
 			flags.param1 = DEPRESS_PAGE_TYPE_BW_PARAM1_SIMPLE;
+			flags.param2 = DEPRESS_PAGE_TYPE_BW_PARAM2_FLOYDSTEINBERG;
 		} else if(!wcscmp(*argsp, DEPRESS_ARG_PAGETYPE_BW_PARAM1_ERRDIFF)) {
 			if(flags.type == DEPRESS_PAGE_TYPE_BW)
 				flags.param1 = DEPRESS_PAGE_TYPE_BW_PARAM1_ERRDIFF;
@@ -119,6 +131,29 @@ int wmain(int argc, wchar_t **argv)
 				flags.param1 = DEPRESS_PAGE_TYPE_BW_PARAM1_ADAPTIVE;
 			else
 				wprintf(L"Warning: argument %ls can be set only with %ls\n", DEPRESS_ARG_PAGETYPE_BW_PARAM1_ADAPTIVE, DEPRESS_ARG_PAGETYPE_BW);
+		} else if(!wcscmp(*argsp, DEPRESS_ARG_PAGETYPE_BW_PARAM2_STUCKI)) {
+			if(flags.type == DEPRESS_PAGE_TYPE_BW && flags.param1 == DEPRESS_PAGE_TYPE_BW_PARAM1_ERRDIFF)
+				flags.param2 = DEPRESS_PAGE_TYPE_BW_PARAM2_STUCKI;
+			else
+				wprintf(L"Warning: argument %ls can be set only with %ls\n", DEPRESS_ARG_PAGETYPE_BW_PARAM2_STUCKI, DEPRESS_ARG_PAGETYPE_BW_PARAM1_ERRDIFF);
+		} else if(!wcscmp(*argsp, DEPRESS_ARG_PAGETYPE_BW_DETECTILLRECTS)) {
+			if(flags.type == DEPRESS_PAGE_TYPE_BW)
+				flags.detect_illrects = true;
+			else
+				wprintf(L"Warning: argument %ls can be set only with %ls\n", DEPRESS_ARG_PAGETYPE_BW_DETECTILLRECTS, DEPRESS_ARG_PAGETYPE_BW);
+		} else if(!wcscmp(*argsp, DEPRESS_ARG_MMR)) {
+			flags.mmr = true;
+		} else if(!wcscmp(*argsp, DEPRESS_ARG_BGJPEG)) {
+			flags.bgjpeg = true;
+			wprintf(L"Warning: argument %ls makes JPEG (BGjp) pages, viewers without JPEG support show them blank\n", DEPRESS_ARG_BGJPEG);
+		} else if(!wcscmp(*argsp, DEPRESS_ARG_PASSTHROUGH)) {
+			flags.passthrough = true;
+		} else if(!wcscmp(*argsp, DEPRESS_ARG_LIBDJVU)) {
+#if defined(DEPRESS_USE_LIBDJVULIBRE)
+			flags.libdjvu = true;
+#else
+			wprintf(L"Warning: argument %ls needs depress built with DjVuLibre library\n", DEPRESS_ARG_LIBDJVU);
+#endif
 		} else if(!wcscmp(*argsp, DEPRESS_ARG_PAGETYPE_LAYERED)) {
 			flags.type = DEPRESS_PAGE_TYPE_LAYERED;
 			flags.param1 = 3;
@@ -153,6 +188,11 @@ int wmain(int argc, wchar_t **argv)
 				}
 			} else
 				wprintf(L"Warning: argument " DEPRESS_ARG_PAGETYPE_LAYERED_PARAM2_DOWNSAMPLEFG L" should have parameter\n");
+		} else if(!wcscmp(*argsp, DEPRESS_ARG_PAGETYPE_LAYERED_TILED)) {
+			if(flags.type == DEPRESS_PAGE_TYPE_LAYERED)
+				flags.tiled = true;
+			else
+				wprintf(L"Warning: argument %ls can be set only with %ls\n", DEPRESS_ARG_PAGETYPE_LAYERED_TILED, DEPRESS_ARG_PAGETYPE_LAYERED);
 		} else if(!wcscmp(*argsp, DEPRESS_ARG_PAGETYPE_PALETTIZED)) {
 			flags.type = DEPRESS_PAGE_TYPE_PALETTIZED;
 			flags.param1 = 8;
@@ -186,6 +226,34 @@ int wmain(int argc, wchar_t **argv)
 				flags.param2 = DEPRESS_PAGE_TYPE_PALETTIZED_PARAM2_NOTESHRINK;
 			else
 				wprintf(L"Warning: argument %ls can be set only with %ls\n", DEPRESS_ARG_PAGETYPE_PALETTIZED_PARAM2_NOTESHRINK, DEPRESS_ARG_PAGETYPE_PALETTIZED);
+		} else if(!wcscmp(*argsp, DEPRESS_ARG_SHAREDPALETTE)) {
+			if(argsc > 0) {
+				int pages;
+
+				argsc--;
+				pages = _wtoi(*(++argsp));
+				if(pages < 1) {
+					wprintf(L"Warning: number of pages for shared palette must be greater than 0\n");
+					pages = 8;
+				}
+				document_flags.shared_palette_pages = pages;
+			} else
+				wprintf(L"Warning: argument " DEPRESS_ARG_SHAREDPALETTE L" should have parameter\n");
+		} else if(!wcscmp(*argsp, DEPRESS_ARG_SHAREDDICT)) {
+			if(argsc > 0) {
+				int pages;
+
+				argsc--;
+				pages = _wtoi(*(++argsp));
+				if(pages < 2) {
+					wprintf(L"Warning: number of pages for shared dictionary must be greater than 1\n");
+					pages = 10;
+				}
+				document_flags.shared_dict_pages = pages;
+			} else
+				wprintf(L"Warning: argument " DEPRESS_ARG_SHAREDDICT L" should have parameter\n");
+		} else if(!wcscmp(*argsp, DEPRESS_ARG_DEDUP)) {
+			document_flags.dedup = true;
 		} else if(!wcscmp(*argsp, DEPRESS_ARG_PAGETYPE_AUTO)) {
 			flags.type = DEPRESS_PAGE_TYPE_AUTO;
 			flags.param1 = 0;
@@ -220,6 +288,16 @@ int wmain(int argc, wchar_t **argv)
 				}
 			} else
 				wprintf(L"Warning: argument " DEPRESS_ARG_QUALITY L" should have parameter\n");
+		} else if(!wcscmp(*argsp, DEPRESS_ARG_RESAMPLE)) {
+			if(argsc > 0) {
+				argsc--;
+				flags.resample_dpi = _wtoi(*(++argsp));
+				if(flags.resample_dpi <= 0) {
+					wprintf(L"Warning: resample dpi must be greater than 0\n");
+					flags.resample_dpi = 0;
+				}
+			} else
+				wprintf(L"Warning: argument " DEPRESS_ARG_RESAMPLE L" should have parameter\n");
 		} else if(!wcscmp(*argsp, DEPRESS_ARG_OUTLINE)) {
 			if(argsc > 0) {
 				argsc--;
@@ -238,14 +316,26 @@ int wmain(int argc, wchar_t **argv)
 			L"\t\toptions:\n"
 			L"\t\t\t" DEPRESS_ARG_PAGETYPE_BW L" - create black and white document\n"
 			L"\t\t\t" DEPRESS_ARG_PAGETYPE_BW_PARAM1_ERRDIFF L" - use error diffusion for bw document\n"
+			L"\t\t\t" DEPRESS_ARG_PAGETYPE_BW_PARAM2_STUCKI L" - use Stucki kernel instead of Floyd-Steinberg for error diffusion\n"
 			L"\t\t\t" DEPRESS_ARG_PAGETYPE_BW_PARAM1_ADAPTIVE L" - use adaptive binarization for bw document\n"
+			L"\t\t\t" DEPRESS_ARG_PAGETYPE_BW_DETECTILLRECTS L" - find illustrations on bw pages and keep them in color\n"
+			L"\t\t\t" DEPRESS_ARG_MMR L" - encode lossless bw pages with built-in G4/MMR (not JB2) encoder instead of cjb2, files are bigger\n"
+			L"\t\t\t" DEPRESS_ARG_BGJPEG L" - encode photo pages and backgrounds with built-in JPEG (not IW44) encoder instead of c44\n"
+			L"\t\t\t" DEPRESS_ARG_PASSTHROUGH L" - put JPEG files of photo pages and G4 data of bw TIFF pages into document as is\n"
+#if defined(DEPRESS_USE_LIBDJVULIBRE)
+			L"\t\t\t" DEPRESS_ARG_LIBDJVU L" - encode lossless bw pages and photo pages with linked DjVuLibre instead of cjb2 and c44\n"
+#endif
 			L"\t\t\t" DEPRESS_ARG_PAGETYPE_LAYERED L" - create layered document\n"
 			L"\t\t\t" DEPRESS_ARG_PAGETYPE_LAYERED_PARAM1_DOWNSAMPLEALL L" ratio - sets downsampling ratio for background and foreground layers\n"
 			L"\t\t\t" DEPRESS_ARG_PAGETYPE_LAYERED_PARAM2_DOWNSAMPLEFG L" fgratio - sets further foreground downsampling ratio (ratio*fgratio)\n" 
+			L"\t\t\t" DEPRESS_ARG_PAGETYPE_LAYERED_TILED L" - separate layered pages by tiles to limit thresholding memory for very large pages\n"
 			L"\t\t\t" DEPRESS_ARG_PAGETYPE_PALETTIZED L" - create palettized document\n"
 			L"\t\t\t" DEPRESS_ARG_PAGETYPE_PALETTIZED_PARAM1_PALCOLORS L" colors - number of colors between 2 and 256 (defaults to 8)\n"
 			L"\t\t\t" DEPRESS_ARG_PAGETYPE_PALETTIZED_PARAM2_QUANT L" - use quantization for palettized document\n"
 			L"\t\t\t" DEPRESS_ARG_PAGETYPE_PALETTIZED_PARAM2_NOTESHRINK L" - use noteshrink for palettized document\n"
+			L"\t\t\t" DEPRESS_ARG_SHAREDPALETTE L" pages - use one noteshrink palette for the whole document, sampled from given number of pages\n"
+			L"\t\t\t" DEPRESS_ARG_SHAREDDICT L" pages - encode bw pages with minidjvu, one shared dictionary for given number of pages\n"
+			L"\t\t\t" DEPRESS_ARG_DEDUP L" - encode pages with the same file and options only once\n"
 			L"\t\t\t" DEPRESS_ARG_PAGETYPE_AUTO L" - try to autodetect page type\n"
 			L"\t\t\t" DEPRESS_ARG_PAGETITLEAUTO L" - use file name as page title\n"
 			L"\t\t\t" DEPRESS_ARG_PAGETITLEAUTO_SHORTNAME L" - use short file name as page title (when using previous)\n"
@@ -253,6 +343,7 @@ int wmain(int argc, wchar_t **argv)
 			L"\t\t\t" DEPRESS_ARG_QUALITY L" percents - sets image quality in percents\n"
 			L"\t\t\t\t100 is lossless for BW and good for PHOTO\n"
 			L"\t\t\t" DEPRESS_ARG_DPI L" - DPI parameter (default to 100)\n"
+			L"\t\t\t" DEPRESS_ARG_RESAMPLE L" dpi - downsample pages from " DEPRESS_ARG_DPI L" to dpi after loading\n"
 			L"\t\t\t" DEPRESS_ARG_OUTLINE L" outline_file - sets file with outlines\n\n"
 		);
 
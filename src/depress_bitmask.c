@@ -0,0 +1,382 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if defined(_DEBUG) && defined(USE_STB_LEAKCHECK)
+#include "third_party/stb_leakcheck.h"
+#endif
+
+#include "../include/depress_bitmask.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool depressBitmaskCreate(depress_bitmask_type *mask, unsigned int width, unsigned int height)
+{
+	size_t words_in_row;
+
+	memset(mask, 0, sizeof(depress_bitmask_type));
+
+	if(width == 0 || height == 0) return false;
+
+	words_in_row = ((size_t)width+63)/64;
+	if(SIZE_MAX/sizeof(uint64_t)/height <= words_in_row) return false;
+
+	mask->words = calloc(words_in_row*height, sizeof(uint64_t));
+	if(!mask->words) return false;
+
+	mask->width = width;
+	mask->height = height;
+	mask->stride = words_in_row*sizeof(uint64_t);
+
+	return true;
+}
+
+void depressBitmaskDestroy(depress_bitmask_type *mask)
+{
+	if(mask->words) free(mask->words);
+
+	memset(mask, 0, sizeof(depress_bitmask_type));
+}
+
+// Clears bits after width in the row
+static void depressBitmaskClearPadding(unsigned char *row, unsigned int width, size_t stride)
+{
+	size_t bytes = ((size_t)width+7)/8;
+
+	if(width%8) row[bytes-1] &= (unsigned char)(0xff00 >> (width%8));
+	if(bytes < stride) memset(row+bytes, 0, stride-bytes);
+}
+
+void depressBitmaskInvert(depress_bitmask_type *mask)
+{
+	int y;
+
+#pragma omp parallel for
+	for(y = 0; y < (int)mask->height; y++)
+		depressBitmaskInvertRow(mask, y);
+}
+
+void depressBitmaskInvertRow(depress_bitmask_type *mask, unsigned int y)
+{
+	uint64_t *w;
+	size_t i, words_in_row;
+
+	words_in_row = mask->stride/sizeof(uint64_t);
+	w = mask->words+(size_t)y*words_in_row;
+	for(i = 0; i < words_in_row; i++)
+		w[i] = ~w[i];
+
+	depressBitmaskClearPadding(depressBitmaskRow(mask, y), mask->width, mask->stride);
+}
+
+// Tests bits [x0, x1) of the row. Empty range has all bits set and no any bit set
+static bool depressBitmaskTestRange(const unsigned char *row, unsigned int x0, unsigned int x1, bool all)
+{
+	unsigned int x = x0;
+
+	while(x < x1) {
+		unsigned int n;
+		unsigned char m, b;
+
+		n = 8-x%8; // Bits till the end of the byte
+		if(n > x1-x) n = x1-x;
+		m = (unsigned char)((0xff >> (x%8)) & (0xff00 >> (x%8+n)));
+		b = row[x/8] & m;
+		if(all) {
+			if(b != m) return false;
+		} else {
+			if(b) return true;
+		}
+		x += n;
+	}
+
+	return all;
+}
+
+/*
+	Makes dst from src: every pixel of dst covers pixels (x, y) of src with
+	x*dst->width/src->width and y*dst->height/src->height equal to its coordinates.
+	dst pixel is set if all (if all is true) or any of these src pixels are set.
+*/
+bool depressBitmaskReduce(const depress_bitmask_type *src, depress_bitmask_type *dst, bool all)
+{
+	int failed = 0;
+
+	if(!src->words || !dst->words) return false;
+
+#pragma omp parallel reduction(+:failed)
+	{
+		uint64_t *acc;
+		int r;
+
+		acc = malloc(src->stride);
+		if(!acc) failed++;
+
+#pragma omp for
+		for(r = 0; r < (int)dst->height; r++)
+			if(acc) depressBitmaskReduceRow(src, dst, r, all, acc);
+
+		if(acc) free(acc);
+	}
+
+	return failed == 0;
+}
+
+// Makes row r of dst as depressBitmaskReduce() does, acc is src->stride bytes of scratch
+void depressBitmaskReduceRow(const depress_bitmask_type *src, depress_bitmask_type *dst, unsigned int r, bool all, uint64_t *acc)
+{
+	unsigned int y0, y1, y, c, x0, x1;
+	unsigned char *row, *out, bits;
+	size_t i, words_in_row;
+
+	words_in_row = src->stride/sizeof(uint64_t);
+
+	// Rows of src with y*dst->height/src->height == r
+	y0 = (unsigned int)(((uint64_t)r*src->height+dst->height-1)/dst->height);
+	y1 = (unsigned int)(((uint64_t)(r+1)*src->height+dst->height-1)/dst->height);
+	if(y1 > src->height) y1 = src->height;
+
+	if(y0 < y1) {
+		memcpy(acc, src->words+(size_t)y0*words_in_row, src->stride);
+		for(y = y0+1; y < y1; y++) {
+			const uint64_t *w = src->words+(size_t)y*words_in_row;
+
+			if(all)
+				for(i = 0; i < words_in_row; i++) acc[i] &= w[i];
+			else
+				for(i = 0; i < words_in_row; i++) acc[i] |= w[i];
+		}
+	} else
+		memset(acc, all?0xff:0, src->stride);
+
+	row = (unsigned char *)acc;
+	out = depressBitmaskRow(dst, r);
+	bits = 0;
+	x0 = 0;
+	for(c = 0; c < dst->width; c++) {
+		x1 = (unsigned int)(((uint64_t)(c+1)*src->width+dst->width-1)/dst->width);
+		if(x1 > src->width) x1 = src->width;
+
+		if(depressBitmaskTestRange(row, x0, x1, all))
+			bits |= (unsigned char)(0x80 >> (c%8));
+		if(c%8 == 7) {
+			*out++ = bits;
+			bits = 0;
+		}
+
+		x0 = (x1 > x0)?x1:x0;
+	}
+	if(dst->width%8) *out = bits;
+}
+
+// Sets pixels of the mask that are darker than 128 in gray image of the same size
+void depressBitmaskFromGray(depress_bitmask_type *mask, const unsigned char *buf)
+{
+	int y;
+
+#pragma omp parallel for
+	for(y = 0; y < (int)mask->height; y++) {
+		const unsigned char *g;
+		unsigned char *row, bits = 0;
+		unsigned int x;
+
+		g = buf+(size_t)y*mask->width;
+		row = depressBitmaskRow(mask, y);
+		for(x = 0; x < mask->width; x++) {
+			if(g[x] < 128) bits |= (unsigned char)(0x80 >> (x%8));
+			if(x%8 == 7) {
+				*row++ = bits;
+				bits = 0;
+			}
+		}
+		if(mask->width%8) *row = bits;
+	}
+}
+
+// Root of the run in union-find forest, paths are halved on the way
+static size_t depressBitmaskFindRoot(size_t *parent, size_t i)
+{
+	while(parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+
+	return i;
+}
+
+/*
+	Finds 8-connected components of set pixels. Runs of set pixels are returned grouped
+	by components (rows of component go from top to bottom), components are in order of
+	their first pixel from top to bottom and from left to right.
+	runs and components are allocated with malloc (NULL if there are no set pixels).
+*/
+bool depressBitmaskGetComponents(const depress_bitmask_type *mask, depress_bitmask_run_type **runs, depress_bitmask_component_type **components, size_t *nof_components)
+{
+	depress_bitmask_run_type *r = 0, *sorted = 0;
+	depress_bitmask_component_type *c = 0;
+	size_t *parent = 0, *comp = 0, nof_runs = 0, max_runs = 0, prev_start = 0, prev_end = 0, n = 0, i, j;
+	unsigned int y;
+
+	*runs = 0;
+	*components = 0;
+	*nof_components = 0;
+
+	if(!mask->words) return false;
+
+	for(y = 0; y < mask->height; y++) {
+		const unsigned char *row = depressBitmaskRow(mask, y);
+		size_t row_start = nof_runs;
+		unsigned int x = 0;
+
+		while(x < mask->width) {
+			unsigned int x0;
+
+			// Whole bytes of white pixels are skipped at once
+			if(x%8 == 0 && !row[x/8]) {
+				x += 8;
+				continue;
+			}
+			if(!(row[x/8] & (0x80 >> (x%8)))) {
+				x++;
+				continue;
+			}
+
+			x0 = x;
+			while(x < mask->width && (row[x/8] & (0x80 >> (x%8)))) {
+				if(x%8 == 0 && row[x/8] == 0xff && x+8 <= mask->width)
+					x += 8;
+				else
+					x++;
+			}
+
+			if(nof_runs == max_runs) {
+				depress_bitmask_run_type *new_r;
+				size_t *new_parent;
+
+				max_runs = max_runs?max_runs*2:1024;
+				if(max_runs > SIZE_MAX/sizeof(depress_bitmask_run_type)) goto LABEL_ERROR;
+				new_r = realloc(r, max_runs*sizeof(depress_bitmask_run_type));
+				if(!new_r) goto LABEL_ERROR;
+				r = new_r;
+				new_parent = realloc(parent, max_runs*sizeof(size_t));
+				if(!new_parent) goto LABEL_ERROR;
+				parent = new_parent;
+			}
+			r[nof_runs].y = y;
+			r[nof_runs].x0 = x0;
+			r[nof_runs].x1 = x;
+			parent[nof_runs] = nof_runs;
+
+			// Runs of the previous row touching this one (diagonally too)
+			while(prev_start < prev_end && r[prev_start].x1 < x0) prev_start++;
+			for(i = prev_start; i < prev_end && r[i].x0 <= x; i++) {
+				size_t a, b;
+
+				a = depressBitmaskFindRoot(parent, i);
+				b = depressBitmaskFindRoot(parent, nof_runs);
+				// Smaller index is the root, so root is the first run of the component
+				if(a < b) parent[b] = a;
+				else if(b < a) parent[a] = b;
+			}
+			if(i > prev_start) prev_start = i-1;
+
+			nof_runs++;
+		}
+
+		prev_start = row_start;
+		prev_end = nof_runs;
+	}
+
+	if(!nof_runs) {
+		free(r);
+		free(parent);
+
+		return true;
+	}
+
+	// Components are numbered in order of their first runs
+	comp = malloc(nof_runs*sizeof(size_t));
+	if(!comp) goto LABEL_ERROR;
+	for(i = 0; i < nof_runs; i++) {
+		size_t root = depressBitmaskFindRoot(parent, i);
+
+		if(root == i) comp[i] = n++;
+		else comp[i] = comp[root];
+	}
+
+	c = malloc(n*sizeof(depress_bitmask_component_type));
+	sorted = malloc(nof_runs*sizeof(depress_bitmask_run_type));
+	if(!c || !sorted) goto LABEL_ERROR;
+
+	for(i = 0; i < n; i++) {
+		c[i].x0 = mask->width;
+		c[i].y0 = mask->height;
+		c[i].x1 = c[i].y1 = 0;
+		c[i].nof_runs = 0;
+	}
+	for(i = 0; i < nof_runs; i++) {
+		depress_bitmask_component_type *ci = c+comp[i];
+
+		if(r[i].x0 < ci->x0) ci->x0 = r[i].x0;
+		if(r[i].x1 > ci->x1) ci->x1 = r[i].x1;
+		if(r[i].y < ci->y0) ci->y0 = r[i].y;
+		if(r[i].y+1 > ci->y1) ci->y1 = r[i].y+1;
+		ci->nof_runs++;
+	}
+
+	// Runs are grouped by components keeping their order
+	for(i = 0, j = 0; i < n; i++) {
+		c[i].first_run = j;
+		j += c[i].nof_runs;
+		c[i].nof_runs = 0;
+	}
+	for(i = 0; i < nof_runs; i++) {
+		depress_bitmask_component_type *ci = c+comp[i];
+
+		sorted[ci->first_run+ci->nof_runs++] = r[i];
+	}
+
+	free(r);
+	free(parent);
+	free(comp);
+
+	*runs = sorted;
+	*components = c;
+	*nof_components = n;
+
+	return true;
+
+LABEL_ERROR:
+	if(r) free(r);
+	if(parent) free(parent);
+	if(comp) free(comp);
+	if(c) free(c);
+	if(sorted) free(sorted);
+
+	return false;
+}
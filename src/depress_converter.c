@@ -40,10 +40,18 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <io.h>
 #endif
 
+#include "../include/depress_bitmask.h"
 #include "../include/depress_converter.h"
 #include "../include/depress_image.h"
 #include "../include/depress_flags.h"
+#include "../include/depress_iff.h"
+#include "../include/depress_jpeg.h"
+#if defined(DEPRESS_USE_LIBDJVULIBRE)
+#include "../include/depress_libdjvu.h"
+#endif
+#include "../include/depress_mmr.h"
 #include "../include/depress_threads.h"
+#include "../include/depress_tiff.h"
 #include "../include/ppm_save.h"
 
 #include <stdlib.h>
@@ -53,20 +61,241 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define THRESHOLD_IMPLEMENTATION
 #include "third_party/djvul.h"
 
+// Tiles of layered pages with tiled flag, every thread needs about 20 MB per channel for one tile
+#define DEPRESS_LAYERED_TILE_SIZE 2048
+#define DEPRESS_LAYERED_TILE_HALO 512
+
 int depressDjvuConvertLayeredPage(const depress_flags_type flags, depress_load_image_type load_image, void *load_image_ctx, size_t load_image_id, wchar_t *tempfile, wchar_t *outputfile, depress_djvulibre_paths_type *djvulibre_paths);
+int depressDjvuConvertCompoundPage(const depress_flags_type flags, depress_load_image_type load_image, void *load_image_ctx, size_t load_image_id, wchar_t *tempfile, wchar_t *outputfile, depress_djvulibre_paths_type *djvulibre_paths);
+
+// Pages resampled after decode are encoded with the new dpi
+int depressDjvuGetPageDpi(const depress_flags_type *flags)
+{
+	if(flags->resample_dpi > 0 && flags->resample_dpi < flags->dpi)
+		return flags->resample_dpi;
+	else
+		return flags->dpi;
+}
+
+// Lossless bilevel data may be encoded with built-in MMR encoder, lossy is left to cjb2
+static bool depressDjvuUseMmr(const depress_flags_type *flags)
+{
+	return flags->mmr && (flags->quality < 0 || flags->quality >= 100);
+}
+
+// Saves DjVu page with the mask in Smmr chunk
+static bool depressDjvuSaveMmrPage(const wchar_t *outputfile, const depress_bitmask_type *mask, int dpi)
+{
+	depress_iff_form_type page = { 0 };
+	unsigned char *data = 0;
+	size_t size = 0;
+	bool success = false;
+
+	if(!depressMmrEncode(mask, &data, &size) || size > UINT32_MAX) goto EXIT;
+
+	memcpy(page.form_id, "DJVU", 4);
+	if(!depressIffAddDjvuInfo(&page, mask->width, mask->height, dpi)) goto EXIT;
+	if(!depressIffAddChunk(&page, "Smmr", data, (uint32_t)size)) goto EXIT;
+
+	success = depressIffSave(outputfile, &page);
+
+EXIT:
+	if(data) free(data);
+	depressIffFree(&page);
+
+	return success;
+}
+
+// JPEG quality of BGjp chunks, page quality 100 is JPEG quality 90
+static int depressDjvuGetJpegQuality(const depress_flags_type *flags)
+{
+	int quality = flags->quality;
+
+	if(quality < 0 || quality > 100) quality = 100;
+
+	return 50+quality*2/5;
+}
+
+// Saves DjVu page with the image in BGjp chunk
+static bool depressDjvuSaveJpegPage(const wchar_t *outputfile, unsigned int sizex, unsigned int sizey, int channels, const unsigned char *buffer, int quality, int dpi)
+{
+	depress_iff_form_type page = { 0 };
+	unsigned char *data = 0;
+	size_t size = 0;
+	bool success = false;
+
+	if(!depressJpegEncode(sizex, sizey, channels, buffer, quality, &data, &size) || size > UINT32_MAX) goto EXIT;
+
+	memcpy(page.form_id, "DJVU", 4);
+	if(!depressIffAddDjvuInfo(&page, sizex, sizey, dpi)) goto EXIT;
+	if(!depressIffAddChunk(&page, "BGjp", data, (uint32_t)size)) goto EXIT;
+
+	success = depressIffSave(outputfile, &page);
+
+EXIT:
+	if(data) free(data);
+	depressIffFree(&page);
+
+	return success;
+}
+
+/*
+	Puts JPEG file of photo page into BGjp chunk as is, with INFO chunk from JPEG header.
+	Returns false if page should be encoded as usual (source is not suitable JPEG, or it
+	should be resampled)
+*/
+static bool depressDjvuSaveJpegPassthroughPage(const depress_flags_type *flags, depress_load_image_type load_image, void *load_image_ctx, size_t load_image_id, const wchar_t *outputfile)
+{
+	depress_iff_form_type page = { 0 };
+	unsigned char *data = 0;
+	size_t size = 0;
+	unsigned int sizex, sizey;
+	int channels;
+	bool success = false;
+
+	if(!flags->passthrough || flags->type != DEPRESS_PAGE_TYPE_COLOR || !load_image.load_data) return false;
+	if(depressDjvuGetPageDpi(flags) != flags->dpi) return false;
+
+	if(!load_image.load_data(load_image_ctx, load_image_id, &data, &size)) return false;
+	if(!depressJpegGetInfo(data, size, &sizex, &sizey, &channels) || size > UINT32_MAX) goto EXIT;
+
+	memcpy(page.form_id, "DJVU", 4);
+	if(!depressIffAddDjvuInfo(&page, sizex, sizey, flags->dpi)) goto EXIT;
+	if(!depressIffAddChunk(&page, "BGjp", data, (uint32_t)size)) goto EXIT;
+
+	success = depressIffSave(outputfile, &page);
+
+EXIT:
+	free(data);
+	depressIffFree(&page);
+
+	return success;
+}
+
+/*
+	Puts G4 data of bilevel TIFF page into Smmr chunk as is (only bits are reversed
+	for files with the lowest bit first). Returns false if page should be encoded as usual
+*/
+static bool depressDjvuSaveMmrPassthroughPage(const depress_flags_type *flags, depress_load_image_type load_image, void *load_image_ctx, size_t load_image_id, const wchar_t *outputfile)
+{
+	depress_iff_form_type page = { 0 };
+	depress_tiff_page_type tiff = { 0 };
+	unsigned char *data = 0, *chunk = 0;
+	size_t size = 0, chunk_size = 0, i, j;
+	bool success = false;
+
+	if(!flags->passthrough || flags->type != DEPRESS_PAGE_TYPE_BW || flags->nof_illrects || flags->detect_illrects || !load_image.load_data) return false;
+	if(depressDjvuGetPageDpi(flags) != flags->dpi) return false;
+
+	if(!load_image.load_data(load_image_ctx, load_image_id, &data, &size)) return false;
+	if(!depressTiffReadPage(data, size, depressTiffGetFirstPage(data, size), &tiff)) goto EXIT;
+
+	// Uncompressed mode of G4 is not supported by DjVu
+	if(tiff.compression != DEPRESS_TIFF_COMPRESSION_CCITT_G4 || tiff.bits_per_sample != 1 || tiff.samples_per_pixel != 1 || (tiff.t6_options & 2)) goto EXIT;
+	if(tiff.photometric != DEPRESS_TIFF_PHOTOMETRIC_WHITE_IS_ZERO && tiff.photometric != DEPRESS_TIFF_PHOTOMETRIC_BLACK_IS_ZERO) goto EXIT;
+	// Turned pages are decoded and turned before encoding
+	if(tiff.orientation != 1) goto EXIT;
+
+	// Strips point into data, so it can be changed in place
+	if(tiff.fill_order == 2)
+		for(i = 0; i < tiff.nof_strips; i++) {
+			unsigned char *p = (unsigned char *)tiff.strips[i];
+
+			for(j = 0; j < tiff.strip_sizes[i]; j++) {
+				unsigned char b = p[j];
+
+				b = (unsigned char)((b >> 4) | (b << 4));
+				b = (unsigned char)(((b >> 2) & 0x33) | ((b & 0x33) << 2));
+				p[j] = (unsigned char)(((b >> 1) & 0x55) | ((b & 0x55) << 1));
+			}
+		}
+
+	if(!depressMmrMakeChunk(tiff.width, tiff.height, tiff.photometric == DEPRESS_TIFF_PHOTOMETRIC_BLACK_IS_ZERO, tiff.rows_per_strip,
+		tiff.strips, tiff.strip_sizes, tiff.nof_strips, &chunk, &chunk_size) || chunk_size > UINT32_MAX) goto EXIT;
+
+	memcpy(page.form_id, "DJVU", 4);
+	if(!depressIffAddDjvuInfo(&page, tiff.width, tiff.height, flags->dpi)) goto EXIT;
+	if(!depressIffAddChunk(&page, "Smmr", chunk, (uint32_t)chunk_size)) goto EXIT;
+
+	success = depressIffSave(outputfile, &page);
+
+EXIT:
+	if(chunk) free(chunk);
+	depressTiffFreePage(&tiff);
+	free(data);
+	depressIffFree(&page);
+
+	return success;
+}
+
+#if defined(DEPRESS_USE_LIBDJVULIBRE)
+/*
+	Encodes BW and color pages in process with linked DjVuLibre (with libdjvu flag).
+	Returns false if page should be encoded with tools (lossy BW pages are left to cjb2,
+	because it finds similar shapes)
+*/
+static bool depressDjvuConvertPageWithLibdjvu(const depress_flags_type *flags, int sizex, int sizey, int channels, const unsigned char *buffer, int dpi, const wchar_t *outputfile)
+{
+	unsigned char *data = 0;
+	size_t size = 0;
+	FILE *f;
+	bool success = true;
+
+	if(!flags->libdjvu) return false;
+
+	if(flags->type == DEPRESS_PAGE_TYPE_BW && !flags->nof_illrects) {
+		if(flags->quality >= 0 && flags->quality < 100) return false;
+		if(channels != 1) return false;
+
+		if(!depressLibdjvuEncodeBW(sizex, sizey, buffer, dpi, &data, &size)) return false;
+	} else if(flags->type == DEPRESS_PAGE_TYPE_COLOR) {
+		int quality, slices[3];
+
+		quality = flags->quality + 30;
+		if(quality < 30) quality = 30;
+		if(quality > 130) quality = 130;
+		slices[0] = quality-25;
+		slices[1] = quality-15;
+		slices[2] = quality;
+
+		if(!depressLibdjvuEncodePhoto(sizex, sizey, channels, buffer, slices, 3, dpi, &data, &size)) return false;
+	} else
+		return false;
+
+	f = _wfopen(outputfile, L"wb");
+	if(!f) success = false;
+	if(success && fwrite(data, 1, size, f) != size) success = false;
+	if(f && fclose(f)) success = false;
+
+	free(data);
+
+	return success;
+}
+#endif
 
 int depressDjvuConvertPage(depress_flags_type flags, depress_load_image_type load_image, void *load_image_ctx, size_t load_image_id, wchar_t *tempfile, wchar_t *outputfile, depress_djvulibre_paths_type *djvulibre_paths)
 {
 	FILE *f_temp = 0;
 	int sizex, sizey, channels;
 	wchar_t *arg0 = 0, *arg_options, *arg_temp = 0, *djvulibre_path;
-	unsigned char *buffer = 0;
+	unsigned char *buffer = 0, *indices = 0;
+	unsigned char palette[3*256];
+	int colors, bg_index;
+	bool is_indexed = false;
 	const size_t arg0_size = 3*32768+1536; // 2*3(braces)+3(spaces)+1024(options)<1536
 	int convert_status = DEPRESS_CONVERT_PAGE_STATUS_OK;
+	int dpi = depressDjvuGetPageDpi(&flags);
 
 	// Checking for modes that needed separate complex functions
 	if(flags.type == DEPRESS_PAGE_TYPE_LAYERED)
 		return depressDjvuConvertLayeredPage(flags, load_image, load_image_ctx, load_image_id, tempfile, outputfile, djvulibre_paths);
+	if(flags.type == DEPRESS_PAGE_TYPE_BW && (flags.nof_illrects || flags.detect_illrects))
+		return depressDjvuConvertCompoundPage(flags, load_image, load_image_ctx, load_image_id, tempfile, outputfile, djvulibre_paths);
+
+	if(depressDjvuSaveJpegPassthroughPage(&flags, load_image, load_image_ctx, load_image_id, outputfile))
+		return DEPRESS_CONVERT_PAGE_STATUS_OK;
+	if(depressDjvuSaveMmrPassthroughPage(&flags, load_image, load_image_ctx, load_image_id, outputfile))
+		return DEPRESS_CONVERT_PAGE_STATUS_OK;
 
 	arg0 = malloc((arg0_size+1024+80)*sizeof(wchar_t)); // 
 
@@ -97,6 +326,40 @@ int depressDjvuConvertPage(depress_flags_type flags, depress_load_image_type loa
 		if(flags.type == DEPRESS_PAGE_TYPE_BW) depressImageSimplyBinarize(&buffer, sizex, sizey, channels);
 	}
 
+	// Gray pages don't need chroma in c44
+	if(flags.type == DEPRESS_PAGE_TYPE_COLOR && depressImageIsNeutral(sizex, sizey, channels, buffer)) {
+		depressImageConvertToGray(&buffer, sizex, sizey, channels);
+		channels = 1;
+	}
+
+	if(flags.type == DEPRESS_PAGE_TYPE_BW && !flags.nof_illrects && channels == 1 && depressDjvuUseMmr(&flags)) {
+		depress_bitmask_type mask;
+
+		if(!depressBitmaskCreate(&mask, sizex, sizey)) {
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_ALLOC_MEMORY;
+
+			goto EXIT;
+		}
+		depressBitmaskFromGray(&mask, buffer);
+		if(!depressDjvuSaveMmrPage(outputfile, &mask, dpi))
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+		depressBitmaskDestroy(&mask);
+
+		goto EXIT;
+	}
+
+	if(flags.type == DEPRESS_PAGE_TYPE_COLOR && flags.bgjpeg) {
+		if(!depressDjvuSaveJpegPage(outputfile, sizex, sizey, channels, buffer, depressDjvuGetJpegQuality(&flags), dpi))
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+		goto EXIT;
+	}
+
+#if defined(DEPRESS_USE_LIBDJVULIBRE)
+	if(depressDjvuConvertPageWithLibdjvu(&flags, sizex, sizey, channels, buffer, dpi, outputfile))
+		goto EXIT;
+#endif
+
 	if(flags.type == DEPRESS_PAGE_TYPE_BW) {
 		if(!flags.nof_illrects) {
 			if(!pbmSave(sizex, sizey, buffer, f_temp)) {
@@ -111,6 +374,16 @@ int depressDjvuConvertPage(depress_flags_type flags, depress_load_image_type loa
 				goto EXIT;
 			}
 		}
+	} else if(flags.type == DEPRESS_PAGE_TYPE_PALETTIZED && channels == 3 &&
+		depressImageMakeIndexed(buffer, sizex, sizey, (flags.param1 < 2)?2:((flags.param1 > 256)?256:flags.param1), palette, &colors, &indices, &bg_index)) {
+		// Image is already remapped to palette (quantization or noteshrink), so pass it to csepdjvu as is
+		if(!ppmRleSave(sizex, sizey, indices, palette, colors, bg_index, f_temp)) {
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+			goto EXIT;
+		}
+
+		is_indexed = true;
 	} else {
 		if(!ppmSave(sizex, sizey, channels, buffer, f_temp)) {
 			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
@@ -120,6 +393,7 @@ int depressDjvuConvertPage(depress_flags_type flags, depress_load_image_type loa
 	}
 
 	free(buffer); buffer = 0;
+	if(indices) { free(indices); indices = 0; }
 	fclose(f_temp); f_temp = 0;
 
 	*arg_options = 0;
@@ -137,8 +411,17 @@ int depressDjvuConvertPage(depress_flags_type flags, depress_load_image_type loa
 			wcscat(arg_options, arg_temp);
 		}
 
-		if(flags.dpi > 0) {
-			swprintf(arg_temp, 80, L" -dpi %d", flags.dpi);
+		if(dpi > 0) {
+			swprintf(arg_temp, 80, L" -dpi %d", dpi);
+			wcscat(arg_options, arg_temp);
+		}
+
+		swprintf(arg0, arg0_size, L"\"%ls\" %ls \"%ls\" \"%ls\"", djvulibre_path, arg_options, tempfile, outputfile);
+	} else if(is_indexed) {
+		djvulibre_path = djvulibre_paths->csepdjvu_path;
+
+		if(dpi > 0) {
+			swprintf(arg_temp, 80, L"-d %d", dpi);
 			wcscat(arg_options, arg_temp);
 		}
 
@@ -155,8 +438,8 @@ int depressDjvuConvertPage(depress_flags_type flags, depress_load_image_type loa
 		swprintf(arg_temp, 80, L"-colors %d", colors);
 		wcscat(arg_options, arg_temp);
 
-		if(flags.dpi > 0) {
-			swprintf(arg_temp, 80, L" -dpi %d", flags.dpi);
+		if(dpi > 0) {
+			swprintf(arg_temp, 80, L" -dpi %d", dpi);
 			wcscat(arg_options, arg_temp);
 		}
 
@@ -173,8 +456,8 @@ int depressDjvuConvertPage(depress_flags_type flags, depress_load_image_type loa
 		swprintf(arg_temp, 80, L"-slice %d,%d,%d", quality-25, quality-15, quality);
 		wcscat(arg_options, arg_temp);
 
-		if(flags.dpi > 0) {
-			swprintf(arg_temp, 80, L" -dpi %d", flags.dpi);
+		if(dpi > 0) {
+			swprintf(arg_temp, 80, L" -dpi %d", dpi);
 			wcscat(arg_options, arg_temp);
 		}
 
@@ -192,6 +475,7 @@ EXIT:
 
 	if(f_temp) fclose(f_temp);
 	if(buffer) free(buffer);
+	if(indices) free(indices);
 
 	while(1) {
 		if(!_waccess(tempfile, 06)) {
@@ -207,15 +491,181 @@ EXIT:
 	return convert_status;
 }
 
+// Saves BW page as PBM for minidjvu, that encodes several pages with shared dictionary
+int depressDjvuConvertPageToPbm(const depress_flags_type flags, depress_load_image_type load_image, void *load_image_ctx, size_t load_image_id, wchar_t *pbmfile)
+{
+	FILE *f = 0;
+	int sizex, sizey, channels;
+	unsigned char *buffer = 0;
+	int convert_status = DEPRESS_CONVERT_PAGE_STATUS_OK;
+
+	if(!load_image.load_from_ctx(load_image_ctx, load_image_id, &sizex, &sizey, &channels, &buffer, flags)) {
+		convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_OPEN_IMAGE;
+
+		goto EXIT;
+	}
+
+	if(channels != 1) {
+		convert_status = DEPRESS_CONVERT_PAGE_STATUS_GENERIC_ERROR;
+
+		goto EXIT;
+	}
+
+	f = _wfopen(pbmfile, L"wb");
+	if(!f) {
+		convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+		goto EXIT;
+	}
+	if(!pbmSave(sizex, sizey, buffer, f)) {
+		convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+		goto EXIT;
+	}
+
+EXIT:
+	if(f) fclose(f);
+	if(buffer) free(buffer);
+
+	return convert_status;
+}
+
+// c44 writes IW44 data as BG44 chunks of DjVu page or as PM44/BM44 chunks of IW44 file
+static bool depressDjvuCopyIw44Chunks(depress_iff_form_type *page, const depress_iff_form_type *iw44, const char *id)
+{
+	size_t nof_copied = 0;
+
+	if(!depressIffCopyChunks(page, iw44, "BG44", id, &nof_copied)) return false;
+	if(!nof_copied && !depressIffCopyChunks(page, iw44, "PM44", id, &nof_copied)) return false;
+	if(!nof_copied && !depressIffCopyChunks(page, iw44, "BM44", id, &nof_copied)) return false;
+
+	return nof_copied > 0;
+}
+
+/*
+	Makes DjVu page from chunks of the encoders output in process, as djvuextract and djvumake do.
+	sjbzfile is output of cjb2 (or page with Smmr chunk), fg44file and bg44file are outputs of c44 (fg44file may be NULL),
+	bg44file may also be page with BGjp chunk.
+	outputfile may be the same as any of them.
+*/
+static bool depressDjvuAssemblePage(const wchar_t *outputfile, unsigned int width, unsigned int height, int dpi, const wchar_t *sjbzfile, const wchar_t *fg44file, const wchar_t *bg44file)
+{
+	depress_iff_form_type page = { 0 }, sjbz = { 0 }, fg44 = { 0 }, bg44 = { 0 };
+	size_t nof_copied = 0;
+	bool success = false;
+
+	if(!depressIffLoad(sjbzfile, &sjbz)) goto EXIT;
+	if(fg44file && !depressIffLoad(fg44file, &fg44)) goto EXIT;
+	if(!depressIffLoad(bg44file, &bg44)) goto EXIT;
+
+	memcpy(page.form_id, "DJVU", 4);
+	if(!depressIffAddDjvuInfo(&page, width, height, dpi)) goto EXIT;
+	if(!depressIffCopyChunks(&page, &sjbz, "Sjbz", 0, &nof_copied)) goto EXIT;
+	if(!nof_copied && !depressIffCopyChunks(&page, &sjbz, "Smmr", 0, &nof_copied)) goto EXIT;
+	if(!nof_copied) goto EXIT;
+	if(fg44file && !depressDjvuCopyIw44Chunks(&page, &fg44, "FG44")) goto EXIT;
+	if(!depressIffCopyChunks(&page, &bg44, "BGjp", 0, &nof_copied)) goto EXIT;
+	if(!nof_copied && !depressDjvuCopyIw44Chunks(&page, &bg44, "BG44")) goto EXIT;
+
+	success = depressIffSave(outputfile, &page);
+
+EXIT:
+	depressIffFree(&page);
+	depressIffFree(&sjbz);
+	depressIffFree(&fg44);
+	depressIffFree(&bg44);
+
+	return success;
+}
+
+/*
+	Makes BG mask (black where all pixels are FG) and FG mask (black where all pixels are BG)
+	from the page mask and downsamples FG (if fg_small isn't NULL) in one pass over the page.
+	Page is processed by rows of FG mask. Every row of BG mask is made with the row of FG mask
+	that has the first page row of it, so every row of the output is written once.
+*/
+static bool depressDjvuLayeredPostprocess(const depress_bitmask_type *mask, depress_bitmask_type *bg_mask, depress_bitmask_type *fg_mask,
+	const unsigned char *fg, unsigned char *fg_small, int channels, unsigned int fg_downsample, unsigned int bg_width, unsigned int bg_height)
+{
+	int failed = 0;
+
+#pragma omp parallel reduction(+:failed)
+	{
+		uint64_t *acc;
+		int yf;
+
+		acc = malloc(mask->stride);
+		if(!acc) failed++;
+
+#pragma omp for
+		for(yf = 0; yf < (int)fg_mask->height; yf++) {
+			unsigned int y, y0, y1, yb;
+
+			if(!acc) continue;
+
+			depressBitmaskReduceRow(mask, fg_mask, yf, false, acc);
+			depressBitmaskInvertRow(fg_mask, yf);
+
+			// Page rows of this FG row
+			y0 = (unsigned int)(((uint64_t)yf*mask->height+fg_mask->height-1)/fg_mask->height);
+			y1 = (unsigned int)(((uint64_t)(yf+1)*mask->height+fg_mask->height-1)/fg_mask->height);
+			if(y1 > mask->height) y1 = mask->height;
+			for(y = y0; y < y1; y++) {
+				yb = (unsigned int)((uint64_t)y*bg_mask->height/mask->height);
+				if(y == 0 || (unsigned int)((uint64_t)(y-1)*bg_mask->height/mask->height) != yb)
+					depressBitmaskReduceRow(mask, bg_mask, yb, true, acc);
+			}
+
+			if(fg_small) {
+				unsigned int xf, yb0, yb1, xb0, xb1, xb;
+				unsigned char *out;
+				int d;
+
+				yb0 = (unsigned int)yf*fg_downsample;
+				yb1 = (yb0+fg_downsample < bg_height)?(yb0+fg_downsample):bg_height;
+				out = fg_small+(size_t)yf*fg_mask->width*channels;
+
+				for(xf = 0; xf < fg_mask->width; xf++) {
+					xb0 = xf*fg_downsample;
+					xb1 = (xb0+fg_downsample < bg_width)?(xb0+fg_downsample):bg_width;
+
+					for(d = 0; d < channels; d++) {
+						unsigned long s = 0, n;
+						const unsigned char *in;
+
+						for(yb = yb0; yb < yb1; yb++) {
+							in = fg+((size_t)yb*bg_width+xb0)*channels+d;
+							for(xb = xb0; xb < xb1; xb++) {
+								s += *in;
+								in += channels;
+							}
+						}
+						n = (unsigned long)(yb1-yb0)*(xb1-xb0);
+						if(n == 0) n = 1;
+						s = (s+(n>>1))/n;
+						*out++ = (unsigned char)((s < 255)?s:255);
+					}
+				}
+			}
+		}
+
+		if(acc) free(acc);
+	}
+
+	return failed == 0;
+}
+
 int depressDjvuConvertLayeredPage(const depress_flags_type flags, depress_load_image_type load_image, void *load_image_ctx, size_t load_image_id, wchar_t *tempfile, wchar_t *outputfile, depress_djvulibre_paths_type *djvulibre_paths)
 {
 	FILE *f_temp = 0;
 	int sizex, sizey, channels;
 	wchar_t *arg0 = 0, *arg_options, *arg_temp = 0, *arg_sjbz = 0, *arg_fg44 = 0, *arg_bg44 = 0;
 	size_t outputfile_length = 0;
-	unsigned char *buffer = 0, *buffer_mask = 0, *buffer_bg = 0, *buffer_fg = 0;
+	unsigned char *buffer = 0, *buffer_bg = 0, *buffer_fg = 0, *buffer_fg_small = 0;
+	depress_bitmask_type mask = { 0 }, bg_mask = { 0 }, fg_mask = { 0 };
 	const size_t arg0_size = 5*32768+1536; // 2*3(braces)+3(spaces)+1024(options)<1536
 	int convert_status = DEPRESS_CONVERT_PAGE_STATUS_OK;
+	int dpi = depressDjvuGetPageDpi(&flags);
 
 	outputfile_length = wcslen(outputfile);
 	if(outputfile_length > (32768-5-1)) {
@@ -239,11 +689,11 @@ int depressDjvuConvertLayeredPage(const depress_flags_type flags, depress_load_i
 	}
 
 	memcpy(arg_sjbz, outputfile, (outputfile_length+1)*sizeof(wchar_t));
-	wcscpy(arg_sjbz+outputfile_length, L".sjbz"); // Mask chunk (also I used this filename for bg/fg mask pbm)
+	wcscpy(arg_sjbz+outputfile_length, L".sjbz"); // Bg/fg mask pbm
 	memcpy(arg_fg44, outputfile, (outputfile_length+1)*sizeof(wchar_t));
-	wcscpy(arg_fg44+outputfile_length, L".fg44"); // Foreground chunk
+	wcscpy(arg_fg44+outputfile_length, L".fg44"); // Encoded foreground
 	memcpy(arg_bg44, outputfile, (outputfile_length+1)*sizeof(wchar_t));
-	wcscpy(arg_bg44+outputfile_length, L".bg44"); // Background chunk
+	wcscpy(arg_bg44+outputfile_length, L".bg44"); // Encoded background
 
 	if(!load_image.load_from_ctx(load_image_ctx, load_image_id, &sizex, &sizey, &channels, &buffer, flags)) {
 		convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_OPEN_IMAGE;
@@ -254,7 +704,6 @@ int depressDjvuConvertLayeredPage(const depress_flags_type flags, depress_load_i
 	{
 		unsigned int bg_downsample, fg_downsample;
 		unsigned int bg_width, bg_height, fg_width, fg_height;
-		size_t i;
 		int quality;
 
 		quality = flags.quality + 30;
@@ -271,23 +720,43 @@ int depressDjvuConvertLayeredPage(const depress_flags_type flags, depress_load_i
 		fg_width = bg_width/fg_downsample+(bg_width%fg_downsample>0);
 		fg_height = bg_height/fg_downsample+(bg_height%fg_downsample>0);
 
-		buffer_mask = malloc((size_t)sizex*(size_t)sizey);
 		buffer_bg = malloc(bg_width*bg_height*channels);
 		buffer_fg = malloc(bg_width*bg_height*channels);
-		if(!buffer_mask || !buffer_bg || !buffer_fg) {
+		if(fg_downsample > 1)
+			buffer_fg_small = malloc(fg_width*fg_height*channels);
+		if(!buffer_bg || !buffer_fg || (fg_downsample > 1 && !buffer_fg_small) ||
+			!depressBitmaskCreate(&mask, sizex, sizey) ||
+			!depressBitmaskCreate(&bg_mask, bg_width, bg_height) ||
+			!depressBitmaskCreate(&fg_mask, fg_width, fg_height)) {
 			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_ALLOC_MEMORY;
 
 			goto EXIT;
 		}
 
-		ImageDjvulThreshold(buffer, (bool *)buffer_mask, buffer_bg, buffer_fg, sizex, sizey, channels,
-			bg_downsample, 0, 1, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f);
+		if(flags.tiled) {
+			if(!ImageDjvulThresholdTiled(buffer, NULL, buffer_bg, buffer_fg, sizex, sizey, channels,
+				bg_downsample, 0, 1, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, DEPRESS_LAYERED_TILE_SIZE, DEPRESS_LAYERED_TILE_HALO)) {
+				convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_ALLOC_MEMORY;
 
-		for(i = 0; i < (size_t)sizex*(size_t)sizey; i++)
-			if(buffer_mask[i]) buffer_mask[i] = 0; else buffer_mask[i] = 255;
+				goto EXIT;
+			}
+		} else
+			ImageDjvulThreshold(buffer, NULL, buffer_bg, buffer_fg, sizex, sizey, channels,
+				bg_downsample, 0, 1, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f);
 
-		if(fg_downsample > 1)
-			ImageFGdownsample(buffer_fg, bg_width, bg_height, channels, flags.param2);
+		ImageDjvulThresholdMaskBits(buffer, depressBitmaskRow(&mask, 0), (unsigned int)mask.stride, buffer_bg, buffer_fg, sizex, sizey, channels, bg_downsample);
+		free(buffer); buffer = 0;
+
+		if(!depressDjvuLayeredPostprocess(&mask, &bg_mask, &fg_mask, buffer_fg, buffer_fg_small, channels, fg_downsample, bg_width, bg_height)) {
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_ALLOC_MEMORY;
+
+			goto EXIT;
+		}
+		if(buffer_fg_small) {
+			free(buffer_fg);
+			buffer_fg = buffer_fg_small;
+			buffer_fg_small = 0;
+		}
 
 		// Save background
 		f_temp = _wfopen(tempfile, L"wb");
@@ -309,34 +778,21 @@ int depressDjvuConvertLayeredPage(const depress_flags_type flags, depress_load_i
 
 			goto EXIT;
 		}
-		memset(buffer_bg, 0, bg_width*bg_height);
-		for(i = 0; i < (size_t)sizey; i++) {
-			size_t j;
-
-			for(j = 0; j < (size_t)sizex; j++)
-				if(buffer_mask[i*sizex+j])
-					buffer_bg[(i*bg_height/sizey)*bg_width+(j*bg_width/sizex)] = 255;
-		}
-		if(!pbmSave(bg_width, bg_height, buffer_bg, f_temp)) {
+		free(buffer_bg); buffer_bg = 0;
+		if(!pbmSavePacked(bg_width, bg_height, bg_mask.stride, depressBitmaskRow(&bg_mask, 0), f_temp)) {
 			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
 
 			goto EXIT;
 		}
-		free(buffer_bg); buffer_bg = 0;
+		depressBitmaskDestroy(&bg_mask);
 		fclose(f_temp); f_temp = 0;
 		// Convert background
-		swprintf(arg0, arg0_size, L"\"%ls\" -slice %d,%d,%d -mask \"%ls\" \"%ls\" \"%ls\"", djvulibre_paths->c44_path, quality-25, quality-15, quality, arg_sjbz, tempfile, outputfile);
+		swprintf(arg0, arg0_size, L"\"%ls\" -slice %d,%d,%d -mask \"%ls\" \"%ls\" \"%ls\"", djvulibre_paths->c44_path, quality-25, quality-15, quality, arg_sjbz, tempfile, arg_bg44);
 		if(depressSpawn(djvulibre_paths->c44_path, arg0, true, true) == DEPRESS_INVALID_PROCESS_HANDLE) {
 			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
 			
 			goto EXIT;
 		}
-		swprintf(arg0, arg0_size, L"\"%ls\" \"%ls\" \"BG44=%ls\"", djvulibre_paths->djvuextract_path, outputfile, arg_bg44);
-		if(depressSpawn(djvulibre_paths->djvuextract_path, arg0, true, true) == DEPRESS_INVALID_PROCESS_HANDLE) {
-			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE; 
-			
-			goto EXIT;
-		}
 
 		// Save foreground
 		f_temp = _wfopen(tempfile, L"wb");
@@ -358,34 +814,21 @@ int depressDjvuConvertLayeredPage(const depress_flags_type flags, depress_load_i
 
 			goto EXIT;
 		}
-		memset(buffer_fg, 0, fg_width*fg_height);
-		for(i = 0; i < (size_t)sizey; i++) {
-			size_t j;
-
-			for(j = 0; j < (size_t)sizex; j++)
-				if(!buffer_mask[i*sizex+j])
-					buffer_fg[(i*fg_height/sizey)*fg_width+(j*fg_width/sizex)] = 255;
-		}
-		if(!pbmSave(fg_width, fg_height, buffer_fg, f_temp)) {
+		free(buffer_fg); buffer_fg = 0;
+		if(!pbmSavePacked(fg_width, fg_height, fg_mask.stride, depressBitmaskRow(&fg_mask, 0), f_temp)) {
 			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
 
 			goto EXIT;
 		}
-		free(buffer_fg); buffer_fg = 0;
+		depressBitmaskDestroy(&fg_mask);
 		fclose(f_temp); f_temp = 0;
 		// Convert foreground
-		swprintf(arg0, arg0_size, L"\"%ls\" -slice %d -mask \"%ls\" \"%ls\" \"%ls\"", djvulibre_paths->c44_path, quality, arg_sjbz, tempfile, outputfile);
+		swprintf(arg0, arg0_size, L"\"%ls\" -slice %d -mask \"%ls\" \"%ls\" \"%ls\"", djvulibre_paths->c44_path, quality, arg_sjbz, tempfile, arg_fg44);
 		if(depressSpawn(djvulibre_paths->c44_path, arg0, true, true) == DEPRESS_INVALID_PROCESS_HANDLE) {
 			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE; 
 			
 			goto EXIT;
 		}
-		swprintf(arg0, arg0_size, L"\"%ls\" \"%ls\" \"BG44=%ls\"", djvulibre_paths->djvuextract_path, outputfile, arg_fg44);
-		if(depressSpawn(djvulibre_paths->djvuextract_path, arg0, true, true) == DEPRESS_INVALID_PROCESS_HANDLE) {
-			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
-			
-			goto EXIT;
-		}
 
 		// Save mask
 		f_temp = _wfopen(tempfile, L"wb");
@@ -394,12 +837,12 @@ int depressDjvuConvertLayeredPage(const depress_flags_type flags, depress_load_i
 
 			goto EXIT;
 		}
-		if(!pbmSave(sizex, sizey, buffer_mask, f_temp)) {
+		if(!pbmSavePacked(sizex, sizey, mask.stride, depressBitmaskRow(&mask, 0), f_temp)) {
 			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
 
 			goto EXIT;
 		}
-		free(buffer_mask); buffer_mask = 0;
+		depressBitmaskDestroy(&mask);
 		fclose(f_temp); f_temp = 0;
 		swprintf(arg0, arg0_size, L"\"%ls\" \"%ls\" \"%ls\"", djvulibre_paths->cjb2_path, tempfile, outputfile);
 		if(depressSpawn(djvulibre_paths->cjb2_path, arg0, true, true) == DEPRESS_INVALID_PROCESS_HANDLE) {
@@ -407,19 +850,10 @@ int depressDjvuConvertLayeredPage(const depress_flags_type flags, depress_load_i
 
 			goto EXIT;
 		}
-		swprintf(arg0, arg0_size, L"\"%ls\" \"%ls\" \"Sjbz=%ls\"", djvulibre_paths->djvuextract_path, outputfile, arg_sjbz);
-		if(depressSpawn(djvulibre_paths->djvuextract_path, arg0, true, true) == DEPRESS_INVALID_PROCESS_HANDLE) {
-			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
-
-			goto EXIT;
-		}
 
-		swprintf(arg_options, 1024, L"INFO=,,%d", flags.dpi);
-		swprintf(arg0, arg0_size, L"\"%ls\" \"%ls\" %ls \"Sjbz=%ls\" \"FG44=%ls\" \"BG44=%ls\"", djvulibre_paths->djvumake_path,
-			outputfile, arg_options, arg_sjbz, arg_fg44, arg_bg44);
-		if(depressSpawn(djvulibre_paths->djvumake_path, arg0, true, true) == DEPRESS_INVALID_PROCESS_HANDLE) {
+		if(!depressDjvuAssemblePage(outputfile, sizex, sizey, dpi, outputfile, arg_fg44, arg_bg44)) {
 			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
-			
+
 			goto EXIT;
 		}
 	}
@@ -427,9 +861,12 @@ int depressDjvuConvertLayeredPage(const depress_flags_type flags, depress_load_i
 EXIT:
 	if(f_temp) fclose(f_temp);
 	if(buffer) free(buffer);
-	if(buffer_mask) free(buffer_mask);
 	if(buffer_bg) free(buffer_bg);
 	if(buffer_fg) free(buffer_fg);
+	if(buffer_fg_small) free(buffer_fg_small);
+	depressBitmaskDestroy(&mask);
+	depressBitmaskDestroy(&bg_mask);
+	depressBitmaskDestroy(&fg_mask);
 
 	{
 		bool del_temp = true, del_sjbz = false, del_fg44 = false, del_bg44 = false;
@@ -487,3 +924,317 @@ EXIT:
 
 	return convert_status;
 }
+
+/*
+	Splits BW page with illustration rectangles into text mask (binarized
+	page outside of rectangles) and background (rectangles on white page).
+	Binarization is the same as for BW pages without rectangles.
+*/
+static bool depressDjvuCompoundSplit(unsigned char *buffer, int sizex, int sizey, int channels, const depress_flags_type *flags, depress_bitmask_type *mask)
+{
+	unsigned char *gray = 0, *inside = 0;
+	size_t i;
+	int y;
+	bool result = false;
+
+	gray = malloc((size_t)sizex*(size_t)sizey);
+	inside = malloc(sizex);
+	if(!gray || !inside) goto EXIT;
+
+	// Same luminance as stb_image gives for BW pages
+	if(channels == 3) {
+		for(i = 0; i < (size_t)sizex*(size_t)sizey; i++)
+			gray[i] = (unsigned char)((buffer[3*i]*77+buffer[3*i+1]*150+buffer[3*i+2]*29) >> 8);
+	} else
+		memcpy(gray, buffer, (size_t)sizex*(size_t)sizey);
+
+	if(flags->param1 == DEPRESS_PAGE_TYPE_BW_PARAM1_ERRDIFF) {
+		if(!depressImageApplyErrorDiffusion(gray, sizex, sizey, flags->param2)) goto EXIT;
+	} else if(flags->param1 == DEPRESS_PAGE_TYPE_BW_PARAM1_ADAPTIVE) {
+		if(!depressImageApplyAdaptiveBinarization(gray, sizex, sizey)) goto EXIT;
+	}
+
+	for(y = 0; y < sizey; y++) {
+		unsigned char *row, *pix, bits = 0;
+		const unsigned char *g;
+		int x;
+
+		memset(inside, 0, sizex);
+		for(i = 0; i < flags->nof_illrects; i++) {
+			const depress_illustration_rect_type *r = flags->illrects+i;
+			unsigned int x1;
+
+			if((unsigned int)y < r->y || (unsigned int)y-r->y >= r->height || r->x >= (unsigned int)sizex) continue;
+
+			x1 = (r->width < (unsigned int)sizex-r->x)?(r->x+r->width):(unsigned int)sizex;
+			memset(inside+r->x, 1, x1-r->x);
+		}
+
+		row = depressBitmaskRow(mask, y);
+		pix = buffer+(size_t)y*sizex*channels;
+		g = gray+(size_t)y*sizex;
+		for(x = 0; x < sizex; x++) {
+			if(inside[x])
+				pix += channels;
+			else {
+				if(g[x] < 128) bits |= (unsigned char)(0x80 >> (x%8));
+				memset(pix, 255, channels);
+				pix += channels;
+			}
+
+			if(x%8 == 7) {
+				*row++ = bits;
+				bits = 0;
+			}
+		}
+		if(sizex%8) *row = bits;
+	}
+
+	result = true;
+
+EXIT:
+	if(gray) free(gray);
+	if(inside) free(inside);
+
+	return result;
+}
+
+int depressDjvuConvertCompoundPage(const depress_flags_type flags, depress_load_image_type load_image, void *load_image_ctx, size_t load_image_id, wchar_t *tempfile, wchar_t *outputfile, depress_djvulibre_paths_type *djvulibre_paths)
+{
+	FILE *f_temp = 0;
+	int sizex, sizey, channels;
+	wchar_t *arg0 = 0, *arg_options, *arg_temp = 0, *arg_bg44 = 0;
+	size_t outputfile_length = 0;
+	unsigned char *buffer = 0;
+	depress_bitmask_type mask = { 0 };
+	depress_flags_type page_flags = flags;
+	depress_illustration_rect_type *detected_illrects = 0;
+	const size_t arg0_size = 3*32768+1536; // 2*3(braces)+3(spaces)+1024(options)<1536
+	int convert_status = DEPRESS_CONVERT_PAGE_STATUS_OK;
+	int dpi = depressDjvuGetPageDpi(&flags);
+
+	outputfile_length = wcslen(outputfile);
+	if(outputfile_length > (32768-5-1)) {
+		convert_status = DEPRESS_CONVERT_PAGE_STATUS_GENERIC_ERROR;
+
+		goto EXIT;
+	}
+
+	arg0 = malloc((arg0_size+1024+80+32768)*sizeof(wchar_t));
+
+	if(!arg0) {
+		convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_ALLOC_MEMORY;
+
+		goto EXIT;
+	} else {
+		arg_options = arg0 + arg0_size;
+		arg_temp = arg_options + 1024;
+		arg_bg44 = arg_temp + 80;
+	}
+
+	memcpy(arg_bg44, outputfile, (outputfile_length+1)*sizeof(wchar_t));
+	wcscpy(arg_bg44+outputfile_length, L".bg44"); // Encoded background
+
+	if(!load_image.load_from_ctx(load_image_ctx, load_image_id, &sizex, &sizey, &channels, &buffer, flags)) {
+		convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_OPEN_IMAGE;
+
+		goto EXIT;
+	}
+
+	if(page_flags.nof_illrects && dpi != flags.dpi) {
+		size_t i;
+
+		// Illustration rectangles are set in pixels of the source image
+		detected_illrects = malloc(page_flags.nof_illrects*sizeof(depress_illustration_rect_type));
+		if(!detected_illrects) {
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_ALLOC_MEMORY;
+
+			goto EXIT;
+		}
+
+		for(i = 0; i < page_flags.nof_illrects; i++) {
+			const depress_illustration_rect_type *r = flags.illrects+i;
+			unsigned int x1, y1;
+
+			detected_illrects[i].x = (unsigned int)depressImageResampleSize((int)r->x, flags.dpi, dpi);
+			detected_illrects[i].y = (unsigned int)depressImageResampleSize((int)r->y, flags.dpi, dpi);
+			x1 = (unsigned int)depressImageResampleSize((int)(r->x+r->width), flags.dpi, dpi);
+			y1 = (unsigned int)depressImageResampleSize((int)(r->y+r->height), flags.dpi, dpi);
+			detected_illrects[i].width = (x1 > detected_illrects[i].x)?(x1-detected_illrects[i].x):1;
+			detected_illrects[i].height = (y1 > detected_illrects[i].y)?(y1-detected_illrects[i].y):1;
+		}
+		page_flags.illrects = detected_illrects;
+	} else if(!page_flags.nof_illrects) {
+		if(!depressImageDetectIllrects(buffer, sizex, sizey, channels, &detected_illrects, &page_flags.nof_illrects)) {
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_ALLOC_MEMORY;
+
+			goto EXIT;
+		}
+		page_flags.illrects = detected_illrects;
+	}
+
+	if(!depressBitmaskCreate(&mask, sizex, sizey) || !depressDjvuCompoundSplit(buffer, sizex, sizey, channels, &page_flags, &mask)) {
+		convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_ALLOC_MEMORY;
+
+		goto EXIT;
+	}
+
+	// Nothing was found, page is just BW
+	if(!page_flags.nof_illrects && depressDjvuUseMmr(&flags)) {
+		if(!depressDjvuSaveMmrPage(outputfile, &mask, dpi))
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+		goto EXIT;
+	} else if(!page_flags.nof_illrects) {
+		free(buffer); buffer = 0;
+
+		f_temp = _wfopen(tempfile, L"wb");
+		if(!f_temp) {
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+			goto EXIT;
+		}
+		if(!pbmSavePacked(sizex, sizey, mask.stride, depressBitmaskRow(&mask, 0), f_temp)) {
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+			goto EXIT;
+		}
+		depressBitmaskDestroy(&mask);
+		fclose(f_temp); f_temp = 0;
+
+		*arg_options = 0;
+		if(flags.quality >= 0 && flags.quality <= 100) {
+			swprintf(arg_temp, 80, L" -losslevel %d", 200 - 2 * flags.quality); // 0 - 100%, 200 - 0%
+			wcscat(arg_options, arg_temp);
+		}
+		if(dpi > 0) {
+			swprintf(arg_temp, 80, L" -dpi %d", dpi);
+			wcscat(arg_options, arg_temp);
+		}
+		swprintf(arg0, arg0_size, L"\"%ls\"%ls \"%ls\" \"%ls\"", djvulibre_paths->cjb2_path, arg_options, tempfile, outputfile);
+		if(depressSpawn(djvulibre_paths->cjb2_path, arg0, true, true) == DEPRESS_INVALID_PROCESS_HANDLE)
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+		goto EXIT;
+	}
+
+	if(flags.bgjpeg) {
+		if(!depressDjvuSaveJpegPage(arg_bg44, sizex, sizey, channels, buffer, depressDjvuGetJpegQuality(&flags), dpi)) {
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+			goto EXIT;
+		}
+		free(buffer); buffer = 0;
+	} else {
+		// Save background, it's flat outside of rectangles so IW44 spends almost nothing on it
+		f_temp = _wfopen(tempfile, L"wb");
+		if(!f_temp) {
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+			goto EXIT;
+		}
+		if(!ppmSave(sizex, sizey, channels, buffer, f_temp)) {
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+			goto EXIT;
+		}
+		free(buffer); buffer = 0;
+		fclose(f_temp); f_temp = 0;
+		// Convert background
+		{
+			int quality;
+
+			quality = flags.quality + 30;
+			if(quality < 30) quality = 30;
+			if(quality > 130) quality = 130;
+
+			swprintf(arg0, arg0_size, L"\"%ls\" -slice %d,%d,%d \"%ls\" \"%ls\"", djvulibre_paths->c44_path, quality-25, quality-15, quality, tempfile, arg_bg44);
+		}
+		if(depressSpawn(djvulibre_paths->c44_path, arg0, true, true) == DEPRESS_INVALID_PROCESS_HANDLE) {
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+			goto EXIT;
+		}
+	}
+
+	if(depressDjvuUseMmr(&flags)) {
+		if(!depressDjvuSaveMmrPage(outputfile, &mask, dpi)) {
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+			goto EXIT;
+		}
+		depressBitmaskDestroy(&mask);
+	} else {
+		// Save mask
+		f_temp = _wfopen(tempfile, L"wb");
+		if(!f_temp) {
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+			goto EXIT;
+		}
+		if(!pbmSavePacked(sizex, sizey, mask.stride, depressBitmaskRow(&mask, 0), f_temp)) {
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+			goto EXIT;
+		}
+		depressBitmaskDestroy(&mask);
+		fclose(f_temp); f_temp = 0;
+		// Convert mask
+		*arg_options = 0;
+		if(flags.quality >= 0 && flags.quality <= 100) {
+			swprintf(arg_temp, 80, L" -losslevel %d", 200 - 2 * flags.quality); // 0 - 100%, 200 - 0%
+			wcscat(arg_options, arg_temp);
+		}
+		swprintf(arg0, arg0_size, L"\"%ls\"%ls \"%ls\" \"%ls\"", djvulibre_paths->cjb2_path, arg_options, tempfile, outputfile);
+		if(depressSpawn(djvulibre_paths->cjb2_path, arg0, true, true) == DEPRESS_INVALID_PROCESS_HANDLE) {
+			convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+			goto EXIT;
+		}
+	}
+
+	// Text is black without FG chunk
+	if(!depressDjvuAssemblePage(outputfile, sizex, sizey, dpi, outputfile, 0, arg_bg44)) {
+		convert_status = DEPRESS_CONVERT_PAGE_STATUS_CANT_SAVE_PAGE;
+
+		goto EXIT;
+	}
+
+EXIT:
+	if(f_temp) fclose(f_temp);
+	if(buffer) free(buffer);
+	if(detected_illrects) free(detected_illrects);
+	depressBitmaskDestroy(&mask);
+
+	{
+		bool del_temp = true, del_bg44 = false;
+
+		if(arg_bg44) del_bg44 = true;
+
+		while(del_temp || del_bg44) {
+			if(!_waccess(tempfile, 06)) {
+				if(_wremove(tempfile) == -1)
+#if defined(_WIN32)
+					Sleep(0);
+#else
+					usleep(1000);
+#endif
+			} else del_temp = false;
+
+			if(arg_bg44) {
+				if(!_waccess(arg_bg44, 06)) {
+					if(_wremove(arg_bg44) == -1)
+#if defined(_WIN32)
+						Sleep(0);
+#else
+						usleep(1000);
+#endif
+				} else del_bg44 = false;
+			}
+		}
+	}
+
+	if(arg0) free(arg0);
+
+	return convert_status;
+}
@@ -37,10 +37,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "../include/depress_document.h"
 #include "../include/depress_maker_djvu.h"
 #include "../include/interlocked_ptr.h"
+#include "../include/depress_tiff.h"
+#include "../include/depress_zip.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 
 #ifndef MAXULONG_PTR
 #define MAXULONG_PTR !((ULONG_PTR)0)
@@ -93,9 +96,28 @@ bool depressDocumentInitDjvu(depress_document_type *document, depress_document_f
 
 	djvu_ctx->output_file = output_file;
 
+	if(document_flags.shared_dict_pages > 1) {
+		if(!djvu_ctx->djvulibre_paths.minidjvu_path[0]) {
+			wprintf(L"Can't find minidjvu, it's needed for shared dictionaries. minidjvu isn't part of DjVuLibre, install it and add it to PATH\n");
+			free(djvu_ctx);
+
+			return false;
+		}
+
+		djvu_ctx->pending_pages = malloc(document_flags.shared_dict_pages*sizeof(size_t));
+		if(!djvu_ctx->pending_pages) {
+			free(djvu_ctx);
+
+			return false;
+		}
+		djvu_ctx->shared_dict_pages = document_flags.shared_dict_pages;
+	}
+
 	memset(&djvu, 0, sizeof(depress_maker_type));
 	djvu.convert_ctx = depressMakerDjvuConvertCtx;
 	djvu.merge_ctx = depressMakerDjvuMergeCtx;
+	djvu.finish_merge_ctx = depressMakerDjvuFinishMergeCtx;
+	djvu.merge_duplicate_ctx = depressMakerDjvuMergeDuplicateCtx;
 	djvu.cleanup_ctx = depressMakerDjvuCleanupCtx;
 	djvu.finalize_ctx = depressMakerDjvuFinalizeCtx;
 	djvu.free_ctx = depressMakerDjvuFreeCtx;
@@ -126,6 +148,17 @@ bool depressDocumentDestroy(depress_document_type *document)
 		document->global_error_event = DEPRESS_INVALID_EVENT_HANDLE;
 	}
 
+	if(document->shared_palettes) {
+		size_t i;
+
+		for(i = 0; i < document->shared_palettes_num; i++)
+			free(document->shared_palettes[i]);
+		free(document->shared_palettes);
+
+		document->shared_palettes = 0;
+		document->shared_palettes_num = 0;
+	}
+
 	depressFreeDocumentFlags(&document->document_flags);
 
 	document->is_init = false;
@@ -133,6 +166,239 @@ bool depressDocumentDestroy(depress_document_type *document)
 	return true;
 }
 
+static bool depressDocumentIsNoteshrinkPage(depress_task_type *task, int colors)
+{
+	if(task->flags.type != DEPRESS_PAGE_TYPE_PALETTIZED) return false;
+	if(task->flags.param2 != DEPRESS_PAGE_TYPE_PALETTIZED_PARAM2_NOTESHRINK) return false;
+	if(task->flags.shared_palette) return false;
+	if(colors && task->flags.param1 != colors) return false;
+
+	return true;
+}
+
+// Builds one noteshrink palette for all pages with the same number of colors
+// from pixels sampled on evenly spaced pages
+static bool depressDocumentCreateSharedPalettes(depress_document_type *document)
+{
+	size_t i;
+
+	for(i = 0; i < document->tasks_num; i++) {
+		unsigned char *samples = 0;
+		size_t samples_num = 0, pages_num = 0, pages_to_sample, j, k;
+		float *palette, **new_palettes;
+		int colors;
+
+		if(!depressDocumentIsNoteshrinkPage(document->tasks+i, 0)) continue;
+
+		colors = document->tasks[i].flags.param1;
+
+		// Pages with these colors were already sampled and none of them loaded
+		for(j = 0; j < i; j++)
+			if(depressDocumentIsNoteshrinkPage(document->tasks+j, colors)) break;
+		if(j < i) continue;
+
+		for(j = i; j < document->tasks_num; j++)
+			if(depressDocumentIsNoteshrinkPage(document->tasks+j, colors)) pages_num++;
+
+		pages_to_sample = document->document_flags.shared_palette_pages;
+		if(pages_to_sample > pages_num) pages_to_sample = pages_num;
+
+		wprintf(L"Creating shared palette from %llu pages\n", (unsigned long long)pages_to_sample);
+
+		for(j = i, k = 0; j < document->tasks_num; j++) {
+			depress_flags_type flags;
+			unsigned char *buf = 0;
+			int sizex, sizey, channels;
+			bool is_selected;
+
+			if(!depressDocumentIsNoteshrinkPage(document->tasks+j, colors)) continue;
+
+			// Take pages evenly spaced among pages_num
+			is_selected = (k*pages_to_sample)%pages_num < pages_to_sample;
+			k++;
+			if(!is_selected) continue;
+
+			flags = document->tasks[j].flags;
+			flags.type = DEPRESS_PAGE_TYPE_COLOR;
+			flags.illrects = 0;
+			flags.nof_illrects = 0;
+
+			if(!document->tasks[j].load_image.load_from_ctx(document->tasks[j].load_image_ctx, j, &sizex, &sizey, &channels, &buf, flags))
+				continue; // Page will report the error itself
+
+			if(!depressImageSampleNoteshrinkPixels(buf, sizex, sizey, channels, pages_to_sample, &samples, &samples_num)) {
+				free(buf);
+				if(samples) free(samples);
+
+				return false;
+			}
+
+			free(buf);
+		}
+
+		// Pages keep their own palettes and report load errors themselves
+		if(samples_num == 0) {
+			if(samples) free(samples);
+			wprintf(L"Warning: no pages for shared palette are loaded, pages use their own palettes\n");
+
+			continue;
+		}
+
+		palette = depressImageCreateNoteshrinkPalette(samples, samples_num, colors);
+		free(samples);
+		if(!palette) return false;
+
+		new_palettes = realloc(document->shared_palettes, (document->shared_palettes_num+1)*sizeof(float *));
+		if(!new_palettes) {
+			free(palette);
+
+			return false;
+		}
+		document->shared_palettes = new_palettes;
+		document->shared_palettes[document->shared_palettes_num++] = palette;
+
+		for(j = i; j < document->tasks_num; j++)
+			if(depressDocumentIsNoteshrinkPage(document->tasks+j, colors))
+				document->tasks[j].flags.shared_palette = palette;
+	}
+
+	return true;
+}
+
+typedef struct {
+	uint64_t hash;
+	size_t id;
+} depress_document_page_hash_type;
+
+static int depressDocumentComparePageHashes(const void *a, const void *b)
+{
+	const depress_document_page_hash_type *ha, *hb;
+
+	ha = (const depress_document_page_hash_type *)a;
+	hb = (const depress_document_page_hash_type *)b;
+
+	if(ha->hash != hb->hash) return ha->hash < hb->hash ? -1 : 1;
+	if(ha->id != hb->id) return ha->id < hb->id ? -1 : 1;
+
+	return 0;
+}
+
+// Hashes flags that change encoded page, page title is added later
+static uint64_t depressDocumentHashPageFlags(uint64_t hash, const depress_flags_type *flags)
+{
+	int values[7];
+
+	values[0] = flags->type;
+	values[1] = flags->param1;
+	values[2] = flags->param2;
+	values[3] = flags->quality;
+	values[4] = flags->dpi;
+	values[5] = flags->resample_dpi;
+	values[6] = (flags->detect_illrects ? 1 : 0) | (flags->mmr ? 2 : 0) | (flags->bgjpeg ? 4 : 0) | (flags->passthrough ? 8 : 0) | (flags->tiled ? 16 : 0) | (flags->libdjvu ? 32 : 0);
+
+	hash = depressHashData(hash, values, sizeof(values));
+	hash = depressHashData(hash, &flags->shared_palette, sizeof(const float *));
+	if(flags->nof_illrects)
+		hash = depressHashData(hash, flags->illrects, flags->nof_illrects*sizeof(depress_illustration_rect_type));
+
+	return hash;
+}
+
+static bool depressDocumentArePageFlagsEqual(const depress_flags_type *a, const depress_flags_type *b)
+{
+	depress_flags_type fa, fb;
+
+	if(a->shared_palette != b->shared_palette) return false;
+
+	fa = *a;
+	fb = *b;
+	fa.page_title = fb.page_title = 0;
+
+	return depressArePageFlagsEqual(&fa, &fb);
+}
+
+// Equal hashes are only candidates, data of pages is compared byte by byte
+static bool depressDocumentArePagesDataEqual(const depress_task_type *a, size_t id_a, const depress_task_type *b, size_t id_b)
+{
+	unsigned char *data_a = 0, *data_b = 0;
+	size_t size_a = 0, size_b = 0;
+	bool equal = false;
+
+	if(!a->load_image.load_data(a->load_image_ctx, id_a, &data_a, &size_a)) goto EXIT;
+	if(!b->load_image.load_data(b->load_image_ctx, id_b, &data_b, &size_b)) goto EXIT;
+
+	equal = size_a == size_b && !memcmp(data_a, data_b, size_a);
+
+EXIT:
+	if(data_a) free(data_a);
+	if(data_b) free(data_b);
+
+	return equal;
+}
+
+// Pages with the same image data and flags are encoded only once
+static bool depressDocumentFindDuplicatePages(depress_document_type *document)
+{
+	depress_document_page_hash_type *hashes;
+	size_t nof_hashes = 0, nof_duplicates = 0, i, j, group;
+	int t;
+
+	if(document->tasks_num > INT_MAX || SIZE_MAX/sizeof(depress_document_page_hash_type) < document->tasks_num) return false;
+
+	hashes = malloc(document->tasks_num*sizeof(depress_document_page_hash_type));
+	if(!hashes) return false;
+
+	// Every file is read to hash it, so pages are hashed in parallel
+#pragma omp parallel for schedule(dynamic)
+	for(t = 0; t < (int)document->tasks_num; t++) {
+		depress_task_type *task = document->tasks+t;
+		uint64_t hash;
+
+		task->original_id = t;
+		hashes[t].id = SIZE_MAX;
+
+		if(!task->load_image.get_hash || !task->load_image.load_data) continue;
+		if(!task->load_image.get_hash(task->load_image_ctx, t, &hash))
+			continue; // Page will report the error itself
+
+		hashes[t].hash = depressDocumentHashPageFlags(hash, &task->flags);
+		hashes[t].id = t;
+	}
+
+	for(i = 0; i < document->tasks_num; i++)
+		if(hashes[i].id != SIZE_MAX)
+			hashes[nof_hashes++] = hashes[i];
+
+	qsort(hashes, nof_hashes, sizeof(depress_document_page_hash_type), depressDocumentComparePageHashes);
+
+	for(group = 0, i = 0; i < nof_hashes; i++) {
+		depress_task_type *task = document->tasks+hashes[i].id;
+
+		if(hashes[i].hash != hashes[group].hash) group = i;
+
+		// Earlier pages of the group go first, so the original is always merged before its copies
+		for(j = group; j < i; j++) {
+			depress_task_type *original = document->tasks+hashes[j].id;
+
+			if(original->original_id != hashes[j].id) continue;
+			if(!depressDocumentArePageFlagsEqual(&original->flags, &task->flags)) continue;
+			if(!depressDocumentArePagesDataEqual(original, hashes[j].id, task, hashes[i].id)) continue;
+
+			task->original_id = hashes[j].id;
+			nof_duplicates++;
+
+			break;
+		}
+	}
+
+	free(hashes);
+
+	if(nof_duplicates)
+		wprintf(L"Found %llu duplicate pages\n", (unsigned long long)nof_duplicates);
+
+	return true;
+}
+
 bool depressDocumentRunTasks(depress_document_type *document)
 {
 	unsigned int i;
@@ -148,6 +414,21 @@ bool depressDocumentRunTasks(depress_document_type *document)
 	if(document->tasks == 0)
 		return false;
 
+	if(document->document_flags.shared_palette_pages > 0)
+		if(!depressDocumentCreateSharedPalettes(document)) {
+			wprintf(L"Can't create shared palette\n");
+
+			goto LABEL_ERROR;
+		}
+
+	// Duplicates are found after shared palettes are assigned, because palette is part of page flags
+	if(document->document_flags.dedup && document->maker.merge_duplicate_ctx)
+		if(!depressDocumentFindDuplicatePages(document)) {
+			wprintf(L"Can't find duplicate pages\n");
+
+			goto LABEL_ERROR;
+		}
+
 	document->threads_num = depressGetNumberOfThreads();
 	if(document->threads_num == 0) document->threads_num = 1;
 	if(document->threads_num > 64) document->threads_num = 64;
@@ -255,7 +536,7 @@ LABEL_ERROR:
 
 int depressDocumentProcessTasks(depress_document_type *document)
 {
-	bool success = true;
+	bool success = true, result;
 	int process_status = DEPRESS_DOCUMENT_PROCESS_STATUS_OK;
 	size_t filecount = 0;
 	unsigned int i;
@@ -279,13 +560,19 @@ int depressDocumentProcessTasks(depress_document_type *document)
 			if(process_status == DEPRESS_DOCUMENT_PROCESS_STATUS_OK || process_status == DEPRESS_DOCUMENT_PROCESS_STATUS_GENERIC_ERROR)
 				process_status = document->tasks[filecount].process_status;
 		} else {
-			if(process_status == DEPRESS_DOCUMENT_PROCESS_STATUS_OK && filecount > 0) {
-				wprintf(L"Merging file \"%ls\"\n", document->tasks[filecount].load_image.get_name(document->tasks[filecount].load_image_ctx, filecount));
+			if(process_status == DEPRESS_DOCUMENT_PROCESS_STATUS_OK) {
+				if(filecount > 0)
+					wprintf(L"Merging file \"%ls\"\n", document->tasks[filecount].load_image.get_name(document->tasks[filecount].load_image_ctx, filecount));
 
-				if(!document->maker.merge_ctx(document->maker_ctx, filecount)) {
+				if(document->tasks[filecount].original_id != filecount)
+					result = document->maker.merge_duplicate_ctx(document->maker_ctx, filecount, document->tasks[filecount].original_id);
+				else
+					result = document->maker.merge_ctx(document->maker_ctx, filecount, document->tasks[filecount].flags);
+
+				if(!result) {
 					depressSetEvent(document->global_error_event);
 					process_status = DEPRESS_DOCUMENT_PROCESS_STATUS_CANT_ADD_PAGE;
-				} else
+				} else if(filecount > 0)
 					InterlockedExchangePtr((uintptr_t *)(&document->tasks_processed), filecount);
 			}
 			if(filecount > 0)
@@ -293,6 +580,11 @@ int depressDocumentProcessTasks(depress_document_type *document)
 		}
 	}
 
+	// Pages kept by the maker for merging together
+	if(process_status == DEPRESS_DOCUMENT_PROCESS_STATUS_OK && document->maker.finish_merge_ctx)
+		if(!document->maker.finish_merge_ctx(document->maker_ctx))
+			process_status = DEPRESS_DOCUMENT_PROCESS_STATUS_CANT_ADD_PAGE;
+
 	depressWaitForMultipleThreads(document->threads_num, document->threads);
 
 	for(i = 0; i < document->threads_num; i++)
@@ -413,6 +705,8 @@ bool depressDocumentAddTaskFromImageFile(depress_document_type *document, const
 	load_image.load_from_ctx = depressImageLoadFromCtx;
 	load_image.free_ctx = depressImageFreeCtx;
 	load_image.get_name = depressImageGetNameCtx;
+	load_image.get_hash = depressImageGetHashCtx;
+	load_image.load_data = depressImageLoadDataCtx;
 	
 	result = depressDocumentAddTask(document, load_image, load_image_ctx, flags);
 
@@ -421,12 +715,92 @@ bool depressDocumentAddTaskFromImageFile(depress_document_type *document, const
 	return result;
 }
 
+// Adds task for every page of TIFF file
+bool depressDocumentAddTasksFromTiffFile(depress_document_type *document, const wchar_t *inputfile, const depress_flags_type flags)
+{
+	depress_load_image_type load_image;
+	void *load_image_ctx;
+	size_t nof_pages, i;
+
+	if(!document->is_init) return false;
+
+	load_image_ctx = depressImageTiffCreateCtx(inputfile, document->tasks_num, &nof_pages);
+	if(!load_image_ctx) return false;
+
+	memset(&load_image, 0, sizeof(depress_load_image_type));
+	load_image.load_from_ctx = depressImageTiffLoadFromCtx;
+	load_image.free_ctx = depressImageTiffFreeCtx;
+	load_image.get_name = depressImageTiffGetNameCtx;
+	load_image.get_hash = depressImageTiffGetHashCtx;
+	load_image.load_data = depressImageTiffLoadDataCtx;
+
+	for(i = 0; i < nof_pages; i++) {
+		if(!depressDocumentAddTask(document, load_image, load_image_ctx, flags)) {
+			// Context is freed after the last page
+			for(; i < nof_pages; i++)
+				depressImageTiffFreeCtx(load_image_ctx, 0);
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Adds task for every image in ZIP (CBZ) archive, in order of names
+bool depressDocumentAddTasksFromZipFile(depress_document_type *document, const wchar_t *inputfile, const depress_flags_type flags)
+{
+	depress_load_image_type load_image;
+	void *load_image_ctx;
+	size_t nof_pages, i;
+
+	if(!document->is_init) return false;
+
+	load_image_ctx = depressImageZipCreateCtx(inputfile, document->tasks_num, &nof_pages);
+	if(!load_image_ctx) return false;
+
+	memset(&load_image, 0, sizeof(depress_load_image_type));
+	load_image.load_from_ctx = depressImageZipLoadFromCtx;
+	load_image.free_ctx = depressImageZipFreeCtx;
+	load_image.get_name = depressImageZipGetNameCtx;
+	load_image.get_hash = depressImageZipGetHashCtx;
+	load_image.load_data = depressImageZipLoadDataCtx;
+
+	for(i = 0; i < nof_pages; i++) {
+		if(!depressDocumentAddTask(document, load_image, load_image_ctx, flags)) {
+			// Context is freed after the last page
+			for(; i < nof_pages; i++)
+				depressImageZipFreeCtx(load_image_ctx, 0);
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// First bytes of the file, zero filled for short files (errors are reported on loading the image)
+static void depressDocumentReadSignature(const wchar_t *filename, unsigned char *signature, size_t size)
+{
+	FILE *f;
+
+	memset(signature, 0, size);
+
+	f = _wfopen(filename, L"rb");
+	if(!f) return;
+
+	if(fread(signature, 1, size, f) < size) memset(signature, 0, size);
+
+	fclose(f);
+}
+
 bool depressDocumentCreateTasksFromTextFile(depress_document_type *document, const wchar_t *textfile, const wchar_t *textfilepath, depress_flags_type flags)
 {
 	FILE *f;
 	size_t task_inputfile_length;
 	wchar_t *inputfile;
 	wchar_t *inputfile_fullname;
+	unsigned char signature[32];
 
 	if(document->tasks)
 		depressDestroyTasks(document->tasks, document->tasks_num);
@@ -475,7 +849,15 @@ bool depressDocumentCreateTasksFromTextFile(depress_document_type *document, con
 		
 		if(task_inputfile_length >= 32768 || task_inputfile_length == 0) goto LABEL_ERROR;
 
-		if(!depressDocumentAddTaskFromImageFile(document, inputfile_fullname, flags)) goto LABEL_ERROR;
+		// Multi-page files and archives give a task for every page
+		depressDocumentReadSignature(inputfile_fullname, signature, sizeof(signature));
+		if(depressTiffIsTiff(signature, sizeof(signature))) {
+			if(!depressDocumentAddTasksFromTiffFile(document, inputfile_fullname, flags)) goto LABEL_ERROR;
+		} else if(depressZipIsZip(signature, sizeof(signature))) {
+			if(!depressDocumentAddTasksFromZipFile(document, inputfile_fullname, flags)) goto LABEL_ERROR;
+		} else {
+			if(!depressDocumentAddTaskFromImageFile(document, inputfile_fullname, flags)) goto LABEL_ERROR;
+		}
 	}
 
 	free(inputfile);
@@ -0,0 +1,114 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if defined(_DEBUG) && defined(USE_STB_LEAKCHECK)
+#include "third_party/stb_leakcheck.h"
+#endif
+
+#include "../include/depress_filemap.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include "unixsupport/wfopen.h"
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+bool depressMapFile(const wchar_t *filename, depress_filemap_type *map)
+{
+#if defined(_WIN32)
+	HANDLE file, mapping;
+	LARGE_INTEGER filesize;
+	void *data = 0;
+
+	memset(map, 0, sizeof(depress_filemap_type));
+
+	file = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE) return false;
+
+	if(!GetFileSizeEx(file, &filesize) || filesize.QuadPart <= 0 || (uint64_t)filesize.QuadPart > SIZE_MAX) {
+		CloseHandle(file);
+
+		return false;
+	}
+
+	// View keeps the mapping and the file open
+	mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(mapping) {
+		data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+
+	if(!data) return false;
+
+	map->data = data;
+	map->size = (size_t)filesize.QuadPart;
+
+	return true;
+#else
+	FILE *f;
+	struct stat st;
+	void *data = MAP_FAILED;
+
+	memset(map, 0, sizeof(depress_filemap_type));
+
+	f = _wfopen(filename, L"rb");
+	if(!f) return false;
+
+	// Mapping stays valid after the file is closed
+	if(!fstat(fileno(f), &st) && st.st_size > 0 && (uint64_t)st.st_size <= SIZE_MAX)
+		data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+	fclose(f);
+
+	if(data == MAP_FAILED) return false;
+
+	map->data = data;
+	map->size = (size_t)st.st_size;
+
+	return true;
+#endif
+}
+
+void depressUnmapFile(depress_filemap_type *map)
+{
+	if(!map->data) return;
+
+#if defined(_WIN32)
+	UnmapViewOfFile(map->data);
+#else
+	munmap((void *)map->data, map->size);
+#endif
+
+	memset(map, 0, sizeof(depress_filemap_type));
+}
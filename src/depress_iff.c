@@ -0,0 +1,237 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if defined(_DEBUG) && defined(USE_STB_LEAKCHECK)
+#include "third_party/stb_leakcheck.h"
+#endif
+
+#if !defined(_WIN32)
+#include "unixsupport/wfopen.h"
+#endif
+
+#include "../include/depress_iff.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEPRESS_IFF_DJVU_VERSION 26 // Version of DjVu page written in INFO chunk
+#define DEPRESS_IFF_DJVU_GAMMA 22
+#define DEPRESS_IFF_DJVU_ROTATE0 1
+
+static uint32_t depressIffReadBE32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void depressIffWriteBE32(unsigned char *p, uint32_t v)
+{
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+/*
+	Loads IFF file with one FORM (optionally preceded by "AT&T" magic as in DjVu files)
+*/
+bool depressIffLoad(const wchar_t *filename, depress_iff_form_type *form)
+{
+	FILE *f = 0;
+	unsigned char header[16], chunk_header[8];
+	uint32_t form_size, offset;
+	size_t header_size = 12;
+	bool success = false;
+
+	memset(form, 0, sizeof(depress_iff_form_type));
+
+	f = _wfopen(filename, L"rb");
+	if(!f) return false;
+
+	if(fread(header, 1, 16, f) != 16) goto EXIT;
+	if(!memcmp(header, "AT&T", 4)) {
+		memmove(header, header+4, 12);
+		header_size = 16;
+	}
+	if(memcmp(header, "FORM", 4)) goto EXIT;
+	form_size = depressIffReadBE32(header+4);
+	if(form_size < 4) goto EXIT;
+	memcpy(form->form_id, header+8, 4);
+	if(fseek(f, (long)header_size, SEEK_SET)) goto EXIT;
+
+	offset = 4;
+	while(offset+8 <= form_size) {
+		depress_iff_chunk_type *chunk;
+		uint32_t size;
+
+		if(fread(chunk_header, 1, 8, f) != 8) goto EXIT;
+		size = depressIffReadBE32(chunk_header+4);
+		if(size > form_size-offset-8) goto EXIT;
+
+		if(!depressIffAddChunk(form, (const char *)chunk_header, 0, size)) goto EXIT;
+		chunk = form->chunks+form->nof_chunks-1;
+		if(size > 0 && fread(chunk->data, 1, size, f) != size) goto EXIT;
+
+		offset += 8+size;
+		if(offset & 1) { // Chunks are aligned by 2 bytes
+			if(offset < form_size && fgetc(f) == EOF) goto EXIT;
+			offset++;
+		}
+	}
+
+	success = true;
+
+EXIT:
+	fclose(f);
+
+	if(!success) depressIffFree(form);
+
+	return success;
+}
+
+/*
+	Saves FORM to DjVu file ("AT&T" magic and FORM)
+*/
+bool depressIffSave(const wchar_t *filename, const depress_iff_form_type *form)
+{
+	FILE *f = 0;
+	unsigned char header[16];
+	uint64_t form_size = 4;
+	size_t i;
+	bool success = true;
+
+	for(i = 0; i < form->nof_chunks; i++) {
+		form_size += 8+(uint64_t)form->chunks[i].size;
+		if(i+1 < form->nof_chunks) form_size += form->chunks[i].size & 1;
+	}
+	if(form_size > UINT32_MAX) return false;
+
+	f = _wfopen(filename, L"wb");
+	if(!f) return false;
+
+	memcpy(header, "AT&TFORM", 8);
+	depressIffWriteBE32(header+8, (uint32_t)form_size);
+	memcpy(header+12, form->form_id, 4);
+	if(fwrite(header, 1, 16, f) != 16) success = false;
+
+	for(i = 0; success && i < form->nof_chunks; i++) {
+		const depress_iff_chunk_type *chunk = form->chunks+i;
+
+		memcpy(header, chunk->id, 4);
+		depressIffWriteBE32(header+4, chunk->size);
+		if(fwrite(header, 1, 8, f) != 8) success = false;
+		if(success && chunk->size > 0 && fwrite(chunk->data, 1, chunk->size, f) != chunk->size) success = false;
+		// Pad between chunks, as djvulibre does
+		if(success && (chunk->size & 1) && i+1 < form->nof_chunks && fputc(0, f) == EOF) success = false;
+	}
+
+	if(fclose(f)) success = false;
+
+	return success;
+}
+
+void depressIffFree(depress_iff_form_type *form)
+{
+	size_t i;
+
+	for(i = 0; i < form->nof_chunks; i++)
+		if(form->chunks[i].data) free(form->chunks[i].data);
+	if(form->chunks) free(form->chunks);
+
+	memset(form, 0, sizeof(depress_iff_form_type));
+}
+
+/*
+	Adds chunk with copy of data. If data is NULL, chunk data is allocated but not set
+*/
+bool depressIffAddChunk(depress_iff_form_type *form, const char *id, const unsigned char *data, uint32_t size)
+{
+	depress_iff_chunk_type *new_chunks, *chunk;
+
+	if(SIZE_MAX/sizeof(depress_iff_chunk_type) <= form->nof_chunks) return false;
+
+	new_chunks = realloc(form->chunks, (form->nof_chunks+1)*sizeof(depress_iff_chunk_type));
+	if(!new_chunks) return false;
+	form->chunks = new_chunks;
+
+	chunk = form->chunks+form->nof_chunks;
+	memcpy(chunk->id, id, 4);
+	chunk->size = size;
+	chunk->data = malloc(size?size:1);
+	if(!chunk->data) return false;
+	if(data && size) memcpy(chunk->data, data, size);
+
+	form->nof_chunks++;
+
+	return true;
+}
+
+/*
+	Copies all chunks with given id from src to dst, renaming them to new_id (if not NULL)
+*/
+bool depressIffCopyChunks(depress_iff_form_type *dst, const depress_iff_form_type *src, const char *id, const char *new_id, size_t *nof_copied)
+{
+	size_t i;
+
+	*nof_copied = 0;
+
+	for(i = 0; i < src->nof_chunks; i++) {
+		const depress_iff_chunk_type *chunk = src->chunks+i;
+
+		if(memcmp(chunk->id, id, 4)) continue;
+
+		if(!depressIffAddChunk(dst, new_id?new_id:id, chunk->data, chunk->size)) return false;
+		(*nof_copied)++;
+	}
+
+	return true;
+}
+
+/*
+	Adds INFO chunk of DjVu page
+*/
+bool depressIffAddDjvuInfo(depress_iff_form_type *form, unsigned int width, unsigned int height, int dpi)
+{
+	unsigned char info[10];
+
+	if(width == 0 || width > 0xffff || height == 0 || height > 0xffff) return false;
+	if(dpi <= 0 || dpi > 0xffff) dpi = 300;
+
+	info[0] = (unsigned char)(width >> 8);
+	info[1] = (unsigned char)width;
+	info[2] = (unsigned char)(height >> 8);
+	info[3] = (unsigned char)height;
+	info[4] = DEPRESS_IFF_DJVU_VERSION & 0xff;
+	info[5] = DEPRESS_IFF_DJVU_VERSION >> 8;
+	info[6] = (unsigned char)dpi; // dpi is little endian
+	info[7] = (unsigned char)(dpi >> 8);
+	info[8] = DEPRESS_IFF_DJVU_GAMMA;
+	info[9] = DEPRESS_IFF_DJVU_ROTATE0;
+
+	return depressIffAddChunk(form, "INFO", info, 10);
+}
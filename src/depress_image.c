@@ -35,9 +35,18 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include "../include/depress_image.h"
+#include "../include/depress_tiff.h"
+#include "../include/depress_filemap.h"
+#include "../include/depress_zip.h"
 
 #include "third_party/noteshrink.h"
 
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <wctype.h>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "third_party/stb_image.h"
 
@@ -61,6 +70,464 @@ wchar_t *depressImageGetNameCtx(void *ctx, size_t id)
 
 	return (wchar_t *)ctx;
 }
+
+bool depressImageGetHashCtx(void *ctx, size_t id, uint64_t *hash)
+{
+	FILE *f;
+	unsigned char *data;
+	size_t size, filesize = 0;
+	bool result = false;
+
+	(void)id;
+
+	data = malloc(65536);
+	if(!data) return false;
+
+	f = _wfopen((wchar_t *)ctx, L"rb");
+	if(!f) goto EXIT;
+
+	*hash = DEPRESS_HASH_INIT;
+	while((size = fread(data, 1, 65536, f)) > 0) {
+		*hash = depressHashData(*hash, data, size);
+		filesize += size;
+	}
+	if(ferror(f)) goto EXIT;
+
+	*hash = depressHashData(*hash, &filesize, sizeof(size_t));
+
+	result = true;
+
+EXIT:
+	if(f) fclose(f);
+	free(data);
+
+	return result;
+}
+
+bool depressImageLoadDataCtx(void *ctx, size_t id, unsigned char **data, size_t *size)
+{
+	FILE *f;
+	long filesize;
+	bool result = false;
+
+	(void)id;
+
+	*data = 0;
+
+	f = _wfopen((wchar_t *)ctx, L"rb");
+	if(!f) return false;
+
+	if(fseek(f, 0, SEEK_END)) goto EXIT;
+	filesize = ftell(f);
+	if(filesize <= 0 || fseek(f, 0, SEEK_SET)) goto EXIT;
+
+	*data = malloc(filesize);
+	if(!*data) goto EXIT;
+
+	if(fread(*data, 1, filesize, f) != (size_t)filesize) goto EXIT;
+
+	*size = filesize;
+	result = true;
+
+EXIT:
+	if(!result && *data) {
+		free(*data);
+		*data = 0;
+	}
+	fclose(f);
+
+	return result;
+}
+
+// Pages of multi-page TIFF file share one context, every page is decoded only when it's needed
+typedef struct {
+	wchar_t *filename;
+	wchar_t **names; // File name and page number, 0 for single page file
+	size_t *ifds;
+	size_t nof_pages;
+	size_t first_id; // Id of task with the first page
+	size_t refs;
+} depress_image_tiff_ctx_type;
+
+void *depressImageTiffCreateCtx(const wchar_t *filename, size_t first_id, size_t *nof_pages)
+{
+	depress_image_tiff_ctx_type *tiff_ctx;
+	depress_filemap_type map;
+	size_t filename_size;
+	bool success = false;
+
+	*nof_pages = 0;
+
+	tiff_ctx = calloc(1, sizeof(depress_image_tiff_ctx_type));
+	if(!tiff_ctx) return 0;
+
+	filename_size = (wcslen(filename)+1)*sizeof(wchar_t);
+	tiff_ctx->filename = malloc(filename_size);
+	if(!tiff_ctx->filename) goto EXIT;
+	memcpy(tiff_ctx->filename, filename, filename_size);
+
+	if(!depressMapFile(filename, &map)) goto EXIT;
+	success = depressTiffGetPages(map.data, map.size, &tiff_ctx->ifds, &tiff_ctx->nof_pages);
+	depressUnmapFile(&map);
+	if(!success) goto EXIT;
+	success = false;
+
+	if(tiff_ctx->nof_pages > 1) {
+		size_t name_size, i;
+
+		tiff_ctx->names = calloc(tiff_ctx->nof_pages, sizeof(wchar_t *));
+		if(!tiff_ctx->names) goto EXIT;
+
+		name_size = wcslen(filename)+22;
+		for(i = 0; i < tiff_ctx->nof_pages; i++) {
+			tiff_ctx->names[i] = malloc(name_size*sizeof(wchar_t));
+			if(!tiff_ctx->names[i]) goto EXIT;
+
+			swprintf(tiff_ctx->names[i], name_size, L"%ls/%llu", filename, (unsigned long long)(i+1));
+		}
+	}
+
+	tiff_ctx->first_id = first_id;
+	tiff_ctx->refs = tiff_ctx->nof_pages;
+	*nof_pages = tiff_ctx->nof_pages;
+
+	success = true;
+
+EXIT:
+	if(!success) {
+		if(tiff_ctx->names) {
+			size_t i;
+
+			for(i = 0; i < tiff_ctx->nof_pages; i++)
+				if(tiff_ctx->names[i]) free(tiff_ctx->names[i]);
+			free(tiff_ctx->names);
+		}
+		if(tiff_ctx->ifds) free(tiff_ctx->ifds);
+		if(tiff_ctx->filename) free(tiff_ctx->filename);
+		free(tiff_ctx);
+
+		return 0;
+	}
+
+	return tiff_ctx;
+}
+
+bool depressImageTiffLoadFromCtx(void *ctx, size_t id, int *sizex, int *sizey, int *channels, unsigned char **buf, depress_flags_type flags)
+{
+	depress_image_tiff_ctx_type *tiff_ctx = ctx;
+	depress_filemap_type map;
+	bool success;
+
+	if(!depressMapFile(tiff_ctx->filename, &map)) return false;
+	success = depressTiffDecodePage(map.data, map.size, tiff_ctx->ifds[id-tiff_ctx->first_id], sizex, sizey, channels, buf);
+	depressUnmapFile(&map);
+
+	if(!success) return false;
+
+	if(!depressImageConvertChannels(buf, *sizex, *sizey, channels, depressImageGetDesiredChannels(flags))) return false;
+
+	return depressImageApplyFlags(buf, sizex, sizey, *channels, flags);
+}
+
+// Called once for every page
+void depressImageTiffFreeCtx(void *ctx, size_t id)
+{
+	depress_image_tiff_ctx_type *tiff_ctx = ctx;
+
+	(void)id;
+
+	if(--tiff_ctx->refs) return;
+
+	if(tiff_ctx->names) {
+		size_t i;
+
+		for(i = 0; i < tiff_ctx->nof_pages; i++)
+			free(tiff_ctx->names[i]);
+		free(tiff_ctx->names);
+	}
+	free(tiff_ctx->filename);
+	free(tiff_ctx->ifds);
+	free(tiff_ctx);
+}
+
+wchar_t *depressImageTiffGetNameCtx(void *ctx, size_t id)
+{
+	depress_image_tiff_ctx_type *tiff_ctx = ctx;
+
+	if(!tiff_ctx->names) return tiff_ctx->filename;
+
+	return tiff_ctx->names[id-tiff_ctx->first_id];
+}
+
+bool depressImageTiffGetHashCtx(void *ctx, size_t id, uint64_t *hash)
+{
+	unsigned char *data;
+	size_t size;
+
+	if(!depressImageTiffLoadDataCtx(ctx, id, &data, &size)) return false;
+
+	*hash = depressHashData(DEPRESS_HASH_INIT, data, size);
+	*hash = depressHashData(*hash, &size, sizeof(size_t));
+
+	free(data);
+
+	return true;
+}
+
+// Page is extracted into single page TIFF file
+bool depressImageTiffLoadDataCtx(void *ctx, size_t id, unsigned char **data, size_t *size)
+{
+	depress_image_tiff_ctx_type *tiff_ctx = ctx;
+	depress_filemap_type map;
+	bool success;
+
+	if(!depressMapFile(tiff_ctx->filename, &map)) return false;
+	success = depressTiffExtractPage(map.data, map.size, tiff_ctx->ifds[id-tiff_ctx->first_id], data, size);
+	depressUnmapFile(&map);
+
+	return success;
+}
+
+// Pages of ZIP (CBZ) archive share one context, central directory is read once
+typedef struct {
+	wchar_t *filename;
+	depress_zip_entry_type *entries; // Only images, sorted by name
+	wchar_t **names; // Archive file name and path inside archive
+	size_t nof_pages;
+	size_t first_id; // Id of task with the first page
+	size_t refs;
+} depress_image_zip_ctx_type;
+
+static bool depressImageIsImageName(const wchar_t *name)
+{
+	static const wchar_t *extensions[] = { L"jpg", L"jpeg", L"png", L"bmp", L"gif", L"tga", L"psd", L"pnm", L"pbm", L"pgm", L"ppm", L"tif", L"tiff" };
+	const wchar_t *ext;
+	size_t i, j;
+
+	// Resource forks of macOS archivers have the same names as images
+	if(!wcsncmp(name, L"__MACOSX/", 9)) return false;
+
+	ext = wcsrchr(name, '.');
+	if(!ext || wcschr(ext, '/')) return false;
+	ext++;
+
+	for(i = 0; i < sizeof(extensions)/sizeof(const wchar_t *); i++) {
+		if(wcslen(ext) != wcslen(extensions[i])) continue;
+
+		for(j = 0; ext[j]; j++)
+			if((wchar_t)towlower(ext[j]) != extensions[i][j]) break;
+		if(!ext[j]) return true;
+	}
+
+	return false;
+}
+
+static bool depressImageIsDigit(wchar_t c)
+{
+	return c >= '0' && c <= '9';
+}
+
+// Natural order, numbers in names are compared by value, so page2 goes before page10
+static int depressImageCompareZipEntries(const void *a, const void *b)
+{
+	const wchar_t *pa, *pb;
+
+	pa = ((const depress_zip_entry_type *)a)->name;
+	pb = ((const depress_zip_entry_type *)b)->name;
+
+	while(*pa && *pb) {
+		if(depressImageIsDigit(*pa) && depressImageIsDigit(*pb)) {
+			const wchar_t *ea, *eb;
+
+			// Leading zeros don't change value, then longer number is bigger
+			while(*pa == '0' && depressImageIsDigit(pa[1])) pa++;
+			while(*pb == '0' && depressImageIsDigit(pb[1])) pb++;
+			for(ea = pa; depressImageIsDigit(*ea); ea++);
+			for(eb = pb; depressImageIsDigit(*eb); eb++);
+
+			if(ea-pa != eb-pb) return (ea-pa < eb-pb)?-1:1;
+			for(; pa < ea; pa++, pb++)
+				if(*pa != *pb) return (*pa < *pb)?-1:1;
+
+			continue;
+		}
+
+		if(*pa != *pb) return (*pa < *pb)?-1:1;
+		pa++;
+		pb++;
+	}
+
+	if(*pa || *pb) return *pa?1:-1;
+
+	// Names that differ only in leading zeros keep stable order
+	return wcscmp(((const depress_zip_entry_type *)a)->name, ((const depress_zip_entry_type *)b)->name);
+}
+
+void *depressImageZipCreateCtx(const wchar_t *filename, size_t first_id, size_t *nof_pages)
+{
+	depress_image_zip_ctx_type *zip_ctx;
+	depress_zip_entry_type *entries = 0;
+	depress_filemap_type map;
+	size_t nof_entries = 0, filename_length, i;
+	bool success = false;
+
+	*nof_pages = 0;
+
+	zip_ctx = calloc(1, sizeof(depress_image_zip_ctx_type));
+	if(!zip_ctx) return 0;
+
+	filename_length = wcslen(filename);
+	zip_ctx->filename = malloc((filename_length+1)*sizeof(wchar_t));
+	if(!zip_ctx->filename) goto EXIT;
+	memcpy(zip_ctx->filename, filename, (filename_length+1)*sizeof(wchar_t));
+
+	if(!depressMapFile(filename, &map)) goto EXIT;
+	success = depressZipGetEntries(map.data, map.size, &entries, &nof_entries);
+	depressUnmapFile(&map);
+	if(!success) goto EXIT;
+	success = false;
+
+	// Entries which are not images are freed
+	for(i = 0; i < nof_entries; i++) {
+		if(depressImageIsImageName(entries[i].name))
+			entries[zip_ctx->nof_pages++] = entries[i];
+		else
+			free(entries[i].name);
+	}
+	zip_ctx->entries = entries;
+	nof_entries = zip_ctx->nof_pages;
+	if(!zip_ctx->nof_pages) goto EXIT;
+
+	qsort(zip_ctx->entries, zip_ctx->nof_pages, sizeof(depress_zip_entry_type), depressImageCompareZipEntries);
+
+	zip_ctx->names = calloc(zip_ctx->nof_pages, sizeof(wchar_t *));
+	if(!zip_ctx->names) goto EXIT;
+
+	for(i = 0; i < zip_ctx->nof_pages; i++) {
+		size_t name_length = wcslen(zip_ctx->entries[i].name);
+
+		zip_ctx->names[i] = malloc((filename_length+name_length+2)*sizeof(wchar_t));
+		if(!zip_ctx->names[i]) goto EXIT;
+
+		memcpy(zip_ctx->names[i], filename, filename_length*sizeof(wchar_t));
+		zip_ctx->names[i][filename_length] = '/';
+		memcpy(zip_ctx->names[i]+filename_length+1, zip_ctx->entries[i].name, (name_length+1)*sizeof(wchar_t));
+	}
+
+	zip_ctx->first_id = first_id;
+	zip_ctx->refs = zip_ctx->nof_pages;
+	*nof_pages = zip_ctx->nof_pages;
+
+	success = true;
+
+EXIT:
+	if(!success) {
+		if(zip_ctx->names) {
+			for(i = 0; i < zip_ctx->nof_pages; i++)
+				if(zip_ctx->names[i]) free(zip_ctx->names[i]);
+			free(zip_ctx->names);
+		}
+		depressZipFreeEntries(entries, nof_entries);
+		if(zip_ctx->filename) free(zip_ctx->filename);
+		free(zip_ctx);
+
+		return 0;
+	}
+
+	return zip_ctx;
+}
+
+bool depressImageZipLoadFromCtx(void *ctx, size_t id, int *sizex, int *sizey, int *channels, unsigned char **buf, depress_flags_type flags)
+{
+	unsigned char *data;
+	size_t size;
+	bool success;
+
+	*buf = 0;
+
+	if(!depressImageZipLoadDataCtx(ctx, id, &data, &size)) return false;
+	success = depressImageDecodeMemory(data, size, sizex, sizey, channels, buf, depressImageGetDesiredChannels(flags));
+	free(data);
+
+	if(!success) return false;
+
+	return depressImageApplyFlags(buf, sizex, sizey, *channels, flags);
+}
+
+// Called once for every page
+void depressImageZipFreeCtx(void *ctx, size_t id)
+{
+	depress_image_zip_ctx_type *zip_ctx = ctx;
+	size_t i;
+
+	(void)id;
+
+	if(--zip_ctx->refs) return;
+
+	for(i = 0; i < zip_ctx->nof_pages; i++)
+		free(zip_ctx->names[i]);
+	free(zip_ctx->names);
+	depressZipFreeEntries(zip_ctx->entries, zip_ctx->nof_pages);
+	free(zip_ctx->filename);
+	free(zip_ctx);
+}
+
+wchar_t *depressImageZipGetNameCtx(void *ctx, size_t id)
+{
+	depress_image_zip_ctx_type *zip_ctx = ctx;
+
+	return zip_ctx->names[id-zip_ctx->first_id];
+}
+
+bool depressImageZipGetHashCtx(void *ctx, size_t id, uint64_t *hash)
+{
+	unsigned char *data;
+	size_t size;
+
+	if(!depressImageZipLoadDataCtx(ctx, id, &data, &size)) return false;
+
+	*hash = depressHashData(DEPRESS_HASH_INIT, data, size);
+	*hash = depressHashData(*hash, &size, sizeof(size_t));
+
+	free(data);
+
+	return true;
+}
+
+// Only this file is unpacked from mapped archive
+bool depressImageZipLoadDataCtx(void *ctx, size_t id, unsigned char **data, size_t *size)
+{
+	depress_image_zip_ctx_type *zip_ctx = ctx;
+	depress_filemap_type map;
+	bool success;
+
+	if(!depressMapFile(zip_ctx->filename, &map)) return false;
+	success = depressZipReadEntry(map.data, map.size, zip_ctx->entries+(id-zip_ctx->first_id), data, size);
+	depressUnmapFile(&map);
+
+	return success;
+}
+
+// FNV-1a like hash taking 8 bytes per step with xor-shift after every word, so results
+// differ from FNV-1a. For finding candidate duplicates, not for security
+uint64_t depressHashData(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *p;
+	uint64_t word;
+	size_t i;
+
+	p = (const unsigned char *)data;
+
+	for(i = 0; i + 8 <= size; i += 8) {
+		memcpy(&word, p + i, 8);
+		hash = (hash ^ word) * 1099511628211ULL;
+		hash ^= hash >> 32;
+	}
+	for(; i < size; i++)
+		hash = (hash ^ p[i]) * 1099511628211ULL;
+
+	return hash;
+}
 //#include <time.h>
 //#include <Windows.h>
 bool depressLoadImageForPreview(wchar_t *filename, int *sizex, int *sizey, int *channels, unsigned char **buf, depress_flags_type flags)
@@ -68,8 +535,6 @@ bool depressLoadImageForPreview(wchar_t *filename, int *sizex, int *sizey, int *
 	bool result = false;
 	//clock_t c0, c1, c2; wchar_t tempstr[256];
 
-	if(flags.type == 3) flags.param2 = 1; // We don't have default quantization algorithm here we will use noteshrink
-
 	//c0 = clock();
 
 	result = depressLoadImageFromFileAndApplyFlags(filename, sizex, sizey, channels, buf, flags);
@@ -77,7 +542,7 @@ bool depressLoadImageForPreview(wchar_t *filename, int *sizex, int *sizey, int *
 
 	//c1 = clock();
 	
-	if(flags.type == 1 && flags.nof_illrects == 0) { // Need to binarize image
+	if(flags.type == 1 && flags.nof_illrects == 0 && !flags.detect_illrects) { // Need to binarize image
 		size_t i, len;
 		unsigned char *p;
 
@@ -100,24 +565,142 @@ bool depressLoadImageForPreview(wchar_t *filename, int *sizex, int *sizey, int *
 bool depressLoadImageFromFileAndApplyFlags(wchar_t *filename, int *sizex, int *sizey, int *channels, unsigned char **buf, depress_flags_type flags)
 {
 	FILE *f = 0;
-	int desired_channels = 0;
+	unsigned char signature[8] = { 0 };
+	int desired_channels;
 
 	f = _wfopen(filename, L"rb");
 	if(!f)
 		return false;
 
+	desired_channels = depressImageGetDesiredChannels(flags);
+
+	// Only the first page is loaded from TIFF file
+	if(fread(signature, 1, 8, f) == 8 && depressTiffIsTiff(signature, 8)) {
+		depress_filemap_type map;
+		bool success = false;
+
+		fclose(f);
+
+		*buf = 0;
+		if(!depressMapFile(filename, &map)) return false;
+		success = depressImageDecodeMemory(map.data, map.size, sizex, sizey, channels, buf, desired_channels);
+		depressUnmapFile(&map);
+
+		if(!success) return false;
+	} else {
+		rewind(f);
+
+		*buf = depressLoadImage(f, sizex, sizey, channels, desired_channels);
+
+		fclose(f);
+
+		if(!(*buf))
+			return false;
+	}
+
+	return depressImageApplyFlags(buf, sizex, sizey, *channels, flags);
+}
+
+// Decodes image file in memory, only the first page is decoded from TIFF file
+bool depressImageDecodeMemory(const unsigned char *data, size_t size, int *sizex, int *sizey, int *channels, unsigned char **buf, int desired_channels)
+{
+	*buf = 0;
+
+	if(depressTiffIsTiff(data, size)) {
+		if(!depressTiffDecodePage(data, size, depressTiffGetFirstPage(data, size), sizex, sizey, channels, buf)) return false;
+
+		return depressImageConvertChannels(buf, *sizex, *sizey, channels, desired_channels);
+	}
+
+	if(size > INT_MAX) return false;
+
+	if(desired_channels) {
+		*buf = stbi_load_from_memory(data, (int)size, sizex, sizey, channels, desired_channels);
+		*channels = desired_channels;
+	} else if(stbi_info_from_memory(data, (int)size, sizex, sizey, channels)) {
+		switch(*channels) {
+			case 1:
+			case 3:
+				*buf = stbi_load_from_memory(data, (int)size, sizex, sizey, channels, 0);
+				break;
+			case 2:
+				*buf = stbi_load_from_memory(data, (int)size, sizex, sizey, channels, 1);
+				*channels = 1;
+				break;
+			case 4:
+				*buf = stbi_load_from_memory(data, (int)size, sizex, sizey, channels, 3);
+				*channels = 3;
+				break;
+		}
+	}
+
+	return *buf != 0;
+}
+
+int depressImageGetDesiredChannels(depress_flags_type flags)
+{
 	if(flags.type == DEPRESS_PAGE_TYPE_BW) {
-		if(!flags.nof_illrects) desired_channels = 1;
+		if(!flags.nof_illrects && !flags.detect_illrects) return 1;
 	} else if(flags.type == DEPRESS_PAGE_TYPE_PALETTIZED) {
-		desired_channels = 3;
+		return 3;
 	}
 
-	*buf = depressLoadImage(f, sizex, sizey, channels, desired_channels);
+	return 0;
+}
 
-	fclose(f);
+// Converts gray image into RGB or back, buf is freed on error
+bool depressImageConvertChannels(unsigned char **buf, int sizex, int sizey, int *channels, int desired_channels)
+{
+	if(!desired_channels || desired_channels == *channels) return true;
 
-	if(!(*buf))
-		return false;
+	if(desired_channels == 1 && *channels == 3) {
+		depressImageConvertToGray(buf, sizex, sizey, 3);
+	} else if(desired_channels == 3 && *channels == 1) {
+		unsigned char *new_buf;
+		size_t i;
+
+		if(SIZE_MAX/3/(size_t)sizex < (size_t)sizey) goto LABEL_ERROR;
+
+		new_buf = realloc(*buf, (size_t)sizex*(size_t)sizey*3);
+		if(!new_buf) goto LABEL_ERROR;
+		*buf = new_buf;
+
+		// From the end, so pixels are not overwritten before they are read
+		for(i = (size_t)sizex*(size_t)sizey; i > 0; i--)
+			new_buf[3*(i-1)] = new_buf[3*(i-1)+1] = new_buf[3*(i-1)+2] = new_buf[i-1];
+	} else
+		goto LABEL_ERROR;
+
+	*channels = desired_channels;
+
+	return true;
+
+LABEL_ERROR:
+	free(*buf);
+	*buf = 0;
+
+	return false;
+}
+
+// Resampling, color reduction and binarization, buf is freed on error
+bool depressImageApplyFlags(unsigned char **buf, int *sizex, int *sizey, int channels, depress_flags_type flags)
+{
+	if(flags.resample_dpi > 0 && flags.resample_dpi < flags.dpi) {
+		bool resampled;
+
+		// Pages binarized by simple threshold are downsampled by majority of black and white pixels,
+		// error diffusion and adaptive binarization need gray
+		if(flags.type == DEPRESS_PAGE_TYPE_BW && flags.param1 == DEPRESS_PAGE_TYPE_BW_PARAM1_SIMPLE &&
+			!flags.nof_illrects && !flags.detect_illrects && channels == 1)
+			resampled = depressImageResampleBilevel(buf, sizex, sizey, flags.dpi, flags.resample_dpi);
+		else
+			resampled = depressImageResample(buf, sizex, sizey, channels, flags.dpi, flags.resample_dpi);
+		if(!resampled) {
+			free(*buf);
+
+			return false;
+		}
+	}
 
 	if(flags.type == DEPRESS_PAGE_TYPE_PALETTIZED) {
 		if(flags.param2 == DEPRESS_PAGE_TYPE_PALETTIZED_PARAM2_QUANT) {
@@ -127,7 +710,7 @@ bool depressLoadImageFromFileAndApplyFlags(wchar_t *filename, int *sizex, int *s
 				return false;
 			}
 		} else if(flags.param2 == DEPRESS_PAGE_TYPE_PALETTIZED_PARAM2_NOTESHRINK) {
-			if(!depressImageApplyNoteshrink(*buf, *sizex, *sizey, flags.param1)) {
+			if(!depressImageApplyNoteshrink(*buf, *sizex, *sizey, flags.param1, flags.shared_palette)) {
 				free(*buf);
 
 				return false;
@@ -135,12 +718,19 @@ bool depressLoadImageFromFileAndApplyFlags(wchar_t *filename, int *sizex, int *s
 		}
 	}
 
-	if(!flags.nof_illrects) {
-		if(flags.type == DEPRESS_PAGE_TYPE_BW && flags.param1 == DEPRESS_PAGE_TYPE_BW_PARAM1_ERRDIFF)
-			depressImageApplyErrorDiffusion(*buf, *sizex, *sizey);
-		else if(flags.type == DEPRESS_PAGE_TYPE_BW && flags.param1 == DEPRESS_PAGE_TYPE_BW_PARAM1_ADAPTIVE) {
-			if(!depressImageApplyAdaptiveBinarization(*buf, *sizex, *sizey))
+	if(!flags.nof_illrects && !flags.detect_illrects) {
+		if(flags.type == DEPRESS_PAGE_TYPE_BW && flags.param1 == DEPRESS_PAGE_TYPE_BW_PARAM1_ERRDIFF) {
+			if(!depressImageApplyErrorDiffusion(*buf, *sizex, *sizey, flags.param2)) {
+				free(*buf);
+
+				return false;
+			}
+		} else if(flags.type == DEPRESS_PAGE_TYPE_BW && flags.param1 == DEPRESS_PAGE_TYPE_BW_PARAM1_ADAPTIVE) {
+			if(!depressImageApplyAdaptiveBinarization(*buf, *sizex, *sizey)) {
+				free(*buf);
+
 				return false;
+			}
 		}
 	}
 
@@ -174,107 +764,486 @@ unsigned char *depressLoadImage(FILE *f, int *sizex, int *sizey, int *channels,
 	return buf;
 }
 
+#define DEPRESS_DETECT_TYPE_V_IN_BW_MIN 5
+#define DEPRESS_DETECT_TYPE_V_IN_BW_MAX 250
+#define DEPRESS_DETECT_TYPE_S_IN_BW_DIV 48 // Saturation in BW range is <= 1/48
+
+/*
+	Counts pixels with Value (HSV) in BW range and with Saturation in BW range.
+	Functions for 1 and 3 channels have constant number of channels,
+	so the compiler can unroll and vectorize them
+*/
+#define DEPRESS_DETECT_TYPE_COUNT(name, CH) \
+static void name(const unsigned char *buf, size_t size, int channels, size_t *v_in_bw_ranges, size_t *s_in_bw_ranges) \
+{ \
+	size_t i, v_in = 0, s_in = 0; \
+	int ch; \
+\
+	ch = (CH)?(CH):channels; \
+	for(i = 0; i < size; i++) { \
+		unsigned int min, max; \
+		int j; \
+\
+		min = max = buf[0]; \
+		for(j = 1; j < ch; j++) { \
+			if(buf[j] < min) min = buf[j]; \
+			if(buf[j] > max) max = buf[j]; \
+		} \
+		buf += ch; \
+\
+		v_in += (max <= DEPRESS_DETECT_TYPE_V_IN_BW_MIN || max >= DEPRESS_DETECT_TYPE_V_IN_BW_MAX); \
+		s_in += (DEPRESS_DETECT_TYPE_S_IN_BW_DIV*(max-min) <= max); \
+	} \
+\
+	*v_in_bw_ranges = v_in; \
+	*s_in_bw_ranges = s_in; \
+}
+
+DEPRESS_DETECT_TYPE_COUNT(depressImageDetectTypeCount1, 1)
+DEPRESS_DETECT_TYPE_COUNT(depressImageDetectTypeCount3, 3)
+DEPRESS_DETECT_TYPE_COUNT(depressImageDetectTypeCountN, 0)
+
 int depressImageDetectType(int sizex, int sizey, int channels, const unsigned char *buf)
 {
 	int type = DEPRESS_PAGE_TYPE_COLOR;
-	const unsigned char v_in_bw_min = 5, v_in_bw_max = 250;
-	const double s_in_bw_min = 1.0/48.0;
 	const double v_out_in_percentage = 1.0/256.0;
 	const double s_out_in_percentage = 1.0/128.0;
 	size_t v_in_bw_ranges = 0, v_out_bw_ranges = 0; //   Value (HSV)          
 	size_t s_in_bw_ranges = 0, s_out_bw_ranges = 0; //   Saturation (HSV)          
+	size_t size;
 	
 	if(sizex < 1 || sizey < 1 || channels < 1) return type;
 	if(SIZE_MAX/(size_t)sizex < (size_t)sizey) return type;
 	if(SIZE_MAX/((size_t)sizex*(size_t)sizey) < (size_t)channels) return type;
 
-	if(channels == 1) {
-		size_t i;
-		type = DEPRESS_PAGE_TYPE_BW;
-		for(i = 0; i < (size_t)sizex*(size_t)sizey; i++) {
-			if(buf[i] <= v_in_bw_min || buf[i] >= v_in_bw_max) v_in_bw_ranges++; else v_out_bw_ranges++;
-		}
-	} else {
-		size_t i;
+	type = DEPRESS_PAGE_TYPE_BW;
+	size = (size_t)sizex*(size_t)sizey;
+	if(channels == 1)
+		depressImageDetectTypeCount1(buf, size, channels, &v_in_bw_ranges, &s_in_bw_ranges);
+	else if(channels == 3)
+		depressImageDetectTypeCount3(buf, size, channels, &v_in_bw_ranges, &s_in_bw_ranges);
+	else
+		depressImageDetectTypeCountN(buf, size, channels, &v_in_bw_ranges, &s_in_bw_ranges);
+	v_out_bw_ranges = size-v_in_bw_ranges;
+	s_out_bw_ranges = size-s_in_bw_ranges;
 
-		type = DEPRESS_PAGE_TYPE_BW;
-		for(i = 0; i < (size_t)sizex*(size_t)sizey; i++) {
-			unsigned char min, max;
-			size_t j;
-			double s = 0.0;
+	//wprintf(L"v in %u v out %u s in %u s out %u\n", (unsigned int)v_in_bw_ranges, (unsigned int)v_out_bw_ranges, (unsigned int)s_in_bw_ranges, (unsigned int)s_out_bw_ranges);
 
-			min = max = buf[i*(size_t)channels];
+	if(v_in_bw_ranges == 0)
+		type = DEPRESS_PAGE_TYPE_COLOR;
+	else if((double)v_out_bw_ranges > (double)v_in_bw_ranges*v_out_in_percentage)
+		type = DEPRESS_PAGE_TYPE_COLOR;
+	else if(s_in_bw_ranges != 0 || s_out_bw_ranges != 0) {
+		if(s_in_bw_ranges == 0)
+			type = DEPRESS_PAGE_TYPE_COLOR;
+		else if((double)s_out_bw_ranges > (double)s_in_bw_ranges*s_out_in_percentage)
+			type = DEPRESS_PAGE_TYPE_COLOR;
+	}
+
+	return type;
+}
+
+void depressImageSimplyBinarize(unsigned char **buf, int sizex, int sizey, int channels)
+{
+	unsigned char *orig_buf, *new_buf;
+	size_t i;
+
+	if(sizex < 1 || sizey < 1 || channels < 2) return;
+	if(SIZE_MAX/(size_t)sizex < (size_t)sizey) return;
+	if(SIZE_MAX/((size_t)sizex*(size_t)sizey) < (size_t)channels) return;
+
+	orig_buf = *buf;
+	for(i = 1; i < (size_t)sizex*(size_t)sizey; i++) {
+		orig_buf[i] = orig_buf[i*(size_t)channels];
+		if(orig_buf[i] >= 128) orig_buf[i] = 255; else orig_buf[i] = 0;
+	}
+
+	new_buf = realloc(orig_buf, (size_t)sizex*(size_t)sizey);
+	if(new_buf) *buf = new_buf;
+}
+
+int depressImageResampleSize(int size, int from_dpi, int to_dpi)
+{
+	int64_t new_size;
+
+	if(from_dpi <= 0 || to_dpi <= 0 || to_dpi >= from_dpi) return size;
+
+	new_size = ((int64_t)size*to_dpi+from_dpi/2)/from_dpi;
+
+	return (new_size > 0)?(int)new_size:1;
+}
+
+/*
+	Downsamples image from from_dpi to to_dpi with area averaging:
+	every pixel of new image is mean of the source area it covers.
+	Source pixels on the border of the area are taken with the covered part.
+*/
+bool depressImageResample(unsigned char **buf, int *sizex, int *sizey, int channels, int from_dpi, int to_dpi)
+{
+	const unsigned char *src;
+	unsigned char *new_buf;
+	int sx, sy, nx, ny, oy, failed = 0;
+	size_t row_size;
+	uint64_t total;
+
+	if(*sizex < 1 || *sizey < 1 || channels < 1) return false;
+	if(from_dpi <= 0 || to_dpi <= 0) return false;
+
+	sx = *sizex;
+	sy = *sizey;
+	nx = depressImageResampleSize(sx, from_dpi, to_dpi);
+	ny = depressImageResampleSize(sy, from_dpi, to_dpi);
+	if(nx == sx && ny == sy) return true;
+
+	if(SIZE_MAX/sizeof(uint32_t)/(size_t)channels < (size_t)sx) return false;
+	if(SIZE_MAX/(size_t)channels/(size_t)nx < (size_t)ny) return false;
+	if((uint64_t)sy*255 > UINT32_MAX) return false;
+
+	row_size = (size_t)sx*(size_t)channels;
+	total = (uint64_t)sx*(uint64_t)sy;
+	src = *buf;
+
+	new_buf = malloc((size_t)nx*(size_t)ny*(size_t)channels);
+	if(!new_buf) return false;
+
+#pragma omp parallel reduction(+:failed)
+	{
+		uint32_t *acc;
+
+		acc = malloc(row_size*sizeof(uint32_t));
+#pragma omp for
+		for(oy = 0; oy < ny; oy++) {
+			int64_t a0, a1;
+			unsigned char *out;
+			size_t i;
+			int y, ox, d;
+
+			if(!acc) {
+				failed++;
+				continue;
+			}
+
+			// Rows are summed with weights of overlap in units of 1/ny of source row
+			memset(acc, 0, row_size*sizeof(uint32_t));
+			a0 = (int64_t)oy*sy;
+			a1 = a0+sy;
+			for(y = (int)(a0/ny); (int64_t)y*ny < a1; y++) {
+				int64_t b0, b1;
+				const unsigned char *in;
+				uint32_t w;
+
+				b0 = (int64_t)y*ny;
+				b1 = b0+ny;
+				w = (uint32_t)(((b1 < a1)?b1:a1)-((b0 > a0)?b0:a0));
+				in = src+(size_t)y*row_size;
+				for(i = 0; i < row_size; i++)
+					acc[i] += in[i]*w;
+			}
 
-			for(j = 1; j < (size_t)channels; j++) {
-				if(buf[i*(size_t)channels+j] < min) {
-					min = buf[i*(size_t)channels+j];
-				} else if(buf[i*(size_t)channels+j] > max) {
-					max = buf[i*(size_t)channels+j];
+			// Columns are summed with weights of overlap in units of 1/nx of source column
+			out = new_buf+(size_t)oy*(size_t)nx*(size_t)channels;
+			for(ox = 0; ox < nx; ox++) {
+				int64_t c0, c1;
+				int x0, x1;
+
+				c0 = (int64_t)ox*sx;
+				c1 = c0+sx;
+				x0 = (int)(c0/nx);
+				x1 = (int)((c1+nx-1)/nx);
+				for(d = 0; d < channels; d++) {
+					uint64_t s = 0;
+					int x;
+
+					for(x = x0; x < x1; x++) {
+						int64_t e0, e1;
+
+						e0 = (int64_t)x*nx;
+						e1 = e0+nx;
+						s += (uint64_t)acc[(size_t)x*channels+d]*(uint64_t)(((e1 < c1)?e1:c1)-((e0 > c0)?e0:c0));
+					}
+
+					*out++ = (unsigned char)((s+total/2)/total);
 				}
 			}
+		}
+
+		free(acc);
+	}
+
+	if(failed) {
+		free(new_buf);
+
+		return false;
+	}
+
+	free(*buf);
+	*buf = new_buf;
+	*sizex = nx;
+	*sizey = ny;
+
+	return true;
+}
+
+/*
+	Downsamples gray image of bilevel page from from_dpi to to_dpi by majority:
+	every source pixel is black (darker than 128) or white and belongs to one pixel
+	of new image, that is black if at least half of its source pixels are black
+	(so thin lines are not lost on ties). New image has only 0 and 255.
+*/
+bool depressImageResampleBilevel(unsigned char **buf, int *sizex, int *sizey, int from_dpi, int to_dpi)
+{
+	const unsigned char *src;
+	unsigned char *new_buf;
+	unsigned int *xmap = 0, *cols = 0;
+	int sx, sy, nx, ny, oy, x, failed = 0;
+
+	if(*sizex < 1 || *sizey < 1) return false;
+	if(from_dpi <= 0 || to_dpi <= 0) return false;
+
+	sx = *sizex;
+	sy = *sizey;
+	nx = depressImageResampleSize(sx, from_dpi, to_dpi);
+	ny = depressImageResampleSize(sy, from_dpi, to_dpi);
+	if(nx == sx && ny == sy) return true;
+
+	if(SIZE_MAX/(size_t)nx < (size_t)ny) return false;
+
+	src = *buf;
+
+	new_buf = malloc((size_t)nx*(size_t)ny);
+	xmap = malloc((size_t)sx*sizeof(unsigned int));
+	cols = calloc((size_t)nx, sizeof(unsigned int));
+	if(!new_buf || !xmap || !cols) goto LABEL_ERROR;
+
+	// Pixel x of the row belongs to x*nx/sx pixel of new row
+	for(x = 0; x < sx; x++) {
+		xmap[x] = (unsigned int)((int64_t)x*nx/sx);
+		cols[xmap[x]]++;
+	}
+
+#pragma omp parallel reduction(+:failed)
+	{
+		unsigned int *black;
+
+		black = malloc((size_t)nx*sizeof(unsigned int));
+#pragma omp for
+		for(oy = 0; oy < ny; oy++) {
+			unsigned char *out;
+			unsigned int rows;
+			int y, y0, y1, xi, ox;
+
+			if(!black) {
+				failed++;
+				continue;
+			}
+
+			// Rows with y*ny/sy == oy
+			y0 = (int)(((int64_t)oy*sy+ny-1)/ny);
+			y1 = (int)(((int64_t)(oy+1)*sy+ny-1)/ny);
+			if(y1 > sy) y1 = sy;
+			rows = (unsigned int)(y1-y0);
+
+			memset(black, 0, (size_t)nx*sizeof(unsigned int));
+			for(y = y0; y < y1; y++) {
+				const unsigned char *in = src+(size_t)y*sx;
+
+				for(xi = 0; xi < sx; xi++)
+					black[xmap[xi]] += (in[xi] < 128);
+			}
+
+			out = new_buf+(size_t)oy*nx;
+			for(ox = 0; ox < nx; ox++)
+				out[ox] = ((uint64_t)black[ox]*2 >= (uint64_t)cols[ox]*rows)?0:255;
+		}
+
+		free(black);
+	}
+
+	if(failed) goto LABEL_ERROR;
+
+	free(xmap);
+	free(cols);
+	free(*buf);
+	*buf = new_buf;
+	*sizex = nx;
+	*sizey = ny;
+
+	return true;
 
-			if(max != 0) s = 1.0 - (double)min/(double)max;
+LABEL_ERROR:
+	if(new_buf) free(new_buf);
+	if(xmap) free(xmap);
+	if(cols) free(cols);
 
-			if(max <= v_in_bw_min || max >= v_in_bw_max) v_in_bw_ranges++; else v_out_bw_ranges++;
-			if(s <= s_in_bw_min) s_in_bw_ranges++; else s_out_bw_ranges++;
-		}
-	}
+	return false;
+}
 
-	//wprintf(L"v in %u v out %u s in %u s out %u\n", (unsigned int)v_in_bw_ranges, (unsigned int)v_out_bw_ranges, (unsigned int)s_in_bw_ranges, (unsigned int)s_out_bw_ranges);
+#define DEPRESS_NEUTRAL_CHROMA_MAX 16 // Max difference between channels of neutral pixel
+#define DEPRESS_NEUTRAL_COLORED_DIV 1024 // Neutral image has no more than 1/1024 of colored pixels
 
-	if(v_in_bw_ranges == 0)
-		type = DEPRESS_PAGE_TYPE_COLOR;
-	else if((double)v_out_bw_ranges > (double)v_in_bw_ranges*v_out_in_percentage)
-		type = DEPRESS_PAGE_TYPE_COLOR;
-	else if(s_in_bw_ranges != 0 || s_out_bw_ranges != 0) {
-		if(s_in_bw_ranges == 0)
-			type = DEPRESS_PAGE_TYPE_COLOR;
-		else if((double)s_out_bw_ranges > (double)s_in_bw_ranges*s_out_in_percentage)
-			type = DEPRESS_PAGE_TYPE_COLOR;
+/*
+	Checks if color image is really gray (pencil drawings, black and white photos, etc.)
+*/
+bool depressImageIsNeutral(int sizex, int sizey, int channels, const unsigned char *buf)
+{
+	size_t colored = 0;
+	int y;
+
+	if(sizex < 1 || sizey < 1 || channels != 3) return false;
+	if(SIZE_MAX/3/(size_t)sizex < (size_t)sizey) return false;
+
+#pragma omp parallel for reduction(+:colored)
+	for(y = 0; y < sizey; y++) {
+		const unsigned char *p;
+		int x;
+
+		p = buf+(size_t)y*(size_t)sizex*3;
+		for(x = 0; x < sizex; x++) {
+			unsigned int min, max;
+
+			min = max = p[0];
+			if(p[1] < min) min = p[1];
+			if(p[1] > max) max = p[1];
+			if(p[2] < min) min = p[2];
+			if(p[2] > max) max = p[2];
+			colored += (max-min > DEPRESS_NEUTRAL_CHROMA_MAX);
+			p += 3;
+		}
 	}
 
-	return type;
+	return colored <= (size_t)sizex*(size_t)sizey/DEPRESS_NEUTRAL_COLORED_DIV;
 }
 
-void depressImageSimplyBinarize(unsigned char **buf, int sizex, int sizey, int channels)
+void depressImageConvertToGray(unsigned char **buf, int sizex, int sizey, int channels)
 {
 	unsigned char *orig_buf, *new_buf;
 	size_t i;
 
-	if(sizex < 1 || sizey < 1 || channels < 2) return;
-	if(SIZE_MAX/(size_t)sizex < (size_t)sizey) return;
-	if(SIZE_MAX/((size_t)sizex*(size_t)sizey) < (size_t)channels) return;
+	if(sizex < 1 || sizey < 1 || channels != 3) return;
+	if(SIZE_MAX/3/(size_t)sizex < (size_t)sizey) return;
 
 	orig_buf = *buf;
-	for(i = 1; i < (size_t)sizex*(size_t)sizey; i++) {
-		orig_buf[i] = orig_buf[i*(size_t)channels];
-		if(orig_buf[i] >= 128) orig_buf[i] = 255; else orig_buf[i] = 0;
+	for(i = 0; i < (size_t)sizex*(size_t)sizey; i++) {
+		const unsigned char *p = orig_buf+i*3;
+
+		orig_buf[i] = (unsigned char)((77*(unsigned int)p[0]+150*(unsigned int)p[1]+29*(unsigned int)p[2]+128) >> 8);
 	}
 
 	new_buf = realloc(orig_buf, (size_t)sizex*(size_t)sizey);
 	if(new_buf) *buf = new_buf;
 }
 
-void depressImageApplyErrorDiffusion(unsigned char* buf, int sizex, int sizey)
+#define DEPRESS_ERRDIFF_FRACTION_BITS 4 // Error buffer holds pixel values in 12.4 fixed point
+#define DEPRESS_ERRDIFF_BLOCK 64 // Width of the block processed by one thread in wavefront
+
+static void depressImageDiffuseAdd(short *work, int sizex, int sizey, int x, int y, int err)
 {
-	int i, j, acc = 0;
-	unsigned char *p;
+	if(x < 0 || x >= sizex || y >= sizey) return;
 
-	if(!buf || sizex <= 0 || sizey <= 0) return;
+	work[(size_t)y*(size_t)sizex+(size_t)x] += (short)err;
+}
 
-	p = buf;
+static void depressImageDiffuseBlock(unsigned char *buf, short *work, int sizex, int sizey, int y, int x0, int kernel)
+{
+	int x, x1;
+	size_t offset;
 
-	for(i = 0; i < sizey; i++) {
-		for(j = 0; j < sizex; j++) {
-			acc += *p;
-			
-			if(acc >= 255) {
-				acc -= 255;
-				*(p++) = 255;
-			} else
-				*(p++) = 0;
+	x1 = x0+DEPRESS_ERRDIFF_BLOCK;
+	if(x1 > sizex) x1 = sizex;
+
+	offset = (size_t)y*(size_t)sizex;
+
+	for(x = x0; x < x1; x++) {
+		int v, err, e1, e2, e4, e8;
+
+		v = work[offset+x];
+		if(v >= (128 << DEPRESS_ERRDIFF_FRACTION_BITS)) {
+			buf[offset+x] = 255;
+			err = v-(255 << DEPRESS_ERRDIFF_FRACTION_BITS);
+		} else {
+			buf[offset+x] = 0;
+			err = v;
+		}
+
+		if(kernel == DEPRESS_PAGE_TYPE_BW_PARAM2_STUCKI) {
+			//         X   8   4
+			// 2   4   8   4   2
+			// 1   2   4   2   1   (1/42)
+			e1 = err/42;
+			e2 = err*2/42;
+			e4 = err*4/42;
+			e8 = err*8/42;
+
+			depressImageDiffuseAdd(work, sizex, sizey, x+1, y, err-e8-4*e4-4*e2-2*e1);
+			depressImageDiffuseAdd(work, sizex, sizey, x+2, y, e4);
+			depressImageDiffuseAdd(work, sizex, sizey, x-2, y+1, e2);
+			depressImageDiffuseAdd(work, sizex, sizey, x-1, y+1, e4);
+			depressImageDiffuseAdd(work, sizex, sizey, x, y+1, e8);
+			depressImageDiffuseAdd(work, sizex, sizey, x+1, y+1, e4);
+			depressImageDiffuseAdd(work, sizex, sizey, x+2, y+1, e2);
+			depressImageDiffuseAdd(work, sizex, sizey, x-2, y+2, e1);
+			depressImageDiffuseAdd(work, sizex, sizey, x-1, y+2, e2);
+			depressImageDiffuseAdd(work, sizex, sizey, x, y+2, e4);
+			depressImageDiffuseAdd(work, sizex, sizey, x+1, y+2, e2);
+			depressImageDiffuseAdd(work, sizex, sizey, x+2, y+2, e1);
+		} else {
+			//     X   7
+			// 3   5   1   (1/16)
+			e1 = err/16;
+			e2 = err*3/16;
+			e4 = err*5/16;
+
+			depressImageDiffuseAdd(work, sizex, sizey, x+1, y, err-e1-e2-e4);
+			depressImageDiffuseAdd(work, sizex, sizey, x-1, y+1, e2);
+			depressImageDiffuseAdd(work, sizex, sizey, x, y+1, e4);
+			depressImageDiffuseAdd(work, sizex, sizey, x+1, y+1, e1);
+		}
+	}
+}
+
+bool depressImageApplyErrorDiffusion(unsigned char *buf, int sizex, int sizey, int kernel)
+{
+	short *work;
+	size_t i;
+	int nof_blocks, nof_steps;
+
+	if(!buf || sizex <= 0 || sizey <= 0) return false;
+	if(SIZE_MAX/sizeof(short)/(size_t)sizex < (size_t)sizey) return false;
+	if(INT_MAX/2 < sizey) return false;
+
+	work = malloc((size_t)sizex*(size_t)sizey*sizeof(short));
+	if(!work) return false;
+
+	for(i = 0; i < (size_t)sizex*(size_t)sizey; i++)
+		work[i] = (short)(buf[i] << DEPRESS_ERRDIFF_FRACTION_BITS);
+
+	// Block (y, b) gets error from (y, b-1), (y-1, b+1) and (y-2, b+1),
+	// so all blocks with the same b+2*y can be processed simultaneously.
+	// Each row trails the previous one by two blocks.
+	nof_blocks = (sizex+DEPRESS_ERRDIFF_BLOCK-1)/DEPRESS_ERRDIFF_BLOCK;
+	nof_steps = nof_blocks+2*(sizey-1);
+
+#pragma omp parallel
+	{
+		int step;
+
+		for(step = 0; step < nof_steps; step++) {
+			int y, y_min, y_max;
+
+			y_min = step-nof_blocks+1;
+			if(y_min < 0) y_min = 0; else y_min = (y_min+1)/2;
+			y_max = step/2;
+			if(y_max > sizey-1) y_max = sizey-1;
+
+#pragma omp for
+			for(y = y_min; y <= y_max; y++)
+				depressImageDiffuseBlock(buf, work, sizex, sizey, y, (step-2*y)*DEPRESS_ERRDIFF_BLOCK, kernel);
 		}
 	}
+
+	free(work);
+
+	return true;
 }
 
 //#include <time.h>
@@ -366,22 +1335,390 @@ bool depressImageApplyAdaptiveBinarization(unsigned char* buf, int sizex, int si
 	return true;
 }
 
+// Color quantization by Xiaolin Wu's variance minimization method (Graphics Gems II).
+// Colors are reduced to 5 bits per channel, cumulative moments are stored in
+// 33x33x33 cubes (zero plane at index 0) and boxes are split along the axis
+// which gives the biggest variance decrease.
+
+#define DEPRESS_QUANT_SIDE 33
+#define DEPRESS_QUANT_INDEX(r, g, b) (((size_t)(r)*DEPRESS_QUANT_SIDE+(size_t)(g))*DEPRESS_QUANT_SIDE+(size_t)(b))
+
+enum {
+	DEPRESS_QUANT_DIR_R,
+	DEPRESS_QUANT_DIR_G,
+	DEPRESS_QUANT_DIR_B
+};
+
+typedef struct {
+	int r0, r1; // r0 is exclusive, r1 is inclusive
+	int g0, g1;
+	int b0, b1;
+	int vol;
+} depress_quant_box_type;
+
+typedef struct {
+	int64_t *wt, *mr, *mg, *mb;
+	double *m2;
+} depress_quant_moments_type;
+
+static int64_t depressQuantVolume(const depress_quant_box_type *box, const int64_t *m)
+{
+	return m[DEPRESS_QUANT_INDEX(box->r1, box->g1, box->b1)]
+		-m[DEPRESS_QUANT_INDEX(box->r1, box->g1, box->b0)]
+		-m[DEPRESS_QUANT_INDEX(box->r1, box->g0, box->b1)]
+		+m[DEPRESS_QUANT_INDEX(box->r1, box->g0, box->b0)]
+		-m[DEPRESS_QUANT_INDEX(box->r0, box->g1, box->b1)]
+		+m[DEPRESS_QUANT_INDEX(box->r0, box->g1, box->b0)]
+		+m[DEPRESS_QUANT_INDEX(box->r0, box->g0, box->b1)]
+		-m[DEPRESS_QUANT_INDEX(box->r0, box->g0, box->b0)];
+}
+
+static double depressQuantVolumeD(const depress_quant_box_type *box, const double *m)
+{
+	return m[DEPRESS_QUANT_INDEX(box->r1, box->g1, box->b1)]
+		-m[DEPRESS_QUANT_INDEX(box->r1, box->g1, box->b0)]
+		-m[DEPRESS_QUANT_INDEX(box->r1, box->g0, box->b1)]
+		+m[DEPRESS_QUANT_INDEX(box->r1, box->g0, box->b0)]
+		-m[DEPRESS_QUANT_INDEX(box->r0, box->g1, box->b1)]
+		+m[DEPRESS_QUANT_INDEX(box->r0, box->g1, box->b0)]
+		+m[DEPRESS_QUANT_INDEX(box->r0, box->g0, box->b1)]
+		-m[DEPRESS_QUANT_INDEX(box->r0, box->g0, box->b0)];
+}
+
+// Part of the box volume which doesn't depend on the cut position
+static int64_t depressQuantBottom(const depress_quant_box_type *box, int dir, const int64_t *m)
+{
+	switch(dir) {
+		case DEPRESS_QUANT_DIR_R:
+			return -m[DEPRESS_QUANT_INDEX(box->r0, box->g1, box->b1)]
+				+m[DEPRESS_QUANT_INDEX(box->r0, box->g1, box->b0)]
+				+m[DEPRESS_QUANT_INDEX(box->r0, box->g0, box->b1)]
+				-m[DEPRESS_QUANT_INDEX(box->r0, box->g0, box->b0)];
+		case DEPRESS_QUANT_DIR_G:
+			return -m[DEPRESS_QUANT_INDEX(box->r1, box->g0, box->b1)]
+				+m[DEPRESS_QUANT_INDEX(box->r1, box->g0, box->b0)]
+				+m[DEPRESS_QUANT_INDEX(box->r0, box->g0, box->b1)]
+				-m[DEPRESS_QUANT_INDEX(box->r0, box->g0, box->b0)];
+		default:
+			return -m[DEPRESS_QUANT_INDEX(box->r1, box->g1, box->b0)]
+				+m[DEPRESS_QUANT_INDEX(box->r1, box->g0, box->b0)]
+				+m[DEPRESS_QUANT_INDEX(box->r0, box->g1, box->b0)]
+				-m[DEPRESS_QUANT_INDEX(box->r0, box->g0, box->b0)];
+	}
+}
+
+// Part of the box volume which depends on the cut position
+static int64_t depressQuantTop(const depress_quant_box_type *box, int dir, int pos, const int64_t *m)
+{
+	switch(dir) {
+		case DEPRESS_QUANT_DIR_R:
+			return m[DEPRESS_QUANT_INDEX(pos, box->g1, box->b1)]
+				-m[DEPRESS_QUANT_INDEX(pos, box->g1, box->b0)]
+				-m[DEPRESS_QUANT_INDEX(pos, box->g0, box->b1)]
+				+m[DEPRESS_QUANT_INDEX(pos, box->g0, box->b0)];
+		case DEPRESS_QUANT_DIR_G:
+			return m[DEPRESS_QUANT_INDEX(box->r1, pos, box->b1)]
+				-m[DEPRESS_QUANT_INDEX(box->r1, pos, box->b0)]
+				-m[DEPRESS_QUANT_INDEX(box->r0, pos, box->b1)]
+				+m[DEPRESS_QUANT_INDEX(box->r0, pos, box->b0)];
+		default:
+			return m[DEPRESS_QUANT_INDEX(box->r1, box->g1, pos)]
+				-m[DEPRESS_QUANT_INDEX(box->r1, box->g0, pos)]
+				-m[DEPRESS_QUANT_INDEX(box->r0, box->g1, pos)]
+				+m[DEPRESS_QUANT_INDEX(box->r0, box->g0, pos)];
+	}
+}
+
+static double depressQuantVariance(const depress_quant_box_type *box, const depress_quant_moments_type *m)
+{
+	double dr, dg, db, w;
+
+	w = (double)depressQuantVolume(box, m->wt);
+	if(w <= 0) return 0;
+
+	dr = (double)depressQuantVolume(box, m->mr);
+	dg = (double)depressQuantVolume(box, m->mg);
+	db = (double)depressQuantVolume(box, m->mb);
+
+	return depressQuantVolumeD(box, m->m2)-(dr*dr+dg*dg+db*db)/w;
+}
+
+static double depressQuantMaximize(const depress_quant_box_type *box, int dir, int first, int last, int *cut, const depress_quant_moments_type *m, int64_t whole_r, int64_t whole_g, int64_t whole_b, int64_t whole_w)
+{
+	int64_t base_r, base_g, base_b, base_w;
+	double max = 0;
+	int i;
+
+	base_r = depressQuantBottom(box, dir, m->mr);
+	base_g = depressQuantBottom(box, dir, m->mg);
+	base_b = depressQuantBottom(box, dir, m->mb);
+	base_w = depressQuantBottom(box, dir, m->wt);
+
+	*cut = -1;
+
+	for(i = first; i < last; i++) {
+		double half_r, half_g, half_b, half_w, temp;
+
+		half_w = (double)(base_w+depressQuantTop(box, dir, i, m->wt));
+		if(half_w <= 0) continue; // Subbox must not be empty
+
+		half_r = (double)(base_r+depressQuantTop(box, dir, i, m->mr));
+		half_g = (double)(base_g+depressQuantTop(box, dir, i, m->mg));
+		half_b = (double)(base_b+depressQuantTop(box, dir, i, m->mb));
+		temp = (half_r*half_r+half_g*half_g+half_b*half_b)/half_w;
+
+		half_w = (double)whole_w-half_w;
+		if(half_w <= 0) continue;
+
+		half_r = (double)whole_r-half_r;
+		half_g = (double)whole_g-half_g;
+		half_b = (double)whole_b-half_b;
+		temp += (half_r*half_r+half_g*half_g+half_b*half_b)/half_w;
+
+		if(temp > max) {
+			max = temp;
+			*cut = i;
+		}
+	}
+
+	return max;
+}
+
+static bool depressQuantCut(depress_quant_box_type *set1, depress_quant_box_type *set2, const depress_quant_moments_type *m)
+{
+	int64_t whole_r, whole_g, whole_b, whole_w;
+	double max_r, max_g, max_b;
+	int cut_r, cut_g, cut_b, dir;
+
+	whole_r = depressQuantVolume(set1, m->mr);
+	whole_g = depressQuantVolume(set1, m->mg);
+	whole_b = depressQuantVolume(set1, m->mb);
+	whole_w = depressQuantVolume(set1, m->wt);
+
+	max_r = depressQuantMaximize(set1, DEPRESS_QUANT_DIR_R, set1->r0+1, set1->r1, &cut_r, m, whole_r, whole_g, whole_b, whole_w);
+	max_g = depressQuantMaximize(set1, DEPRESS_QUANT_DIR_G, set1->g0+1, set1->g1, &cut_g, m, whole_r, whole_g, whole_b, whole_w);
+	max_b = depressQuantMaximize(set1, DEPRESS_QUANT_DIR_B, set1->b0+1, set1->b1, &cut_b, m, whole_r, whole_g, whole_b, whole_w);
+
+	if(max_r >= max_g && max_r >= max_b) {
+		dir = DEPRESS_QUANT_DIR_R;
+		if(cut_r < 0) return false; // Can't split the box
+	} else if(max_g >= max_r && max_g >= max_b)
+		dir = DEPRESS_QUANT_DIR_G;
+	else
+		dir = DEPRESS_QUANT_DIR_B;
+
+	*set2 = *set1;
+
+	switch(dir) {
+		case DEPRESS_QUANT_DIR_R:
+			set2->r0 = set1->r1 = cut_r;
+			break;
+		case DEPRESS_QUANT_DIR_G:
+			set2->g0 = set1->g1 = cut_g;
+			break;
+		case DEPRESS_QUANT_DIR_B:
+			set2->b0 = set1->b1 = cut_b;
+			break;
+	}
+
+	set1->vol = (set1->r1-set1->r0)*(set1->g1-set1->g0)*(set1->b1-set1->b0);
+	set2->vol = (set2->r1-set2->r0)*(set2->g1-set2->g0)*(set2->b1-set2->b0);
+
+	return true;
+}
+
+// Converts histogram to cumulative moments
+static void depressQuantMoments(depress_quant_moments_type *m)
+{
+	int r, g, b;
+
+	for(r = 1; r < DEPRESS_QUANT_SIDE; r++) {
+		int64_t area_w[DEPRESS_QUANT_SIDE], area_r[DEPRESS_QUANT_SIDE], area_g[DEPRESS_QUANT_SIDE], area_b[DEPRESS_QUANT_SIDE];
+		double area_2[DEPRESS_QUANT_SIDE];
+
+		for(b = 0; b < DEPRESS_QUANT_SIDE; b++) {
+			area_w[b] = area_r[b] = area_g[b] = area_b[b] = 0;
+			area_2[b] = 0;
+		}
+
+		for(g = 1; g < DEPRESS_QUANT_SIDE; g++) {
+			int64_t line_w = 0, line_r = 0, line_g = 0, line_b = 0;
+			double line_2 = 0;
+
+			for(b = 1; b < DEPRESS_QUANT_SIDE; b++) {
+				size_t ind1, ind2;
+
+				ind1 = DEPRESS_QUANT_INDEX(r, g, b);
+				ind2 = DEPRESS_QUANT_INDEX(r-1, g, b);
+
+				line_w += m->wt[ind1];
+				line_r += m->mr[ind1];
+				line_g += m->mg[ind1];
+				line_b += m->mb[ind1];
+				line_2 += m->m2[ind1];
+
+				area_w[b] += line_w;
+				area_r[b] += line_r;
+				area_g[b] += line_g;
+				area_b[b] += line_b;
+				area_2[b] += line_2;
+
+				m->wt[ind1] = m->wt[ind2]+area_w[b];
+				m->mr[ind1] = m->mr[ind2]+area_r[b];
+				m->mg[ind1] = m->mg[ind2]+area_g[b];
+				m->mb[ind1] = m->mb[ind2]+area_b[b];
+				m->m2[ind1] = m->m2[ind2]+area_2[b];
+			}
+		}
+	}
+}
+
 bool depressImageApplyQuantization(unsigned char *buf, int sizex, int sizey, int colors)
 {
-	(void)buf;
-	(void)sizex;
-	(void)sizey;
+	depress_quant_moments_type m;
+	depress_quant_box_type cube[256];
+	double vv[256];
+	unsigned char palette[3*256];
+	unsigned char *tag = 0;
+	size_t i, cube_size;
+	int k, next;
+	bool success = true;
+
+	if(!buf || sizex <= 0 || sizey <= 0) return false;
+	if(SIZE_MAX/3/(size_t)sizex < (size_t)sizey) return false;
 
 	if(colors < 2) colors = 2;
 	if(colors > 256) colors = 256;
 
-	return true;
+	cube_size = DEPRESS_QUANT_SIDE*DEPRESS_QUANT_SIDE*DEPRESS_QUANT_SIDE;
+
+	m.wt = calloc(cube_size, sizeof(int64_t));
+	m.mr = calloc(cube_size, sizeof(int64_t));
+	m.mg = calloc(cube_size, sizeof(int64_t));
+	m.mb = calloc(cube_size, sizeof(int64_t));
+	m.m2 = calloc(cube_size, sizeof(double));
+	tag = calloc(32*32*32, 1);
+	if(!m.wt || !m.mr || !m.mg || !m.mb || !m.m2 || !tag) success = false;
+
+	// Build histogram
+	if(success) {
+		unsigned char *p;
+
+		p = buf;
+		for(i = 0; i < (size_t)sizex*(size_t)sizey; i++) {
+			size_t ind;
+			int r, g, b;
+
+			r = p[0];
+			g = p[1];
+			b = p[2];
+			p += 3;
+
+			ind = DEPRESS_QUANT_INDEX((r >> 3)+1, (g >> 3)+1, (b >> 3)+1);
+			m.wt[ind]++;
+			m.mr[ind] += r;
+			m.mg[ind] += g;
+			m.mb[ind] += b;
+			m.m2[ind] += (double)(r*r+g*g+b*b);
+		}
+
+		depressQuantMoments(&m);
+	}
+
+	// Split color space into boxes
+	if(success) {
+		cube[0].r0 = cube[0].g0 = cube[0].b0 = 0;
+		cube[0].r1 = cube[0].g1 = cube[0].b1 = DEPRESS_QUANT_SIDE-1;
+		cube[0].vol = (DEPRESS_QUANT_SIDE-1)*(DEPRESS_QUANT_SIDE-1)*(DEPRESS_QUANT_SIDE-1);
+		vv[0] = 0;
+
+		next = 0;
+		for(k = 1; k < colors; k++) {
+			double temp;
+			int l;
+
+			if(depressQuantCut(&cube[next], &cube[k], &m)) {
+				// Boxes with one cell can't be split further
+				vv[next] = (cube[next].vol > 1) ? depressQuantVariance(&cube[next], &m) : 0;
+				vv[k] = (cube[k].vol > 1) ? depressQuantVariance(&cube[k], &m) : 0;
+			} else {
+				vv[next] = 0;
+				k--;
+			}
+
+			next = 0;
+			temp = vv[0];
+			for(l = 1; l <= k; l++) {
+				if(vv[l] > temp) {
+					temp = vv[l];
+					next = l;
+				}
+			}
+
+			if(temp <= 0) {
+				colors = k+1;
+				break;
+			}
+		}
+	}
+
+	// Fill palette and RGB->index lookup cube
+	if(success) {
+		for(k = 0; k < colors; k++) {
+			int64_t w;
+			int r, g, b;
+
+			w = depressQuantVolume(&cube[k], m.wt);
+			if(w > 0) {
+				palette[3*k] = (unsigned char)((depressQuantVolume(&cube[k], m.mr)+w/2)/w);
+				palette[3*k+1] = (unsigned char)((depressQuantVolume(&cube[k], m.mg)+w/2)/w);
+				palette[3*k+2] = (unsigned char)((depressQuantVolume(&cube[k], m.mb)+w/2)/w);
+			} else
+				palette[3*k] = palette[3*k+1] = palette[3*k+2] = 0;
+
+			for(r = cube[k].r0; r < cube[k].r1; r++)
+				for(g = cube[k].g0; g < cube[k].g1; g++)
+					for(b = cube[k].b0; b < cube[k].b1; b++)
+						tag[(r << 10)+(g << 5)+b] = (unsigned char)k;
+		}
+	}
+
+	// Map pixels
+	if(success) {
+		int y;
+
+#pragma omp parallel for
+		for(y = 0; y < sizey; y++) {
+			unsigned char *p;
+			int x;
+
+			p = buf+(size_t)y*(size_t)sizex*3;
+			for(x = 0; x < sizex; x++) {
+				const unsigned char *c;
+
+				c = palette+3*tag[((p[0] >> 3) << 10)+((p[1] >> 3) << 5)+(p[2] >> 3)];
+				p[0] = c[0];
+				p[1] = c[1];
+				p[2] = c[2];
+				p += 3;
+			}
+		}
+	}
+
+	if(m.wt) free(m.wt);
+	if(m.mr) free(m.mr);
+	if(m.mg) free(m.mg);
+	if(m.mb) free(m.mb);
+	if(m.m2) free(m.m2);
+	if(tag) free(tag);
+
+	return success;
 }
 
-bool depressImageApplyNoteshrink(unsigned char *buf, int sizex, int sizey, int colors)
+bool depressImageApplyNoteshrink(unsigned char *buf, int sizex, int sizey, int colors, const float *shared_palette)
 {
-	float *palette = 0, *p3;
-	unsigned char *newbuf = 0, *p, *p2;
+	float *palette = 0;
+	unsigned char *newbuf = 0;
 	NSHOption option;
 	bool success = true;
 	size_t i;
@@ -401,8 +1738,12 @@ bool depressImageApplyNoteshrink(unsigned char *buf, int sizex, int sizey, int c
 		if(!newbuf) success = false;
 	}
 
-	if(success)
-		success = NSHPaletteCreate(buf, sizex, sizey, 3, option, palette, colors);
+	if(success) {
+		if(shared_palette)
+			memcpy(palette, shared_palette, 3*colors*sizeof(float));
+		else
+			success = NSHPaletteCreate(buf, sizex, sizey, 3, option, palette, colors);
+	}
 
 	if(success)
 		success = NSHPaletteApply(buf, sizex, sizey, 3, palette, colors, option, newbuf);
@@ -426,20 +1767,35 @@ bool depressImageApplyNoteshrink(unsigned char *buf, int sizex, int sizey, int c
 	}
 
 	if(success) {
+		unsigned char palette8[3*256];
+		int y;
+
 		for(i = 0; i < 3*(size_t)(colors); i++) {
-			palette[i] += 0.5f;
-			if(palette[i] < 0) palette[i] = 0;
-			if(palette[i] > 255) palette[i] = 255;
+			float c;
+
+			c = palette[i]+0.5f;
+			if(c < 0) c = 0;
+			if(c > 255) c = 255;
+			palette8[i] = (unsigned char)c;
 		}
 
-		p = buf;
-		p2 = newbuf;
-		for(i = 0; i < (size_t)(sizex*sizey); i++) {
-			p3 = palette+(*p2)*3;
-			*p = (unsigned int)(*p3); p++; p3++;
-			*p = (unsigned int)(*p3); p++; p3++;
-			*p = (unsigned int)(*p3); p++; p3++;
-			p2++;
+#pragma omp parallel for
+		for(y = 0; y < sizey; y++) {
+			unsigned char *p, *p2;
+			int x;
+
+			p = buf+(size_t)y*(size_t)sizex*3;
+			p2 = newbuf+(size_t)y*(size_t)sizex;
+			for(x = 0; x < sizex; x++) {
+				const unsigned char *p3;
+
+				p3 = palette8+(*p2)*3;
+				p[0] = p3[0];
+				p[1] = p3[1];
+				p[2] = p3[2];
+				p += 3;
+				p2++;
+			}
 		}
 	}
 
@@ -448,3 +1804,356 @@ bool depressImageApplyNoteshrink(unsigned char *buf, int sizex, int sizey, int c
 
 	return success;
 }
+
+#define DEPRESS_INDEXED_HASH_SIZE 1024
+
+/*
+	Converts RGB image that has no more than max_colors (up to 256) distinct colors
+	(i.e. already remapped to palette) to palette and index buffer.
+	bg_index is the most frequent color. Returns false if image has more colors.
+*/
+bool depressImageMakeIndexed(const unsigned char *buf, int sizex, int sizey, int max_colors, unsigned char *palette, int *colors, unsigned char **indices, int *bg_index)
+{
+	uint32_t hash_keys[DEPRESS_INDEXED_HASH_SIZE];
+	short hash_values[DEPRESS_INDEXED_HASH_SIZE];
+	size_t counts[256];
+	size_t i, size;
+	uint32_t last_key = 0;
+	int last_index = -1, nof_colors = 0, best;
+	unsigned char *p;
+
+	*indices = 0;
+
+	if(sizex <= 0 || sizey <= 0) return false;
+	if(max_colors < 1 || max_colors > 256) return false;
+	if(SIZE_MAX/(size_t)sizex < (size_t)sizey) return false;
+
+	size = (size_t)sizex*sizey;
+
+	p = malloc(size);
+	if(!p) return false;
+
+	for(i = 0; i < DEPRESS_INDEXED_HASH_SIZE; i++) hash_values[i] = -1;
+	memset(counts, 0, sizeof(counts));
+
+	for(i = 0; i < size; i++) {
+		uint32_t key;
+
+		key = ((uint32_t)buf[3*i] << 16) | ((uint32_t)buf[3*i+1] << 8) | buf[3*i+2];
+
+		if(key != last_key || last_index < 0) {
+			size_t h;
+
+			h = ((key * 2654435761u) >> 22) & (DEPRESS_INDEXED_HASH_SIZE-1);
+			while(hash_values[h] >= 0 && hash_keys[h] != key)
+				h = (h+1) & (DEPRESS_INDEXED_HASH_SIZE-1);
+
+			if(hash_values[h] < 0) {
+				if(nof_colors == max_colors) {
+					free(p);
+
+					return false;
+				}
+
+				hash_keys[h] = key;
+				hash_values[h] = (short)nof_colors;
+				palette[3*nof_colors] = buf[3*i];
+				palette[3*nof_colors+1] = buf[3*i+1];
+				palette[3*nof_colors+2] = buf[3*i+2];
+				nof_colors++;
+			}
+
+			last_key = key;
+			last_index = hash_values[h];
+		}
+
+		p[i] = (unsigned char)last_index;
+		counts[last_index]++;
+	}
+
+	best = 0;
+	for(i = 1; i < (size_t)nof_colors; i++)
+		if(counts[i] > counts[best]) best = (int)i;
+
+	*colors = nof_colors;
+	*bg_index = best;
+	*indices = p;
+
+	return true;
+}
+
+bool depressImageSampleNoteshrinkPixels(const unsigned char *buf, int sizex, int sizey, int channels, size_t nof_pages, unsigned char **samples, size_t *samples_num)
+{
+	NSHOption option;
+	unsigned char *rgb = 0, *new_samples;
+	size_t i, page_samples_num, image_size;
+
+	if(!buf || sizex <= 0 || sizey <= 0 || nof_pages == 0) return false;
+	if(channels != 1 && channels != 3) return false;
+	if(SIZE_MAX/3/(size_t)sizex < (size_t)sizey) return false;
+
+	option = NSHMakeDefaultOption();
+	image_size = (size_t)sizex*(size_t)sizey;
+
+	// All pages together give as many samples as one page would
+	page_samples_num = (size_t)(option.SampleFraction*image_size)/nof_pages;
+	if(page_samples_num == 0) page_samples_num = 1;
+
+	if((SIZE_MAX-*samples_num)/3 < page_samples_num) return false;
+	new_samples = realloc(*samples, 3*(*samples_num+page_samples_num));
+	if(!new_samples) return false;
+	*samples = new_samples;
+
+	if(channels == 1) {
+		rgb = malloc(3*image_size);
+		if(!rgb) return false;
+
+		for(i = 0; i < image_size; i++)
+			rgb[3*i] = rgb[3*i+1] = rgb[3*i+2] = buf[i];
+	}
+
+	*samples_num += NSHSamplePixels(rgb?rgb:(unsigned char *)buf, sizex, sizey, 3, option, *samples+3*(*samples_num), page_samples_num);
+
+	if(rgb) free(rgb);
+
+	return true;
+}
+
+float *depressImageCreateNoteshrinkPalette(unsigned char *samples, size_t samples_num, int colors)
+{
+	float *palette;
+
+	if(colors < 2) colors = 2;
+	if(colors > 256) colors = 256;
+
+	palette = malloc(3*colors*sizeof(float));
+	if(!palette) return 0;
+
+	if(!NSHPaletteCreateFromSamples(samples, samples_num, 3, NSHMakeDefaultOption(), palette, colors)) {
+		free(palette);
+
+		return 0;
+	}
+
+	return palette;
+}
+
+#define DEPRESS_ILLRECTS_CELLS 512 // Cells on the longer side of the page
+#define DEPRESS_ILLRECTS_MIN_CELL 4 // Minimal size of the cell in pixels
+#define DEPRESS_ILLRECTS_MIDTONE_MIN 48
+#define DEPRESS_ILLRECTS_MIDTONE_MAX 208
+#define DEPRESS_ILLRECTS_SATURATION 64 // Colored pixels are treated as mid-tone
+#define DEPRESS_ILLRECTS_SMOOTHNESS 24 // Maximal difference of mean with neighbour cells for halftones
+#define DEPRESS_ILLRECTS_MIN_AREA 256 // Region should cover at least 1/256 of the page
+#define DEPRESS_ILLRECTS_MIN_FILL 3 // At least 1/3 of region cells should be mid-tone
+
+/*
+	Finds photos and halftones on scanned BW page. Page is viewed as cells, cell
+	is mid-tone if at least half of its pixels are neither black nor white or if
+	its mean is mid-tone and close to means of neighbour cells (halftone dots are
+	smaller than the cell, while text strokes and gaps are not).
+	Mid-tone cells are grown by one cell to join halftone dots and light areas
+	of photos, then bounding rectangles of large and dense enough connected
+	regions are returned (overlapping ones are merged).
+*/
+bool depressImageDetectIllrects(const unsigned char *buf, int sizex, int sizey, int channels, depress_illustration_rect_type **illrects, size_t *nof_illrects)
+{
+	unsigned char *cells = 0, *grown = 0, *means = 0;
+	int *stack = 0;
+	int cell, cw, ch, cy;
+	depress_illustration_rect_type *rects = 0;
+	size_t nof_rects = 0, max_rects = 0, i, j;
+	bool merged, result = false;
+
+	*illrects = 0;
+	*nof_illrects = 0;
+
+	if(sizex < 1 || sizey < 1 || (channels != 1 && channels != 3)) return false;
+
+	cell = ((sizex > sizey)?sizex:sizey)/DEPRESS_ILLRECTS_CELLS;
+	if(cell < DEPRESS_ILLRECTS_MIN_CELL) cell = DEPRESS_ILLRECTS_MIN_CELL;
+	cw = (sizex+cell-1)/cell;
+	ch = (sizey+cell-1)/cell;
+
+	cells = malloc((size_t)cw*ch);
+	grown = malloc((size_t)cw*ch);
+	means = malloc((size_t)cw*ch);
+	stack = malloc((size_t)cw*ch*sizeof(int));
+	if(!cells || !grown || !means || !stack) goto EXIT;
+
+	// Mid-tone cells
+#pragma omp parallel for
+	for(cy = 0; cy < ch; cy++) {
+		int cx, x, y, x0, x1, y0, y1, midtones;
+		unsigned long sum;
+
+		y0 = cy*cell;
+		y1 = (y0+cell < sizey)?(y0+cell):sizey;
+		for(cx = 0; cx < cw; cx++) {
+			x0 = cx*cell;
+			x1 = (x0+cell < sizex)?(x0+cell):sizex;
+			midtones = 0;
+			sum = 0;
+			for(y = y0; y < y1; y++) {
+				const unsigned char *p = buf+((size_t)y*sizex+x0)*channels;
+
+				for(x = x0; x < x1; x++) {
+					int v, sat = 0;
+
+					if(channels == 3) {
+						int vmin, vmax;
+
+						v = (p[0]*77+p[1]*150+p[2]*29) >> 8;
+						vmin = (p[0] < p[1])?p[0]:p[1]; if(p[2] < vmin) vmin = p[2];
+						vmax = (p[0] > p[1])?p[0]:p[1]; if(p[2] > vmax) vmax = p[2];
+						sat = vmax-vmin;
+					} else
+						v = *p;
+					if((v >= DEPRESS_ILLRECTS_MIDTONE_MIN && v <= DEPRESS_ILLRECTS_MIDTONE_MAX) || sat >= DEPRESS_ILLRECTS_SATURATION)
+						midtones++;
+					sum += v;
+					p += channels;
+				}
+			}
+			cells[(size_t)cy*cw+cx] = (2*midtones >= (x1-x0)*(y1-y0));
+			means[(size_t)cy*cw+cx] = (unsigned char)(sum/((x1-x0)*(y1-y0)));
+		}
+	}
+
+	// Halftone cells
+#pragma omp parallel for
+	for(cy = 0; cy < ch; cy++) {
+		int cx, d, m, k;
+		bool smooth;
+
+		for(cx = 0; cx < cw; cx++) {
+			k = cy*cw+cx;
+			m = means[k];
+			if(cells[k] || m < DEPRESS_ILLRECTS_MIDTONE_MIN || m > DEPRESS_ILLRECTS_MIDTONE_MAX) continue;
+
+			smooth = true;
+			for(d = 0; d < 4 && smooth; d++) {
+				int nx = cx, ny = cy;
+
+				if(d == 0) nx--; else if(d == 1) nx++; else if(d == 2) ny--; else ny++;
+				if(nx < 0 || nx >= cw || ny < 0 || ny >= ch) continue;
+				if(abs(m-means[ny*cw+nx]) > DEPRESS_ILLRECTS_SMOOTHNESS) smooth = false;
+			}
+			if(smooth) cells[k] = 1;
+		}
+	}
+
+	// Grow by one cell
+	for(cy = 0; cy < ch; cy++) {
+		int cx, dx, dy;
+
+		for(cx = 0; cx < cw; cx++) {
+			unsigned char g = 0;
+
+			for(dy = -1; dy <= 1 && !g; dy++)
+				for(dx = -1; dx <= 1 && !g; dx++)
+					if(cy+dy >= 0 && cy+dy < ch && cx+dx >= 0 && cx+dx < cw)
+						g = cells[(size_t)(cy+dy)*cw+cx+dx];
+			grown[(size_t)cy*cw+cx] = g;
+		}
+	}
+
+	// Connected regions
+	for(i = 0; i < (size_t)cw*ch; i++) {
+		int sp = 0, bx0, by0, bx1, by1;
+		size_t filled = 0;
+
+		if(grown[i] != 1) continue;
+
+		bx0 = bx1 = (int)(i%cw);
+		by0 = by1 = (int)(i/cw);
+		grown[i] = 2;
+		stack[sp++] = (int)i;
+		while(sp > 0) {
+			int k, x, y;
+
+			k = stack[--sp];
+			x = k%cw;
+			y = k/cw;
+			if(cells[k]) filled++;
+			if(x < bx0) bx0 = x;
+			if(x > bx1) bx1 = x;
+			if(y < by0) by0 = y;
+			if(y > by1) by1 = y;
+
+			if(x > 0 && grown[k-1] == 1) { grown[k-1] = 2; stack[sp++] = k-1; }
+			if(x < cw-1 && grown[k+1] == 1) { grown[k+1] = 2; stack[sp++] = k+1; }
+			if(y > 0 && grown[k-cw] == 1) { grown[k-cw] = 2; stack[sp++] = k-cw; }
+			if(y < ch-1 && grown[k+cw] == 1) { grown[k+cw] = 2; stack[sp++] = k+cw; }
+		}
+
+		if((size_t)(bx1-bx0+1)*(by1-by0+1)*DEPRESS_ILLRECTS_MIN_AREA < (size_t)cw*ch) continue;
+		if(filled*DEPRESS_ILLRECTS_MIN_FILL < (size_t)(bx1-bx0+1)*(by1-by0+1)) continue;
+
+		if(nof_rects == max_rects) {
+			depress_illustration_rect_type *new_rects;
+
+			max_rects = max_rects?2*max_rects:16;
+			new_rects = realloc(rects, max_rects*sizeof(depress_illustration_rect_type));
+			if(!new_rects) goto EXIT;
+			rects = new_rects;
+		}
+		// Rectangles are kept in cells until merged
+		rects[nof_rects].x = bx0;
+		rects[nof_rects].y = by0;
+		rects[nof_rects].width = bx1-bx0+1;
+		rects[nof_rects].height = by1-by0+1;
+		nof_rects++;
+	}
+
+	// Merge overlapping rectangles
+	do {
+		merged = false;
+		for(i = 0; i < nof_rects; i++)
+			for(j = i+1; j < nof_rects; j++) {
+				depress_illustration_rect_type *a = rects+i, *b = rects+j;
+				unsigned int x1, y1;
+
+				if(a->x >= b->x+b->width || b->x >= a->x+a->width || a->y >= b->y+b->height || b->y >= a->y+a->height)
+					continue;
+
+				x1 = (a->x+a->width > b->x+b->width)?(a->x+a->width):(b->x+b->width);
+				y1 = (a->y+a->height > b->y+b->height)?(a->y+a->height):(b->y+b->height);
+				if(b->x < a->x) a->x = b->x;
+				if(b->y < a->y) a->y = b->y;
+				a->width = x1-a->x;
+				a->height = y1-a->y;
+				rects[j] = rects[--nof_rects];
+				j--;
+				merged = true;
+			}
+	} while(merged);
+
+	for(i = 0; i < nof_rects; i++) {
+		unsigned int x1, y1;
+
+		x1 = (rects[i].x+rects[i].width)*cell;
+		y1 = (rects[i].y+rects[i].height)*cell;
+		rects[i].x *= cell;
+		rects[i].y *= cell;
+		rects[i].width = ((x1 < (unsigned int)sizex)?x1:(unsigned int)sizex)-rects[i].x;
+		rects[i].height = ((y1 < (unsigned int)sizey)?y1:(unsigned int)sizey)-rects[i].y;
+	}
+
+	if(nof_rects) {
+		*illrects = rects;
+		*nof_illrects = nof_rects;
+		rects = 0;
+	}
+
+	result = true;
+
+EXIT:
+	if(cells) free(cells);
+	if(grown) free(grown);
+	if(means) free(means);
+	if(stack) free(stack);
+	if(rects) free(rects);
+
+	return result;
+}
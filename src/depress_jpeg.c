@@ -0,0 +1,531 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if defined(_DEBUG) && defined(USE_STB_LEAKCHECK)
+#include "third_party/stb_leakcheck.h"
+#endif
+
+#include "../include/depress_jpeg.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	unsigned char *data;
+	size_t size;
+	size_t allocated;
+	uint32_t acc; // Bits not written yet, the last of them is the least significant bit
+	unsigned int nof_bits;
+	bool failed;
+} depress_jpeg_writer_type;
+
+typedef struct {
+	unsigned short code[256];
+	unsigned char length[256];
+} depress_jpeg_huffman_type;
+
+// Tables of luma (0) and chroma (1)
+typedef struct {
+	unsigned char quant[2][64]; // Zigzag order, as written in DQT
+	float scale[2][64]; // Reciprocals of quantization values, natural order
+	depress_jpeg_huffman_type dc[2];
+	depress_jpeg_huffman_type ac[2];
+	float dct[64]; // dct[u*8+x] is basis function u at x
+} depress_jpeg_tables_type;
+
+static const unsigned char depress_jpeg_zigzag[64] = {
+	0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// Example tables from Annex K of T.81, natural order
+static const unsigned char depress_jpeg_base_quant[2][64] = {
+	{
+		16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+		14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+		18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+		49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99
+	},
+	{
+		17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+		24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+		99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+		99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99
+	}
+};
+
+// Number of codes of each length from 1 to 16 and symbols for them (Annex K)
+static const unsigned char depress_jpeg_dc_bits[2][16] = {
+	{ 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 }
+};
+
+static const unsigned char depress_jpeg_dc_values[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const unsigned char depress_jpeg_ac_bits[2][16] = {
+	{ 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d },
+	{ 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 }
+};
+
+static const unsigned char depress_jpeg_ac_values[2][162] = {
+	{
+		0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+		0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+		0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+		0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+		0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+		0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+		0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+		0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+		0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+		0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+		0xf9, 0xfa
+	},
+	{
+		0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+		0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+		0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+		0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+		0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+		0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+		0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+		0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+		0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+		0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+		0xf9, 0xfa
+	}
+};
+
+static void depressJpegPutByte(depress_jpeg_writer_type *w, unsigned char b)
+{
+	if(w->size == w->allocated) {
+		unsigned char *_data;
+		size_t new_allocated;
+
+		new_allocated = w->allocated?(2*w->allocated):4096;
+		_data = realloc(w->data, new_allocated);
+		if(!_data) {
+			w->failed = true;
+
+			return;
+		}
+		w->data = _data;
+		w->allocated = new_allocated;
+	}
+
+	w->data[w->size++] = b;
+}
+
+static void depressJpegPutWord(depress_jpeg_writer_type *w, unsigned int v)
+{
+	depressJpegPutByte(w, (unsigned char)(v >> 8));
+	depressJpegPutByte(w, (unsigned char)v);
+}
+
+// Entropy coded data, 0xff is followed by stuffed 0
+static void depressJpegPutBits(depress_jpeg_writer_type *w, unsigned int code, unsigned int length)
+{
+	w->acc = (w->acc << length) | code;
+	w->nof_bits += length;
+
+	while(w->nof_bits >= 8) {
+		unsigned char b;
+
+		w->nof_bits -= 8;
+		b = (unsigned char)(w->acc >> w->nof_bits);
+		depressJpegPutByte(w, b);
+		if(b == 0xff) depressJpegPutByte(w, 0);
+	}
+
+	w->acc &= (1u << w->nof_bits) - 1;
+}
+
+// Pads the last byte with 1 bits
+static void depressJpegFlushBits(depress_jpeg_writer_type *w)
+{
+	if(w->nof_bits) depressJpegPutBits(w, (1u << (8-w->nof_bits)) - 1, 8-w->nof_bits);
+}
+
+// Codes value as its category (with the run of zeros before it for AC) and additional bits
+static void depressJpegPutValue(depress_jpeg_writer_type *w, const depress_jpeg_huffman_type *h, int run, int v)
+{
+	unsigned int category = 0, a;
+
+	a = (v < 0)?-v:v;
+	while(a) {
+		category++;
+		a >>= 1;
+	}
+
+	depressJpegPutBits(w, h->code[(run << 4) | category], h->length[(run << 4) | category]);
+	if(category) depressJpegPutBits(w, (unsigned int)((v < 0)?(v+(1 << category)-1):v), category);
+}
+
+static void depressJpegBuildHuffman(depress_jpeg_huffman_type *h, const unsigned char *bits, const unsigned char *values)
+{
+	unsigned int code = 0, length, i, k = 0;
+
+	memset(h, 0, sizeof(depress_jpeg_huffman_type));
+
+	for(length = 1; length <= 16; length++) {
+		for(i = 0; i < bits[length-1]; i++, k++) {
+			h->code[values[k]] = (unsigned short)code++;
+			h->length[values[k]] = (unsigned char)length;
+		}
+		code <<= 1;
+	}
+}
+
+static void depressJpegBuildTables(depress_jpeg_tables_type *t, int quality)
+{
+	int scale, i, u, x;
+
+	if(quality < 1) quality = 1;
+	if(quality > 100) quality = 100;
+	scale = (quality < 50)?(5000/quality):(200-2*quality); // As in IJG libjpeg
+
+	for(i = 0; i < 2; i++) {
+		int k;
+
+		for(k = 0; k < 64; k++) {
+			int n = depress_jpeg_zigzag[k], q;
+
+			q = (depress_jpeg_base_quant[i][n]*scale+50)/100;
+			if(q < 1) q = 1;
+			if(q > 255) q = 255;
+
+			t->quant[i][k] = (unsigned char)q;
+			t->scale[i][n] = 1.0f/q;
+		}
+
+		depressJpegBuildHuffman(t->dc+i, depress_jpeg_dc_bits[i], depress_jpeg_dc_values);
+		depressJpegBuildHuffman(t->ac+i, depress_jpeg_ac_bits[i], depress_jpeg_ac_values[i]);
+	}
+
+	// Orthonormal DCT-II, that is the same as FDCT of T.81
+	for(u = 0; u < 8; u++)
+		for(x = 0; x < 8; x++)
+			t->dct[u*8+x] = (float)(((u == 0)?sqrt(0.125):0.5)*cos((2*x+1)*u*3.14159265358979323846/16));
+}
+
+static void depressJpegEncodeBlock(depress_jpeg_writer_type *w, const depress_jpeg_tables_type *t, int table, const float *samples, int *dc_pred)
+{
+	float rows[64];
+	int coefs[64], k, run;
+
+	// Rows, then columns
+	for(k = 0; k < 64; k++) {
+		const float *s = samples+(k/8)*8, *b = t->dct+(k%8)*8;
+
+		rows[k] = s[0]*b[0]+s[1]*b[1]+s[2]*b[2]+s[3]*b[3]+s[4]*b[4]+s[5]*b[5]+s[6]*b[6]+s[7]*b[7];
+	}
+	for(k = 0; k < 64; k++) {
+		int n = depress_jpeg_zigzag[k], u = n%8;
+		const float *b = t->dct+(n/8)*8;
+		float v;
+
+		v = rows[u]*b[0]+rows[8+u]*b[1]+rows[16+u]*b[2]+rows[24+u]*b[3]+rows[32+u]*b[4]+rows[40+u]*b[5]+rows[48+u]*b[6]+rows[56+u]*b[7];
+		v *= t->scale[table][n];
+		coefs[k] = (int)((v < 0)?(v-0.5f):(v+0.5f));
+		// Baseline limits AC values to 10 bits
+		if(coefs[k] > 1023) coefs[k] = 1023;
+		if(coefs[k] < -1023) coefs[k] = -1023;
+	}
+
+	depressJpegPutValue(w, t->dc+table, 0, coefs[0]-*dc_pred);
+	*dc_pred = coefs[0];
+
+	run = 0;
+	for(k = 1; k < 64; k++) {
+		if(!coefs[k]) {
+			run++;
+			continue;
+		}
+
+		while(run >= 16) {
+			depressJpegPutBits(w, t->ac[table].code[0xf0], t->ac[table].length[0xf0]); // ZRL
+			run -= 16;
+		}
+		depressJpegPutValue(w, t->ac+table, run, coefs[k]);
+		run = 0;
+	}
+	if(run) depressJpegPutBits(w, t->ac[table].code[0], t->ac[table].length[0]); // EOB
+}
+
+// Encodes one row of MCUs (restart interval), MCU is 8x8 for gray and 16x16 with 4:2:0 chroma for RGB
+static void depressJpegEncodeRow(depress_jpeg_writer_type *w, const depress_jpeg_tables_type *t, unsigned int sizex, unsigned int sizey, int channels, const unsigned char *buf, unsigned int row)
+{
+	float luma[256], cb[64], cr[64], block[64];
+	int dc_pred[3] = { 0, 0, 0 };
+	unsigned int mcu_size, x0, y0, x, y;
+
+	mcu_size = (channels == 3)?16:8;
+	y0 = row*mcu_size;
+
+	for(x0 = 0; x0 < sizex; x0 += mcu_size) {
+		// Samples outside of image repeat the last column and row
+		for(y = 0; y < mcu_size; y++) {
+			const unsigned char *p;
+			unsigned int sy;
+
+			sy = (y0+y < sizey)?(y0+y):(sizey-1);
+			p = buf+(size_t)sy*sizex*channels;
+			for(x = 0; x < mcu_size; x++) {
+				unsigned int sx = (x0+x < sizex)?(x0+x):(sizex-1);
+
+				if(channels == 3) {
+					const unsigned char *c = p+(size_t)sx*3;
+
+					luma[y*16+x] = 0.299f*c[0]+0.587f*c[1]+0.114f*c[2]-128.0f;
+				} else
+					luma[y*8+x] = p[sx]-128.0f;
+			}
+		}
+
+		if(channels == 3) {
+			unsigned int b;
+
+			for(y = 0; y < 8; y++) {
+				for(x = 0; x < 8; x++) {
+					float r = 0, g = 0, bl = 0;
+					unsigned int i;
+
+					for(i = 0; i < 4; i++) {
+						unsigned int sx, sy;
+						const unsigned char *c;
+
+						sx = x0+2*x+i%2;
+						sy = y0+2*y+i/2;
+						if(sx >= sizex) sx = sizex-1;
+						if(sy >= sizey) sy = sizey-1;
+						c = buf+((size_t)sy*sizex+sx)*3;
+						r += c[0];
+						g += c[1];
+						bl += c[2];
+					}
+					r *= 0.25f;
+					g *= 0.25f;
+					bl *= 0.25f;
+
+					cb[y*8+x] = -0.168736f*r-0.331264f*g+0.5f*bl;
+					cr[y*8+x] = 0.5f*r-0.418688f*g-0.081312f*bl;
+				}
+			}
+
+			for(b = 0; b < 4; b++) {
+				for(y = 0; y < 8; y++)
+					memcpy(block+y*8, luma+(8*(b/2)+y)*16+8*(b%2), 8*sizeof(float));
+				depressJpegEncodeBlock(w, t, 0, block, dc_pred);
+			}
+			depressJpegEncodeBlock(w, t, 1, cb, dc_pred+1);
+			depressJpegEncodeBlock(w, t, 1, cr, dc_pred+2);
+		} else
+			depressJpegEncodeBlock(w, t, 0, luma, dc_pred);
+	}
+
+	depressJpegFlushBits(w);
+}
+
+static void depressJpegPutHeaders(depress_jpeg_writer_type *w, const depress_jpeg_tables_type *t, unsigned int sizex, unsigned int sizey, int channels, unsigned int restart_interval)
+{
+	static const unsigned char jfif[14] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+	int nof_tables, i, c;
+
+	nof_tables = (channels == 3)?2:1;
+
+	depressJpegPutWord(w, 0xffd8); // SOI
+
+	depressJpegPutWord(w, 0xffe0); // APP0
+	depressJpegPutWord(w, 2+sizeof(jfif));
+	for(i = 0; i < (int)sizeof(jfif); i++) depressJpegPutByte(w, jfif[i]);
+
+	depressJpegPutWord(w, 0xffdb); // DQT
+	depressJpegPutWord(w, 2+65*nof_tables);
+	for(i = 0; i < nof_tables; i++) {
+		depressJpegPutByte(w, (unsigned char)i);
+		for(c = 0; c < 64; c++) depressJpegPutByte(w, t->quant[i][c]);
+	}
+
+	depressJpegPutWord(w, 0xffc0); // SOF0
+	depressJpegPutWord(w, 8+3*channels);
+	depressJpegPutByte(w, 8);
+	depressJpegPutWord(w, sizey);
+	depressJpegPutWord(w, sizex);
+	depressJpegPutByte(w, (unsigned char)channels);
+	for(c = 0; c < channels; c++) {
+		depressJpegPutByte(w, (unsigned char)(c+1));
+		depressJpegPutByte(w, (channels == 3 && c == 0)?0x22:0x11);
+		depressJpegPutByte(w, (unsigned char)((c == 0)?0:1));
+	}
+
+	depressJpegPutWord(w, 0xffc4); // DHT
+	depressJpegPutWord(w, 2+nof_tables*(17+12+17+162));
+	for(i = 0; i < nof_tables; i++) {
+		depressJpegPutByte(w, (unsigned char)i);
+		for(c = 0; c < 16; c++) depressJpegPutByte(w, depress_jpeg_dc_bits[i][c]);
+		for(c = 0; c < 12; c++) depressJpegPutByte(w, depress_jpeg_dc_values[c]);
+		depressJpegPutByte(w, (unsigned char)(0x10 | i));
+		for(c = 0; c < 16; c++) depressJpegPutByte(w, depress_jpeg_ac_bits[i][c]);
+		for(c = 0; c < 162; c++) depressJpegPutByte(w, depress_jpeg_ac_values[i][c]);
+	}
+
+	depressJpegPutWord(w, 0xffdd); // DRI
+	depressJpegPutWord(w, 4);
+	depressJpegPutWord(w, restart_interval);
+
+	depressJpegPutWord(w, 0xffda); // SOS
+	depressJpegPutWord(w, 6+2*channels);
+	depressJpegPutByte(w, (unsigned char)channels);
+	for(c = 0; c < channels; c++) {
+		depressJpegPutByte(w, (unsigned char)(c+1));
+		depressJpegPutByte(w, (unsigned char)((c == 0)?0x00:0x11));
+	}
+	depressJpegPutByte(w, 0);
+	depressJpegPutByte(w, 63);
+	depressJpegPutByte(w, 0);
+}
+
+bool depressJpegEncode(unsigned int sizex, unsigned int sizey, int channels, const unsigned char *buf, int quality, unsigned char **data, size_t *size)
+{
+	depress_jpeg_tables_type *tables = 0;
+	depress_jpeg_writer_type header = { 0 }, *rows = 0;
+	unsigned int mcu_size;
+	int nof_rows, r, failed = 0;
+	size_t total;
+	bool success = false;
+
+	*data = 0;
+	*size = 0;
+
+	if(sizex == 0 || sizex > 0xffff || sizey == 0 || sizey > 0xffff) return false;
+	if(channels != 1 && channels != 3) return false;
+
+	mcu_size = (channels == 3)?16:8;
+	nof_rows = (int)((sizey+mcu_size-1)/mcu_size);
+
+	tables = malloc(sizeof(depress_jpeg_tables_type));
+	rows = calloc(nof_rows, sizeof(depress_jpeg_writer_type));
+	if(!tables || !rows) goto EXIT;
+
+	depressJpegBuildTables(tables, quality);
+
+#pragma omp parallel for reduction(+:failed)
+	for(r = 0; r < nof_rows; r++) {
+		depressJpegEncodeRow(rows+r, tables, sizex, sizey, channels, buf, (unsigned int)r);
+		if(rows[r].failed) failed++;
+	}
+	if(failed) goto EXIT;
+
+	depressJpegPutHeaders(&header, tables, sizex, sizey, channels, (sizex+mcu_size-1)/mcu_size);
+	if(header.failed) goto EXIT;
+
+	// Rows are separated by RST0..RST7 markers
+	total = header.size+2;
+	for(r = 0; r < nof_rows; r++) {
+		if(SIZE_MAX-2-rows[r].size < total) goto EXIT;
+		total += rows[r].size+2;
+	}
+
+	*data = malloc(total);
+	if(!*data) goto EXIT;
+
+	memcpy(*data, header.data, header.size);
+	*size = header.size;
+	for(r = 0; r < nof_rows; r++) {
+		if(r > 0) {
+			(*data)[(*size)++] = 0xff;
+			(*data)[(*size)++] = (unsigned char)(0xd0+(r-1)%8);
+		}
+		memcpy(*data+*size, rows[r].data, rows[r].size);
+		*size += rows[r].size;
+	}
+	(*data)[(*size)++] = 0xff; // EOI
+	(*data)[(*size)++] = 0xd9;
+
+	success = true;
+
+EXIT:
+	if(tables) free(tables);
+	if(rows) {
+		for(r = 0; r < nof_rows; r++)
+			if(rows[r].data) free(rows[r].data);
+		free(rows);
+	}
+	if(header.data) free(header.data);
+
+	return success;
+}
+
+bool depressJpegGetInfo(const unsigned char *data, size_t size, unsigned int *sizex, unsigned int *sizey, int *channels)
+{
+	size_t pos = 2;
+
+	if(size < 4 || data[0] != 0xff || data[1] != 0xd8) return false;
+
+	while(pos + 4 <= size) {
+		unsigned char marker;
+		size_t length;
+
+		if(data[pos] != 0xff) return false;
+		marker = data[pos+1];
+		if(marker == 0xff) { // Fill byte
+			pos++;
+			continue;
+		}
+		pos += 2;
+
+		// Markers without segment
+		if(marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) continue;
+
+		length = ((size_t)data[pos] << 8) | data[pos+1];
+		if(length < 2 || pos + length > size) return false;
+
+		if(marker == 0xc0 || marker == 0xc1 || marker == 0xc2) { // Baseline, extended and progressive with Huffman coding
+			if(length < 8) return false;
+			if(data[pos+2] != 8) return false;
+
+			*sizey = ((unsigned int)data[pos+3] << 8) | data[pos+4];
+			*sizex = ((unsigned int)data[pos+5] << 8) | data[pos+6];
+			*channels = data[pos+7];
+
+			return *sizex > 0 && *sizey > 0 && (*channels == 1 || *channels == 3);
+		}
+
+		// Lossless, hierarchical and arithmetic coding, or no frame header before scan
+		if((marker >= 0xc3 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc) || marker == 0xda || marker == 0xd9)
+			return false;
+
+		pos += length;
+	}
+
+	return false;
+}
@@ -0,0 +1,238 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if defined(_DEBUG) && defined(USE_STB_LEAKCHECK)
+extern "C" {
+#include "third_party/stb_leakcheck.h"
+}
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "DjVuGlobal.h"
+#include "GBitmap.h"
+#include "GPixmap.h"
+#include "JB2Image.h"
+#include "IW44Image.h"
+#include "DjVuInfo.h"
+#include "ByteStream.h"
+#include "IFFByteStream.h"
+
+#include "../include/depress_bitmask.h"
+#include "../include/depress_libdjvu.h"
+
+#ifdef HAVE_NAMESPACES
+using namespace DJVU;
+#endif
+
+namespace {
+	void depressLibdjvuPutInfo(IFFByteStream &iff, unsigned int sizex, unsigned int sizey, int dpi)
+	{
+		GP<DjVuInfo> info = DjVuInfo::create();
+
+		info->width = (int)sizex;
+		info->height = (int)sizey;
+		if(dpi > 0) info->dpi = dpi;
+
+		iff.put_chunk("INFO");
+		info->encode(*iff.get_bytestream());
+		iff.close_chunk();
+	}
+
+	bool depressLibdjvuGetData(GP<ByteStream> obs, unsigned char **data, size_t *size)
+	{
+		size_t data_size;
+
+		data_size = obs->size();
+		*data = (unsigned char *)malloc(data_size?data_size:1);
+		if(!(*data)) return false;
+
+		obs->seek(0);
+		if(obs->readall(*data, data_size) != data_size) {
+			free(*data);
+			*data = 0;
+
+			return false;
+		}
+		*size = data_size;
+
+		return true;
+	}
+}
+
+/*
+	Lossless JB2 page, pixels darker than 128 are black. Every connected component
+	of black pixels is a separate shape (similar shapes are not matched).
+*/
+bool depressLibdjvuEncodeBW(unsigned int sizex, unsigned int sizey, const unsigned char *buf, int dpi, unsigned char **data, size_t *size)
+{
+	depress_bitmask_type mask;
+	depress_bitmask_run_type *runs = 0;
+	depress_bitmask_component_type *components = 0;
+	size_t nof_components = 0;
+	bool success = false;
+
+	*data = 0;
+	*size = 0;
+
+	if(sizex == 0 || sizey == 0 || !buf) return false;
+
+	if(!depressBitmaskCreate(&mask, sizex, sizey)) return false;
+	depressBitmaskFromGray(&mask, buf);
+	if(!depressBitmaskGetComponents(&mask, &runs, &components, &nof_components)) {
+		depressBitmaskDestroy(&mask);
+
+		return false;
+	}
+	depressBitmaskDestroy(&mask);
+
+	try {
+		GP<JB2Image> jimg = JB2Image::create();
+		GP<ByteStream> obs = ByteStream::create();
+		GP<IFFByteStream> giff = IFFByteStream::create(obs);
+		IFFByteStream &iff = *giff;
+		size_t i, j;
+
+		jimg->set_dimension(sizex, sizey);
+		for(i = 0; i < nof_components; i++) {
+			const depress_bitmask_component_type *c = components+i;
+			unsigned int width = c->x1-c->x0, height = c->y1-c->y0;
+			GP<GBitmap> bitmap = GBitmap::create(height, width);
+			JB2Shape shape;
+			JB2Blit blit;
+
+			// Rows of GBitmap start from the bottom
+			for(j = 0; j < c->nof_runs; j++) {
+				const depress_bitmask_run_type *r = runs+c->first_run+j;
+				unsigned char *row = (*bitmap)[c->y1-1-r->y];
+
+				memset(row+(r->x0-c->x0), 1, r->x1-r->x0);
+			}
+
+			shape.parent = -1;
+			shape.bits = bitmap;
+			blit.left = (unsigned short)c->x0;
+			blit.bottom = (unsigned short)(sizey-c->y1);
+			blit.shapeno = jimg->add_shape(shape);
+			jimg->add_blit(blit);
+		}
+
+		iff.put_chunk("FORM:DJVU", 1);
+		depressLibdjvuPutInfo(iff, sizex, sizey, dpi);
+		iff.put_chunk("Sjbz");
+		jimg->encode(iff.get_bytestream());
+		iff.close_chunk();
+		iff.close_chunk();
+		giff = 0;
+
+		success = depressLibdjvuGetData(obs, data, size);
+	} catch(...) {
+		if(*data) free(*data);
+		*data = 0;
+	}
+
+	if(runs) free(runs);
+	if(components) free(components);
+
+	return success;
+}
+
+/*
+	IW44 page with one BG44 chunk per slice (slices are cumulative, as in c44 -slice)
+*/
+bool depressLibdjvuEncodePhoto(unsigned int sizex, unsigned int sizey, int channels, const unsigned char *buf, const int *slices, int nof_slices, int dpi, unsigned char **data, size_t *size)
+{
+	*data = 0;
+	*size = 0;
+
+	if(sizex == 0 || sizey == 0 || !buf || nof_slices <= 0) return false;
+	if(channels != 1 && channels != 3) return false;
+
+	try {
+		GP<IW44Image> iw;
+		GP<ByteStream> obs = ByteStream::create();
+		GP<IFFByteStream> giff = IFFByteStream::create(obs);
+		IFFByteStream &iff = *giff;
+		unsigned int x, y;
+		int i;
+
+		// Rows start from the bottom in both GBitmap and GPixmap
+		if(channels == 1) {
+			GP<GBitmap> bitmap = GBitmap::create(sizey, sizex);
+
+			bitmap->set_grays(256);
+			for(y = 0; y < sizey; y++) {
+				unsigned char *row = (*bitmap)[sizey-1-y];
+				const unsigned char *p = buf+(size_t)y*sizex;
+
+				for(x = 0; x < sizex; x++)
+					row[x] = (unsigned char)(255-p[x]); // Gray level 0 is white in GBitmap
+			}
+			iw = IW44Image::create_encode(*bitmap);
+		} else {
+			GP<GPixmap> pixmap = GPixmap::create(sizey, sizex);
+
+			for(y = 0; y < sizey; y++) {
+				GPixel *row = (*pixmap)[sizey-1-y];
+				const unsigned char *p = buf+(size_t)y*sizex*3;
+
+				for(x = 0; x < sizex; x++) {
+					row[x].r = p[0];
+					row[x].g = p[1];
+					row[x].b = p[2];
+					p += 3;
+				}
+			}
+			iw = IW44Image::create_encode(*pixmap, GP<GBitmap>(), IW44Image::CRCBnormal);
+		}
+
+		iff.put_chunk("FORM:DJVU", 1);
+		depressLibdjvuPutInfo(iff, sizex, sizey, dpi);
+		for(i = 0; i < nof_slices; i++) {
+			IWEncoderParms parms;
+
+			parms.slices = slices[i];
+			parms.bytes = 0;
+			parms.decibels = 0;
+
+			iff.put_chunk("BG44");
+			iw->encode_chunk(iff.get_bytestream(), parms);
+			iff.close_chunk();
+		}
+		iff.close_chunk();
+		giff = 0;
+
+		return depressLibdjvuGetData(obs, data, size);
+	} catch(...) {
+		if(*data) free(*data);
+		*data = 0;
+
+		return false;
+	}
+}
@@ -33,6 +33,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wchar.h>
 #include <math.h>
 
@@ -46,6 +47,123 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <io.h>
 #endif
 
+static void depressMakerDjvuRemoveFile(const wchar_t *filename)
+{
+	if(!_waccess(filename, 06))
+		if(_wremove(filename) == -1)
+#if defined(_WIN32)
+			Sleep(0);
+#else
+			usleep(1000);
+#endif
+}
+
+// Plain BW pages go to minidjvu if shared dictionaries are enabled
+static bool depressMakerDjvuIsSharedDictPage(const depress_maker_djvu_ctx_type *djvu_ctx, const depress_flags_type *flags)
+{
+	if(djvu_ctx->shared_dict_pages < 2) return false;
+
+	return flags->type == DEPRESS_PAGE_TYPE_BW && !flags->nof_illrects && !flags->detect_illrects;
+}
+
+// Same loss level as cjb2 gets, 0 is lossless
+static int depressMakerDjvuGetAggression(const depress_flags_type *flags)
+{
+	if(flags->quality >= 0 && flags->quality < 100)
+		return 200 - 2 * flags->quality;
+	else
+		return 0;
+}
+
+// Remembers where merged page went in the output file
+static bool depressMakerDjvuAddPage(depress_maker_djvu_ctx_type *djvu_ctx, size_t id)
+{
+	if(id >= djvu_ctx->page_numbers_max) {
+		size_t new_max, *new_numbers;
+
+		new_max = djvu_ctx->page_numbers_max?djvu_ctx->page_numbers_max:64;
+		while(new_max <= id) {
+			if(new_max > SIZE_MAX/2/sizeof(size_t)) return false;
+			new_max *= 2;
+		}
+
+		new_numbers = realloc(djvu_ctx->page_numbers, new_max*sizeof(size_t));
+		if(!new_numbers) return false;
+
+		// 0 is for tasks that aren't merged yet
+		memset(new_numbers+djvu_ctx->page_numbers_max, 0, (new_max-djvu_ctx->page_numbers_max)*sizeof(size_t));
+		djvu_ctx->page_numbers = new_numbers;
+		djvu_ctx->page_numbers_max = new_max;
+	}
+
+	djvu_ctx->page_numbers[id] = ++djvu_ctx->nof_pages;
+
+	return true;
+}
+
+/*
+	Encodes pending pages with minidjvu into one document with shared dictionary
+	and inserts it into the output file (or makes output file from it)
+*/
+static bool depressMakerDjvuMergeSharedDictPages(depress_maker_djvu_ctx_type *djvu_ctx)
+{
+	wchar_t *arg0 = 0, *p, target_file[32768], pbm_file[32768];
+	size_t arg0_size, i;
+	bool is_temp_target, result = false;
+
+	if(!djvu_ctx->nof_pending_pages) return true;
+
+	is_temp_target = djvu_ctx->is_output_created;
+	if(is_temp_target)
+		swprintf(target_file, 32768, L"%ls/shared%llu.djvu", djvu_ctx->temp_path, (unsigned long long)djvu_ctx->pending_pages[0]);
+	else
+		wcscpy(target_file, djvu_ctx->output_file);
+
+	arg0_size = (djvu_ctx->nof_pending_pages+3)*32770+1024;
+	arg0 = malloc(arg0_size*sizeof(wchar_t));
+	if(!arg0) goto EXIT;
+
+	p = arg0;
+	p += swprintf(p, arg0_size, L"\"%ls\" -p %u", djvu_ctx->djvulibre_paths.minidjvu_path, (unsigned int)djvu_ctx->nof_pending_pages);
+	if(djvu_ctx->pending_dpi > 0)
+		p += swprintf(p, arg0_size-(p-arg0), L" -d %d", djvu_ctx->pending_dpi);
+	if(djvu_ctx->pending_aggression > 0)
+		p += swprintf(p, arg0_size-(p-arg0), L" --lossy -a %d", djvu_ctx->pending_aggression);
+	for(i = 0; i < djvu_ctx->nof_pending_pages; i++)
+		p += swprintf(p, arg0_size-(p-arg0), L" \"%ls/temp%llu.pbm\"", djvu_ctx->temp_path, (unsigned long long)djvu_ctx->pending_pages[i]);
+	swprintf(p, arg0_size-(p-arg0), L" \"%ls\"", target_file);
+
+	if(depressSpawn(djvu_ctx->djvulibre_paths.minidjvu_path, arg0, true, true) == DEPRESS_INVALID_PROCESS_HANDLE)
+		goto EXIT;
+
+	// djvm inserts all pages of the document together with their dictionaries
+	if(is_temp_target) {
+		swprintf(arg0, arg0_size, L"\"%ls\" -i \"%ls\" \"%ls\"", djvu_ctx->djvulibre_paths.djvm_path, djvu_ctx->output_file, target_file);
+		if(depressSpawn(djvu_ctx->djvulibre_paths.djvm_path, arg0, true, true) == DEPRESS_INVALID_PROCESS_HANDLE)
+			goto EXIT;
+	}
+
+	djvu_ctx->is_output_created = true;
+
+	for(i = 0; i < djvu_ctx->nof_pending_pages; i++)
+		if(!depressMakerDjvuAddPage(djvu_ctx, djvu_ctx->pending_pages[i])) goto EXIT;
+
+	result = true;
+
+EXIT:
+	for(i = 0; i < djvu_ctx->nof_pending_pages; i++) {
+		swprintf(pbm_file, 32768, L"%ls/temp%llu.pbm", djvu_ctx->temp_path, (unsigned long long)djvu_ctx->pending_pages[i]);
+		depressMakerDjvuRemoveFile(pbm_file);
+	}
+	djvu_ctx->nof_pending_pages = 0;
+
+	if(is_temp_target) depressMakerDjvuRemoveFile(target_file);
+
+	if(arg0) free(arg0);
+
+	return result;
+}
+
 int depressMakerDjvuConvertCtx(void *ctx, size_t id, depress_flags_type flags, depress_load_image_type load_image, void *load_image_ctx)
 {
 	depress_maker_djvu_ctx_type *djvu_ctx;
@@ -53,6 +171,12 @@ int depressMakerDjvuConvertCtx(void *ctx, size_t id, depress_flags_type flags, d
 
 	djvu_ctx = (depress_maker_djvu_ctx_type *)ctx;
 
+	if(depressMakerDjvuIsSharedDictPage(djvu_ctx, &flags)) {
+		swprintf(page_file, 32768, L"%ls/temp%llu.pbm", djvu_ctx->temp_path, (unsigned long long)id);
+
+		return depressDjvuConvertPageToPbm(flags, load_image, load_image_ctx, id, page_file);
+	}
+
 	swprintf(temp_file, 32768, L"%ls/temp%llu.ppm", djvu_ctx->temp_path, (unsigned long long)id);
 
 	if(id == 0)
@@ -63,14 +187,40 @@ int depressMakerDjvuConvertCtx(void *ctx, size_t id, depress_flags_type flags, d
 	return depressDjvuConvertPage(flags, load_image, load_image_ctx, id, temp_file, page_file, &(djvu_ctx->djvulibre_paths));
 }
 
-bool depressMakerDjvuMergeCtx(void *ctx, size_t id)
+bool depressMakerDjvuMergeCtx(void *ctx, size_t id, depress_flags_type flags)
 {
 	bool result = true;
 	depress_maker_djvu_ctx_type *djvu_ctx;
 
 	djvu_ctx = (depress_maker_djvu_ctx_type *)ctx;
 
-	if(id > 0) {
+	if(depressMakerDjvuIsSharedDictPage(djvu_ctx, &flags)) {
+		int dpi, aggression;
+
+		dpi = depressDjvuGetPageDpi(&flags);
+		aggression = depressMakerDjvuGetAggression(&flags);
+
+		// Pages of one minidjvu run share dpi and loss level
+		if(djvu_ctx->nof_pending_pages && (djvu_ctx->pending_dpi != dpi || djvu_ctx->pending_aggression != aggression))
+			if(!depressMakerDjvuMergeSharedDictPages(djvu_ctx)) return false;
+
+		djvu_ctx->pending_pages[djvu_ctx->nof_pending_pages++] = id;
+		djvu_ctx->pending_dpi = dpi;
+		djvu_ctx->pending_aggression = aggression;
+
+		if(djvu_ctx->nof_pending_pages == djvu_ctx->shared_dict_pages)
+			return depressMakerDjvuMergeSharedDictPages(djvu_ctx);
+
+		return true;
+	}
+
+	if(!depressMakerDjvuMergeSharedDictPages(djvu_ctx)) return false;
+
+	// The first page is converted right into the output file
+	if(id == 0) {
+		djvu_ctx->is_output_created = true;
+		result = depressMakerDjvuAddPage(djvu_ctx, id);
+	} else {
 		wchar_t *arg0 = 0;
 		wchar_t page_file[32768];
 
@@ -82,6 +232,8 @@ bool depressMakerDjvuMergeCtx(void *ctx, size_t id)
 
 		if(depressSpawn(djvu_ctx->djvulibre_paths.djvm_path, arg0, true, true) == DEPRESS_INVALID_PROCESS_HANDLE)
 			result = false;
+		else
+			result = depressMakerDjvuAddPage(djvu_ctx, id);
 
 		free(arg0);
 	}
@@ -89,6 +241,11 @@ bool depressMakerDjvuMergeCtx(void *ctx, size_t id)
 	return result;
 }
 
+bool depressMakerDjvuFinishMergeCtx(void *ctx)
+{
+	return depressMakerDjvuMergeSharedDictPages((depress_maker_djvu_ctx_type *)ctx);
+}
+
 void depressMakerDjvuCleanupCtx(void *ctx, size_t id)
 {
 	depress_maker_djvu_ctx_type* djvu_ctx;
@@ -100,13 +257,7 @@ void depressMakerDjvuCleanupCtx(void *ctx, size_t id)
 
 		swprintf(page_file, 32768, L"%ls/temp%llu.djvu", djvu_ctx->temp_path, (unsigned long long)id);
 
-		if(!_waccess(page_file, 06))
-			if(_wremove(page_file) == -1)
-#if defined(_WIN32)
-				Sleep(0);
-#else
-				usleep(1000);
-#endif
+		depressMakerDjvuRemoveFile(page_file);
 	}
 }
 
@@ -277,12 +428,82 @@ bool depressMakerDjvuFinalizeCtx(void *ctx, const depress_maker_finalize_type fi
 	return true;
 }
 
+/*
+	Copies already merged page from the output file with djvused save-page-with
+	(included dictionaries are merged into the copy) and inserts it as a new page
+*/
+bool depressMakerDjvuMergeDuplicateCtx(void *ctx, size_t id, size_t original_id)
+{
+	FILE *djvused;
+	wchar_t *opencommand = 0, page_file[32768];
+	depress_maker_djvu_ctx_type *djvu_ctx;
+	char *page_file_utf8 = 0;
+	bool result = false;
+
+	djvu_ctx = (depress_maker_djvu_ctx_type *)ctx;
+
+	// Original page can wait for minidjvu
+	if(!depressMakerDjvuMergeSharedDictPages(djvu_ctx)) return false;
+
+	if(original_id >= djvu_ctx->page_numbers_max || !djvu_ctx->page_numbers[original_id]) return false;
+
+	opencommand = malloc(65622*sizeof(wchar_t));
+	if(!opencommand) goto EXIT;
+
+	page_file_utf8 = malloc(131072);
+	if(!page_file_utf8) goto EXIT;
+
+	swprintf(page_file, 32768, L"%ls/temp%llu.djvu", djvu_ctx->temp_path, (unsigned long long)id);
+	depressDocumentGetTitle(page_file, page_file_utf8, false);
+
+#if defined(WIN32)
+	swprintf(opencommand, 65622, L"\"\"%ls\" \"%ls\"\"", djvu_ctx->djvulibre_paths.djvused_path, djvu_ctx->output_file);
+#else
+	swprintf(opencommand, 65622, L"\"%ls\" \"%ls\"", djvu_ctx->djvulibre_paths.djvused_path, djvu_ctx->output_file);
+#endif
+
+	djvused = _wpopen(opencommand, L"wt");
+	if(!djvused) goto EXIT;
+
+	fprintf(djvused, "select %llu; save-page-with '%s'\n", (unsigned long long)djvu_ctx->page_numbers[original_id], page_file_utf8);
+
+	if(_pclose(djvused) != 0) goto EXIT;
+
+	swprintf(opencommand, 65622, L"\"%ls\" -i \"%ls\" \"%ls\"", djvu_ctx->djvulibre_paths.djvm_path, djvu_ctx->output_file, page_file);
+	if(depressSpawn(djvu_ctx->djvulibre_paths.djvm_path, opencommand, true, true) == DEPRESS_INVALID_PROCESS_HANDLE)
+		goto EXIT;
+
+	result = depressMakerDjvuAddPage(djvu_ctx, id);
+
+EXIT:
+	if(opencommand) free(opencommand);
+	if(page_file_utf8) free(page_file_utf8);
+
+	return result;
+}
+
 void depressMakerDjvuFreeCtx(void *ctx)
 {
 	depress_maker_djvu_ctx_type *djvu_ctx;
 
 	djvu_ctx = (depress_maker_djvu_ctx_type*)ctx;
 
+	if(djvu_ctx->pending_pages) {
+		size_t i;
+
+		// Pages left after error
+		for(i = 0; i < djvu_ctx->nof_pending_pages; i++) {
+			wchar_t pbm_file[32768];
+
+			swprintf(pbm_file, 32768, L"%ls/temp%llu.pbm", djvu_ctx->temp_path, (unsigned long long)djvu_ctx->pending_pages[i]);
+			depressMakerDjvuRemoveFile(pbm_file);
+		}
+
+		free(djvu_ctx->pending_pages);
+	}
+
+	if(djvu_ctx->page_numbers) free(djvu_ctx->page_numbers);
+
 	depressDestroyTempFolder(djvu_ctx->temp_path);
 
 	free(ctx);
@@ -0,0 +1,585 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if defined(_DEBUG) && defined(USE_STB_LEAKCHECK)
+#include "third_party/stb_leakcheck.h"
+#endif
+
+#include "../include/depress_mmr.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Rows in strip, every strip starts from white reference row
+#define DEPRESS_MMR_ROWS_PER_STRIP 512
+
+#define DEPRESS_MMR_MAGIC 0x4d4d5200 // "MMR" and flags: bit 0 - inverted, bit 1 - striped
+#define DEPRESS_MMR_MAGIC_INVERTED 0x1
+#define DEPRESS_MMR_MAGIC_STRIPED 0x4d4d5202
+
+typedef struct {
+	unsigned short code;
+	unsigned short length;
+} depress_mmr_code_type;
+
+typedef struct {
+	unsigned char *data;
+	size_t size;
+	size_t allocated;
+	uint32_t acc; // Bits not written yet, the last of them is the least significant bit
+	unsigned int nof_bits;
+	bool failed;
+} depress_mmr_writer_type;
+
+// Terminating codes for runs 0..63
+static const depress_mmr_code_type depress_mmr_white_terminating[64] = {
+	{ 0x035, 8 }, { 0x007, 6 }, { 0x007, 4 }, { 0x008, 4 }, { 0x00b, 4 }, { 0x00c, 4 }, { 0x00e, 4 }, { 0x00f, 4 },
+	{ 0x013, 5 }, { 0x014, 5 }, { 0x007, 5 }, { 0x008, 5 }, { 0x008, 6 }, { 0x003, 6 }, { 0x034, 6 }, { 0x035, 6 },
+	{ 0x02a, 6 }, { 0x02b, 6 }, { 0x027, 7 }, { 0x00c, 7 }, { 0x008, 7 }, { 0x017, 7 }, { 0x003, 7 }, { 0x004, 7 },
+	{ 0x028, 7 }, { 0x02b, 7 }, { 0x013, 7 }, { 0x024, 7 }, { 0x018, 7 }, { 0x002, 8 }, { 0x003, 8 }, { 0x01a, 8 },
+	{ 0x01b, 8 }, { 0x012, 8 }, { 0x013, 8 }, { 0x014, 8 }, { 0x015, 8 }, { 0x016, 8 }, { 0x017, 8 }, { 0x028, 8 },
+	{ 0x029, 8 }, { 0x02a, 8 }, { 0x02b, 8 }, { 0x02c, 8 }, { 0x02d, 8 }, { 0x004, 8 }, { 0x005, 8 }, { 0x00a, 8 },
+	{ 0x00b, 8 }, { 0x052, 8 }, { 0x053, 8 }, { 0x054, 8 }, { 0x055, 8 }, { 0x024, 8 }, { 0x025, 8 }, { 0x058, 8 },
+	{ 0x059, 8 }, { 0x05a, 8 }, { 0x05b, 8 }, { 0x04a, 8 }, { 0x04b, 8 }, { 0x032, 8 }, { 0x033, 8 }, { 0x034, 8 }
+};
+static const depress_mmr_code_type depress_mmr_black_terminating[64] = {
+	{ 0x037, 10 }, { 0x002, 3 }, { 0x003, 2 }, { 0x002, 2 }, { 0x003, 3 }, { 0x003, 4 }, { 0x002, 4 }, { 0x003, 5 },
+	{ 0x005, 6 }, { 0x004, 6 }, { 0x004, 7 }, { 0x005, 7 }, { 0x007, 7 }, { 0x004, 8 }, { 0x007, 8 }, { 0x018, 9 },
+	{ 0x017, 10 }, { 0x018, 10 }, { 0x008, 10 }, { 0x067, 11 }, { 0x068, 11 }, { 0x06c, 11 }, { 0x037, 11 }, { 0x028, 11 },
+	{ 0x017, 11 }, { 0x018, 11 }, { 0x0ca, 12 }, { 0x0cb, 12 }, { 0x0cc, 12 }, { 0x0cd, 12 }, { 0x068, 12 }, { 0x069, 12 },
+	{ 0x06a, 12 }, { 0x06b, 12 }, { 0x0d2, 12 }, { 0x0d3, 12 }, { 0x0d4, 12 }, { 0x0d5, 12 }, { 0x0d6, 12 }, { 0x0d7, 12 },
+	{ 0x06c, 12 }, { 0x06d, 12 }, { 0x0da, 12 }, { 0x0db, 12 }, { 0x054, 12 }, { 0x055, 12 }, { 0x056, 12 }, { 0x057, 12 },
+	{ 0x064, 12 }, { 0x065, 12 }, { 0x052, 12 }, { 0x053, 12 }, { 0x024, 12 }, { 0x037, 12 }, { 0x038, 12 }, { 0x027, 12 },
+	{ 0x028, 12 }, { 0x058, 12 }, { 0x059, 12 }, { 0x02b, 12 }, { 0x02c, 12 }, { 0x05a, 12 }, { 0x066, 12 }, { 0x067, 12 }
+};
+
+// Make-up codes for runs 64..1728
+static const depress_mmr_code_type depress_mmr_white_makeup[27] = {
+	{ 0x01b, 5 }, { 0x012, 5 }, { 0x017, 6 }, { 0x037, 7 }, { 0x036, 8 }, { 0x037, 8 }, { 0x064, 8 }, { 0x065, 8 },
+	{ 0x068, 8 }, { 0x067, 8 }, { 0x0cc, 9 }, { 0x0cd, 9 }, { 0x0d2, 9 }, { 0x0d3, 9 }, { 0x0d4, 9 }, { 0x0d5, 9 },
+	{ 0x0d6, 9 }, { 0x0d7, 9 }, { 0x0d8, 9 }, { 0x0d9, 9 }, { 0x0da, 9 }, { 0x0db, 9 }, { 0x098, 9 }, { 0x099, 9 },
+	{ 0x09a, 9 }, { 0x018, 6 }, { 0x09b, 9 }
+};
+static const depress_mmr_code_type depress_mmr_black_makeup[27] = {
+	{ 0x00f, 10 }, { 0x0c8, 12 }, { 0x0c9, 12 }, { 0x05b, 12 }, { 0x033, 12 }, { 0x034, 12 }, { 0x035, 12 }, { 0x06c, 13 },
+	{ 0x06d, 13 }, { 0x04a, 13 }, { 0x04b, 13 }, { 0x04c, 13 }, { 0x04d, 13 }, { 0x072, 13 }, { 0x073, 13 }, { 0x074, 13 },
+	{ 0x075, 13 }, { 0x076, 13 }, { 0x077, 13 }, { 0x052, 13 }, { 0x053, 13 }, { 0x054, 13 }, { 0x055, 13 }, { 0x05a, 13 },
+	{ 0x05b, 13 }, { 0x064, 13 }, { 0x065, 13 }
+};
+
+// Make-up codes for runs 1792..2560, same for both colors
+static const depress_mmr_code_type depress_mmr_extended_makeup[13] = {
+	{ 0x008, 11 }, { 0x00c, 11 }, { 0x00d, 11 }, { 0x012, 12 }, { 0x013, 12 }, { 0x014, 12 }, { 0x015, 12 }, { 0x016, 12 },
+	{ 0x017, 12 }, { 0x01c, 12 }, { 0x01d, 12 }, { 0x01e, 12 }, { 0x01f, 12 }
+};
+
+static const depress_mmr_code_type depress_mmr_pass = { 0x1, 4 };
+static const depress_mmr_code_type depress_mmr_horizontal = { 0x1, 3 };
+static const depress_mmr_code_type depress_mmr_eol = { 0x1, 12 };
+
+// Vertical mode codes for b1-a1 from -3 to 3 (VR3..VL3)
+static const depress_mmr_code_type depress_mmr_vertical[7] = {
+	{ 0x03, 7 }, { 0x03, 6 }, { 0x3, 3 }, { 0x1, 1 }, { 0x2, 3 }, { 0x02, 6 }, { 0x02, 7 }
+};
+
+static void depressMmrPutBits(depress_mmr_writer_type *w, depress_mmr_code_type code)
+{
+	w->acc = (w->acc << code.length) | code.code;
+	w->nof_bits += code.length;
+
+	while(w->nof_bits >= 8) {
+		w->nof_bits -= 8;
+
+		if(w->size == w->allocated) {
+			unsigned char *_data;
+			size_t new_allocated;
+
+			new_allocated = w->allocated?(2*w->allocated):4096;
+			_data = realloc(w->data, new_allocated);
+			if(!_data) {
+				w->failed = true;
+				w->size = 0;
+				continue;
+			}
+			w->data = _data;
+			w->allocated = new_allocated;
+		}
+
+		w->data[w->size++] = (unsigned char)(w->acc >> w->nof_bits);
+	}
+
+	w->acc &= (1u << w->nof_bits) - 1;
+}
+
+static void depressMmrPutRun(depress_mmr_writer_type *w, unsigned int run, bool black)
+{
+	const depress_mmr_code_type *terminating, *makeup;
+
+	terminating = black?depress_mmr_black_terminating:depress_mmr_white_terminating;
+	makeup = black?depress_mmr_black_makeup:depress_mmr_white_makeup;
+
+	while(run >= 2560+64) {
+		depressMmrPutBits(w, depress_mmr_extended_makeup[12]);
+		run -= 2560;
+	}
+	if(run >= 1792) {
+		depressMmrPutBits(w, depress_mmr_extended_makeup[(run-1792)/64]);
+		run %= 64;
+	} else if(run >= 64) {
+		depressMmrPutBits(w, makeup[run/64-1]);
+		run %= 64;
+	}
+	depressMmrPutBits(w, terminating[run]);
+}
+
+#define depressMmrPixel(row, x) (((row)[(x)/8] >> (7-(x)%8)) & 1)
+
+// Returns first x in [start, end) with pixel not equal to color or end
+static unsigned int depressMmrFindChange(const unsigned char *row, unsigned int start, unsigned int end, unsigned int color)
+{
+	unsigned int x = start;
+	unsigned char same = color?0xff:0;
+
+	while(x < end) {
+		if(x%8 == 0 && row[x/8] == same) {
+			x += 8;
+			continue;
+		}
+		if(depressMmrPixel(row, x) != color) return x;
+		x++;
+	}
+
+	return end;
+}
+
+// Two-dimensional coding of the row (a0, a1, a2, b1 and b2 are changing elements as named in T.6)
+static void depressMmrEncodeRow(depress_mmr_writer_type *w, const unsigned char *row, const unsigned char *ref, unsigned int width)
+{
+	unsigned int a0 = 0, a1, a2, b1, b2;
+
+	a1 = depressMmrPixel(row, 0)?0:depressMmrFindChange(row, 0, width, 0);
+	b1 = depressMmrPixel(ref, 0)?0:depressMmrFindChange(ref, 0, width, 0);
+
+	while(1) {
+		b2 = (b1 < width)?depressMmrFindChange(ref, b1, width, depressMmrPixel(ref, b1)):width;
+
+		if(b2 < a1) {
+			depressMmrPutBits(w, depress_mmr_pass);
+			a0 = b2;
+		} else {
+			int d = (int)b1-(int)a1;
+
+			if(d >= -3 && d <= 3) {
+				depressMmrPutBits(w, depress_mmr_vertical[d+3]);
+				a0 = a1;
+			} else {
+				bool black;
+
+				a2 = (a1 < width)?depressMmrFindChange(row, a1, width, depressMmrPixel(row, a1)):width;
+				// a0 is imaginary white pixel before the row at the start
+				black = (a0+a1 != 0) && depressMmrPixel(row, a0);
+
+				depressMmrPutBits(w, depress_mmr_horizontal);
+				depressMmrPutRun(w, a1-a0, black);
+				depressMmrPutRun(w, a2-a1, !black);
+				a0 = a2;
+			}
+		}
+
+		if(a0 >= width) break;
+
+		a1 = depressMmrFindChange(row, a0, width, depressMmrPixel(row, a0));
+		b1 = depressMmrFindChange(ref, a0, width, !depressMmrPixel(row, a0));
+		b1 = depressMmrFindChange(ref, b1, width, depressMmrPixel(row, a0));
+	}
+}
+
+static void depressMmrWriteBE(unsigned char *p, uint32_t v, int bytes)
+{
+	while(bytes--) {
+		p[bytes] = (unsigned char)v;
+		v >>= 8;
+	}
+}
+
+bool depressMmrEncode(const depress_bitmask_type *mask, unsigned char **data, size_t *size)
+{
+	depress_mmr_writer_type *strips = 0;
+	unsigned char *white = 0, *p;
+	int nof_strips, s, failed = 0;
+	size_t total;
+	bool success = false;
+
+	*data = 0;
+	*size = 0;
+
+	if(!mask->words || mask->width > 0xffff || mask->height > 0xffff) return false;
+
+	nof_strips = (int)((mask->height+DEPRESS_MMR_ROWS_PER_STRIP-1)/DEPRESS_MMR_ROWS_PER_STRIP);
+	strips = calloc(nof_strips, sizeof(depress_mmr_writer_type));
+	white = calloc(1, mask->stride);
+	if(!strips || !white) goto EXIT;
+
+#pragma omp parallel for reduction(+:failed)
+	for(s = 0; s < nof_strips; s++) {
+		depress_mmr_writer_type *w = strips+s;
+		unsigned int y, y0, y1;
+
+		y0 = (unsigned int)s*DEPRESS_MMR_ROWS_PER_STRIP;
+		y1 = (y0+DEPRESS_MMR_ROWS_PER_STRIP < mask->height)?(y0+DEPRESS_MMR_ROWS_PER_STRIP):mask->height;
+
+		for(y = y0; y < y1 && !w->failed; y++)
+			depressMmrEncodeRow(w, depressBitmaskRow(mask, y), (y > y0)?depressBitmaskRow(mask, y-1):white, mask->width);
+
+		// EOFB, then pad to byte
+		depressMmrPutBits(w, depress_mmr_eol);
+		depressMmrPutBits(w, depress_mmr_eol);
+		if(w->nof_bits) {
+			depress_mmr_code_type pad = { 0, 0 };
+
+			pad.length = (unsigned short)(8-w->nof_bits);
+			depressMmrPutBits(w, pad);
+		}
+
+		if(w->failed) failed++;
+	}
+	if(failed) goto EXIT;
+
+	// Header (magic, width, height, rows per strip), then every strip prefixed by its size
+	total = 10;
+	for(s = 0; s < nof_strips; s++) {
+		if(strips[s].size > UINT32_MAX || SIZE_MAX-4-strips[s].size < total) goto EXIT;
+		total += 4+strips[s].size;
+	}
+
+	*data = malloc(total);
+	if(!*data) goto EXIT;
+
+	p = *data;
+	depressMmrWriteBE(p, DEPRESS_MMR_MAGIC_STRIPED, 4);
+	depressMmrWriteBE(p+4, mask->width, 2);
+	depressMmrWriteBE(p+6, mask->height, 2);
+	depressMmrWriteBE(p+8, DEPRESS_MMR_ROWS_PER_STRIP, 2);
+	p += 10;
+	for(s = 0; s < nof_strips; s++) {
+		depressMmrWriteBE(p, (uint32_t)strips[s].size, 4);
+		if(strips[s].size) memcpy(p+4, strips[s].data, strips[s].size);
+		p += 4+strips[s].size;
+	}
+	*size = total;
+
+	success = true;
+
+EXIT:
+	if(strips) {
+		for(s = 0; s < nof_strips; s++)
+			if(strips[s].data) free(strips[s].data);
+		free(strips);
+	}
+	if(white) free(white);
+
+	return success;
+}
+
+bool depressMmrMakeChunk(unsigned int width, unsigned int height, bool inverted, unsigned int rows_per_strip, const unsigned char * const *strips, const size_t *strip_sizes, size_t nof_strips, unsigned char **data, size_t *size)
+{
+	unsigned char *p;
+	size_t total, s;
+	uint32_t magic;
+
+	*data = 0;
+	*size = 0;
+
+	if(!width || !height || width > 0xffff || height > 0xffff || !nof_strips) return false;
+	if(nof_strips > 1 && (rows_per_strip > 0xffff || nof_strips != (height-1)/rows_per_strip+1)) return false;
+
+	magic = DEPRESS_MMR_MAGIC;
+	if(inverted) magic |= DEPRESS_MMR_MAGIC_INVERTED;
+
+	// One strip goes right after width and height, others are prefixed by their sizes
+	if(nof_strips == 1) {
+		total = 8+strip_sizes[0];
+	} else {
+		magic |= DEPRESS_MMR_MAGIC_STRIPED;
+
+		total = 10;
+		for(s = 0; s < nof_strips; s++) {
+			if(strip_sizes[s] > UINT32_MAX || SIZE_MAX-4-strip_sizes[s] < total) return false;
+			total += 4+strip_sizes[s];
+		}
+	}
+
+	*data = malloc(total);
+	if(!*data) return false;
+
+	p = *data;
+	depressMmrWriteBE(p, magic, 4);
+	depressMmrWriteBE(p+4, width, 2);
+	depressMmrWriteBE(p+6, height, 2);
+	p += 8;
+	if(nof_strips == 1) {
+		if(strip_sizes[0]) memcpy(p, strips[0], strip_sizes[0]);
+	} else {
+		depressMmrWriteBE(p, rows_per_strip, 2);
+		p += 2;
+		for(s = 0; s < nof_strips; s++) {
+			depressMmrWriteBE(p, (uint32_t)strip_sizes[s], 4);
+			if(strip_sizes[s]) memcpy(p+4, strips[s], strip_sizes[s]);
+			p += 4+strip_sizes[s];
+		}
+	}
+	*size = total;
+
+	return true;
+}
+
+// Decoding table of run codes, indexed by the next 13 bits
+typedef struct {
+	short run; // -1 for invalid code
+	unsigned char length;
+} depress_mmr_run_entry_type;
+
+#define DEPRESS_MMR_LOOKUP_BITS 13
+
+typedef struct {
+	const unsigned char *data;
+	size_t size;
+	size_t pos; // In bits
+} depress_mmr_reader_type;
+
+static void depressMmrAddRunCodes(depress_mmr_run_entry_type *table, const depress_mmr_code_type *codes, size_t nof_codes, int first_run, int run_step)
+{
+	size_t i;
+
+	for(i = 0; i < nof_codes; i++) {
+		unsigned int shift, j;
+
+		shift = DEPRESS_MMR_LOOKUP_BITS-codes[i].length;
+		for(j = 0; j < (1u << shift); j++) {
+			table[((unsigned int)codes[i].code << shift)+j].run = (short)(first_run+(int)i*run_step);
+			table[((unsigned int)codes[i].code << shift)+j].length = (unsigned char)codes[i].length;
+		}
+	}
+}
+
+static void depressMmrBuildRunTable(depress_mmr_run_entry_type *table, bool black)
+{
+	size_t i;
+
+	for(i = 0; i < (1u << DEPRESS_MMR_LOOKUP_BITS); i++) {
+		table[i].run = -1;
+		table[i].length = 0;
+	}
+
+	depressMmrAddRunCodes(table, black?depress_mmr_black_terminating:depress_mmr_white_terminating, 64, 0, 1);
+	depressMmrAddRunCodes(table, black?depress_mmr_black_makeup:depress_mmr_white_makeup, 27, 64, 64);
+	depressMmrAddRunCodes(table, depress_mmr_extended_makeup, 13, 1792, 64);
+}
+
+// Bits after the end of data are zeros
+static unsigned int depressMmrPeekBits(const depress_mmr_reader_type *r, unsigned int nof_bits)
+{
+	uint32_t acc = 0;
+	size_t byte;
+	unsigned int i;
+
+	byte = r->pos/8;
+	for(i = 0; i < 4; i++)
+		acc = (acc << 8) | ((byte+i < r->size)?r->data[byte+i]:0);
+
+	return (unsigned int)((acc << (r->pos%8)) >> (32-nof_bits));
+}
+
+static int depressMmrReadRun(depress_mmr_reader_type *r, const depress_mmr_run_entry_type *table)
+{
+	int run = 0;
+
+	while(1) {
+		const depress_mmr_run_entry_type *entry;
+
+		entry = table+depressMmrPeekBits(r, DEPRESS_MMR_LOOKUP_BITS);
+		if(entry->run < 0) return -1;
+		r->pos += entry->length;
+		run += entry->run;
+
+		if(entry->run < 64) return run;
+	}
+}
+
+// Sets bits from x0 to x1 (not including) in packed row
+static void depressMmrFillBlack(unsigned char *row, unsigned int x0, unsigned int x1)
+{
+	while(x0 < x1 && x0%8) {
+		row[x0/8] |= 0x80 >> (x0%8);
+		x0++;
+	}
+	while(x0+8 <= x1) {
+		row[x0/8] = 0xff;
+		x0 += 8;
+	}
+	while(x0 < x1) {
+		row[x0/8] |= 0x80 >> (x0%8);
+		x0++;
+	}
+}
+
+/*
+	Changing elements of reference row are kept in ref (even indices are changes to black,
+	odd to white), followed by width three times. a0 is -1 before the first pixel of the row.
+*/
+bool depressMmrDecode(const unsigned char *data, size_t size, unsigned int width, unsigned int rows, unsigned char *buf, size_t stride)
+{
+	depress_mmr_reader_type r;
+	depress_mmr_run_entry_type *tables = 0;
+	unsigned int *ref = 0, *cur = 0, y;
+	bool success = false;
+
+	if(!width) return false;
+
+	r.data = data;
+	r.size = size;
+	r.pos = 0;
+
+	tables = malloc(2*(1u << DEPRESS_MMR_LOOKUP_BITS)*sizeof(depress_mmr_run_entry_type));
+	ref = malloc(((size_t)width+3)*sizeof(unsigned int));
+	cur = malloc(((size_t)width+3)*sizeof(unsigned int));
+	if(!tables || !ref || !cur) goto EXIT;
+
+	depressMmrBuildRunTable(tables, false);
+	depressMmrBuildRunTable(tables+(1u << DEPRESS_MMR_LOOKUP_BITS), true);
+
+	ref[0] = ref[1] = ref[2] = width;
+
+	for(y = 0; y < rows; y++) {
+		unsigned char *row = buf+y*stride;
+		unsigned int *swap, nof_cur = 0, k = 0;
+		int a0 = -1, color = 0;
+
+		memset(row, 0, (width+7)/8);
+
+		// EOFB, the rest is white
+		if(depressMmrPeekBits(&r, 12) == 1 && depressMmrPeekBits(&r, 24) == 0x1001) break;
+
+		while(a0 < (int)width) {
+			unsigned int b1, b2, p, start;
+			int a1;
+
+			// b1 is the first change on reference row after a0 to the color opposite to a0
+			while(k > 0 && (int)ref[k-1] > a0) k--;
+			while((int)ref[k] <= a0 || (k & 1) != (unsigned int)color) k++;
+			b1 = ref[k];
+			b2 = ref[k+1];
+
+			start = (a0 < 0)?0:(unsigned int)a0;
+			p = depressMmrPeekBits(&r, 7);
+
+			if(p & 0x40) { // V0
+				r.pos += 1;
+				a1 = (int)b1;
+			} else if((p >> 4) == 0x3) { // VR1
+				r.pos += 3;
+				a1 = (int)b1+1;
+			} else if((p >> 4) == 0x2) { // VL1
+				r.pos += 3;
+				a1 = (int)b1-1;
+			} else if((p >> 4) == 0x1) { // Horizontal
+				int run1, run2;
+
+				r.pos += 3;
+				run1 = depressMmrReadRun(&r, tables+(color?(1u << DEPRESS_MMR_LOOKUP_BITS):0));
+				if(run1 < 0) goto EXIT;
+				run2 = depressMmrReadRun(&r, tables+(color?0:(1u << DEPRESS_MMR_LOOKUP_BITS)));
+				if(run2 < 0) goto EXIT;
+				if((unsigned int)run1 > width-start || (unsigned int)run2 > width-start-(unsigned int)run1) goto EXIT;
+
+				if(color) depressMmrFillBlack(row, start, start+run1);
+				else depressMmrFillBlack(row, start+run1, start+run1+run2);
+
+				if(start+run1 < width) {
+					if(nof_cur >= width) goto EXIT;
+					cur[nof_cur++] = start+run1;
+				}
+				if(start+run1+run2 < width) {
+					if(nof_cur >= width) goto EXIT;
+					cur[nof_cur++] = start+run1+run2;
+				}
+				a0 = (int)(start+run1+run2);
+
+				continue;
+			} else if((p >> 3) == 0x1) { // Pass
+				r.pos += 4;
+				if(b2 < start) goto EXIT;
+				if(color) depressMmrFillBlack(row, start, b2);
+				a0 = (int)b2;
+
+				continue;
+			} else if((p >> 1) == 0x3) { // VR2
+				r.pos += 6;
+				a1 = (int)b1+2;
+			} else if((p >> 1) == 0x2) { // VL2
+				r.pos += 6;
+				a1 = (int)b1-2;
+			} else if(p == 0x3) { // VR3
+				r.pos += 7;
+				a1 = (int)b1+3;
+			} else if(p == 0x2) { // VL3
+				r.pos += 7;
+				a1 = (int)b1-3;
+			} else // EOL in the middle of row, extensions (uncompressed mode) and errors
+				goto EXIT;
+
+			if(a1 < (int)start || a1 > (int)width) goto EXIT;
+
+			if(color) depressMmrFillBlack(row, start, (unsigned int)a1);
+			if(a1 < (int)width) {
+				if(nof_cur >= width) goto EXIT;
+				cur[nof_cur++] = (unsigned int)a1;
+			}
+			a0 = a1;
+			color = !color;
+		}
+
+		cur[nof_cur] = cur[nof_cur+1] = cur[nof_cur+2] = width;
+		swap = ref; ref = cur; cur = swap;
+
+		if(r.pos > 8*r.size) goto EXIT;
+	}
+
+	for(; y < rows; y++)
+		memset(buf+y*stride, 0, (width+7)/8);
+
+	success = true;
+
+EXIT:
+	if(tables) free(tables);
+	if(ref) free(ref);
+	if(cur) free(cur);
+
+	return success;
+}
@@ -33,6 +33,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "../include/depress_paths.h"
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #if defined(_WIN32)
 #include <Windows.h>
@@ -264,6 +266,51 @@ static LPWSTR depressGetProgramInstallPath(LPCWSTR reg_subkey, int registry_view
 
 #endif
 
+#if !defined(_WIN32)
+// Searches executable in folders from PATH, as shell does
+static bool depressFindExecutableInPath(const wchar_t *name, wchar_t *out_filename, size_t buflen)
+{
+	const char *path, *end;
+	size_t name_len;
+
+	out_filename[0] = 0;
+
+	path = getenv("PATH");
+	if(!path) return false;
+
+	name_len = wcslen(name);
+
+	while(*path) {
+		size_t dir_len;
+
+		end = strchr(path, ':');
+		if(!end) end = path+strlen(path);
+		dir_len = (size_t)(end-path);
+
+		if(dir_len && dir_len <= PATH_MAX) {
+			char dir[PATH_MAX+1];
+			size_t wdir_len;
+
+			memcpy(dir, path, dir_len);
+			dir[dir_len] = 0;
+
+			wdir_len = mbstowcs(out_filename, dir, buflen);
+			if(wdir_len != (size_t)-1 && wdir_len+name_len+2 < buflen) {
+				out_filename[wdir_len] = L'/';
+				wcscpy(out_filename+wdir_len+1, name);
+				if(!_waccess(out_filename, 01)) return true;
+			}
+		}
+
+		path = *end?end+1:end;
+	}
+
+	out_filename[0] = 0;
+
+	return false;
+}
+#endif
+
 bool depressGetDjvulibrePaths(depress_djvulibre_paths_type *djvulibre_paths)
 {
 #if defined(_WIN32)
@@ -306,6 +353,11 @@ bool depressGetDjvulibrePaths(depress_djvulibre_paths_type *djvulibre_paths)
 	if(!filename_len) filename_len = SearchPathW(NULL, L"djvumake.exe", NULL, 32768, djvulibre_paths->djvumake_path, NULL);
 	if(filename_len == 0 || filename_len > 32768) goto DEPRESS_FAILURE;
 
+	// minidjvu isn't part of DjVuLibre and needed only for shared dictionaries
+	filename_len = SearchPathW(reg_key_value, L"minidjvu.exe", NULL, 32768, djvulibre_paths->minidjvu_path, NULL);
+	if(!filename_len) filename_len = SearchPathW(NULL, L"minidjvu.exe", NULL, 32768, djvulibre_paths->minidjvu_path, NULL);
+	if(filename_len == 0 || filename_len > 32768) djvulibre_paths->minidjvu_path[0] = 0;
+
 	if(reg_key_value) free(reg_key_value);
 	return true;
 
@@ -322,6 +374,8 @@ DEPRESS_FAILURE:
 	wcscpy(djvulibre_paths->djvused_path, L"djvused");
 	wcscpy(djvulibre_paths->djvuextract_path, L"djvuextract");
 	wcscpy(djvulibre_paths->djvumake_path, L"djvumake");
+	// minidjvu isn't part of DjVuLibre, so it's checked beforehand to fail before converting
+	depressFindExecutableInPath(L"minidjvu", djvulibre_paths->minidjvu_path, 32768);
 #endif
 
 	return true;
@@ -73,6 +73,7 @@ bool depressAddTask(const depress_task_type *task, depress_task_type **tasks_out
 
 	tasks[tasks_num] = *task;
 	tasks[tasks_num].process_status = DEPRESS_DOCUMENT_PROCESS_STATUS_OK;
+	tasks[tasks_num].original_id = tasks_num;
 	tasks[tasks_num].is_completed = false;
 
 	tasks[tasks_num].finished = depressCreateEvent();
@@ -157,9 +158,16 @@ bool depressArePageFlagsEqual(depress_flags_type *a, depress_flags_type *b)
 {
 	if(a->type != b->type) return false;
 	if(a->dpi != b->dpi) return false;
+	if(a->resample_dpi != b->resample_dpi) return false;
 	if(a->quality != b->quality) return false;
 	if(a->param1 != b->param1) return false;
 	if(a->param2 != b->param2) return false;
+	if(a->detect_illrects != b->detect_illrects) return false;
+	if(a->mmr != b->mmr) return false;
+	if(a->bgjpeg != b->bgjpeg) return false;
+	if(a->passthrough != b->passthrough) return false;
+	if(a->tiled != b->tiled) return false;
+	if(a->libdjvu != b->libdjvu) return false;
 	if(a->nof_illrects != b->nof_illrects) return false;
 	if(a->nof_illrects > 0) {
 		if(memcmp(a->illrects, b->illrects, a->nof_illrects*sizeof(depress_illustration_rect_type))) return false;
@@ -190,7 +198,10 @@ void *depressThreadTaskProc(void *args)
 			if(depressWaitForEvent(arg.global_error_event, 0))
 				global_error = true;
 
-		if(global_error == false) {
+		// Duplicate pages are copied from the original page while merging
+		if(global_error == false && arg.tasks[i].original_id != i)
+			arg.tasks[i].is_completed = true;
+		else if(global_error == false) {
 			int convert_status;
 
 			convert_status = arg.maker.convert_ctx(arg.maker_ctx, i, arg.tasks[i].flags, arg.tasks[i].load_image, arg.tasks[i].load_image_ctx);
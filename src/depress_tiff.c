@@ -0,0 +1,875 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if defined(_DEBUG) && defined(USE_STB_LEAKCHECK)
+#include "third_party/stb_leakcheck.h"
+#endif
+
+#include "../include/depress_tiff.h"
+#include "../include/depress_mmr.h"
+
+#include "third_party/stb_image.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+	DEPRESS_TIFF_TAG_IMAGE_WIDTH = 256,
+	DEPRESS_TIFF_TAG_IMAGE_LENGTH = 257,
+	DEPRESS_TIFF_TAG_BITS_PER_SAMPLE = 258,
+	DEPRESS_TIFF_TAG_COMPRESSION = 259,
+	DEPRESS_TIFF_TAG_PHOTOMETRIC = 262,
+	DEPRESS_TIFF_TAG_FILL_ORDER = 266,
+	DEPRESS_TIFF_TAG_STRIP_OFFSETS = 273,
+	DEPRESS_TIFF_TAG_ORIENTATION = 274,
+	DEPRESS_TIFF_TAG_SAMPLES_PER_PIXEL = 277,
+	DEPRESS_TIFF_TAG_ROWS_PER_STRIP = 278,
+	DEPRESS_TIFF_TAG_STRIP_BYTE_COUNTS = 279,
+	DEPRESS_TIFF_TAG_PLANAR_CONFIG = 284,
+	DEPRESS_TIFF_TAG_T6_OPTIONS = 293,
+	DEPRESS_TIFF_TAG_PREDICTOR = 317,
+	DEPRESS_TIFF_TAG_COLORMAP = 320,
+	DEPRESS_TIFF_TAG_TILE_WIDTH = 322
+};
+
+enum {
+	DEPRESS_TIFF_TYPE_SHORT = 3,
+	DEPRESS_TIFF_TYPE_LONG = 4
+};
+
+typedef struct {
+	const unsigned char *data;
+	size_t size;
+	bool big_endian;
+} depress_tiff_reader_type;
+
+// Reads number of 1, 2 or 4 bytes, pos must be checked by caller
+static uint32_t depressTiffRead(const depress_tiff_reader_type *r, size_t pos, unsigned int bytes)
+{
+	uint32_t value = 0;
+	unsigned int i;
+
+	for(i = 0; i < bytes; i++) {
+		if(r->big_endian)
+			value = (value << 8) | r->data[pos+i];
+		else
+			value |= (uint32_t)r->data[pos+i] << (8*i);
+	}
+
+	return value;
+}
+
+bool depressTiffIsTiff(const unsigned char *data, size_t size)
+{
+	if(size < 8) return false;
+
+	return !memcmp(data, "II*\0", 4) || !memcmp(data, "MM\0*", 4);
+}
+
+static void depressTiffInitReader(depress_tiff_reader_type *r, const unsigned char *data, size_t size)
+{
+	r->data = data;
+	r->size = size;
+	r->big_endian = data[0] == 'M';
+}
+
+// Checks that IFD at pos fits into the file
+static bool depressTiffIsIfdValid(const depress_tiff_reader_type *r, size_t pos)
+{
+	if(pos < 8 || pos > r->size-2) return false;
+
+	return r->size-pos-2 >= (size_t)depressTiffRead(r, pos, 2)*12+4;
+}
+
+static size_t depressTiffGetNextIfd(const depress_tiff_reader_type *r, size_t pos)
+{
+	return depressTiffRead(r, pos+2+(size_t)depressTiffRead(r, pos, 2)*12, 4);
+}
+
+// Returns position of values of IFD entry, or 0 if they don't fit into the file
+static size_t depressTiffGetValuesPos(const depress_tiff_reader_type *r, size_t entry, unsigned int *type_size, size_t *count)
+{
+	unsigned int type;
+	size_t pos;
+
+	type = depressTiffRead(r, entry+2, 2);
+	if(type == DEPRESS_TIFF_TYPE_SHORT) *type_size = 2;
+	else if(type == DEPRESS_TIFF_TYPE_LONG) *type_size = 4;
+	else return 0;
+
+	*count = depressTiffRead(r, entry+4, 4);
+	if(*count == 0 || *count > r->size/(*type_size)) return 0;
+
+	if(*count*(*type_size) <= 4) return entry+8;
+
+	pos = depressTiffRead(r, entry+8, 4);
+	if(pos > r->size || r->size-pos < *count*(*type_size)) return 0;
+
+	return pos;
+}
+
+// Reads the first SHORT or LONG value of IFD entry
+static bool depressTiffGetValue(const depress_tiff_reader_type *r, size_t entry, uint32_t *value)
+{
+	unsigned int type_size;
+	size_t pos, count;
+
+	pos = depressTiffGetValuesPos(r, entry, &type_size, &count);
+	if(!pos) return false;
+
+	*value = depressTiffRead(r, pos, type_size);
+
+	return true;
+}
+
+// Reads all SHORT or LONG values of IFD entry, values is allocated with malloc
+static bool depressTiffGetValues(const depress_tiff_reader_type *r, size_t entry, size_t **values, size_t *count)
+{
+	unsigned int type_size;
+	size_t pos, i;
+
+	pos = depressTiffGetValuesPos(r, entry, &type_size, count);
+	if(!pos) return false;
+
+	*values = malloc(*count*sizeof(size_t));
+	if(!*values) return false;
+
+	for(i = 0; i < *count; i++)
+		(*values)[i] = depressTiffRead(r, pos+i*type_size, type_size);
+
+	return true;
+}
+
+bool depressTiffGetPages(const unsigned char *data, size_t size, size_t **ifds, size_t *nof_pages)
+{
+	depress_tiff_reader_type r;
+	size_t pos, max_pages, allocated = 0;
+
+	*ifds = 0;
+	*nof_pages = 0;
+
+	if(!depressTiffIsTiff(data, size)) return false;
+
+	depressTiffInitReader(&r, data, size);
+
+	pos = depressTiffRead(&r, 4, 4);
+	max_pages = size/18; // Stops on loops, IFD with one entry takes 18 bytes
+
+	while(pos && *nof_pages < max_pages) {
+		if(!depressTiffIsIfdValid(&r, pos)) break; // Pages before damaged IFD are still readable
+
+		if(*nof_pages == allocated) {
+			size_t *_ifds;
+
+			allocated = allocated?(2*allocated):16;
+			_ifds = realloc(*ifds, allocated*sizeof(size_t));
+			if(!_ifds) {
+				free(*ifds);
+				*ifds = 0;
+				*nof_pages = 0;
+
+				return false;
+			}
+			*ifds = _ifds;
+		}
+		(*ifds)[(*nof_pages)++] = pos;
+
+		pos = depressTiffGetNextIfd(&r, pos);
+	}
+
+	return *nof_pages > 0;
+}
+
+size_t depressTiffGetFirstPage(const unsigned char *data, size_t size)
+{
+	depress_tiff_reader_type r;
+	size_t pos;
+
+	if(!depressTiffIsTiff(data, size)) return 0;
+
+	depressTiffInitReader(&r, data, size);
+
+	pos = depressTiffRead(&r, 4, 4);
+
+	return depressTiffIsIfdValid(&r, pos)?pos:0;
+}
+
+bool depressTiffReadPage(const unsigned char *data, size_t size, size_t ifd, depress_tiff_page_type *page)
+{
+	depress_tiff_reader_type r;
+	size_t *offsets = 0, *sizes = 0, *colormap = 0, nof_offsets = 0, nof_sizes = 0, nof_colormap = 0, strips_per_plane, i;
+	unsigned int nof_entries, e;
+	bool has_photometric = false, success = false;
+
+	memset(page, 0, sizeof(depress_tiff_page_type));
+
+	if(!depressTiffIsTiff(data, size)) return false;
+
+	depressTiffInitReader(&r, data, size);
+
+	if(!depressTiffIsIfdValid(&r, ifd)) return false;
+
+	page->big_endian = r.big_endian;
+
+	page->bits_per_sample = 1;
+	page->samples_per_pixel = 1;
+	page->compression = DEPRESS_TIFF_COMPRESSION_NONE;
+	page->fill_order = 1;
+	page->orientation = 1;
+	page->planar_config = 1;
+	page->predictor = 1;
+	page->rows_per_strip = UINT32_MAX;
+
+	nof_entries = depressTiffRead(&r, ifd, 2);
+	for(e = 0; e < nof_entries; e++) {
+		size_t entry = ifd+2+(size_t)e*12;
+		uint32_t value = 0;
+		bool is_read = true;
+
+		switch(depressTiffRead(&r, entry, 2)) {
+			case DEPRESS_TIFF_TAG_IMAGE_WIDTH:
+				is_read = depressTiffGetValue(&r, entry, &page->width);
+				break;
+			case DEPRESS_TIFF_TAG_IMAGE_LENGTH:
+				is_read = depressTiffGetValue(&r, entry, &page->height);
+				break;
+			case DEPRESS_TIFF_TAG_BITS_PER_SAMPLE: // The same for all samples
+				is_read = depressTiffGetValue(&r, entry, &value);
+				page->bits_per_sample = value;
+				break;
+			case DEPRESS_TIFF_TAG_COMPRESSION:
+				is_read = depressTiffGetValue(&r, entry, &value);
+				page->compression = value;
+				break;
+			case DEPRESS_TIFF_TAG_PHOTOMETRIC:
+				is_read = depressTiffGetValue(&r, entry, &value);
+				page->photometric = value;
+				has_photometric = true;
+				break;
+			case DEPRESS_TIFF_TAG_FILL_ORDER:
+				is_read = depressTiffGetValue(&r, entry, &value);
+				page->fill_order = value;
+				break;
+			case DEPRESS_TIFF_TAG_STRIP_OFFSETS:
+				if(offsets) goto EXIT;
+				is_read = depressTiffGetValues(&r, entry, &offsets, &nof_offsets);
+				break;
+			case DEPRESS_TIFF_TAG_ORIENTATION:
+				is_read = depressTiffGetValue(&r, entry, &value);
+				page->orientation = value;
+				break;
+			case DEPRESS_TIFF_TAG_SAMPLES_PER_PIXEL:
+				is_read = depressTiffGetValue(&r, entry, &value);
+				page->samples_per_pixel = value;
+				break;
+			case DEPRESS_TIFF_TAG_ROWS_PER_STRIP:
+				is_read = depressTiffGetValue(&r, entry, &page->rows_per_strip);
+				break;
+			case DEPRESS_TIFF_TAG_STRIP_BYTE_COUNTS:
+				if(sizes) goto EXIT;
+				is_read = depressTiffGetValues(&r, entry, &sizes, &nof_sizes);
+				break;
+			case DEPRESS_TIFF_TAG_PLANAR_CONFIG:
+				is_read = depressTiffGetValue(&r, entry, &value);
+				page->planar_config = value;
+				break;
+			case DEPRESS_TIFF_TAG_T6_OPTIONS:
+				is_read = depressTiffGetValue(&r, entry, &page->t6_options);
+				break;
+			case DEPRESS_TIFF_TAG_PREDICTOR:
+				is_read = depressTiffGetValue(&r, entry, &value);
+				page->predictor = value;
+				break;
+			case DEPRESS_TIFF_TAG_COLORMAP:
+				if(colormap) goto EXIT;
+				is_read = depressTiffGetValues(&r, entry, &colormap, &nof_colormap);
+				break;
+			case DEPRESS_TIFF_TAG_TILE_WIDTH: // Tiled images are not supported
+				goto EXIT;
+		}
+
+		if(!is_read) goto EXIT;
+	}
+
+	if(!page->width || !page->height || !offsets || !sizes) goto EXIT;
+	if(!page->bits_per_sample || !page->samples_per_pixel || page->bits_per_sample > 16 || page->samples_per_pixel > 8) goto EXIT;
+	if(page->planar_config != 1 && page->planar_config != 2) goto EXIT;
+	if(page->orientation < 1 || page->orientation > 8) goto EXIT;
+
+	// Bilevel and gray images may go without photometric interpretation
+	if(!has_photometric && page->samples_per_pixel != 1) goto EXIT;
+
+	if(page->rows_per_strip == 0 || page->rows_per_strip > page->height) page->rows_per_strip = page->height;
+	strips_per_plane = (page->height-1)/page->rows_per_strip+1;
+	page->nof_strips = strips_per_plane;
+	if(page->planar_config == 2) page->nof_strips *= page->samples_per_pixel;
+	if(nof_offsets < page->nof_strips || nof_sizes < page->nof_strips) goto EXIT;
+
+	page->strips = malloc(page->nof_strips*sizeof(const unsigned char *));
+	page->strip_sizes = malloc(page->nof_strips*sizeof(size_t));
+	if(!page->strips || !page->strip_sizes) goto EXIT;
+
+	for(i = 0; i < page->nof_strips; i++) {
+		if(offsets[i] > size || size-offsets[i] < sizes[i]) goto EXIT;
+
+		page->strips[i] = data+offsets[i];
+		page->strip_sizes[i] = sizes[i];
+	}
+
+	// Colormap has 3 values for every possible sample value
+	if(colormap && page->bits_per_sample <= 8 && nof_colormap >= (size_t)3 << page->bits_per_sample) {
+		page->nof_colormap = (size_t)1 << page->bits_per_sample;
+		page->colormap = malloc(3*page->nof_colormap*sizeof(uint16_t));
+		if(!page->colormap) goto EXIT;
+
+		for(i = 0; i < 3*page->nof_colormap; i++)
+			page->colormap[i] = (uint16_t)colormap[i];
+	}
+
+	success = true;
+
+EXIT:
+	if(offsets) free(offsets);
+	if(sizes) free(sizes);
+	if(colormap) free(colormap);
+	if(!success) depressTiffFreePage(page);
+
+	return success;
+}
+
+void depressTiffFreePage(depress_tiff_page_type *page)
+{
+	if(page->strips) free((void *)page->strips);
+	if(page->strip_sizes) free(page->strip_sizes);
+	if(page->colormap) free(page->colormap);
+
+	memset(page, 0, sizeof(depress_tiff_page_type));
+}
+
+static bool depressTiffDecodePackBits(const unsigned char *in, size_t in_size, unsigned char *out, size_t out_size)
+{
+	size_t in_pos = 0, out_pos = 0, n;
+
+	while(in_pos < in_size && out_pos < out_size) {
+		int header = (signed char)in[in_pos++];
+
+		if(header >= 0) { // Literal bytes
+			n = (size_t)header+1;
+			if(n > in_size-in_pos) n = in_size-in_pos;
+			if(n > out_size-out_pos) n = out_size-out_pos;
+			memcpy(out+out_pos, in+in_pos, n);
+			in_pos += (size_t)header+1;
+			out_pos += n;
+		} else if(header != -128) { // Repeated byte
+			if(in_pos >= in_size) break;
+			n = (size_t)(1-header);
+			if(n > out_size-out_pos) n = out_size-out_pos;
+			memset(out+out_pos, in[in_pos++], n);
+			out_pos += n;
+		}
+	}
+
+	return true;
+}
+
+// Codes are from 9 to 12 bits, the highest bit first, and code size grows one code earlier than needed
+static bool depressTiffDecodeLzw(const unsigned char *in, size_t in_size, unsigned char *out, size_t out_size)
+{
+	unsigned short prefix[4096], length[4096];
+	unsigned char suffix[4096], first[4096];
+	size_t bit_pos = 0, out_pos = 0;
+	unsigned int code_size = 9, next = 258, code;
+	int prev = -1;
+
+	// Old style LZW (the lowest bit first) is not supported
+	if(in_size >= 2 && in[0] == 0 && (in[1] & 1)) return false;
+
+	for(code = 0; code < 256; code++) {
+		prefix[code] = 0;
+		length[code] = 1;
+		suffix[code] = first[code] = (unsigned char)code;
+	}
+
+	while(out_pos < out_size && bit_pos+code_size <= 8*in_size) {
+		size_t byte = bit_pos/8, i;
+		uint32_t acc;
+
+		acc = (uint32_t)in[byte] << 16;
+		if(byte+1 < in_size) acc |= (uint32_t)in[byte+1] << 8;
+		if(byte+2 < in_size) acc |= in[byte+2];
+		code = (acc >> (24-code_size-bit_pos%8)) & ((1u << code_size)-1);
+		bit_pos += code_size;
+
+		if(code == 256) { // Clear
+			code_size = 9;
+			next = 258;
+			prev = -1;
+			continue;
+		}
+		if(code == 257) break; // End of information
+
+		if(prev < 0) {
+			if(code > 255) return false;
+			out[out_pos++] = (unsigned char)code;
+			prev = (int)code;
+			continue;
+		}
+
+		if(code > next || (code == next && next == 4096)) return false;
+
+		// New string is the previous one and the first byte of the current one
+		if(next < 4096) {
+			prefix[next] = (unsigned short)prev;
+			suffix[next] = (code == next)?first[prev]:first[code];
+			first[next] = first[prev];
+			length[next] = (unsigned short)(length[prev]+1);
+			next++;
+		}
+
+		// String is written from the end
+		{
+			unsigned int c = code;
+
+			for(i = length[code]; i > 0; i--) {
+				if(out_pos+i-1 < out_size) out[out_pos+i-1] = suffix[c];
+				c = prefix[c];
+			}
+			out_pos += length[code];
+			if(out_pos > out_size) out_pos = out_size;
+		}
+
+		prev = (int)code;
+
+		if(next+1 >= (1u << code_size) && code_size < 12) code_size++;
+	}
+
+	return true;
+}
+
+static void depressTiffReverseBits(unsigned char *p, size_t size)
+{
+	size_t i;
+
+	for(i = 0; i < size; i++) {
+		unsigned char b = p[i];
+
+		b = (unsigned char)((b >> 4) | (b << 4));
+		b = (unsigned char)(((b >> 2) & 0x33) | ((b & 0x33) << 2));
+		p[i] = (unsigned char)(((b >> 1) & 0x55) | ((b & 0x55) << 1));
+	}
+}
+
+// Horizontal differencing, every sample is stored as difference with the same sample of the previous pixel
+static bool depressTiffUndoPredictor(const depress_tiff_page_type *page, unsigned char *rows, size_t nof_rows, size_t row_size)
+{
+	size_t samples, y, i;
+
+	samples = (page->planar_config == 2)?1:page->samples_per_pixel;
+
+	for(y = 0; y < nof_rows; y++) {
+		unsigned char *row = rows+y*row_size;
+
+		if(page->bits_per_sample == 8) {
+			for(i = samples; i < (size_t)page->width*samples; i++)
+				row[i] = (unsigned char)(row[i]+row[i-samples]);
+		} else if(page->bits_per_sample == 16) {
+			for(i = samples; i < (size_t)page->width*samples; i++) {
+				unsigned char *p = row+2*i, *q = row+2*(i-samples);
+				unsigned int v;
+
+				if(page->big_endian) {
+					v = (((unsigned int)p[0] << 8) | p[1]) + (((unsigned int)q[0] << 8) | q[1]);
+					p[0] = (unsigned char)(v >> 8);
+					p[1] = (unsigned char)v;
+				} else {
+					v = (((unsigned int)p[1] << 8) | p[0]) + (((unsigned int)q[1] << 8) | q[0]);
+					p[0] = (unsigned char)v;
+					p[1] = (unsigned char)(v >> 8);
+				}
+			}
+		} else
+			return false;
+	}
+
+	return true;
+}
+
+// Decodes strip into rows of raw samples
+static bool depressTiffDecodeStrip(const depress_tiff_page_type *page, size_t strip, unsigned char *rows, size_t nof_rows, size_t row_size)
+{
+	const unsigned char *in;
+	unsigned char *reversed = 0;
+	size_t in_size, out_size;
+	bool success = false;
+
+	in = page->strips[strip];
+	in_size = page->strip_sizes[strip];
+	out_size = nof_rows*row_size;
+
+	if(page->fill_order == 2) {
+		reversed = malloc(in_size?in_size:1);
+		if(!reversed) return false;
+
+		memcpy(reversed, in, in_size);
+		depressTiffReverseBits(reversed, in_size);
+		in = reversed;
+	}
+
+	switch(page->compression) {
+		case DEPRESS_TIFF_COMPRESSION_NONE:
+			memcpy(rows, in, (in_size < out_size)?in_size:out_size);
+			success = true;
+			break;
+		case DEPRESS_TIFF_COMPRESSION_CCITT_G4:
+			success = depressMmrDecode(in, in_size, page->width, (unsigned int)nof_rows, rows, row_size);
+			break;
+		case DEPRESS_TIFF_COMPRESSION_LZW:
+			success = depressTiffDecodeLzw(in, in_size, rows, out_size);
+			break;
+		case DEPRESS_TIFF_COMPRESSION_DEFLATE:
+		case DEPRESS_TIFF_COMPRESSION_DEFLATE_OLD:
+			// Some writers pad the last strip to full rows_per_strip, so the extra rows are dropped
+			if(in_size <= INT_MAX && out_size <= INT_MAX) {
+				char *inflated;
+				int inflated_size = 0;
+
+				inflated = stbi_zlib_decode_malloc_guesssize((const char *)in, (int)in_size, (int)out_size, &inflated_size);
+				if(inflated) {
+					memcpy(rows, inflated, ((size_t)inflated_size < out_size)?(size_t)inflated_size:out_size);
+					free(inflated);
+					success = true;
+				}
+			}
+			break;
+		case DEPRESS_TIFF_COMPRESSION_PACKBITS:
+			success = depressTiffDecodePackBits(in, in_size, rows, out_size);
+			break;
+	}
+
+	if(success && page->predictor == 2)
+		success = depressTiffUndoPredictor(page, rows, nof_rows, row_size);
+
+	if(reversed) free(reversed);
+
+	return success;
+}
+
+// Reads sample scaled to 8 bits (or index of palette), samples of 1, 2 and 4 bits don't cross bytes
+static unsigned int depressTiffGetSample(const depress_tiff_page_type *page, const unsigned char *row, size_t index)
+{
+	size_t bit;
+	unsigned int max_value;
+
+	switch(page->bits_per_sample) {
+		case 8:
+			return row[index];
+		case 16: // The highest byte
+			return page->big_endian?row[2*index]:row[2*index+1];
+		default:
+			bit = index*page->bits_per_sample;
+			max_value = (1u << page->bits_per_sample)-1;
+
+			return (row[bit/8] >> (8-page->bits_per_sample-bit%8)) & max_value;
+	}
+}
+
+static bool depressTiffIsPageSupported(const depress_tiff_page_type *page)
+{
+	switch(page->compression) {
+		case DEPRESS_TIFF_COMPRESSION_NONE:
+		case DEPRESS_TIFF_COMPRESSION_LZW:
+		case DEPRESS_TIFF_COMPRESSION_DEFLATE:
+		case DEPRESS_TIFF_COMPRESSION_DEFLATE_OLD:
+		case DEPRESS_TIFF_COMPRESSION_PACKBITS:
+			break;
+		case DEPRESS_TIFF_COMPRESSION_CCITT_G4:
+			if(page->bits_per_sample != 1 || page->samples_per_pixel != 1) return false;
+			break;
+		default:
+			return false;
+	}
+
+	if(page->bits_per_sample != 1 && page->bits_per_sample != 2 && page->bits_per_sample != 4 && page->bits_per_sample != 8 && page->bits_per_sample != 16)
+		return false;
+	if(page->predictor != 1 && page->predictor != 2) return false;
+
+	switch(page->photometric) {
+		case DEPRESS_TIFF_PHOTOMETRIC_WHITE_IS_ZERO:
+		case DEPRESS_TIFF_PHOTOMETRIC_BLACK_IS_ZERO:
+			return true;
+		case DEPRESS_TIFF_PHOTOMETRIC_RGB:
+			return page->samples_per_pixel >= 3;
+		case DEPRESS_TIFF_PHOTOMETRIC_PALETTE:
+			return page->samples_per_pixel == 1 && page->colormap;
+		default:
+			return false;
+	}
+}
+
+// Turns decoded page so its rows go from top and columns from left
+static bool depressTiffApplyOrientation(unsigned char **buf, int *sizex, int *sizey, int channels, unsigned int orientation)
+{
+	unsigned char *turned;
+	int width, height, y;
+
+	if(orientation == 1) return true;
+
+	// Rows of stored page are columns of turned one
+	width = (orientation >= 5)?*sizey:*sizex;
+	height = (orientation >= 5)?*sizex:*sizey;
+
+	turned = malloc((size_t)width*height*channels);
+	if(!turned) return false;
+
+#pragma omp parallel for
+	for(y = 0; y < height; y++) {
+		unsigned char *out = turned+(size_t)y*width*channels;
+		int x, sx, sy;
+
+		for(x = 0; x < width; x++) {
+			switch(orientation) {
+				case 2: sx = width-1-x; sy = y; break;
+				case 3: sx = width-1-x; sy = height-1-y; break;
+				case 4: sx = x; sy = height-1-y; break;
+				case 5: sx = y; sy = x; break;
+				case 6: sx = y; sy = width-1-x; break;
+				case 7: sx = height-1-y; sy = width-1-x; break;
+				default: sx = height-1-y; sy = x; break; // 8
+			}
+
+			memcpy(out+(size_t)x*channels, *buf+((size_t)sy*(*sizex)+sx)*channels, channels);
+		}
+	}
+
+	free(*buf);
+	*buf = turned;
+	*sizex = width;
+	*sizey = height;
+
+	return true;
+}
+
+bool depressTiffDecodePage(const unsigned char *data, size_t size, size_t ifd, int *sizex, int *sizey, int *channels, unsigned char **buf)
+{
+	depress_tiff_page_type page;
+	unsigned char *raw = 0;
+	size_t row_size, plane_size, strips_per_plane, nof_planes, samples_in_row;
+	unsigned int max_value;
+	int s, y, failed = 0;
+	bool success = false;
+
+	*buf = 0;
+
+	if(!depressTiffReadPage(data, size, ifd, &page)) return false;
+	if(!depressTiffIsPageSupported(&page)) goto EXIT;
+	if(page.width > INT_MAX || page.height > INT_MAX || page.nof_strips > INT_MAX) goto EXIT;
+
+	nof_planes = (page.planar_config == 2)?page.samples_per_pixel:1;
+	samples_in_row = (page.planar_config == 2)?1:page.samples_per_pixel;
+	if(page.width > (SIZE_MAX-7)/16/samples_in_row) goto EXIT;
+	row_size = ((size_t)page.width*samples_in_row*page.bits_per_sample+7)/8;
+	if(SIZE_MAX/nof_planes/row_size < page.height || SIZE_MAX/3/page.width < page.height) goto EXIT;
+	plane_size = row_size*page.height;
+	strips_per_plane = page.nof_strips/nof_planes;
+
+	raw = calloc(nof_planes, plane_size);
+	if(!raw) goto EXIT;
+
+	// Strips are compressed independently
+#pragma omp parallel for reduction(+:failed)
+	for(s = 0; s < (int)page.nof_strips; s++) {
+		size_t plane, first_row, nof_rows;
+
+		plane = (size_t)s/strips_per_plane;
+		first_row = ((size_t)s%strips_per_plane)*page.rows_per_strip;
+		nof_rows = page.height-first_row;
+		if(nof_rows > page.rows_per_strip) nof_rows = page.rows_per_strip;
+
+		if(!depressTiffDecodeStrip(&page, (size_t)s, raw+plane*plane_size+first_row*row_size, nof_rows, row_size)) failed++;
+	}
+	if(failed) goto EXIT;
+
+	*channels = (page.photometric == DEPRESS_TIFF_PHOTOMETRIC_RGB || page.photometric == DEPRESS_TIFF_PHOTOMETRIC_PALETTE)?3:1;
+	max_value = (page.bits_per_sample < 8)?((1u << page.bits_per_sample)-1):255;
+	*buf = malloc((size_t)page.width*page.height*(*channels));
+	if(!*buf) goto EXIT;
+
+#pragma omp parallel for
+	for(y = 0; y < (int)page.height; y++) {
+		unsigned char *out = *buf+(size_t)y*page.width*(*channels);
+		const unsigned char *row = raw+(size_t)y*row_size;
+		size_t x;
+
+		if(page.photometric == DEPRESS_TIFF_PHOTOMETRIC_PALETTE) {
+			for(x = 0; x < page.width; x++) {
+				unsigned int index = depressTiffGetSample(&page, row, x);
+
+				out[3*x] = (unsigned char)(page.colormap[index] >> 8);
+				out[3*x+1] = (unsigned char)(page.colormap[page.nof_colormap+index] >> 8);
+				out[3*x+2] = (unsigned char)(page.colormap[2*page.nof_colormap+index] >> 8);
+			}
+		} else if(page.photometric == DEPRESS_TIFF_PHOTOMETRIC_RGB) {
+			size_t c;
+
+			for(c = 0; c < 3; c++) {
+				const unsigned char *plane_row = row+((page.planar_config == 2)?c*plane_size:0);
+
+				for(x = 0; x < page.width; x++) {
+					unsigned int v = depressTiffGetSample(&page, plane_row, (page.planar_config == 2)?x:x*samples_in_row+c);
+
+					if(max_value != 255) v = v*255/max_value;
+					out[3*x+c] = (unsigned char)v;
+				}
+			}
+		} else {
+			unsigned int v;
+
+			// Extra samples (like alpha) are skipped
+			for(x = 0; x < page.width; x++) {
+				v = depressTiffGetSample(&page, row, x*samples_in_row);
+				if(max_value != 255) v = v*255/max_value;
+
+				out[x] = (unsigned char)((page.photometric == DEPRESS_TIFF_PHOTOMETRIC_WHITE_IS_ZERO)?(255-v):v);
+			}
+		}
+	}
+
+	*sizex = (int)page.width;
+	*sizey = (int)page.height;
+
+	if(!depressTiffApplyOrientation(buf, sizex, sizey, *channels, page.orientation)) goto EXIT;
+
+	success = true;
+
+EXIT:
+	if(raw) free(raw);
+	if(!success && *buf) {
+		free(*buf);
+		*buf = 0;
+	}
+	depressTiffFreePage(&page);
+
+	return success;
+}
+
+static void depressTiffWrite(unsigned char *p, uint32_t v, unsigned int bytes, bool big_endian)
+{
+	unsigned int i;
+
+	for(i = 0; i < bytes; i++)
+		p[big_endian?(bytes-i-1):i] = (unsigned char)(v >> (8*i));
+}
+
+// Writes IFD entry with the value or position of values
+static void depressTiffWriteEntry(unsigned char *entry, unsigned int tag, unsigned int type, uint32_t count, uint32_t value, bool big_endian)
+{
+	depressTiffWrite(entry, tag, 2, big_endian);
+	depressTiffWrite(entry+2, type, 2, big_endian);
+	depressTiffWrite(entry+4, count, 4, big_endian);
+	// Single short value is in the first half of the field
+	if(type == DEPRESS_TIFF_TYPE_SHORT && count == 1)
+		depressTiffWrite(entry+8, value, 2, big_endian);
+	else
+		depressTiffWrite(entry+8, value, 4, big_endian);
+}
+
+bool depressTiffExtractPage(const unsigned char *data, size_t size, size_t ifd, unsigned char **page_data, size_t *page_size)
+{
+	depress_tiff_page_type page;
+	unsigned char *p, *entry;
+	size_t total, strips_size = 0, offsets_pos, sizes_pos, colormap_pos, strip_pos, i;
+	unsigned int nof_entries;
+	bool success = false;
+
+	*page_data = 0;
+	*page_size = 0;
+
+	if(!depressTiffReadPage(data, size, ifd, &page)) return false;
+
+	// File has the same byte order as source, because 16 bit samples are copied as is
+	// Header, IFD, strip offsets and sizes, colormap, strips
+	nof_entries = page.colormap?15:14;
+	offsets_pos = 8+2+12*(size_t)nof_entries+4;
+	sizes_pos = offsets_pos+4*page.nof_strips;
+	colormap_pos = sizes_pos+4*page.nof_strips;
+	strip_pos = colormap_pos+6*page.nof_colormap;
+	for(i = 0; i < page.nof_strips; i++)
+		strips_size += page.strip_sizes[i];
+	total = strip_pos+strips_size;
+	if(strips_size > UINT32_MAX || total > UINT32_MAX) goto EXIT;
+
+	*page_data = calloc(total, 1);
+	if(!*page_data) goto EXIT;
+	p = *page_data;
+
+	memcpy(p, page.big_endian?"MM\0*":"II*\0", 4);
+	depressTiffWrite(p+4, 8, 4, page.big_endian);
+	depressTiffWrite(p+8, nof_entries, 2, page.big_endian);
+
+	entry = p+10;
+	depressTiffWriteEntry(entry, DEPRESS_TIFF_TAG_IMAGE_WIDTH, DEPRESS_TIFF_TYPE_LONG, 1, page.width, page.big_endian); entry += 12;
+	depressTiffWriteEntry(entry, DEPRESS_TIFF_TAG_IMAGE_LENGTH, DEPRESS_TIFF_TYPE_LONG, 1, page.height, page.big_endian); entry += 12;
+	depressTiffWriteEntry(entry, DEPRESS_TIFF_TAG_BITS_PER_SAMPLE, DEPRESS_TIFF_TYPE_SHORT, 1, page.bits_per_sample, page.big_endian); entry += 12;
+	depressTiffWriteEntry(entry, DEPRESS_TIFF_TAG_COMPRESSION, DEPRESS_TIFF_TYPE_SHORT, 1, page.compression, page.big_endian); entry += 12;
+	depressTiffWriteEntry(entry, DEPRESS_TIFF_TAG_PHOTOMETRIC, DEPRESS_TIFF_TYPE_SHORT, 1, page.photometric, page.big_endian); entry += 12;
+	depressTiffWriteEntry(entry, DEPRESS_TIFF_TAG_FILL_ORDER, DEPRESS_TIFF_TYPE_SHORT, 1, page.fill_order, page.big_endian); entry += 12;
+	depressTiffWriteEntry(entry, DEPRESS_TIFF_TAG_STRIP_OFFSETS, DEPRESS_TIFF_TYPE_LONG, (uint32_t)page.nof_strips,
+		(page.nof_strips == 1)?(uint32_t)strip_pos:(uint32_t)offsets_pos, page.big_endian); entry += 12;
+	depressTiffWriteEntry(entry, DEPRESS_TIFF_TAG_ORIENTATION, DEPRESS_TIFF_TYPE_SHORT, 1, page.orientation, page.big_endian); entry += 12;
+	depressTiffWriteEntry(entry, DEPRESS_TIFF_TAG_SAMPLES_PER_PIXEL, DEPRESS_TIFF_TYPE_SHORT, 1, page.samples_per_pixel, page.big_endian); entry += 12;
+	depressTiffWriteEntry(entry, DEPRESS_TIFF_TAG_ROWS_PER_STRIP, DEPRESS_TIFF_TYPE_LONG, 1, page.rows_per_strip, page.big_endian); entry += 12;
+	depressTiffWriteEntry(entry, DEPRESS_TIFF_TAG_STRIP_BYTE_COUNTS, DEPRESS_TIFF_TYPE_LONG, (uint32_t)page.nof_strips,
+		(page.nof_strips == 1)?(uint32_t)strips_size:(uint32_t)sizes_pos, page.big_endian); entry += 12;
+	depressTiffWriteEntry(entry, DEPRESS_TIFF_TAG_PLANAR_CONFIG, DEPRESS_TIFF_TYPE_SHORT, 1, page.planar_config, page.big_endian); entry += 12;
+	depressTiffWriteEntry(entry, DEPRESS_TIFF_TAG_T6_OPTIONS, DEPRESS_TIFF_TYPE_LONG, 1, page.t6_options, page.big_endian); entry += 12;
+	depressTiffWriteEntry(entry, DEPRESS_TIFF_TAG_PREDICTOR, DEPRESS_TIFF_TYPE_SHORT, 1, page.predictor, page.big_endian); entry += 12;
+	if(page.colormap) {
+		depressTiffWriteEntry(entry, DEPRESS_TIFF_TAG_COLORMAP, DEPRESS_TIFF_TYPE_SHORT, (uint32_t)(3*page.nof_colormap), (uint32_t)colormap_pos, page.big_endian);
+		entry += 12;
+	}
+	depressTiffWrite(entry, 0, 4, page.big_endian); // No next IFD
+
+	for(i = 0; i < 3*page.nof_colormap; i++)
+		depressTiffWrite(p+colormap_pos+2*i, page.colormap[i], 2, page.big_endian);
+
+	for(i = 0; i < page.nof_strips; i++) {
+		depressTiffWrite(p+offsets_pos+4*i, (uint32_t)strip_pos, 4, page.big_endian);
+		depressTiffWrite(p+sizes_pos+4*i, (uint32_t)page.strip_sizes[i], 4, page.big_endian);
+		if(page.strip_sizes[i]) memcpy(p+strip_pos, page.strips[i], page.strip_sizes[i]);
+		strip_pos += page.strip_sizes[i];
+	}
+
+	*page_size = total;
+	success = true;
+
+EXIT:
+	depressTiffFreePage(&page);
+
+	return success;
+}
@@ -0,0 +1,261 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if defined(_DEBUG) && defined(USE_STB_LEAKCHECK)
+#include "third_party/stb_leakcheck.h"
+#endif
+
+#include "../include/depress_zip.h"
+
+#include "third_party/stb_image.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEPRESS_ZIP_LOCAL_HEADER_SIGNATURE 0x04034b50
+#define DEPRESS_ZIP_CENTRAL_HEADER_SIGNATURE 0x02014b50
+#define DEPRESS_ZIP_END_SIGNATURE 0x06054b50
+
+#define DEPRESS_ZIP_LOCAL_HEADER_SIZE 30
+#define DEPRESS_ZIP_CENTRAL_HEADER_SIZE 46
+#define DEPRESS_ZIP_END_SIZE 22
+#define DEPRESS_ZIP_MAX_COMMENT 65535
+
+#define DEPRESS_ZIP_FLAG_ENCRYPTED 0x1
+#define DEPRESS_ZIP_FLAG_UTF8 0x800
+
+// Reads little endian number of 2 or 4 bytes, pos must be checked by caller
+static uint32_t depressZipRead(const unsigned char *data, size_t pos, unsigned int bytes)
+{
+	uint32_t value = 0;
+	unsigned int i;
+
+	for(i = 0; i < bytes; i++)
+		value |= (uint32_t)data[pos+i] << (8*i);
+
+	return value;
+}
+
+bool depressZipIsZip(const unsigned char *data, size_t size)
+{
+	if(size < DEPRESS_ZIP_END_SIZE) return false;
+
+	// Archive starts with the first file or, if it's empty, with end of central directory
+	return depressZipRead(data, 0, 4) == DEPRESS_ZIP_LOCAL_HEADER_SIGNATURE || depressZipRead(data, 0, 4) == DEPRESS_ZIP_END_SIGNATURE;
+}
+
+// Names are in UTF-8, old archivers use OEM code page, so its bytes are taken as is
+static wchar_t *depressZipDecodeName(const unsigned char *name, size_t length)
+{
+	wchar_t *wname, *p;
+	size_t i;
+	bool is_utf8 = true;
+
+	wname = malloc((length+1)*sizeof(wchar_t));
+	if(!wname) return 0;
+
+	p = wname;
+	for(i = 0; i < length && is_utf8;) {
+		uint32_t c = name[i];
+		size_t n, j;
+
+		if(c < 0x80) n = 0;
+		else if((c & 0xe0) == 0xc0) { n = 1; c &= 0x1f; }
+		else if((c & 0xf0) == 0xe0) { n = 2; c &= 0x0f; }
+		else if((c & 0xf8) == 0xf0) { n = 3; c &= 0x07; }
+		else break;
+
+		if(n > length-i-1) break;
+		for(j = 1; j <= n; j++) {
+			if((name[i+j] & 0xc0) != 0x80) is_utf8 = false;
+			c = (c << 6) | (name[i+j] & 0x3f);
+		}
+		if(!is_utf8 || c > 0x10ffff) break;
+
+#if WCHAR_MAX <= 0xffff
+		if(c >= 0x10000) { // Surrogate pair
+			*p++ = (wchar_t)(0xd800+((c-0x10000) >> 10));
+			c = 0xdc00+((c-0x10000) & 0x3ff);
+		}
+#endif
+		*p++ = (wchar_t)c;
+		i += n+1;
+	}
+
+	if(i < length) {
+		p = wname;
+		for(i = 0; i < length; i++)
+			*p++ = name[i];
+	}
+
+	*p = 0;
+
+	return wname;
+}
+
+bool depressZipGetEntries(const unsigned char *data, size_t size, depress_zip_entry_type **entries, size_t *nof_entries)
+{
+	size_t pos, last_pos, cd_pos, cd_size, max_entries, i;
+
+	*entries = 0;
+	*nof_entries = 0;
+
+	if(!depressZipIsZip(data, size)) return false;
+
+	// End of central directory is followed by comment
+	pos = size-DEPRESS_ZIP_END_SIZE;
+	last_pos = (pos > DEPRESS_ZIP_MAX_COMMENT)?(pos-DEPRESS_ZIP_MAX_COMMENT):0;
+	while(depressZipRead(data, pos, 4) != DEPRESS_ZIP_END_SIGNATURE) {
+		if(pos == last_pos) return false;
+		pos--;
+	}
+
+	// ZIP64 archives are not supported
+	max_entries = depressZipRead(data, pos+10, 2);
+	cd_size = depressZipRead(data, pos+12, 4);
+	cd_pos = depressZipRead(data, pos+16, 4);
+	if(max_entries == 0xffff || cd_size == 0xffffffff || cd_pos == 0xffffffff) return false;
+	if(cd_pos > pos || pos-cd_pos < cd_size) return false;
+
+	if(!max_entries) return true;
+
+	*entries = calloc(max_entries, sizeof(depress_zip_entry_type));
+	if(!*entries) return false;
+
+	pos = cd_pos;
+	for(i = 0; i < max_entries; i++) {
+		depress_zip_entry_type *entry = *entries+i;
+		size_t name_length, header_size;
+
+		if(cd_pos+cd_size-pos < DEPRESS_ZIP_CENTRAL_HEADER_SIZE) goto LABEL_ERROR;
+		if(depressZipRead(data, pos, 4) != DEPRESS_ZIP_CENTRAL_HEADER_SIGNATURE) goto LABEL_ERROR;
+
+		name_length = depressZipRead(data, pos+28, 2);
+		header_size = DEPRESS_ZIP_CENTRAL_HEADER_SIZE+name_length+depressZipRead(data, pos+30, 2)+depressZipRead(data, pos+32, 2);
+		if(cd_pos+cd_size-pos < header_size) goto LABEL_ERROR;
+
+		entry->flags = depressZipRead(data, pos+8, 2);
+		entry->method = depressZipRead(data, pos+10, 2);
+		entry->crc32 = depressZipRead(data, pos+16, 4);
+		entry->compressed_size = depressZipRead(data, pos+20, 4);
+		entry->size = depressZipRead(data, pos+24, 4);
+		entry->local_header = depressZipRead(data, pos+42, 4);
+		entry->name = depressZipDecodeName(data+pos+DEPRESS_ZIP_CENTRAL_HEADER_SIZE, name_length);
+		if(!entry->name) goto LABEL_ERROR;
+
+		(*nof_entries)++;
+		pos += header_size;
+	}
+
+	return true;
+
+LABEL_ERROR:
+	depressZipFreeEntries(*entries, *nof_entries);
+	*entries = 0;
+	*nof_entries = 0;
+
+	return false;
+}
+
+void depressZipFreeEntries(depress_zip_entry_type *entries, size_t nof_entries)
+{
+	size_t i;
+
+	if(!entries) return;
+
+	for(i = 0; i < nof_entries; i++)
+		if(entries[i].name) free(entries[i].name);
+
+	free(entries);
+}
+
+// CRC-32 with reversed polynomial 0xedb88320, table is made for every file, so it's thread safe
+static uint32_t depressZipCrc32(const unsigned char *data, size_t size)
+{
+	uint32_t table[256], crc;
+	size_t i;
+
+	for(i = 0; i < 256; i++) {
+		unsigned int k;
+
+		crc = (uint32_t)i;
+		for(k = 0; k < 8; k++)
+			crc = (crc & 1)?(0xedb88320 ^ (crc >> 1)):(crc >> 1);
+		table[i] = crc;
+	}
+
+	crc = 0xffffffff;
+	for(i = 0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+	return crc ^ 0xffffffff;
+}
+
+bool depressZipReadEntry(const unsigned char *data, size_t size, const depress_zip_entry_type *entry, unsigned char **entry_data, size_t *entry_size)
+{
+	size_t pos;
+
+	*entry_data = 0;
+	*entry_size = 0;
+
+	if(entry->flags & DEPRESS_ZIP_FLAG_ENCRYPTED) return false;
+	if(entry->method != 0 && entry->method != 8) return false;
+	if(entry->compressed_size > INT_MAX || entry->size > INT_MAX || !entry->size) return false;
+
+	// Sizes in local header may be zero, so they are taken from central directory
+	pos = entry->local_header;
+	if(pos > size || size-pos < DEPRESS_ZIP_LOCAL_HEADER_SIZE) return false;
+	if(depressZipRead(data, pos, 4) != DEPRESS_ZIP_LOCAL_HEADER_SIGNATURE) return false;
+	pos += DEPRESS_ZIP_LOCAL_HEADER_SIZE+depressZipRead(data, pos+26, 2)+depressZipRead(data, pos+28, 2);
+	if(pos > size || size-pos < entry->compressed_size) return false;
+
+	*entry_data = malloc(entry->size);
+	if(!*entry_data) return false;
+
+	if(entry->method == 0) {
+		if(entry->compressed_size != entry->size) goto LABEL_ERROR;
+
+		memcpy(*entry_data, data+pos, entry->size);
+	} else {
+		if(stbi_zlib_decode_noheader_buffer((char *)*entry_data, (int)entry->size, (const char *)data+pos, (int)entry->compressed_size) != (int)entry->size)
+			goto LABEL_ERROR;
+	}
+
+	if(depressZipCrc32(*entry_data, entry->size) != entry->crc32) goto LABEL_ERROR;
+
+	*entry_size = entry->size;
+
+	return true;
+
+LABEL_ERROR:
+	free(*entry_data);
+	*entry_data = 0;
+
+	return false;
+}
@@ -262,7 +262,7 @@ static bool depressedPagesInsert(int value)
 	}
 
 	IupSetAttribute(adddlg, "DIALOGTYPE", "OPEN");
-	IupSetAttribute(adddlg, "EXTFILTER", "Images (*.jpg;*.bmp;*.png)|*.jpg;*.bmp;*.png|All files (*.*)|*.*|");
+	IupSetAttribute(adddlg, "EXTFILTER", "Images (*.jpg;*.bmp;*.png;*.tif;*.tiff)|*.jpg;*.bmp;*.png;*.tif;*.tiff|All files (*.*)|*.*|");
 
 	IupPopup(adddlg, IUP_CENTER, IUP_CENTER);
 
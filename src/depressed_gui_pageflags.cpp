@@ -50,9 +50,13 @@ static void depressedPageChangeTextsByType(SDepressedAppGuiPageFlags &gui_pagefl
 	switch(type) {
 		case 1:
 			show_param1 = true;
+			show_param2 = true;
 			IupSetAttribute(gui_pageflags.param1_label, "TITLE", "Type of binarization");
 			IupRefresh(gui_pageflags.param1_label);
+			IupSetAttribute(gui_pageflags.param2_label, "TITLE", "Error diffusion kernel");
+			IupRefresh(gui_pageflags.param2_label);
 			IupSetAttribute(gui_pageflags.param1, "TIP", "0 - threshold (default)\n1 - error diffusion\n2 - adaptive");
+			IupSetAttribute(gui_pageflags.param2, "TIP", "0 - Floyd-Steinberg (default)\n1 - Stucki");
 			break;
 		case 2:
 			show_param1 = true;
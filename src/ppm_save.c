@@ -117,3 +117,80 @@ bool pbmRleSave(unsigned int sizex, unsigned int sizey, unsigned char* buf, FILE
 	return true;
 }
 
+// buf has rows of stride bytes, already packed as in PBM
+bool pbmSavePacked(unsigned int sizex, unsigned int sizey, size_t stride, unsigned char *buf, FILE *f)
+{
+	size_t fileline, i;
+
+	if(sizex == 0 || sizey == 0) return false;
+	if(!buf || !f) return false;
+
+	fileline = (size_t)sizex/8;
+	if((size_t)sizex%8 > 0) fileline++;
+
+	if(stride < fileline) return false;
+
+	fprintf(f, "P4\n%u %u\n", sizex, sizey);
+	for(i = 0; i < (size_t)sizey; i++)
+		if(fwrite(buf+i*stride, fileline, 1, f) != 1) return false;
+
+	return true;
+}
+
+#define PPM_RLE_TRANSPARENT 0xfff
+#define PPM_RLE_MAX_RUN 0xfffff
+#define PPM_RLE_BG_SUBSAMPLE 12
+
+static bool ppmRleSaveRun(unsigned int color, unsigned int length, FILE *f)
+{
+	unsigned char run[4];
+
+	run[0] = (unsigned char)(color >> 4);
+	run[1] = (unsigned char)(((color & 0xf) << 4) | (length >> 16));
+	run[2] = (unsigned char)(length >> 8);
+	run[3] = (unsigned char)length;
+
+	return fwrite(run, 4, 1, f) == 1;
+}
+
+/*
+	Saves palettized image in csepdjvu format: color RLE image (R6) with pixels of
+	the transparent color left for the background, followed by flat background
+	of the transparent color (PPM, subsampled by PPM_RLE_BG_SUBSAMPLE).
+	Runs are 32 bit big endian: 12 bits of color index, 20 bits of length.
+*/
+bool ppmRleSave(unsigned int sizex, unsigned int sizey, unsigned char *indices, unsigned char *palette, unsigned int colors, unsigned int transparent, FILE *f)
+{
+	size_t i, j, bg_size;
+	unsigned int bg_sizex, bg_sizey;
+
+	if(sizex == 0 || sizey == 0) return false;
+	if(!indices || !palette || !f) return false;
+	if(colors == 0 || colors > 256 || transparent >= colors) return false;
+
+	fprintf(f, "R6\n%u %u %u\n", sizex, sizey, colors);
+	if(fwrite(palette, 3*colors, 1, f) != 1) return false;
+
+	for(i = 0; i < sizey; i++) {
+		unsigned char *p = indices+i*sizex;
+
+		j = 0;
+		while(j < sizex) {
+			unsigned int color, length = 1;
+
+			color = p[j];
+			while(j+length < sizex && p[j+length] == color && length < PPM_RLE_MAX_RUN) length++;
+			if(!ppmRleSaveRun((color == transparent)?PPM_RLE_TRANSPARENT:color, length, f)) return false;
+			j += length;
+		}
+	}
+
+	bg_sizex = (sizex+PPM_RLE_BG_SUBSAMPLE-1)/PPM_RLE_BG_SUBSAMPLE;
+	bg_sizey = (sizey+PPM_RLE_BG_SUBSAMPLE-1)/PPM_RLE_BG_SUBSAMPLE;
+	bg_size = (size_t)bg_sizex*bg_sizey;
+	fprintf(f, "P6\n%u %u\n255\n", bg_sizex, bg_sizey);
+	for(i = 0; i < bg_size; i++)
+		if(fwrite(palette+3*transparent, 3, 1, f) != 1) return false;
+
+	return true;
+}
@@ -20,6 +20,8 @@ extern "C" {
 #endif
 
 DJVULAPI int ImageDjvulThreshold(unsigned char* buf, bool* bufmask, unsigned char* bufbg, unsigned char* buffg, unsigned int width, unsigned int height, unsigned int channels, unsigned int bgs, unsigned int level, int wbmode, float doverlay, float anisotropic, float contrast, float fbscale, float delta);
+DJVULAPI int ImageDjvulThresholdTiled(unsigned char* buf, bool* bufmask, unsigned char* bufbg, unsigned char* buffg, unsigned int width, unsigned int height, unsigned int channels, unsigned int bgs, unsigned int level, int wbmode, float doverlay, float anisotropic, float contrast, float fbscale, float delta, unsigned int tile, unsigned int halo);
+DJVULAPI int ImageDjvulThresholdMaskBits(unsigned char* buf, unsigned char* bufbits, unsigned int stride, unsigned char* bufbg, unsigned char* buffg, unsigned int width, unsigned int height, unsigned int channels, unsigned int bgs);
 DJVULAPI int ImageDjvulGround(unsigned char* buf, bool* bufmask, unsigned char* bufbg, unsigned char* buffg, unsigned int width, unsigned int height, unsigned int channels, unsigned int bgs, unsigned int level, float doverlay);
 DJVULAPI int ImageFGdownsample(unsigned char* buffg, unsigned int width, unsigned int height, unsigned int channels, unsigned int fgs);
 DJVULAPI int ImageDjvuReconstruct(unsigned char* buf, bool* bufmask, unsigned char* bufbg, unsigned char* buffg, unsigned int width, unsigned int height, unsigned int channels, unsigned int widthbg, unsigned int heightbg, unsigned int widthfg, unsigned int heightfg);
@@ -38,6 +40,9 @@ DJVULAPI int ImageDjvulSelect(unsigned char* buf, bool* bufmask, unsigned char*
 
 #ifdef DJVUL_IMPLEMENTATION
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "threshold.h"
 
 /*
@@ -55,7 +60,7 @@ fbscale = 1.0f [off, regulator]
 delta = 0.0f [off, regulator]
 
 output:
-bufmask - bool* image mask (height * width)
+bufmask - bool* image mask (height * width), may be NULL (see ImageDjvulThresholdMaskBits())
 bufbg, buffg - unsigned char* BG, FG (heightbg * widthbg * channels, heightbg = (height + bgs - 1) / bgs, widthbg = (width + bgs - 1) / bgs)
 level - use level
 
@@ -63,22 +68,428 @@ Use:
 int level = ImageDjvulThreshold(buf, bufmask, bufbg, buffg, width, height, channels, bgs, level, wbmode, doverlay, anisotropic, contrast, fbscale, delta);
 */
 
-DJVULAPI int ImageDjvulThreshold(unsigned char* buf, bool* bufmask, unsigned char* bufbg, unsigned char* buffg, unsigned int width, unsigned int height, unsigned int channels, unsigned int bgs, unsigned int level, int wbmode, float doverlay, float anisotropic, float contrast, float fbscale, float delta)
+/*
+ImageDjvulThresholdRow1(), ImageDjvulThresholdRow3(), ImageDjvulThresholdRowN()
+
+Mask of one row: pixel belongs to FG if it's closer to FG than to BG.
+buf, bufbg, buffg point to the row of the image and to the row of BG, FG.
+Rows for 1 and 3 channels have constant number of channels, so the compiler
+can unroll and vectorize them, ImageDjvulThresholdRowN() is for any channels.
+*/
+
+typedef void (*ImageDjvulThresholdRowFunc)(const unsigned char* buf, bool* mask, const unsigned char* bufbg, const unsigned char* buffg, unsigned int width, unsigned int channels, unsigned int bgs);
+
+#define DJVUL_THRESHOLD_ROW(name, CH) \
+static void name(const unsigned char* buf, bool* mask, const unsigned char* bufbg, const unsigned char* buffg, unsigned int width, unsigned int channels, unsigned int bgs) \
+{ \
+    unsigned int xm, xb, x1, d, ch, mch; \
+    int imd, fgdist, bgdist; \
+\
+    ch = (CH) ? (CH) : channels; \
+    mch = (ch < DJVUL_IMAGE_CHANNELS) ? ch : DJVUL_IMAGE_CHANNELS; \
+    xm = 0; \
+    for (xb = 0; xm < width; xb++) \
+    { \
+        const unsigned char* fg = buffg + xb * ch; \
+        const unsigned char* bg = bufbg + xb * ch; \
+\
+        x1 = ((xm + bgs) < width) ? (xm + bgs) : width; \
+        for (; xm < x1; xm++) \
+        { \
+            fgdist = 0; \
+            bgdist = 0; \
+            for (d = 0; d < mch; d++) \
+            { \
+                imd = (int)buf[d] - (int)fg[d]; \
+                fgdist += (imd < 0) ? -imd : imd; \
+                imd = (int)buf[d] - (int)bg[d]; \
+                bgdist += (imd < 0) ? -imd : imd; \
+            } \
+            mask[xm] = (fgdist < bgdist); \
+            buf += ch; \
+        } \
+    } \
+}
+
+DJVUL_THRESHOLD_ROW(ImageDjvulThresholdRow1, 1)
+DJVUL_THRESHOLD_ROW(ImageDjvulThresholdRow3, 3)
+DJVUL_THRESHOLD_ROW(ImageDjvulThresholdRowN, 0)
+
+/*
+ImageDjvulCellSum1(), ImageDjvulCellSum3(), ImageDjvulCellSumN()
+
+Sums of channels (up to DJVUL_IMAGE_CHANNELS) over w x h pixels of the image
+starting from buf, width - pixels in the row of the image.
+*/
+
+typedef void (*ImageDjvulCellSumFunc)(const unsigned char* buf, unsigned int w, unsigned int h, unsigned int width, unsigned int channels, unsigned long long* csum);
+
+#define DJVUL_CELL_SUM(name, CH) \
+static void name(const unsigned char* buf, unsigned int w, unsigned int h, unsigned int width, unsigned int channels, unsigned long long* csum) \
+{ \
+    unsigned int y, x, d, ch, mch; \
+\
+    ch = (CH) ? (CH) : channels; \
+    mch = (ch < DJVUL_IMAGE_CHANNELS) ? ch : DJVUL_IMAGE_CHANNELS; \
+    for (d = 0; d < mch; d++) \
+    { \
+        csum[d] = 0; \
+    } \
+    for (y = 0; y < h; y++) \
+    { \
+        const unsigned char* p = buf + (unsigned long)width * y * ch; \
+\
+        for (x = 0; x < w; x++) \
+        { \
+            for (d = 0; d < mch; d++) \
+            { \
+                csum[d] += p[d]; \
+            } \
+            p += ch; \
+        } \
+    } \
+}
+
+DJVUL_CELL_SUM(ImageDjvulCellSum1, 1)
+DJVUL_CELL_SUM(ImageDjvulCellSum3, 3)
+DJVUL_CELL_SUM(ImageDjvulCellSumN, 0)
+
+/*
+ImageDjvulThresholdRowSelect(), ImageDjvulCellSumSelect()
+
+Choose kernels for channels once per image.
+*/
+
+static ImageDjvulThresholdRowFunc ImageDjvulThresholdRowSelect(unsigned int channels)
 {
-    unsigned int y, x, d, i, j, mchannels;
-    unsigned int y0, x0, y1, x1, y0b, x0b, y1b, x1b, yb, xb;
-    unsigned int widthbg, heightbg, whcp, blsz;
-    unsigned long k, l, lm, n;
-    unsigned char fgbase, bgbase;
-    unsigned int cnth, cntw;
+    switch (channels)
+    {
+    case 1:
+        return ImageDjvulThresholdRow1;
+    case 3:
+        return ImageDjvulThresholdRow3;
+    default:
+        return ImageDjvulThresholdRowN;
+    }
+}
+
+static ImageDjvulCellSumFunc ImageDjvulCellSumSelect(unsigned int channels)
+{
+    switch (channels)
+    {
+    case 1:
+        return ImageDjvulCellSum1;
+    case 3:
+        return ImageDjvulCellSum3;
+    default:
+        return ImageDjvulCellSumN;
+    }
+}
+
+/*
+ImageDjvulThresholdBlock()
+
+Refines FG and BG of one block of the level.
+Blocks which don't overlap can be processed simultaneously.
+*/
+
+static void ImageDjvulThresholdBlock(unsigned char* buf, unsigned char* bufbg, unsigned char* buffg, const unsigned long long* integral, unsigned int width, unsigned int height, unsigned int widthbg, unsigned int heightbg, unsigned int channels, unsigned int bgs, unsigned int y0, unsigned int x0, unsigned int y1, unsigned int x1, unsigned int y0b, unsigned int x0b, unsigned int y1b, unsigned int x1b, float partl, float anisotropic, float contrast, float fbscale, float delta)
+{
+    unsigned int y, x, d, mchannels;
+    unsigned long k;
+    unsigned long long n;
     int pim[DJVUL_IMAGE_CHANNELS], gim[DJVUL_IMAGE_CHANNELS], tim[DJVUL_IMAGE_CHANNELS];
     int fgim[DJVUL_IMAGE_CHANNELS], bgim[DJVUL_IMAGE_CHANNELS];
     int imd;
-    float fgk, imx, partl, parts, ims[DJVUL_IMAGE_CHANNELS];
-    float fgdist, bgdist, fgdistf, bgdistf, kover, fgpart, bgpart;
+    float fgk, imx, parts;
+    float fgdist, bgdist, fgdistf, bgdistf, fgpart, bgpart;
+    unsigned long long fgnum, bgnum;
+    unsigned long long fgsum[DJVUL_IMAGE_CHANNELS], bgsum[DJVUL_IMAGE_CHANNELS], imsum[DJVUL_IMAGE_CHANNELS];
+
+    mchannels = (channels < DJVUL_IMAGE_CHANNELS) ? channels : DJVUL_IMAGE_CHANNELS;
+
+    // mean region buf
+    for (d = 0; d < mchannels; d++)
+    {
+        imsum[d] = 0;
+    }
+    n = 0;
+    if (integral)
+    {
+        unsigned int cy0, cx0, cy1, cx1, ye, xe, iw;
+        unsigned long long i00, i01, i10, i11;
+
+        // whole bgs x bgs cells of the region from integral image (y0 and x0
+        // are multiples of bgs, cells at the bottom and right edges of the image
+        // are whole too), [y0, ye) x [x0, xe)
+        cy0 = y0 / bgs;
+        cx0 = x0 / bgs;
+        cy1 = (y1 < height) ? (y1 / bgs) : heightbg;
+        cx1 = (x1 < width) ? (x1 / bgs) : widthbg;
+        ye = (y1 < height) ? (cy1 * bgs) : height;
+        xe = (x1 < width) ? (cx1 * bgs) : width;
+
+        iw = widthbg + 1;
+        for (d = 0; d < mchannels; d++)
+        {
+            i00 = integral[((unsigned long long)cy0 * iw + cx0) * mchannels + d];
+            i01 = integral[((unsigned long long)cy0 * iw + cx1) * mchannels + d];
+            i10 = integral[((unsigned long long)cy1 * iw + cx0) * mchannels + d];
+            i11 = integral[((unsigned long long)cy1 * iw + cx1) * mchannels + d];
+            imsum[d] = i11 - i01 - i10 + i00;
+        }
+
+        // parts of cells at the right [xe, x1) and bottom [ye, y1) are scanned
+        for (y = y0; y < y1; y++)
+        {
+            for (x = (y < ye) ? xe : x0; x < x1; x++)
+            {
+                k = (width * y + x) * channels;
+                for (d = 0; d < mchannels; d++)
+                {
+                    imsum[d] += buf[k + d];
+                }
+            }
+        }
+        n = (unsigned long long)(y1 - y0) * (x1 - x0);
+    }
+    else
+    {
+        for (y = y0; y < y1; y++)
+        {
+            for (x = x0; x < x1; x++)
+            {
+                k = (width * y + x) * channels;
+                for (d = 0; d < mchannels; d++)
+                {
+                    imsum[d] += buf[k + d];
+                }
+                n++;
+            }
+        }
+    }
+    for (d = 0; d < mchannels; d++)
+    {
+        gim[d] = (n > 0) ? (int)((imsum[d] + (n >> 1)) / n) : 0;
+    }
+
+    // mean region buffg and bufbg
+    for (d = 0; d < mchannels; d++)
+    {
+        fgsum[d] = 0;
+        bgsum[d] = 0;
+    }
+    n = 0;
+    for (y = y0b; y < y1b; y++)
+    {
+        k = (widthbg * y + x0b) * channels;
+        for (x = x0b; x < x1b; x++)
+        {
+            for (d = 0; d < mchannels; d++)
+            {
+                fgsum[d] += buffg[k + d];
+                bgsum[d] += bufbg[k + d];
+            }
+            k += channels;
+            n++;
+        }
+    }
+    for (d = 0; d < mchannels; d++)
+    {
+        fgim[d] = (n > 0) ? (int)((fgsum[d] + (n >> 1)) / n) : 0;
+        bgim[d] = (n > 0) ? (int)((bgsum[d] + (n >> 1)) / n) : 0;
+    }
+
+    // distance buffg -> buf, bufbg -> buf
+    fgdist = 0.0f;
+    for (d = 0; d < mchannels; d++)
+    {
+        imd = gim[d];
+        imd -= fgim[d];
+        if (imd < 0) imd = -imd;
+        fgdist += imd;
+    }
+    bgdist = 0.0f;
+    for (d = 0; d < mchannels; d++)
+    {
+        imd = gim[d];
+        imd -= bgim[d];
+        if (imd < 0) imd = -imd;
+        bgdist += imd;
+    }
+
+    // anisotropic regulator
+    fgk = (fgdist + bgdist);
+    if (fgk > 0.0f)
+    {
+        fgk = (bgdist - fgdist) / fgk;
+        fgk *= anisotropic;
+        fgk = (float)(exp(fgk));
+    }
+    else
+    {
+        fgk = 1.0f;
+    }
+    fgk *= fbscale;
+
+    // separate FG and BG
+    for (d = 0; d < mchannels; d++)
+    {
+        fgsum[d] = 0;
+        bgsum[d] = 0;
+    }
+    fgnum = 0;
+    bgnum = 0;
+    for (y = y0; y < y1; y++)
+    {
+        for (x = x0; x < x1; x++)
+        {
+            k = (width * y + x) * channels;
+            for (d = 0; d < mchannels; d++)
+            {
+                pim[d] = (int)buf[k + d];
+                tim[d] = pim[d] +  (int)(contrast * (pim[d] - gim[d]));
+            }
+
+            fgdistf = 0.0f;
+            for (d = 0; d < mchannels; d++)
+            {
+                imd = tim[d];
+                imd -= fgim[d];
+                if (imd < 0) imd = -imd;
+                fgdistf += imd;
+            }
+            bgdistf = 0.0f;
+            for (d = 0; d < mchannels; d++)
+            {
+                imd = tim[d];
+                imd -= bgim[d];
+                if (imd < 0) imd = -imd;
+                bgdistf += imd;
+            }
+
+            if ((fgdistf * fgk + delta) < bgdistf)
+            {
+                for (d = 0; d < mchannels; d++)
+                {
+                    fgsum[d] += (unsigned long int)pim[d];
+                }
+                fgnum++;
+            }
+            else
+            {
+                for (d = 0; d < mchannels; d++)
+                {
+                    bgsum[d] += (unsigned long int)pim[d];
+                }
+                bgnum++;
+            }
+        }
+    }
+    if (fgnum > 0)
+    {
+        for (d = 0; d < mchannels; d++)
+        {
+            fgsum[d] += (fgnum >> 1);
+            fgsum[d] /= fgnum;
+            fgim[d] = (int)fgsum[d];
+        }
+    }
+    if (bgnum > 0)
+    {
+        for (d = 0; d < mchannels; d++)
+        {
+            bgsum[d] += (bgnum >> 1);
+            bgsum[d] /= bgnum;
+            bgim[d] = (int)bgsum[d];
+        }
+    }
+
+    fgpart = 1.0f;
+    bgpart = 1.0f;
+    if ((fgdist + bgdist) > 0.0f)
+    {
+        fgpart += (fgdist + fgdist) / (fgdist + bgdist);
+        bgpart += (bgdist + bgdist) / (fgdist + bgdist);
+    }
+    fgpart *= partl;
+    bgpart *= partl;
+
+    // average old and new FG
+    parts = 1.0f /(fgpart + 1.0f);
+    for (y = y0b; y < y1b; y++)
+    {
+        for (x = x0b; x < x1b; x++)
+        {
+            k = (widthbg * y + x) * channels;
+            for (d = 0; d < mchannels; d++)
+            {
+                imx = (float)buffg[k + d];
+                imx *= fgpart;
+                imx += (float)fgim[d];
+                imx *= parts;
+                imx += 0.5f;
+                imx = (imx < 0.0f) ? 0.0f : (imx < 255.0f) ? imx : 255.0f;
+                buffg[k + d] = (unsigned char)imx;
+            }
+        }
+    }
+
+    // average old and new BG
+    parts = 1.0f /(bgpart + 1.0f);
+    for (y = y0b; y < y1b; y++)
+    {
+        for (x = x0b; x < x1b; x++)
+        {
+            k = (widthbg * y + x) * channels;
+            for (d = 0; d < mchannels; d++)
+            {
+                imx = (float)bufbg[k + d];
+                imx *= bgpart;
+                imx += (float)bgim[d];
+                imx *= parts;
+                imx += 0.5f;
+                imx = (imx < 0.0f) ? 0.0f : (imx < 255.0f) ? imx : 255.0f;
+                bufbg[k + d] = (unsigned char)imx;
+            }
+        }
+    }
+}
+
+/*
+ImageDjvulThresholdIntegralSize()
+
+Bytes for integral image of ImageDjvulThresholdWith().
+*/
+
+static size_t ImageDjvulThresholdIntegralSize(unsigned int width, unsigned int height, unsigned int channels, unsigned int bgs)
+{
+    size_t widthbg, heightbg, mchannels;
+
+    widthbg = (width + bgs - 1) / bgs;
+    heightbg = (height + bgs - 1) / bgs;
+    mchannels = (channels < DJVUL_IMAGE_CHANNELS) ? channels : DJVUL_IMAGE_CHANNELS;
+
+    return (heightbg + 1) * (widthbg + 1) * mchannels * sizeof(unsigned long long);
+}
+
+/*
+ImageDjvulThresholdWith()
+
+ImageDjvulThreshold() with integral image in the caller's buffer of
+ImageDjvulThresholdIntegralSize() bytes (NULL to scan blocks directly).
+*/
+
+static int ImageDjvulThresholdWith(unsigned char* buf, bool* bufmask, unsigned char* bufbg, unsigned char* buffg, unsigned int width, unsigned int height, unsigned int channels, unsigned int bgs, unsigned int level, int wbmode, float doverlay, float anisotropic, float contrast, float fbscale, float delta, unsigned long long* integral)
+{
+    unsigned int y, x, d, mchannels;
+    unsigned int widthbg, heightbg, whcp, blsz;
+    unsigned long k, l;
+    unsigned char fgbase, bgbase;
+    unsigned int cnth, cntw, t, stride;
+    float partl, kover;
     unsigned int maskbl, maskover, bgsover;
-    unsigned long int fgnum, bgnum;
-    unsigned long int fgsum[DJVUL_IMAGE_CHANNELS], bgsum[DJVUL_IMAGE_CHANNELS];
+    int yi;
 
     mchannels = (channels < DJVUL_IMAGE_CHANNELS) ? channels : DJVUL_IMAGE_CHANNELS;
     if (bgs > 0)
@@ -117,6 +528,7 @@ DJVULAPI int ImageDjvulThreshold(unsigned char* buf, bool* bufmask, unsigned cha
         doverlay = 0.0f;
     }
     kover = doverlay + 1.0f;
+    stride = (unsigned int)ceil(kover);
 
     // w/b mode {1/-1}
     if (wbmode < 0)
@@ -143,6 +555,53 @@ DJVULAPI int ImageDjvulThreshold(unsigned char* buf, bool* bufmask, unsigned cha
         }
     }
 
+    // Integral image of bgs x bgs cell sums: every level takes means of buf
+    // over whole cells of its blocks from it in O(1), only parts of cells at
+    // the block edges are scanned, sums are the same as without it.
+    // It takes (widthbg + 1) * (heightbg + 1) * 8 bytes per channel (about
+    // 24 / bgs^2 bytes per pixel of RGB image), without memory for it blocks
+    // are scanned directly.
+    if (integral)
+    {
+        unsigned long iw = (unsigned long)(widthbg + 1) * mchannels;
+        ImageDjvulCellSumFunc cellsum = ImageDjvulCellSumSelect(channels);
+
+        memset(integral, 0, iw * sizeof(unsigned long long));
+#pragma omp parallel for
+        for (yi = 0; yi < (int)heightbg; yi++)
+        {
+            unsigned int yc, yc1, xc, xc1, dm;
+            unsigned long long* row;
+            unsigned long long csum[DJVUL_IMAGE_CHANNELS];
+
+            row = integral + (unsigned long)(yi + 1) * iw;
+            yc = (unsigned int)yi * bgs;
+            yc1 = ((yc + bgs) < height) ? (yc + bgs) : height;
+            for (dm = 0; dm < mchannels; dm++)
+            {
+                row[dm] = 0;
+            }
+            for (xc = 0; xc < widthbg; xc++)
+            {
+                xc1 = ((xc + 1) * bgs < width) ? ((xc + 1) * bgs) : width;
+                cellsum(buf + ((unsigned long)width * yc + xc * bgs) * channels, xc1 - xc * bgs, yc1 - yc, width, channels, csum);
+                for (dm = 0; dm < mchannels; dm++)
+                {
+                    row[(xc + 1) * mchannels + dm] = row[xc * mchannels + dm] + csum[dm];
+                }
+            }
+        }
+        for (y = 1; y <= heightbg; y++)
+        {
+            unsigned long long* row = integral + (unsigned long)y * iw;
+
+            for (k = 0; k < iw; k++)
+            {
+                row[k] += row[k - iw];
+            }
+        }
+    }
+
     // level blocks
     for (l = 0; l < level; l++)
     {
@@ -152,309 +611,294 @@ DJVULAPI int ImageDjvulThreshold(unsigned char* buf, bool* bufmask, unsigned cha
         maskover = (unsigned int)(kover * maskbl);
         bgsover = (unsigned int)(kover * blsz);
         partl = (float)(level - l) / (float)level;
-        for (i = 0; i < cnth; i++)
+        // Block overlaps only blocks closer than stride in both directions.
+        // Blocks with the same j + stride * i don't overlap and all overlapping
+        // blocks keep the order of the row by row scan, so each step of this
+        // wavefront can be processed in parallel with the same result.
+        for (t = 0; t < cntw + stride * (cnth - 1); t++)
         {
-            y0 = i * maskbl;
-            y1 = (((y0 + maskover) < height) ? (y0 + maskover) : height);
-            y0b = i * blsz;
-            y1b = (((y0b + bgsover) < heightbg) ? (y0b + bgsover) : heightbg);
-            for (j = 0; j < cntw; j++)
+            int b, bmin, bmax;
+
+            bmin = (t + 1 > cntw) ? (int)((t + 1 - cntw + stride - 1) / stride) : 0;
+            bmax = (int)(t / stride);
+            if (bmax > (int)cnth - 1)
             {
-                x0 = j * maskbl;
-                x1 = (((x0 + maskover) < width) ? (x0 + maskover) : width);
-                x0b = j * blsz;
-                x1b = (((x0b + bgsover) < widthbg) ? (x0b + bgsover) : widthbg);
+                bmax = (int)cnth - 1;
+            }
 
-                // mean region buf
-                for (d = 0; d < mchannels; d++)
-                {
-                    ims[d] = 0.0f;
-                }
-                n = 0;
-                k = 0;
-                for (y = y0; y < y1; y++)
-                {
-                    for (x = x0; x < x1; x++)
-                    {
-                        k = (width * y + x) * channels;
-                        for (d = 0; d < mchannels; d++)
-                        {
-                            ims[d] += (float)buf[k + d];
-                        }
-                        n++;
-                    }
-                }
-                for (d = 0; d < mchannels; d++)
-                {
-                    if (n > 0)
-                    {
-                        ims[d] /= (float)n;
-                    }
-                    ims[d] += 0.5f;
-                    ims[d] = (ims[d] < 0.0f) ? 0.0f : (ims[d] < 255.0f) ? ims[d] : 255.0f;
-                    gim[d] = (int)ims[d];
-                }
+#pragma omp parallel for
+            for (b = bmin; b <= bmax; b++)
+            {
+                unsigned int bi, bj, by0, bx0, by1, bx1, by0b, bx0b, by1b, bx1b;
+
+                bi = (unsigned int)b;
+                bj = t - stride * bi;
+
+                by0 = bi * maskbl;
+                by1 = (((by0 + maskover) < height) ? (by0 + maskover) : height);
+                by0b = bi * blsz;
+                by1b = (((by0b + bgsover) < heightbg) ? (by0b + bgsover) : heightbg);
+                bx0 = bj * maskbl;
+                bx1 = (((bx0 + maskover) < width) ? (bx0 + maskover) : width);
+                bx0b = bj * blsz;
+                bx1b = (((bx0b + bgsover) < widthbg) ? (bx0b + bgsover) : widthbg);
+
+                ImageDjvulThresholdBlock(buf, bufbg, buffg, integral, width, height, widthbg, heightbg, channels, bgs, by0, bx0, by1, bx1, by0b, bx0b, by1b, bx1b, partl, anisotropic, contrast, fbscale, delta);
+            }
+        }
+        blsz >>= 1;
+    }
+
+    // threshold mask
+    if (bufmask)
+    {
+        ImageDjvulThresholdRowFunc thresholdrow = ImageDjvulThresholdRowSelect(channels);
+
+#pragma omp parallel for
+        for (yi = 0; yi < (int)height; yi++)
+        {
+            unsigned long km, lm;
+
+            lm = (unsigned long)yi * width;
+            km = (unsigned long)widthbg * ((unsigned int)yi / bgs) * channels;
+            thresholdrow(buf + lm * channels, bufmask + lm, bufbg + km, buffg + km, width, channels, bgs);
+        }
+    }
+
+    return level;
+}
+
+DJVULAPI int ImageDjvulThreshold(unsigned char* buf, bool* bufmask, unsigned char* bufbg, unsigned char* buffg, unsigned int width, unsigned int height, unsigned int channels, unsigned int bgs, unsigned int level, int wbmode, float doverlay, float anisotropic, float contrast, float fbscale, float delta)
+{
+    unsigned long long* integral;
+    int ret;
+
+    if (bgs == 0)
+    {
+        return 0;
+    }
+
+    integral = (unsigned long long*)malloc(ImageDjvulThresholdIntegralSize(width, height, channels, bgs));
+    ret = ImageDjvulThresholdWith(buf, bufmask, bufbg, buffg, width, height, channels, bgs, level, wbmode, doverlay, anisotropic, contrast, fbscale, delta, integral);
+    free(integral);
+
+    return ret;
+}
+
+/*
+ImageDjvulThresholdTiled()
+
+input:
+buf, bgs, level, wbmode, doverlay, anisotropic, contrast, fbscale, delta - as ImageDjvulThreshold()
+tile = 4096 // size of the tile (rounded up to bgs)
+halo = 1024 // overlap with neighbour tiles (rounded up to bgs)
+
+output:
+bufmask, bufbg, buffg - as ImageDjvulThreshold()
+level - use level (0 on error)
+
+Every tile is thresholded with its halo independently, only the tile itself
+is written to the output. Every thread allocates working buffers for one
+tile with halo once, so memory used besides input and output is about
+threads * (tile + 2 * halo)^2 * (channels * (1 + 10 / bgs^2) + 1) bytes
+(without 1 if bufmask is NULL) whatever the image size is.
+Background estimation is limited by tile and halo sizes, so the output
+differs from ImageDjvulThreshold() a little, mostly near the tile borders.
+
+Use:
+int level = ImageDjvulThresholdTiled(buf, bufmask, bufbg, buffg, width, height, channels, bgs, level, wbmode, doverlay, anisotropic, contrast, fbscale, delta, tile, halo);
+*/
+
+DJVULAPI int ImageDjvulThresholdTiled(unsigned char* buf, bool* bufmask, unsigned char* bufbg, unsigned char* buffg, unsigned int width, unsigned int height, unsigned int channels, unsigned int bgs, unsigned int level, int wbmode, float doverlay, float anisotropic, float contrast, float fbscale, float delta, unsigned int tile, unsigned int halo)
+{
+    unsigned int widthbg, cnth, cntw, whcp, blsz, mw, mh, mwb, mhb;
+    int t, failed = 0;
+
+    if ((bgs == 0) || (tile == 0))
+    {
+        return 0;
+    }
+    widthbg = (width + bgs - 1) / bgs;
+    tile = (tile + bgs - 1) / bgs * bgs;
+    halo = (halo + bgs - 1) / bgs * bgs;
 
-                // mean region buffg
-                for (d = 0; d < mchannels; d++)
-                {
-                    ims[d] = 0.0f;
-                }
-                n = 0;
-                k = 0;
-                for (y = y0b; y < y1b; y++)
-                {
-                    for (x = x0b; x < x1b; x++)
-                    {
-                        k = (widthbg * y + x) * channels;
-                        for (d = 0; d < mchannels; d++)
-                        {
-                            ims[d] += (float)buffg[k + d];
-                        }
-                        n++;
-                    }
-                }
-                for (d = 0; d < mchannels; d++)
-                {
-                    if (n > 0)
-                    {
-                        ims[d] /= (float)n;
-                    }
-                    ims[d] += 0.5f;
-                    ims[d] = (ims[d] < 0.0f) ? 0.0f : (ims[d] < 255.0f) ? ims[d] : 255.0f;
-                    fgim[d] = (int)ims[d];
-                }
+    // The same level for all tiles, even for the smaller ones at the edges
+    if (level == 0)
+    {
+        whcp = tile + 2 * halo;
+        blsz = 1;
+        while (bgs * blsz < whcp)
+        {
+            level++;
+            blsz <<= 1;
+        }
+    }
 
-                // mean region bufbg
-                for (d = 0; d < mchannels; d++)
-                {
-                    ims[d] = 0.0f;
-                }
-                n = 0;
-                k = 0;
-                for (y = y0b; y < y1b; y++)
-                {
-                    for (x = x0b; x < x1b; x++)
-                    {
-                        k = (widthbg * y + x) * channels;
-                        for (d = 0; d < mchannels; d++)
-                        {
-                            ims[d] += (float)bufbg[k + d];
-                        }
-                        n++;
-                    }
-                }
-                for (d = 0; d < mchannels; d++)
-                {
-                    if (n > 0)
-                    {
-                        ims[d] /= (float)n;
-                    }
-                    ims[d] += 0.5f;
-                    ims[d] = (ims[d] < 0.0f) ? 0.0f : (ims[d] < 255.0f) ? ims[d] : 255.0f;
-                    bgim[d] = (int)ims[d];
-                }
+    cnth = (height + tile - 1) / tile;
+    cntw = (width + tile - 1) / tile;
 
-                // distance buffg -> buf, bufbg -> buf
-                fgdist = 0.0f;
-                for (d = 0; d < mchannels; d++)
-                {
-                    imd = gim[d];
-                    imd -= fgim[d];
-                    if (imd < 0) imd = -imd;
-                    fgdist += imd;
-                }
-                bgdist = 0.0f;
-                for (d = 0; d < mchannels; d++)
-                {
-                    imd = gim[d];
-                    imd -= bgim[d];
-                    if (imd < 0) imd = -imd;
-                    bgdist += imd;
-                }
+    // the largest tile with halo
+    mw = ((tile + 2 * halo) < width) ? (tile + 2 * halo) : width;
+    mh = ((tile + 2 * halo) < height) ? (tile + 2 * halo) : height;
+    mwb = (mw + bgs - 1) / bgs;
+    mhb = (mh + bgs - 1) / bgs;
 
-                // anisotropic regulator
-                fgk = (fgdist + bgdist);
-                if (fgk > 0.0f)
-                {
-                    fgk = (bgdist - fgdist) / fgk;
-                    fgk *= anisotropic;
-                    fgk = (float)(exp(fgk));
-                }
-                else
-                {
-                    fgk = 1.0f;
-                }
-                fgk *= fbscale;
+#pragma omp parallel reduction(+:failed)
+    {
+        unsigned char *sbuf, *sbg, *sfg;
+        unsigned long long* sintegral;
+        bool* smask;
+        bool ok;
+
+        sbuf = (unsigned char*)malloc((size_t)mw * mh * channels);
+        smask = bufmask ? (bool*)malloc((size_t)mw * mh * sizeof(bool)) : NULL;
+        sbg = (unsigned char*)malloc((size_t)mwb * mhb * channels);
+        sfg = (unsigned char*)malloc((size_t)mwb * mhb * channels);
+        // without memory for integral image tiles are scanned directly
+        sintegral = (unsigned long long*)malloc(ImageDjvulThresholdIntegralSize(mw, mh, channels, bgs));
+        ok = sbuf && (smask || !bufmask) && sbg && sfg;
+        if (!ok)
+        {
+            failed++;
+        }
 
-                // separate FG and BG
-                for (d = 0; d < mchannels; d++)
-                {
-                    fgsum[d] = 0;
-                    bgsum[d] = 0;
-                }
-                fgnum = 0;
-                bgnum = 0;
-                for (y = y0; y < y1; y++)
-                {
-                    for (x = x0; x < x1; x++)
-                    {
-                        k = (width * y + x) * channels;
-                        for (d = 0; d < mchannels; d++)
-                        {
-                            pim[d] = (int)buf[k + d];
-                            tim[d] = pim[d] +  (int)(contrast * (pim[d] - gim[d]));
-                        }
+#pragma omp for
+        for (t = 0; t < (int)(cnth * cntw); t++)
+        {
+            unsigned int tx0, ty0, tx1, ty1, sx0, sy0, sx1, sy1, sw, sh, swb, y, tw;
 
-                        fgdistf = 0.0f;
-                        for (d = 0; d < mchannels; d++)
-                        {
-                            imd = tim[d];
-                            imd -= fgim[d];
-                            if (imd < 0) imd = -imd;
-                            fgdistf += imd;
-                        }
-                        bgdistf = 0.0f;
-                        for (d = 0; d < mchannels; d++)
-                        {
-                            imd = tim[d];
-                            imd -= bgim[d];
-                            if (imd < 0) imd = -imd;
-                            bgdistf += imd;
-                        }
+            if (!ok)
+            {
+                continue;
+            }
 
-                        if ((fgdistf * fgk + delta) < bgdistf)
-                        {
-                            for (d = 0; d < mchannels; d++)
-                            {
-                                fgsum[d] += (unsigned long int)pim[d];
-                            }
-                            fgnum++;
-                        }
-                        else
-                        {
-                            for (d = 0; d < mchannels; d++)
-                            {
-                                bgsum[d] += (unsigned long int)pim[d];
-                            }
-                            bgnum++;
-                        }
-                    }
-                }
-                if (fgnum > 0)
-                {
-                    for (d = 0; d < mchannels; d++)
-                    {
-                        fgsum[d] += (fgnum >> 1);
-                        fgsum[d] /= fgnum;
-                        fgim[d] = (int)fgsum[d];
-                    }
-                }
-                if (bgnum > 0)
-                {
-                    for (d = 0; d < mchannels; d++)
-                    {
-                        bgsum[d] += (bgnum >> 1);
-                        bgsum[d] /= bgnum;
-                        bgim[d] = (int)bgsum[d];
-                    }
-                }
+            ty0 = (unsigned int)t / cntw * tile;
+            tx0 = (unsigned int)t % cntw * tile;
+            ty1 = ((ty0 + tile) < height) ? (ty0 + tile) : height;
+            tx1 = ((tx0 + tile) < width) ? (tx0 + tile) : width;
+            sy0 = (ty0 > halo) ? (ty0 - halo) : 0;
+            sx0 = (tx0 > halo) ? (tx0 - halo) : 0;
+            sy1 = ((ty1 + halo) < height) ? (ty1 + halo) : height;
+            sx1 = ((tx1 + halo) < width) ? (tx1 + halo) : width;
+            sw = sx1 - sx0;
+            sh = sy1 - sy0;
+            swb = (sw + bgs - 1) / bgs;
+            tw = tx1 - tx0;
+
+            for (y = 0; y < sh; y++)
+            {
+                memcpy(sbuf + (size_t)y * sw * channels, buf + ((size_t)(sy0 + y) * width + sx0) * channels, (size_t)sw * channels);
+            }
 
-                fgpart = 1.0f;
-                bgpart = 1.0f;
-                if ((fgdist + bgdist) > 0.0f)
-                {
-                    fgpart += (fgdist + fgdist) / (fgdist + bgdist);
-                    bgpart += (bgdist + bgdist) / (fgdist + bgdist);
-                }
-                fgpart *= partl;
-                bgpart *= partl;
+            ImageDjvulThresholdWith(sbuf, smask, sbg, sfg, sw, sh, channels, bgs, level, wbmode, doverlay, anisotropic, contrast, fbscale, delta, sintegral);
 
-                // average old and new FG
-                parts = 1.0f /(fgpart + 1.0f);
-                for (y = y0b; y < y1b; y++)
+            // tile origin and halo are multiples of bgs, so BG and FG cells are aligned
+            if (bufmask)
+            {
+                for (y = ty0; y < ty1; y++)
                 {
-                    for (x = x0b; x < x1b; x++)
-                    {
-                        k = (widthbg * y + x) * channels;
-                        for (d = 0; d < mchannels; d++)
-                        {
-                            imx = (float)buffg[k + d];
-                            imx *= fgpart;
-                            imx += (float)fgim[d];
-                            imx *= parts;
-                            imx += 0.5f;
-                            imx = (imx < 0.0f) ? 0.0f : (imx < 255.0f) ? imx : 255.0f;
-                            buffg[k + d] = (unsigned char)imx;
-                        }
-                    }
+                    memcpy(bufmask + (size_t)y * width + tx0, smask + (size_t)(y - sy0) * sw + (tx0 - sx0), tw * sizeof(bool));
                 }
+            }
+            for (y = ty0 / bgs; y < (ty1 + bgs - 1) / bgs; y++)
+            {
+                size_t src, dst, len;
 
-                // average old and new BG
-                parts = 1.0f /(bgpart + 1.0f);
-                for (y = y0b; y < y1b; y++)
-                {
-                    for (x = x0b; x < x1b; x++)
-                    {
-                        k = (widthbg * y + x) * channels;
-                        for (d = 0; d < mchannels; d++)
-                        {
-                            imx = (float)bufbg[k + d];
-                            imx *= bgpart;
-                            imx += (float)bgim[d];
-                            imx *= parts;
-                            imx += 0.5f;
-                            imx = (imx < 0.0f) ? 0.0f : (imx < 255.0f) ? imx : 255.0f;
-                            bufbg[k + d] = (unsigned char)imx;
-                        }
-                    }
-                }
+                src = ((size_t)(y - sy0 / bgs) * swb + (tx0 - sx0) / bgs) * channels;
+                dst = ((size_t)y * widthbg + tx0 / bgs) * channels;
+                len = (size_t)((tx1 + bgs - 1) / bgs - tx0 / bgs) * channels;
+                memcpy(bufbg + dst, sbg + src, len);
+                memcpy(buffg + dst, sfg + src, len);
             }
         }
-        blsz >>= 1;
+
+        free(sbuf);
+        free(smask);
+        free(sbg);
+        free(sfg);
+        free(sintegral);
     }
 
-    // threshold mask
-    l = 0;
-    lm = 0;
-    for (y = 0; y < height; y++)
+    return failed ? 0 : (int)level;
+}
+
+/*
+ImageDjvulThresholdMaskBits()
+
+input:
+buf - unsigned char* image (height * width * channels)
+bufbg, buffg - unsigned char* BG, FG from ImageDjvulThreshold() or ImageDjvulThresholdTiled()
+stride - bytes in row of bufbits (>= (width + 7) / 8)
+bgs = 3 // downscale BG and FG
+
+output:
+bufbits - unsigned char* image mask packed by 8 pixels per byte (height * stride),
+first pixel is the most significant bit (as in PBM), 1 for FG.
+Bytes after (width + 7) / 8 in the row are not changed.
+return - 1 (0 on error)
+
+Same mask as bufmask of ImageDjvulThreshold() without byte per pixel buffer.
+
+Use:
+int ok = ImageDjvulThresholdMaskBits(buf, bufbits, stride, bufbg, buffg, width, height, channels, bgs);
+*/
+
+DJVULAPI int ImageDjvulThresholdMaskBits(unsigned char* buf, unsigned char* bufbits, unsigned int stride, unsigned char* bufbg, unsigned char* buffg, unsigned int width, unsigned int height, unsigned int channels, unsigned int bgs)
+{
+    unsigned int widthbg;
+    int yi, failed = 0;
+    ImageDjvulThresholdRowFunc thresholdrow;
+
+    if ((bgs == 0) || (stride < (width + 7) / 8))
     {
-        yb = y / bgs;
-        for (x = 0; x < width; x++)
+        return 0;
+    }
+    widthbg = (width + bgs - 1) / bgs;
+    thresholdrow = ImageDjvulThresholdRowSelect(channels);
+
+#pragma omp parallel reduction(+:failed)
+    {
+        bool* mask;
+
+        mask = (bool*)malloc(width * sizeof(bool));
+#pragma omp for
+        for (yi = 0; yi < (int)height; yi++)
         {
-            xb = x / bgs;
-            k = (widthbg * yb + xb) * channels;
-            for (d = 0; d < mchannels; d++)
+            unsigned int xm;
+            unsigned long km;
+            unsigned char* row;
+            unsigned char bits;
+
+            if (!mask)
             {
-                pim[d] = (int)buf[l + d];
-                fgim[d] = (int)buffg[k + d];
-                bgim[d] = (int)bufbg[k + d];
+                failed++;
+                continue;
             }
-            l += channels;
-
-            // distance buffg -> buf, bufbg -> buf
-            fgdist = 0.0f;
-            for (d = 0; d < mchannels; d++)
+            km = (unsigned long)widthbg * ((unsigned int)yi / bgs) * channels;
+            thresholdrow(buf + (unsigned long)yi * width * channels, mask, bufbg + km, buffg + km, width, channels, bgs);
+            row = bufbits + (size_t)yi * stride;
+            bits = 0;
+            for (xm = 0; xm < width; xm++)
             {
-                imd = pim[d];
-                imd -= fgim[d];
-                if (imd < 0) imd = -imd;
-                fgdist += (float)imd;
+                if (mask[xm])
+                {
+                    bits |= (unsigned char)(0x80 >> (xm & 7));
+                }
+                if ((xm & 7) == 7)
+                {
+                    *row++ = bits;
+                    bits = 0;
+                }
             }
-            bgdist = 0.0f;
-            for (d = 0; d < mchannels; d++)
+            if (width & 7)
             {
-                imd = pim[d];
-                imd -= bgim[d];
-                if (imd < 0) imd = -imd;
-                bgdist += (float)imd;
+                *row = bits;
             }
-            bufmask[lm] = (fgdist < bgdist);
-            lm++;
         }
+        free(mask);
     }
 
-    return level;
+    return failed ? 0 : 1;
 }
 
 /*
@@ -838,11 +1282,15 @@ DJVULAPI int ImageFGdownsample(unsigned char* buffg, unsigned int width, unsigne
     unsigned int widthfg, heightfg, y, x, y0, x0, y1, x1, xf, yf, d;
     unsigned long int s, n;
     size_t k, kf;
+    unsigned long long csum[DJVUL_IMAGE_CHANNELS];
+    ImageDjvulCellSumFunc cellsum;
 
     if (fgs > 1)
     {
         widthfg = (width + fgs - 1) / fgs;
         heightfg = (height + fgs - 1) / fgs;
+        // cell sums hold only DJVUL_IMAGE_CHANNELS channels
+        cellsum = (channels <= DJVUL_IMAGE_CHANNELS) ? ImageDjvulCellSumSelect(channels) : NULL;
         k = 0;
         for (y = 0; y < heightfg; y++)
         {
@@ -854,6 +1302,20 @@ DJVULAPI int ImageFGdownsample(unsigned char* buffg, unsigned int width, unsigne
                 x0 = x * fgs;
                 x1 = x0 + fgs;
                 x1 = (x1 < width) ? x1 : width;
+                if (cellsum)
+                {
+                    cellsum(buffg + ((size_t)width * y0 + x0) * channels, x1 - x0, y1 - y0, width, channels, csum);
+                    n = (unsigned long int)(x1 - x0) * (y1 - y0);
+                    n = (n > 0) ? n : 1;
+                    for (d = 0; d < channels; d++)
+                    {
+                        s = (unsigned long int)((csum[d] + (n >> 1)) / n);
+                        s = (s < 255) ? s : 255;
+                        buffg[k] = (unsigned char)s;
+                        k++;
+                    }
+                    continue;
+                }
                 for (d = 0; d < channels; d++)
                 {
                     s = 0;
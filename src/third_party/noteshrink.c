@@ -1,5 +1,9 @@
 #include "noteshrink.h"
 
+#include <float.h>
+#include <limits.h>
+#include <string.h>
+
 #define bitsPerSample 6
 
 #if defined(__WATCOMC__)
@@ -22,56 +26,101 @@ static float NSHSquareDistance(float *a, float *b, int channels)
     return squareDistance;
 }
 
-static size_t NSHClosest(float *p, float *means, size_t meansSize, int channels)
-{
-    int d, dChannels;
-    float minimum, squaredDistance, pm[3];
-    size_t idx, i, k;
+// NSHClosest1() and NSHClosest3() have constant number of channels, so the compiler can unroll them
+typedef size_t (*NSHClosestFunc)(float *p, float *means, size_t meansSize, int channels);
 
-    dChannels = (channels < 3) ? channels : 3;
-    minimum = 255.0f * 255.0f * channels;
-    idx = 0;
-    k = 0;
-    for (i = 0; i < meansSize; i++)
+#define NSH_CLOSEST(name, CH) \
+static size_t name(float *p, float *means, size_t meansSize, int channels) \
+{ \
+    int d, ch, dChannels; \
+    float minimum, squaredDistance, delta; \
+    size_t idx, i, k; \
+\
+    ch = (CH) ? (CH) : channels; \
+    dChannels = (ch < 3) ? ch : 3; \
+    minimum = 255.0f * 255.0f * ch; \
+    idx = 0; \
+    k = 0; \
+    for (i = 0; i < meansSize; i++) \
+    { \
+        squaredDistance = 0.0f; \
+        for (d = 0; d < dChannels; d++) \
+        { \
+            delta = p[d] - means[k + d]; \
+            squaredDistance += (delta * delta); \
+        } \
+        k += ch; \
+        if (squaredDistance < minimum) \
+        { \
+            minimum = squaredDistance; \
+            idx = i; \
+        } \
+    } \
+\
+    return idx; \
+}
+
+NSH_CLOSEST(NSHClosest1, 1)
+NSH_CLOSEST(NSHClosest3, 3)
+NSH_CLOSEST(NSHClosest, 0)
+
+static NSHClosestFunc NSHClosestSelect(int channels)
+{
+    switch (channels)
     {
-        for (d = 0; d < dChannels; d++)
-        {
-            pm[d] = means[k + d];
-        }
-        k += channels;
-        squaredDistance = NSHSquareDistance(p, pm, channels);
-        if (squaredDistance < minimum)
-        {
-            minimum = squaredDistance;
-            idx = i;
-        }
+    case 1:
+        return NSHClosest1;
+    case 3:
+        return NSHClosest3;
+    default:
+        return NSHClosest;
     }
-
-    return idx;
 }
 
+#define CLOSEST_CHUNKS 16 // Fixed number of chunks for parallel search, so ties are resolved the same way
+
 static size_t NSHClosestD(float *p, unsigned char *data, size_t dataSize, int channels)
 {
-    int d, dChannels;
-    float minimum, squaredDistance, pm[3];
-    size_t idx, i, k;
+    int c, dChannels;
+    float minimum, chunkMinimum[CLOSEST_CHUNKS];
+    size_t idx, chunkIdx[CLOSEST_CHUNKS];
 
     dChannels = (channels < 3) ? channels : 3;
-    minimum = 255.0f * 255.0f * channels;
-    idx = 0;
-    k = 0;
-    for (i = 0; i < dataSize; i++)
+
+#pragma omp parallel for if(dataSize > 65536)
+    for (c = 0; c < CLOSEST_CHUNKS; c++)
     {
-        for (d = 0; d < dChannels; d++)
+        int d;
+        float squaredDistance, pm[3];
+        size_t i, first, last;
+
+        first = dataSize * (size_t)c / CLOSEST_CHUNKS;
+        last = dataSize * (size_t)(c + 1) / CLOSEST_CHUNKS;
+        chunkMinimum[c] = 255.0f * 255.0f * channels;
+        chunkIdx[c] = 0;
+        for (i = first; i < last; i++)
         {
-            pm[d] = (float)data[k + d];
+            for (d = 0; d < dChannels; d++)
+            {
+                pm[d] = (float)data[i * channels + d];
+            }
+            squaredDistance = NSHSquareDistance(p, pm, channels);
+            if (squaredDistance < chunkMinimum[c])
+            {
+                chunkMinimum[c] = squaredDistance;
+                chunkIdx[c] = i;
+            }
         }
-        k += channels;
-        squaredDistance = NSHSquareDistance(p, pm, channels);
-        if (squaredDistance < minimum)
+    }
+
+    minimum = 255.0f * 255.0f * channels;
+    idx = 0;
+    for (c = 0; c < CLOSEST_CHUNKS; c++)
+    {
+        if (chunkMinimum[c] < minimum)
         {
-            minimum = squaredDistance;
-            idx = i;
+            minimum = chunkMinimum[c];
+            idx = chunkIdx[c];
         }
     }
 
@@ -235,18 +284,78 @@ static void ImageQuantize(unsigned char *img, size_t imageSize, int channels, in
     }
 }
 
+#define KMEANS_BLOCK 64 // Centers processed at once in distance evaluation
+#define KMEANS_CHUNKS 16 // Fixed number of partial sums, so result doesn't depend on number of threads
+
+static void KMeansNearestTwo(const float *p, const float *cx, const float *cy, const float *cz, size_t k, size_t *nearest, float *d1, float *d2)
+{
+    float dist[KMEANS_BLOCK], m1, m2;
+    size_t j0, j, n, idx;
+
+    m1 = m2 = FLT_MAX;
+    idx = 0;
+    for (j0 = 0; j0 < k; j0 += KMEANS_BLOCK)
+    {
+        n = (k - j0 < KMEANS_BLOCK) ? (k - j0) : KMEANS_BLOCK;
+
+        // Branchless loop over SoA centers, compilers vectorize it
+        for (j = 0; j < n; j++)
+        {
+            float dx, dy, dz;
+
+            dx = p[0] - cx[j0 + j];
+            dy = p[1] - cy[j0 + j];
+            dz = p[2] - cz[j0 + j];
+            dist[j] = dx * dx + dy * dy + dz * dz;
+        }
+
+        for (j = 0; j < n; j++)
+        {
+            if (dist[j] < m1)
+            {
+                m2 = m1;
+                m1 = dist[j];
+                idx = j0 + j;
+            }
+            else if (dist[j] < m2)
+            {
+                m2 = dist[j];
+            }
+        }
+    }
+
+    *nearest = idx;
+    *d1 = sqrtf(m1);
+    *d2 = (m2 < FLT_MAX) ? sqrtf(m2) : FLT_MAX;
+}
+
+// k-means with Hamerly's bounds: upper bound of distance to assigned center
+// and lower bound of distance to any other center let skip most of distance
+// evaluations after the first iterations.
 static bool ImageKMeans(unsigned char *data, size_t dataSize, int channels, float* means, size_t k, int maxItr)
 {
-    int pChannels, mChannels, d, itr, changes;
-    float h, p[3], fk, fksq;
-    size_t i, l, n;
-    size_t *clusters = NULL, cluster;
+    int mChannels, d, itr, changes, isize;
+    float h, p[3], fk, fksq, maxDelta1, maxDelta2;
+    size_t i, j, l, n, maxDeltaIdx;
+    size_t *clusters = NULL;
     int *mLen = NULL;
+    float *upper = NULL, *lower = NULL, *cx = NULL, *cy = NULL, *cz = NULL, *delta = NULL, *s = NULL;
+    uint64_t *sums = NULL;
+    bool success = true;
 
-    fk = (k > 0) ? (1.0f / (float)k) : 0.0f;
+    if ((k == 0) || (dataSize == 0))
+    {
+        return true;
+    }
+    if (dataSize > INT_MAX)
+    {
+        return false;
+    }
+    isize = (int)dataSize;
+
+    fk = 1.0f / (float)k;
     fksq = sqrtf(fk);
-    pChannels = 3;
-    mChannels = (channels < pChannels) ? channels : pChannels;
+    mChannels = (channels < 3) ? channels : 3;
     for (i = 0; i < (size_t)k; i++)
     {
         h = ((float)i + 0.5f) * fk;
@@ -261,59 +370,92 @@ static bool ImageKMeans(unsigned char *data, size_t dataSize, int channels, floa
         }
     }
 
-    if (!(clusters = (size_t*)malloc(dataSize * sizeof(size_t))))
+    clusters = (size_t*)malloc(dataSize * sizeof(size_t));
+    upper = (float*)malloc(dataSize * sizeof(float));
+    lower = (float*)malloc(dataSize * sizeof(float));
+    mLen = (int*)malloc(k * sizeof(int));
+    cx = (float*)calloc(k, sizeof(float));
+    cy = (float*)calloc(k, sizeof(float));
+    cz = (float*)calloc(k, sizeof(float));
+    delta = (float*)malloc(k * sizeof(float));
+    s = (float*)malloc(k * sizeof(float));
+    sums = (uint64_t*)malloc(KMEANS_CHUNKS * k * 4 * sizeof(uint64_t));
+    if (!clusters || !upper || !lower || !mLen || !cx || !cy || !cz || !delta || !s || !sums)
     {
-        return false;
+        success = false;
+        goto EXIT;
     }
-    n = 0;
-    for (i = 0; i < dataSize; i++)
+
+    // Missing channels stay zero both in points and centers
+    for (i = 0; i < (size_t)k; i++)
     {
-        for (d = 0; d < mChannels; d++)
-        {
-            p[d] = data[n + d];
-        }
-        clusters[i] = NSHClosest(p, means, k, channels);
-        n += channels;
+        cx[i] = means[i * channels];
+        if (mChannels > 1) cy[i] = means[i * channels + 1];
+        if (mChannels > 2) cz[i] = means[i * channels + 2];
     }
 
-    if (!(mLen = (int*)malloc(k * sizeof(int))))
+#pragma omp parallel for
+    for (isize = 0; isize < (int)dataSize; isize++)
     {
-        free(clusters);
+        float q[3] = { 0.0f, 0.0f, 0.0f };
+        int e;
 
-        return false;
+        for (e = 0; e < mChannels; e++)
+        {
+            q[e] = (float)data[(size_t)isize * channels + e];
+        }
+        KMeansNearestTwo(q, cx, cy, cz, k, &clusters[isize], &upper[isize], &lower[isize]);
     }
+
     for (itr = 0; itr < maxItr; itr++)
     {
-        n = 0;
-        for (i = 0; i < (size_t)k; i++)
-        {
-            for (d = 0; d < mChannels; d++)
-            {
-                means[n + d] = 0.0f;
-            }
-            n += channels;
-            mLen[i] = 0;
-        }
-        n = 0;
-        for (i = 0; i < dataSize; i++)
+        int c;
+
+        // Accumulate integer sums, independent of the order of additions
+#pragma omp parallel for
+        for (c = 0; c < KMEANS_CHUNKS; c++)
         {
-            cluster = clusters[i];
-            for (d = 0; d < mChannels; d++)
+            uint64_t *chunkSums;
+            size_t first, last, m;
+            int e;
+
+            chunkSums = sums + (size_t)c * k * 4;
+            memset(chunkSums, 0, k * 4 * sizeof(uint64_t));
+            first = dataSize * (size_t)c / KMEANS_CHUNKS;
+            last = dataSize * (size_t)(c + 1) / KMEANS_CHUNKS;
+            for (m = first; m < last; m++)
             {
-                means[cluster * channels + d] += (float)data[n + d];
+                uint64_t *cs;
+
+                cs = chunkSums + clusters[m] * 4;
+                for (e = 0; e < mChannels; e++)
+                {
+                    cs[e] += data[m * channels + e];
+                }
+                cs[3]++;
             }
-            mLen[cluster]++;
-            n += channels;
         }
+
         changes = 0;
         n = 0;
         for (i = 0; i < (size_t)k; i++)
         {
+            uint64_t total[4] = { 0, 0, 0, 0 };
+
+            for (c = 0; c < KMEANS_CHUNKS; c++)
+            {
+                for (d = 0; d < 4; d++)
+                {
+                    total[d] += sums[((size_t)c * k + i) * 4 + d];
+                }
+            }
+            mLen[i] = (int)total[3];
+
             if (mLen[i] > 0)
             {
                 for (d = 0; d < mChannels; d++)
                 {
-                    means[n + d] /= (float)mLen[i];
+                    means[n + d] = (float)total[d] / (float)mLen[i];
                 }
             }
             else
@@ -332,37 +474,123 @@ static bool ImageKMeans(unsigned char *data, size_t dataSize, int channels, floa
                 l = NSHClosestD(p, data, dataSize, channels);
                 for (d = 0; d < mChannels; d++)
                 {
-                    means[n + d] += (float)data[l * channels + d];
+                    means[n + d] = (float)data[l * channels + d];
                 }
                 mLen[i] = 1;
                 changes++;
             }
             n += channels;
         }
-        n = 0;
-        for (i = 0; i < dataSize; i++)
+
+        // Center movements
+        maxDelta1 = maxDelta2 = 0.0f;
+        maxDeltaIdx = 0;
+        for (i = 0; i < (size_t)k; i++)
         {
+            float c0[3] = { 0.0f, 0.0f, 0.0f }, dd;
+
             for (d = 0; d < mChannels; d++)
             {
-                p[d] = (float)data[n + d];
+                c0[d] = means[i * channels + d];
             }
-            n += channels;
-            cluster = NSHClosest(p, means, k, channels);
-            if (cluster != clusters[i])
+            dd = (c0[0] - cx[i]) * (c0[0] - cx[i]) + (c0[1] - cy[i]) * (c0[1] - cy[i]) + (c0[2] - cz[i]) * (c0[2] - cz[i]);
+            delta[i] = sqrtf(dd);
+            cx[i] = c0[0];
+            cy[i] = c0[1];
+            cz[i] = c0[2];
+
+            if (delta[i] > maxDelta1)
+            {
+                maxDelta2 = maxDelta1;
+                maxDelta1 = delta[i];
+                maxDeltaIdx = i;
+            }
+            else if (delta[i] > maxDelta2)
             {
+                maxDelta2 = delta[i];
+            }
+        }
+
+        // Half of the distance to the nearest other center
+        for (i = 0; i < (size_t)k; i++)
+        {
+            float minimum = FLT_MAX;
+
+            for (j = 0; j < (size_t)k; j++)
+            {
+                float dd;
+
+                if (j == i)
+                {
+                    continue;
+                }
+                dd = (cx[i] - cx[j]) * (cx[i] - cx[j]) + (cy[i] - cy[j]) * (cy[i] - cy[j]) + (cz[i] - cz[j]) * (cz[i] - cz[j]);
+                if (dd < minimum)
+                {
+                    minimum = dd;
+                }
+            }
+            s[i] = (minimum < FLT_MAX) ? (0.5f * sqrtf(minimum)) : FLT_MAX;
+        }
+
+#pragma omp parallel for reduction(+:changes)
+        for (isize = 0; isize < (int)dataSize; isize++)
+        {
+            float q[3] = { 0.0f, 0.0f, 0.0f }, bound, dx, dy, dz;
+            size_t a, nearest;
+            int e;
+
+            a = clusters[isize];
+            upper[isize] += delta[a];
+            lower[isize] -= (a == maxDeltaIdx) ? maxDelta2 : maxDelta1;
+
+            bound = (s[a] > lower[isize]) ? s[a] : lower[isize];
+            if (upper[isize] <= bound)
+            {
+                continue;
+            }
+
+            for (e = 0; e < mChannels; e++)
+            {
+                q[e] = (float)data[(size_t)isize * channels + e];
+            }
+
+            dx = q[0] - cx[a];
+            dy = q[1] - cy[a];
+            dz = q[2] - cz[a];
+            upper[isize] = sqrtf(dx * dx + dy * dy + dz * dz);
+            if (upper[isize] <= bound)
+            {
+                continue;
+            }
+
+            KMeansNearestTwo(q, cx, cy, cz, k, &nearest, &upper[isize], &lower[isize]);
+            if (nearest != a)
+            {
+                clusters[isize] = nearest;
                 changes++;
-                clusters[i] = cluster;
             }
         }
+
         if (changes == 0)
         {
             break;
         }
     }
-    free(clusters);
-    free(mLen);
 
-    return true;
+EXIT:
+    if (clusters) free(clusters);
+    if (upper) free(upper);
+    if (lower) free(lower);
+    if (mLen) free(mLen);
+    if (cx) free(cx);
+    if (cy) free(cy);
+    if (cz) free(cz);
+    if (delta) free(delta);
+    if (s) free(s);
+    if (sums) free(sums);
+
+    return success;
 }
 
 static bool BGColorFind(unsigned char *image, size_t imageSize, int channels, float *palette, int paletteSize, int bitsPerChannel)
@@ -591,10 +819,37 @@ NOTESHRINKAPI NSHOption NSHMakeDefaultOption()
     return o;
 }
 
+NOTESHRINKAPI size_t NSHSamplePixels(unsigned char *img, int height, int width, int channels, NSHOption option, unsigned char *samples, size_t samplesSize)
+{
+    if (!img || !samples)
+    {
+        return 0;
+    }
+
+    return ImageSamplePixels(img, (size_t)height * width, channels, samples, samplesSize, option);
+}
+
+NOTESHRINKAPI bool NSHPaletteCreateFromSamples(unsigned char *samples, size_t samplesSize, int channels, NSHOption option, float *palette, int paletteSize)
+{
+    if (!samples || !palette || (samplesSize == 0))
+    {
+        return false;
+    }
+    if (option.NumColors < 2)
+    {
+        return false;
+    }
+
+    BGColorFind(samples, samplesSize, channels, palette, paletteSize, bitsPerSample);
+
+    return NSHPaletteGenerate(samples, samplesSize, channels, option, palette, paletteSize);
+}
+
 NOTESHRINKAPI bool NSHPaletteCreate(unsigned char *img, int height, int width, int channels, NSHOption option, float *palette, int paletteSize)
 {
     unsigned char *samples = NULL;
     size_t imgSize, samplesSize;
+    bool result;
 
     if (!img || !palette)
     {
@@ -616,19 +871,78 @@ NOTESHRINKAPI bool NSHPaletteCreate(unsigned char *img, int height, int width, i
         return false;
     }
     samplesSize = ImageSamplePixels(img, imgSize, channels, samples, samplesSize, option);
-    BGColorFind(samples, samplesSize, channels, palette, paletteSize, bitsPerSample);
-    NSHPaletteGenerate(samples, samplesSize, channels, option, palette, paletteSize);
+    result = NSHPaletteCreateFromSamples(samples, samplesSize, channels, option, palette, paletteSize);
     free(samples);
 
+    return result;
+}
+
+#define LUT_BITS 5
+#define LUT_SIDE (1 << LUT_BITS)
+#define LUT_AMBIGUOUS 0x8000 // Cell has several candidates, exact search is needed
+
+// Caches nearest palette entry for each cell of quantized RGB cube.
+// Entry is exact for the whole cell if the second nearest palette entry
+// is farther from the cell center than the nearest one by more than the
+// cell diameter.
+static bool NSHPaletteLUTCreate(float *palette, size_t paletteSize, int channels, uint16_t **lut)
+{
+    int cell;
+    float radius;
+
+    if (!(*lut = (uint16_t*)malloc(LUT_SIDE * LUT_SIDE * LUT_SIDE * sizeof(uint16_t))))
+    {
+        return false;
+    }
+
+    radius = 0.5f * (float)((1 << (8 - LUT_BITS)) - 1) * sqrtf(3.0f);
+
+#pragma omp parallel for
+    for (cell = 0; cell < LUT_SIDE * LUT_SIDE * LUT_SIDE; cell++)
+    {
+        float c[3], d, d1, d2;
+        size_t i, idx;
+        int e;
+
+        for (e = 0; e < 3; e++)
+        {
+            c[e] = (float)(((cell >> ((2 - e) * LUT_BITS)) & (LUT_SIDE - 1)) << (8 - LUT_BITS)) + 0.5f * (float)((1 << (8 - LUT_BITS)) - 1);
+        }
+
+        d1 = d2 = FLT_MAX;
+        idx = 0;
+        for (i = 0; i < paletteSize; i++)
+        {
+            d = NSHSquareDistance(c, palette + i * channels, channels);
+            if (d < d1)
+            {
+                d2 = d1;
+                d1 = d;
+                idx = i;
+            }
+            else if (d < d2)
+            {
+                d2 = d;
+            }
+        }
+
+        if ((paletteSize > 1) && (sqrtf(d2) - sqrtf(d1) <= 2.0f * radius + 0.01f))
+        {
+            idx |= LUT_AMBIGUOUS;
+        }
+        (*lut)[cell] = (uint16_t)idx;
+    }
+
     return true;
 }
 
 NOTESHRINKAPI bool NSHPaletteApply(unsigned char *img, int height, int width, int channels, float *palette, int paletteSize, NSHOption option, unsigned char *result)
 {
-    int d,  mChannels;
-    float p[3];
-    size_t i, k, imgSize, minIdx;
+    int y, mChannels;
+    size_t imgSize;
     bool* fgMask = NULL;
+    uint16_t *lut = NULL;
+    NSHClosestFunc closest = NSHClosestSelect(channels);
 
     imgSize = height * width;
     if (!(fgMask = (bool*)malloc(imgSize * sizeof(bool))))
@@ -638,25 +952,61 @@ NOTESHRINKAPI bool NSHPaletteApply(unsigned char *img, int height, int width, in
     FGMaskCreate(img, imgSize, channels, palette, paletteSize, option, fgMask);
     FGMaskDespeckle(fgMask, width, height, option);
     mChannels = (channels < 3) ? channels : 3;
-    k = 0;
-    for (i = 0; i <  imgSize; i++)
+    if ((mChannels == 3) && (paletteSize <= LUT_AMBIGUOUS))
     {
-        if (!fgMask[i])
+        if (!NSHPaletteLUTCreate(palette, paletteSize, channels, &lut))
         {
-            result[i] = 0;
+            free(fgMask);
+
+            return false;
         }
-        else
+    }
+
+#pragma omp parallel for
+    for (y = 0; y < height; y++)
+    {
+        int x, d;
+        float p[3];
+        size_t i, k;
+
+        i = (size_t)y * width;
+        k = i * channels;
+        for (x = 0; x < width; x++)
         {
-            for (d = 0; d < mChannels; d++)
+            if (!fgMask[i])
             {
-                p[d] = (float)img[k + d];
+                result[i] = 0;
             }
-            minIdx = NSHClosest(p, palette, paletteSize, channels);
-            result[i] = (unsigned char)minIdx;
+            else
+            {
+                uint16_t entry = LUT_AMBIGUOUS;
+
+                if (lut)
+                {
+                    entry = lut[((img[k] >> (8 - LUT_BITS)) << (2 * LUT_BITS)) | ((img[k + 1] >> (8 - LUT_BITS)) << LUT_BITS) | (img[k + 2] >> (8 - LUT_BITS))];
+                }
+                if (entry & LUT_AMBIGUOUS)
+                {
+                    for (d = 0; d < mChannels; d++)
+                    {
+                        p[d] = (float)img[k + d];
+                    }
+                    result[i] = (unsigned char)closest(p, palette, paletteSize, channels);
+                }
+                else
+                {
+                    result[i] = (unsigned char)entry;
+                }
+            }
+            i++;
+            k += channels;
         }
-        k += channels;
     }
     free(fgMask);
+    if (lut)
+    {
+        free(lut);
+    }
 
     return true;
 }
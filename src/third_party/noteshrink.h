@@ -34,6 +34,8 @@ typedef struct {
 
 NOTESHRINKAPI NSHOption NSHMakeDefaultOption();
 NOTESHRINKAPI bool NSHPaletteCreate(unsigned char *img, int height, int width, int channels, NSHOption option, float *palette, int paletteSize);
+NOTESHRINKAPI size_t NSHSamplePixels(unsigned char *img, int height, int width, int channels, NSHOption option, unsigned char *samples, size_t samplesSize);
+NOTESHRINKAPI bool NSHPaletteCreateFromSamples(unsigned char *samples, size_t samplesSize, int channels, NSHOption option, float *palette, int paletteSize);
 NOTESHRINKAPI bool NSHPaletteApply(unsigned char *img, int height, int width, int channels, float *palette, int paletteSize, NSHOption option, unsigned char *result);
 NOTESHRINKAPI bool NSHPaletteSaturate(float *palette, int paletteSize, int channels);
 NOTESHRINKAPI bool NSHPaletteNorm(float *palette, int paletteSize, int channels);
@@ -0,0 +1,255 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Checks that BW page with illustration rectangle is split into text mask without
+// the rectangle and background with only the rectangle (built in process with -mmr and -bgjpeg)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "../include/depress_converter.h"
+#include "../include/depress_bitmask.h"
+#include "../include/depress_iff.h"
+#include "../include/depress_mmr.h"
+
+// Decoder is built into depresscore
+#include "../src/third_party/stb_image.h"
+
+#define TEST_WIDTH 96
+#define TEST_HEIGHT 64
+
+// Illustration with edges on JPEG MCU boundaries
+static const depress_illustration_rect_type test_rect = { 32, 16, 32, 32 };
+
+static depress_djvulibre_paths_type test_paths;
+
+static bool testIsInRect(unsigned int x, unsigned int y)
+{
+	return x >= test_rect.x && x-test_rect.x < test_rect.width && y >= test_rect.y && y-test_rect.y < test_rect.height;
+}
+
+// White page with black lines of "text" crossing the rectangle and a dark gradient in the rectangle
+static void testMakePage(unsigned char *buf)
+{
+	unsigned int x, y;
+
+	for(y = 0; y < TEST_HEIGHT; y++)
+		for(x = 0; x < TEST_WIDTH; x++) {
+			unsigned char *p = buf+((size_t)y*TEST_WIDTH+x)*3;
+
+			if(testIsInRect(x, y)) {
+				p[0] = (unsigned char)(20+2*(x-test_rect.x));
+				p[1] = (unsigned char)(20+3*(y-test_rect.y));
+				p[2] = 60;
+			} else if((y >= 4 && y < 8) || (y >= 30 && y < 33) || (x >= 8 && x < 11))
+				memset(p, 0, 3);
+			else
+				memset(p, 255, 3);
+		}
+}
+
+static bool testLoadFromCtx(void *ctx, size_t id, int *sizex, int *sizey, int *channels, unsigned char **buf, depress_flags_type flags)
+{
+	(void)ctx;
+	(void)id;
+	(void)flags;
+
+	*buf = malloc((size_t)TEST_WIDTH*TEST_HEIGHT*3);
+	if(!*buf) return false;
+	testMakePage(*buf);
+
+	*sizex = TEST_WIDTH;
+	*sizey = TEST_HEIGHT;
+	*channels = 3;
+
+	return true;
+}
+
+static void testFreeCtx(void *ctx, size_t id)
+{
+	(void)ctx;
+	(void)id;
+}
+
+static wchar_t *testGetName(void *ctx, size_t id)
+{
+	(void)ctx;
+	(void)id;
+
+	return L"test_compound";
+}
+
+static const depress_iff_chunk_type *testFindChunk(const depress_iff_form_type *form, const char *id)
+{
+	size_t i;
+
+	for(i = 0; i < form->nof_chunks; i++)
+		if(!memcmp(form->chunks[i].id, id, 4)) return form->chunks+i;
+
+	return 0;
+}
+
+// Mask has text outside of the rectangle only, so it's coded the same as such mask made here
+static bool testCheckMask(const depress_iff_chunk_type *smmr, const unsigned char *page)
+{
+	depress_bitmask_type mask = { 0 };
+	unsigned char *data = 0;
+	size_t size = 0;
+	unsigned int x, y;
+	bool success = false;
+
+	if(!depressBitmaskCreate(&mask, TEST_WIDTH, TEST_HEIGHT)) return false;
+
+	for(y = 0; y < TEST_HEIGHT; y++)
+		for(x = 0; x < TEST_WIDTH; x++)
+			if(!testIsInRect(x, y) && page[((size_t)y*TEST_WIDTH+x)*3] < 128)
+				depressBitmaskRow(&mask, y)[x/8] |= (unsigned char)(0x80 >> (x%8));
+
+	if(!depressMmrEncode(&mask, &data, &size)) goto EXIT;
+
+	success = smmr->size == size && !memcmp(smmr->data, data, size);
+
+EXIT:
+	if(data) free(data);
+	depressBitmaskDestroy(&mask);
+
+	return success;
+}
+
+// Background is white outside of the rectangle and keeps the illustration inside it
+static bool testCheckBackground(const depress_iff_chunk_type *bgjp, const unsigned char *page)
+{
+	unsigned char *bg;
+	int sizex, sizey, channels;
+	unsigned int x, y;
+	long in_diff = 0, n = 0;
+	bool success = true;
+
+	bg = stbi_load_from_memory(bgjp->data, (int)bgjp->size, &sizex, &sizey, &channels, 3);
+	if(!bg) return false;
+	if(sizex != TEST_WIDTH || sizey != TEST_HEIGHT) success = false;
+
+	for(y = 0; y < TEST_HEIGHT && success; y++)
+		for(x = 0; x < TEST_WIDTH; x++) {
+			const unsigned char *p = page+((size_t)y*TEST_WIDTH+x)*3, *b = bg+((size_t)y*TEST_WIDTH+x)*3;
+			int c;
+
+			for(c = 0; c < 3; c++) {
+				if(!testIsInRect(x, y)) {
+					if(b[c] < 240) success = false;
+				} else {
+					in_diff += labs((long)b[c]-(long)p[c]);
+					n++;
+				}
+			}
+		}
+
+	if(success && in_diff > 8*n) success = false;
+
+	stbi_image_free(bg);
+
+	return success;
+}
+
+int main(void)
+{
+	depress_flags_type flags;
+	depress_load_image_type load_image;
+	depress_iff_form_type page = { 0 };
+	const depress_iff_chunk_type *info, *smmr, *bgjp;
+	depress_illustration_rect_type rect = test_rect;
+	unsigned char *source;
+	wchar_t tempfile[] = L"test_compound.tmp", outputfile[] = L"test_compound.djvu";
+	int failed = 0;
+
+	source = malloc((size_t)TEST_WIDTH*TEST_HEIGHT*3);
+	if(!source) return 1;
+	testMakePage(source);
+
+	memset(&flags, 0, sizeof(depress_flags_type));
+	flags.type = DEPRESS_PAGE_TYPE_BW;
+	flags.param1 = DEPRESS_PAGE_TYPE_BW_PARAM1_SIMPLE;
+	flags.quality = 100;
+	flags.dpi = 300;
+	flags.mmr = true;
+	flags.bgjpeg = true;
+	flags.illrects = &rect;
+	flags.nof_illrects = 1;
+
+	memset(&load_image, 0, sizeof(depress_load_image_type));
+	load_image.load_from_ctx = testLoadFromCtx;
+	load_image.free_ctx = testFreeCtx;
+	load_image.get_name = testGetName;
+
+	if(depressDjvuConvertPage(flags, load_image, 0, 0, tempfile, outputfile, &test_paths) != DEPRESS_CONVERT_PAGE_STATUS_OK) {
+		fprintf(stderr, "page is not converted\n");
+		failed++;
+	} else if(!depressIffLoad(outputfile, &page)) {
+		fprintf(stderr, "page is not loaded\n");
+		failed++;
+	} else {
+		info = testFindChunk(&page, "INFO");
+		smmr = testFindChunk(&page, "Smmr");
+		bgjp = testFindChunk(&page, "BGjp");
+
+		if(memcmp(page.form_id, "DJVU", 4) || page.nof_chunks != 3 || !info || !smmr || !bgjp) {
+			fprintf(stderr, "page should have INFO, Smmr and BGjp chunks\n");
+			failed++;
+		} else {
+			if(info->size != 10 || info->data[0]*256+info->data[1] != TEST_WIDTH || info->data[2]*256+info->data[3] != TEST_HEIGHT) {
+				fprintf(stderr, "page size\n");
+				failed++;
+			}
+			if(!testCheckMask(smmr, source)) {
+				fprintf(stderr, "text mask\n");
+				failed++;
+			}
+			if(!testCheckBackground(bgjp, source)) {
+				fprintf(stderr, "background\n");
+				failed++;
+			}
+		}
+	}
+
+	depressIffFree(&page);
+	free(source);
+	remove("test_compound.djvu");
+
+	if(failed) {
+		fprintf(stderr, "%d checks failed\n", failed);
+		return 1;
+	}
+
+	printf("compound: ok\n");
+
+	return 0;
+}
@@ -0,0 +1,163 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Checks that integral image doesn't change thresholding of layered pages and
+// that pages thresholded by tiles are close to the ones thresholded at once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Implementation is built in, so the internal functions can be called
+#define DJVUL_STATIC
+#define DJVUL_IMPLEMENTATION
+#define THRESHOLD_STATIC
+#define THRESHOLD_IMPLEMENTATION
+#include "../src/third_party/djvul.h"
+
+// Page is larger than one tile with halo in both directions
+#define TEST_WIDTH 2000
+#define TEST_HEIGHT 1800
+#define TEST_TILE 1024
+#define TEST_HALO 256
+#define TEST_BGS 3
+
+// Tolerance: share of mask pixels that may differ and mean difference of BG values
+#define TEST_MAX_MASK_DIFF 0.01
+#define TEST_MAX_BG_DIFF 4.0
+
+// Paper with uneven lighting, dark "letters" and a colored illustration
+static void testMakePage(unsigned char *buf, unsigned int width, unsigned int height)
+{
+	unsigned int x, y;
+
+	srand(1);
+
+	for(y = 0; y < height; y++)
+		for(x = 0; x < width; x++) {
+			unsigned char *p = buf+((size_t)y*width+x)*3;
+			int v;
+
+			v = 230-(int)(40*x/width)-(int)(30*y/height)+rand()%7;
+			p[0] = (unsigned char)v;
+			p[1] = (unsigned char)(v-5);
+			p[2] = (unsigned char)(v-15);
+
+			if(x > width/2 && x < width/2+600 && y > 300 && y < 900) {
+				p[0] = (unsigned char)(60+x%128);
+				p[1] = (unsigned char)(120+y%64);
+				p[2] = 40;
+			} else if(x%24 < 14 && y%40 < 22 && (x/24+y/40)%5 && (x%24 < 3 || y%40 < 3 || x%24 > 10)) {
+				p[0] = p[1] = p[2] = (unsigned char)(20+rand()%20);
+			}
+		}
+}
+
+int main(void)
+{
+	unsigned int widthbg, heightbg;
+	unsigned char *buf, *bg, *fg, *bg_tiled, *fg_tiled;
+	bool *mask, *mask_tiled;
+	size_t bg_size;
+	size_t i, n, mask_diff = 0;
+	double bg_diff = 0;
+	int ret = 1;
+
+	// Static functions of djvul.h the test doesn't call
+	(void)ImageDjvulThresholdMaskBits;
+	(void)ImageFGdownsample;
+	(void)ImageDjvuReconstruct;
+	(void)ImageDjvulSelect;
+
+	widthbg = (TEST_WIDTH+TEST_BGS-1)/TEST_BGS;
+	heightbg = (TEST_HEIGHT+TEST_BGS-1)/TEST_BGS;
+	n = (size_t)TEST_WIDTH*TEST_HEIGHT;
+	bg_size = (size_t)widthbg*heightbg*3;
+
+	buf = malloc(n*3);
+	mask = malloc(n*sizeof(bool));
+	mask_tiled = malloc(n*sizeof(bool));
+	bg = malloc(bg_size);
+	fg = malloc(bg_size);
+	bg_tiled = malloc(bg_size);
+	fg_tiled = malloc(bg_size);
+	if(!buf || !mask || !mask_tiled || !bg || !fg || !bg_tiled || !fg_tiled) {
+		printf("Can't allocate memory\n");
+
+		goto EXIT;
+	}
+
+	testMakePage(buf, TEST_WIDTH, TEST_HEIGHT);
+
+	// The same parameters as in depressDjvuConvertLayeredPage()
+	if(!ImageDjvulThreshold(buf, mask, bg, fg, TEST_WIDTH, TEST_HEIGHT, 3, TEST_BGS, 0, 1, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f)) {
+		printf("ImageDjvulThreshold failed\n");
+
+		goto EXIT;
+	}
+	// Blocks are scanned directly without integral image
+	if(!ImageDjvulThresholdWith(buf, mask_tiled, bg_tiled, fg_tiled, TEST_WIDTH, TEST_HEIGHT, 3, TEST_BGS, 0, 1, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, NULL)) {
+		printf("ImageDjvulThresholdWith failed\n");
+
+		goto EXIT;
+	}
+	if(memcmp(mask, mask_tiled, n*sizeof(bool)) || memcmp(bg, bg_tiled, bg_size) || memcmp(fg, fg_tiled, bg_size)) {
+		printf("Thresholding with integral image differs from direct scan\n");
+
+		goto EXIT;
+	}
+
+	if(!ImageDjvulThresholdTiled(buf, mask_tiled, bg_tiled, fg_tiled, TEST_WIDTH, TEST_HEIGHT, 3, TEST_BGS, 0, 1, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, TEST_TILE, TEST_HALO)) {
+		printf("ImageDjvulThresholdTiled failed\n");
+
+		goto EXIT;
+	}
+
+	for(i = 0; i < n; i++)
+		if(mask[i] != mask_tiled[i]) mask_diff++;
+	for(i = 0; i < bg_size; i++)
+		bg_diff += abs((int)bg[i]-(int)bg_tiled[i]);
+	bg_diff /= (double)bg_size;
+
+	printf("Mask pixels differ: %f%% (max %f%%), mean BG difference: %f (max %f)\n",
+		100.0*mask_diff/n, 100.0*TEST_MAX_MASK_DIFF, bg_diff, TEST_MAX_BG_DIFF);
+
+	if((double)mask_diff/n <= TEST_MAX_MASK_DIFF && bg_diff <= TEST_MAX_BG_DIFF) ret = 0;
+
+EXIT:
+	free(buf);
+	free(mask);
+	free(mask_tiled);
+	free(bg);
+	free(fg);
+	free(bg_tiled);
+	free(fg_tiled);
+
+	return ret;
+}
@@ -0,0 +1,221 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Checks byte layout of DjVu pages written by depressIffSave and depressIffAddDjvuInfo
+// and that depressIffLoad reads back what was written
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "../include/depress_iff.h"
+
+#define TEST_FILE L"test_iff.djvu"
+#define TEST_FILE_A "test_iff.djvu"
+
+static size_t testReadFile(unsigned char *buf, size_t max_size)
+{
+	FILE *f;
+	size_t size;
+
+	f = fopen(TEST_FILE_A, "rb");
+	if(!f) return 0;
+	size = fread(buf, 1, max_size, f);
+	fclose(f);
+
+	return size;
+}
+
+static bool testWriteFile(const unsigned char *buf, size_t size)
+{
+	FILE *f;
+	bool success;
+
+	f = fopen(TEST_FILE_A, "wb");
+	if(!f) return false;
+	success = fwrite(buf, 1, size, f) == size;
+	if(fclose(f)) success = false;
+
+	return success;
+}
+
+// Width and height are big endian, version and dpi are little endian
+static bool testInfo(void)
+{
+	static const unsigned char expected[10] = { 0x04, 0xd2, 0x02, 0x37, 26, 0, 0x58, 0x02, 22, 1 };
+	depress_iff_form_type form = { 0 };
+	bool success = false;
+
+	if(!depressIffAddDjvuInfo(&form, 1234, 567, 600)) goto EXIT;
+	if(form.nof_chunks != 1 || memcmp(form.chunks[0].id, "INFO", 4) || form.chunks[0].size != 10) goto EXIT;
+	if(memcmp(form.chunks[0].data, expected, 10)) goto EXIT;
+
+	// Wrong dpi is replaced with 300
+	if(!depressIffAddDjvuInfo(&form, 1, 1, 0)) goto EXIT;
+	if(form.chunks[1].data[6] != 0x2c || form.chunks[1].data[7] != 0x01) goto EXIT;
+
+	// Page size should fit in 16 bits
+	if(depressIffAddDjvuInfo(&form, 0, 1, 300) || depressIffAddDjvuInfo(&form, 1, 0x10000, 300)) goto EXIT;
+	if(form.nof_chunks != 2) goto EXIT;
+
+	success = true;
+
+EXIT:
+	depressIffFree(&form);
+
+	return success;
+}
+
+// Odd chunks are padded with zero byte if another chunk follows, the last one isn't padded
+static bool testSaveLoad(void)
+{
+	static const unsigned char sjbz[3] = { 1, 2, 3 }, bg44[5] = { 4, 5, 6, 7, 8 };
+	static const unsigned char expected[] = {
+		'A', 'T', '&', 'T', 'F', 'O', 'R', 'M', 0, 0, 0, 47, 'D', 'J', 'V', 'U',
+		'I', 'N', 'F', 'O', 0, 0, 0, 10, 0, 100, 0, 50, 26, 0, 0x2c, 0x01, 22, 1,
+		'S', 'j', 'b', 'z', 0, 0, 0, 3, 1, 2, 3, 0,
+		'B', 'G', '4', '4', 0, 0, 0, 5, 4, 5, 6, 7, 8
+	};
+	depress_iff_form_type form = { 0 }, loaded = { 0 }, copy = { 0 };
+	unsigned char file[128];
+	size_t size, nof_copied = 0, i;
+	bool success = false;
+
+	memcpy(form.form_id, "DJVU", 4);
+	if(!depressIffAddDjvuInfo(&form, 100, 50, 300)) goto EXIT;
+	if(!depressIffAddChunk(&form, "Sjbz", sjbz, sizeof(sjbz))) goto EXIT;
+	if(!depressIffAddChunk(&form, "BG44", bg44, sizeof(bg44))) goto EXIT;
+
+	if(!depressIffSave(TEST_FILE, &form)) goto EXIT;
+	size = testReadFile(file, sizeof(file));
+	if(size != sizeof(expected) || memcmp(file, expected, size)) {
+		fprintf(stderr, "saved page differs from expected bytes\n");
+		goto EXIT;
+	}
+
+	if(!depressIffLoad(TEST_FILE, &loaded)) goto EXIT;
+	if(memcmp(loaded.form_id, "DJVU", 4) || loaded.nof_chunks != form.nof_chunks) goto EXIT;
+	for(i = 0; i < form.nof_chunks; i++) {
+		if(memcmp(loaded.chunks[i].id, form.chunks[i].id, 4) || loaded.chunks[i].size != form.chunks[i].size) goto EXIT;
+		if(memcmp(loaded.chunks[i].data, form.chunks[i].data, form.chunks[i].size)) goto EXIT;
+	}
+
+	// Chunks are copied under new name, as BG44 of c44 output becomes FG44
+	if(!depressIffCopyChunks(&copy, &loaded, "BG44", "FG44", &nof_copied) || nof_copied != 1) goto EXIT;
+	if(memcmp(copy.chunks[0].id, "FG44", 4) || copy.chunks[0].size != 5 || memcmp(copy.chunks[0].data, bg44, 5)) goto EXIT;
+
+	// File without AT&T magic and with padded last chunk is read too
+	memcpy(file, expected+4, sizeof(expected)-4);
+	file[7] = 48;
+	file[sizeof(expected)-4] = 0;
+	if(!testWriteFile(file, sizeof(expected)-3)) goto EXIT;
+	depressIffFree(&loaded);
+	if(!depressIffLoad(TEST_FILE, &loaded) || loaded.nof_chunks != 3 || loaded.chunks[2].size != 5) goto EXIT;
+
+	success = true;
+
+EXIT:
+	depressIffFree(&form);
+	depressIffFree(&loaded);
+	depressIffFree(&copy);
+
+	return success;
+}
+
+// Truncated files and chunks larger than the FORM are rejected
+static bool testMalformed(void)
+{
+	depress_iff_form_type form = { 0 }, loaded = { 0 };
+	unsigned char file[128], damaged[128];
+	size_t size, cut;
+	int failed = 0;
+
+	memcpy(form.form_id, "DJVU", 4);
+	if(!depressIffAddDjvuInfo(&form, 100, 50, 300) || !depressIffAddChunk(&form, "Sjbz", (const unsigned char *)"abc", 3) || !depressIffSave(TEST_FILE, &form)) {
+		depressIffFree(&form);
+
+		return false;
+	}
+	depressIffFree(&form);
+	size = testReadFile(file, sizeof(file));
+	if(!size) return false;
+
+	for(cut = 0; cut < size; cut++) {
+		if(!testWriteFile(file, cut)) return false;
+		if(depressIffLoad(TEST_FILE, &loaded)) {
+			fprintf(stderr, "page cut to %u bytes is loaded\n", (unsigned int)cut);
+			depressIffFree(&loaded);
+			failed++;
+		}
+	}
+
+	// Size of Sjbz chunk goes past the end of FORM
+	memcpy(damaged, file, size);
+	damaged[16+8+10+7] = 4;
+	if(!testWriteFile(damaged, size)) return false;
+	if(depressIffLoad(TEST_FILE, &loaded)) {
+		fprintf(stderr, "chunk larger than FORM is loaded\n");
+		depressIffFree(&loaded);
+		failed++;
+	}
+
+	// Not a FORM
+	memcpy(damaged, file, size);
+	damaged[4] = 'X';
+	if(!testWriteFile(damaged, size)) return false;
+	if(depressIffLoad(TEST_FILE, &loaded)) {
+		fprintf(stderr, "file without FORM is loaded\n");
+		depressIffFree(&loaded);
+		failed++;
+	}
+
+	return failed == 0;
+}
+
+int main(void)
+{
+	int failed = 0;
+
+	if(!testInfo()) { fprintf(stderr, "INFO chunk\n"); failed++; }
+	if(!testSaveLoad()) { fprintf(stderr, "save and load\n"); failed++; }
+	if(!testMalformed()) failed++;
+
+	remove(TEST_FILE_A);
+
+	if(failed) {
+		fprintf(stderr, "%d checks failed\n", failed);
+		return 1;
+	}
+
+	printf("iff: ok\n");
+
+	return 0;
+}
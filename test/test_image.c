@@ -0,0 +1,326 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Checks image processing of depresscore on small generated pages and saving of palettized pages
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../include/depress_flags.h"
+#include "../include/depress_image.h"
+#include "../include/ppm_save.h"
+
+#define TEST_DIFFUSION_SIZE 256
+
+// Every pixel passes its whole error to neighbours, so only error that leaves
+// the page through its edges is lost and the number of white pixels of a flat
+// gray page stays close to gray*size/255
+static bool testErrorDiffusion(int kernel)
+{
+	static const unsigned char grays[] = { 8, 48, 88, 128, 168, 208, 248 };
+	unsigned char *buf;
+	size_t i, j, size;
+	int failed = 0;
+
+	size = (size_t)TEST_DIFFUSION_SIZE*TEST_DIFFUSION_SIZE;
+	buf = malloc(size);
+	if(!buf) return false;
+
+	for(i = 0; i < sizeof(grays); i++) {
+		long white = 0, expected;
+
+		memset(buf, grays[i], size);
+		if(!depressImageApplyErrorDiffusion(buf, TEST_DIFFUSION_SIZE, TEST_DIFFUSION_SIZE, kernel)) {
+			failed++;
+			continue;
+		}
+
+		for(j = 0; j < size; j++) {
+			if(buf[j] == 255) white++;
+			else if(buf[j]) break;
+		}
+
+		expected = (long)grays[i]*(long)size/255;
+		if(j < size || labs(white-expected) > TEST_DIFFUSION_SIZE) {
+			fprintf(stderr, "gray %d: %ld white pixels instead of %ld\n", grays[i], white, expected);
+			failed++;
+		}
+	}
+
+	free(buf);
+
+	return failed == 0;
+}
+
+#define TEST_PAGE_SIZE 512
+
+// White page with lines of glyph outlines, like text
+static unsigned char *testMakeTextPage(int channels)
+{
+	unsigned char *buf;
+	int x, y;
+
+	buf = malloc((size_t)TEST_PAGE_SIZE*TEST_PAGE_SIZE*channels);
+	if(!buf) return 0;
+	memset(buf, 255, (size_t)TEST_PAGE_SIZE*TEST_PAGE_SIZE*channels);
+
+	for(y = 16; y < TEST_PAGE_SIZE-16; y++)
+		for(x = 16; x < TEST_PAGE_SIZE-16; x++) {
+			int gx = (x-16)%12, gy = (y-16)%20;
+
+			// Glyph is 8x10 box with 2 pixel strokes
+			if(gx >= 8 || gy >= 10) continue;
+			if(gx < 2 || gx >= 6 || gy < 2 || gy >= 8)
+				memset(buf+((size_t)y*TEST_PAGE_SIZE+x)*channels, 0, channels);
+		}
+
+	return buf;
+}
+
+static void testFillRect(unsigned char *buf, int channels, const depress_illustration_rect_type *r, int kind)
+{
+	unsigned int x, y;
+
+	for(y = r->y; y < r->y+r->height; y++)
+		for(x = r->x; x < r->x+r->width; x++) {
+			unsigned char *p = buf+((size_t)y*TEST_PAGE_SIZE+x)*channels;
+			int c;
+
+			for(c = 0; c < channels; c++) {
+				if(kind == 0) // Photo
+					p[c] = (unsigned char)(60+(x-r->x+y-r->y)*140/(r->width+r->height));
+				else if(kind == 1) // Halftone of 2x2 black dots
+					p[c] = (x%4 < 2 && y%4 < 2)?0:255;
+				else // Light saturated yellow
+					p[c] = (c == 2)?0:255;
+			}
+		}
+}
+
+// Found rectangle covers the illustration and goes out of it by no more than two cells
+static bool testIsRectFound(const depress_illustration_rect_type *found, const depress_illustration_rect_type *r)
+{
+	const unsigned int margin = 8;
+
+	if(found->x > r->x || found->y > r->y) return false;
+	if(found->x+found->width < r->x+r->width || found->y+found->height < r->y+r->height) return false;
+	if(r->x-found->x > margin || r->y-found->y > margin) return false;
+	if(found->x+found->width-r->x-r->width > margin || found->y+found->height-r->y-r->height > margin) return false;
+
+	return true;
+}
+
+static bool testIllrects(int kind, int channels)
+{
+	static const depress_illustration_rect_type rect = { 160, 128, 192, 160 };
+	depress_illustration_rect_type *illrects = 0;
+	unsigned char *buf;
+	size_t nof_illrects = 0;
+	bool success;
+
+	buf = testMakeTextPage(channels);
+	if(!buf) return false;
+	if(kind >= 0) testFillRect(buf, channels, &rect, kind);
+
+	success = depressImageDetectIllrects(buf, TEST_PAGE_SIZE, TEST_PAGE_SIZE, channels, &illrects, &nof_illrects);
+	if(success) {
+		if(kind < 0)
+			success = nof_illrects == 0;
+		else
+			success = nof_illrects == 1 && testIsRectFound(illrects, &rect);
+	}
+
+	if(illrects) free(illrects);
+	free(buf);
+
+	return success;
+}
+
+// Colors get indices in order of appearance, the most frequent one is background
+static bool testMakeIndexed(void)
+{
+	static const unsigned char colors[4][3] = { { 0, 0, 0 }, { 255, 255, 255 }, { 200, 16, 16 }, { 16, 16, 200 } };
+	static const unsigned char pixels[] = {
+		0, 1, 1, 2, 1,
+		1, 1, 2, 2, 1,
+		0, 1, 1, 1, 1
+	};
+	unsigned char buf[sizeof(pixels)*3], palette[3*256], *indices = 0, *many;
+	int nof_colors = 0, bg_index = -1;
+	size_t i;
+	bool success = false;
+
+	for(i = 0; i < sizeof(pixels); i++)
+		memcpy(buf+3*i, colors[pixels[i]], 3);
+
+	if(!depressImageMakeIndexed(buf, 5, 3, 3, palette, &nof_colors, &indices, &bg_index)) return false;
+	if(nof_colors != 3 || bg_index != 1 || memcmp(palette, colors, 9)) goto EXIT;
+	for(i = 0; i < sizeof(pixels); i++)
+		if(indices[i] != pixels[i]) goto EXIT;
+	free(indices);
+	indices = 0;
+
+	// More colors than allowed
+	if(depressImageMakeIndexed(buf, 5, 3, 2, palette, &nof_colors, &indices, &bg_index) || indices) goto EXIT;
+
+	// All 256 colors fit, one more doesn't
+	many = malloc(257*3);
+	if(!many) goto EXIT;
+	for(i = 0; i < 257; i++) {
+		many[3*i] = (unsigned char)i;
+		many[3*i+1] = (unsigned char)(i*7);
+		many[3*i+2] = (unsigned char)(i >> 8);
+	}
+	success = depressImageMakeIndexed(many, 256, 1, 256, palette, &nof_colors, &indices, &bg_index) && nof_colors == 256;
+	for(i = 0; success && i < 256; i++)
+		if(indices[i] != i || memcmp(palette+3*i, many+3*i, 3)) success = false;
+	if(indices) free(indices);
+	indices = 0;
+	if(success && depressImageMakeIndexed(many, 257, 1, 256, palette, &nof_colors, &indices, &bg_index)) success = false;
+	free(many);
+
+EXIT:
+	if(indices) free(indices);
+
+	return success;
+}
+
+static size_t testPutRun(unsigned char *p, unsigned int color, unsigned int length)
+{
+	p[0] = (unsigned char)(color >> 4);
+	p[1] = (unsigned char)(((color & 0xf) << 4) | (length >> 16));
+	p[2] = (unsigned char)(length >> 8);
+	p[3] = (unsigned char)length;
+
+	return 4;
+}
+
+// Writes R6 image to temporary file and compares it with expected bytes
+static bool testCompareRle(unsigned int sizex, unsigned int sizey, unsigned char *indices, unsigned char *palette, unsigned int colors, unsigned int transparent, const unsigned char *expected, size_t expected_size)
+{
+	unsigned char *data;
+	FILE *f;
+	size_t size;
+	bool success = false;
+
+	f = tmpfile();
+	if(!f) return false;
+
+	data = malloc(expected_size+1);
+	if(!data) {
+		fclose(f);
+
+		return false;
+	}
+
+	if(ppmRleSave(sizex, sizey, indices, palette, colors, transparent, f)) {
+		rewind(f);
+		size = fread(data, 1, expected_size+1, f);
+		success = size == expected_size && !memcmp(data, expected, size);
+	}
+
+	free(data);
+	fclose(f);
+
+	return success;
+}
+
+// Runs are 12 bits of color index (0xfff for transparent) and 20 bits of length,
+// they don't cross rows and are split after 0xfffff pixels
+static bool testRleSave(void)
+{
+	unsigned char indices[6] = { 0, 0, 1, 2, 2, 2 }, palette[9] = { 10, 20, 30, 40, 50, 60, 255, 255, 250 };
+	unsigned char expected[256], *row = 0, *long_expected = 0;
+	size_t size;
+	const unsigned int long_row = 0xfffff+2;
+	unsigned int bg_sizex, i;
+	bool success = false;
+
+	size = sprintf((char *)expected, "R6\n3 2 3\n");
+	memcpy(expected+size, palette, 9); size += 9;
+	size += testPutRun(expected+size, 0, 2);
+	size += testPutRun(expected+size, 1, 1);
+	size += testPutRun(expected+size, 0xfff, 3);
+	size += sprintf((char *)expected+size, "P6\n1 1\n255\n");
+	memcpy(expected+size, palette+6, 3); size += 3;
+	if(!testCompareRle(3, 2, indices, palette, 3, 2, expected, size)) return false;
+
+	// Transparent color should be in palette
+	if(testCompareRle(3, 2, indices, palette, 3, 3, expected, size)) return false;
+
+	// Background of the long row is 1/12 of its width
+	bg_sizex = (long_row+11)/12;
+	row = malloc(long_row);
+	long_expected = malloc(128+3*(size_t)bg_sizex);
+	if(!row || !long_expected) goto EXIT;
+	memset(row, 1, long_row);
+
+	size = sprintf((char *)long_expected, "R6\n%u 1 2\n", long_row);
+	memcpy(long_expected+size, palette, 6); size += 6;
+	size += testPutRun(long_expected+size, 1, 0xfffff);
+	size += testPutRun(long_expected+size, 1, 2);
+	size += sprintf((char *)long_expected+size, "P6\n%u 1\n255\n", bg_sizex);
+	for(i = 0; i < bg_sizex; i++) {
+		memcpy(long_expected+size, palette, 3);
+		size += 3;
+	}
+
+	success = testCompareRle(long_row, 1, row, palette, 2, 0, long_expected, size);
+
+EXIT:
+	if(row) free(row);
+	if(long_expected) free(long_expected);
+
+	return success;
+}
+
+int main(void)
+{
+	int failed = 0;
+
+	if(!testErrorDiffusion(DEPRESS_PAGE_TYPE_BW_PARAM2_FLOYDSTEINBERG)) { fprintf(stderr, "Floyd-Steinberg diffusion\n"); failed++; }
+	if(!testErrorDiffusion(DEPRESS_PAGE_TYPE_BW_PARAM2_STUCKI)) { fprintf(stderr, "Stucki diffusion\n"); failed++; }
+	if(!testIllrects(-1, 1)) { fprintf(stderr, "illustrations on text page\n"); failed++; }
+	if(!testIllrects(0, 1)) { fprintf(stderr, "gray photo\n"); failed++; }
+	if(!testIllrects(0, 3)) { fprintf(stderr, "color photo\n"); failed++; }
+	if(!testIllrects(1, 1)) { fprintf(stderr, "halftone\n"); failed++; }
+	if(!testIllrects(2, 3)) { fprintf(stderr, "saturated colors\n"); failed++; }
+	if(!testMakeIndexed()) { fprintf(stderr, "indexed image\n"); failed++; }
+	if(!testRleSave()) { fprintf(stderr, "R6 image\n"); failed++; }
+
+	if(failed) {
+		fprintf(stderr, "%d checks failed\n", failed);
+		return 1;
+	}
+
+	printf("image: ok\n");
+
+	return 0;
+}
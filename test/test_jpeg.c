@@ -0,0 +1,220 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Checks that pages encoded with built-in JPEG encoder decode with stb_image close
+// to the source and that JPEG headers DjVu viewers can't decode are rejected
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include <string.h>
+
+#include "../include/depress_jpeg.h"
+
+// Decoder is built into depresscore
+#include "../src/third_party/stb_image.h"
+
+// Minimal PSNR of decoded page at quality 90, in dB
+#define TEST_MIN_PSNR 30.0
+
+// Smooth gradients and a colored box with edges on MCU boundaries, so chroma subsampling
+// doesn't blur them
+static unsigned char *testMakePage(unsigned int width, unsigned int height, int channels)
+{
+	unsigned char *buf;
+	unsigned int x, y;
+	int c;
+
+	buf = malloc((size_t)width*height*channels);
+	if(!buf) return 0;
+
+	for(y = 0; y < height; y++)
+		for(x = 0; x < width; x++)
+			for(c = 0; c < channels; c++) {
+				unsigned int v;
+
+				if(c == 0) v = x*255/width;
+				else if(c == 1) v = y*255/height;
+				else v = 128;
+				if(x >= 16 && x < ((width-1) & ~15u) && y >= 16 && y < ((height-1) & ~15u)) v = 40+(unsigned int)c*80;
+				buf[((size_t)y*width+x)*channels+c] = (unsigned char)v;
+			}
+
+	return buf;
+}
+
+static bool testRoundTrip(unsigned int width, unsigned int height, int channels)
+{
+	unsigned char *page, *data = 0, *decoded = 0;
+	unsigned int info_width = 0, info_height = 0;
+	int info_channels = 0, dec_width, dec_height, dec_channels;
+	size_t size, i, n;
+	double sum = 0.0, psnr;
+	bool success = false;
+
+	page = testMakePage(width, height, channels);
+	if(!page) goto EXIT;
+
+	if(!depressJpegEncode(width, height, channels, page, 90, &data, &size)) {
+		fprintf(stderr, "%ux%ux%d: can't encode\n", width, height, channels);
+		goto EXIT;
+	}
+
+	if(!depressJpegGetInfo(data, size, &info_width, &info_height, &info_channels)
+		|| info_width != width || info_height != height || info_channels != channels) {
+		fprintf(stderr, "%ux%ux%d: wrong header\n", width, height, channels);
+		goto EXIT;
+	}
+
+	decoded = stbi_load_from_memory(data, (int)size, &dec_width, &dec_height, &dec_channels, channels);
+	if(!decoded || dec_width != (int)width || dec_height != (int)height || dec_channels != channels) {
+		fprintf(stderr, "%ux%ux%d: can't decode\n", width, height, channels);
+		goto EXIT;
+	}
+
+	n = (size_t)width*height*channels;
+	for(i = 0; i < n; i++) {
+		double d = (double)page[i]-(double)decoded[i];
+
+		sum += d*d;
+	}
+	psnr = (sum > 0.0)?10.0*log10(255.0*255.0*(double)n/sum):99.0;
+	if(psnr < TEST_MIN_PSNR) {
+		fprintf(stderr, "%ux%ux%d: PSNR %.2f dB is too low\n", width, height, channels, psnr);
+		goto EXIT;
+	}
+
+	success = true;
+
+EXIT:
+	if(page) free(page);
+	if(data) free(data);
+	if(decoded) stbi_image_free(decoded);
+
+	return success;
+}
+
+// Lower quality gives smaller file
+static bool testQuality(void)
+{
+	unsigned char *page, *data_low = 0, *data_high = 0;
+	size_t size_low = 0, size_high = 0;
+	bool success = false;
+
+	page = testMakePage(320, 240, 3);
+	if(!page) goto EXIT;
+
+	if(!depressJpegEncode(320, 240, 3, page, 10, &data_low, &size_low)) goto EXIT;
+	if(!depressJpegEncode(320, 240, 3, page, 100, &data_high, &size_high)) goto EXIT;
+
+	success = size_low < size_high;
+
+EXIT:
+	if(!success) fprintf(stderr, "quality doesn't change size\n");
+	if(page) free(page);
+	if(data_low) free(data_low);
+	if(data_high) free(data_high);
+
+	return success;
+}
+
+static bool testMalformed(void)
+{
+	unsigned char page[16*16*3] = { 0 }, *data = 0, *copy = 0;
+	unsigned int width, height;
+	int channels, failed = 0;
+	size_t size = 0, sof;
+
+	// Invalid arguments of encoder
+	if(depressJpegEncode(0, 16, 3, page, 90, &data, &size)) failed++;
+	if(depressJpegEncode(16, 70000, 3, page, 90, &data, &size)) failed++;
+	if(depressJpegEncode(16, 16, 2, page, 90, &data, &size)) failed++;
+
+	if(!depressJpegEncode(16, 16, 3, page, 90, &data, &size)) return false;
+	copy = malloc(size);
+	if(!copy) {
+		free(data);
+		return false;
+	}
+
+	// No SOI, truncated headers
+	if(depressJpegGetInfo(data+1, size-1, &width, &height, &channels)) failed++;
+	if(depressJpegGetInfo(data, 3, &width, &height, &channels)) failed++;
+	for(sof = 2; sof+1 < size; sof++)
+		if(data[sof] == 0xff && data[sof+1] == 0xc0) break;
+	if(sof+1 >= size) {
+		failed++;
+		goto EXIT;
+	}
+	if(depressJpegGetInfo(data, sof+6, &width, &height, &channels)) failed++;
+
+	// 12 bit precision, arithmetic coding, zero width, 4 channels
+	memcpy(copy, data, size);
+	copy[sof+4] = 12;
+	if(depressJpegGetInfo(copy, size, &width, &height, &channels)) failed++;
+	memcpy(copy, data, size);
+	copy[sof+1] = 0xc9;
+	if(depressJpegGetInfo(copy, size, &width, &height, &channels)) failed++;
+	memcpy(copy, data, size);
+	copy[sof+7] = copy[sof+8] = 0;
+	if(depressJpegGetInfo(copy, size, &width, &height, &channels)) failed++;
+	memcpy(copy, data, size);
+	copy[sof+9] = 4;
+	if(depressJpegGetInfo(copy, size, &width, &height, &channels)) failed++;
+
+EXIT:
+	if(failed) fprintf(stderr, "%d malformed JPEG checks failed\n", failed);
+	free(data);
+	free(copy);
+
+	return failed == 0;
+}
+
+int main(void)
+{
+	int failed = 0;
+
+	if(!testRoundTrip(301, 203, 3)) failed++;
+	if(!testRoundTrip(301, 203, 1)) failed++;
+	if(!testRoundTrip(17, 9, 3)) failed++;
+	if(!testRoundTrip(1, 1, 1)) failed++;
+	if(!testRoundTrip(17, 9, 1)) failed++;
+	if(!testRoundTrip(34, 18, 3)) failed++;
+	if(!testQuality()) failed++;
+	if(!testMalformed()) failed++;
+
+	if(failed) {
+		fprintf(stderr, "%d checks failed\n", failed);
+		return 1;
+	}
+
+	printf("jpeg: ok\n");
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Checks that BW page encoded with linked DjVuLibre decodes to the same bitmap
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "DjVuGlobal.h"
+#include "GBitmap.h"
+#include "GString.h"
+#include "JB2Image.h"
+#include "ByteStream.h"
+#include "IFFByteStream.h"
+
+#include "../include/depress_libdjvu.h"
+
+#ifdef HAVE_NAMESPACES
+using namespace DJVU;
+#endif
+
+#define TEST_WIDTH 301
+#define TEST_HEIGHT 203
+
+// Several "letters", a ring and a diagonal line (8-connected only)
+static void testMakePage(unsigned char *buf)
+{
+	unsigned int x, y;
+
+	for(y = 0; y < TEST_HEIGHT; y++)
+		for(x = 0; x < TEST_WIDTH; x++) {
+			bool black = false;
+			int dx = (int)x-220, dy = (int)y-60;
+
+			if(x%20 < 12 && y%30 < 20 && (x%20 < 3 || y%30 < 3) && y < 150) black = true;
+			if(dx*dx+dy*dy < 30*30 && dx*dx+dy*dy > 20*20) black = true;
+			if(y > 160 && x == y+90) black = true;
+
+			buf[(size_t)y*TEST_WIDTH+x] = black?(unsigned char)(x%100):(unsigned char)(128+y%128);
+		}
+}
+
+int main(void)
+{
+	unsigned char *buf, *data = 0;
+	size_t size = 0;
+	int ret = 1;
+
+	buf = (unsigned char *)malloc(TEST_WIDTH*TEST_HEIGHT);
+	if(!buf) return 1;
+	testMakePage(buf);
+
+	if(!depressLibdjvuEncodeBW(TEST_WIDTH, TEST_HEIGHT, buf, 300, &data, &size)) {
+		printf("depressLibdjvuEncodeBW failed\n");
+		free(buf);
+
+		return 1;
+	}
+
+	try {
+		GP<ByteStream> ibs = ByteStream::create(data, size);
+		GP<IFFByteStream> giff = IFFByteStream::create(ibs);
+		GP<JB2Image> jimg = JB2Image::create();
+		GP<GBitmap> bitmap;
+		GUTF8String chkid;
+		bool has_sjbz = false, same = true;
+		unsigned int x, y;
+
+		if(!giff->get_chunk(chkid) || chkid != "FORM:DJVU") throw 0;
+		while(giff->get_chunk(chkid)) {
+			if(chkid == "Sjbz") {
+				jimg->decode(giff->get_bytestream());
+				has_sjbz = true;
+			}
+			giff->close_chunk();
+		}
+		if(!has_sjbz) throw 0;
+
+		bitmap = jimg->get_bitmap();
+		if(bitmap->rows() != TEST_HEIGHT || bitmap->columns() != TEST_WIDTH) throw 0;
+
+		// Rows of GBitmap start from the bottom
+		for(y = 0; y < TEST_HEIGHT; y++) {
+			const unsigned char *row = (*bitmap)[TEST_HEIGHT-1-y];
+
+			for(x = 0; x < TEST_WIDTH; x++)
+				if((row[x] != 0) != (buf[(size_t)y*TEST_WIDTH+x] < 128)) same = false;
+		}
+
+		printf("Shapes: %d, bitmaps are %s\n", jimg->get_shape_count(), same?"the same":"different");
+
+		if(same && jimg->get_shape_count() > 1) ret = 0;
+	} catch(...) {
+		printf("Can't decode page\n");
+	}
+
+	free(data);
+	free(buf);
+
+	return ret;
+}
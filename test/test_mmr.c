@@ -0,0 +1,273 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Checks that pages encoded with built-in G4/MMR encoder decode back to the same
+// pixels and that malformed G4 data is rejected
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../include/depress_bitmask.h"
+#include "../include/depress_mmr.h"
+
+// Width is not multiple of 8 and page has three strips, the last one is short
+#define TEST_WIDTH 1203
+#define TEST_HEIGHT 1100
+
+static uint32_t testReadBE(const unsigned char *p, int bytes)
+{
+	uint32_t v = 0;
+
+	while(bytes--)
+		v = (v << 8) | *p++;
+
+	return v;
+}
+
+// Text-like strokes, a solid block, a noisy region and a fully black row
+static void testMakePage(depress_bitmask_type *mask)
+{
+	unsigned int x, y;
+
+	srand(1);
+
+	for(y = 0; y < mask->height; y++) {
+		unsigned char *row = depressBitmaskRow(mask, y);
+
+		for(x = 0; x < mask->width; x++) {
+			bool black;
+
+			if(y == 700)
+				black = true;
+			else if(y >= 100 && y < 300 && x >= 50 && x < 1200)
+				black = ((x/7)%3 == 0) || ((y/11)%4 == 0 && (x/5)%2 == 0);
+			else if(y >= 400 && y < 520 && x >= 200 && x < 600)
+				black = true;
+			else if(y >= 800 && y < 1000)
+				black = (rand()%3 == 0);
+			else
+				black = (x == y) || (x+y == 1000);
+
+			if(black) row[x/8] |= (unsigned char)(0x80 >> (x%8));
+		}
+	}
+}
+
+// Decodes Smmr chunk made by depressMmrEncode into mask
+static bool testDecodeChunk(const unsigned char *data, size_t size, depress_bitmask_type *mask)
+{
+	unsigned int width, height, rows_per_strip, y;
+	size_t pos;
+
+	if(size < 10 || testReadBE(data, 4) != 0x4d4d5202) return false;
+
+	width = testReadBE(data+4, 2);
+	height = testReadBE(data+6, 2);
+	rows_per_strip = testReadBE(data+8, 2);
+	if(width != mask->width || height != mask->height || !rows_per_strip) return false;
+
+	pos = 10;
+	for(y = 0; y < height; y += rows_per_strip) {
+		unsigned int rows;
+		size_t strip_size;
+
+		if(size-pos < 4) return false;
+		strip_size = testReadBE(data+pos, 4);
+		pos += 4;
+		if(size-pos < strip_size) return false;
+
+		rows = (height-y < rows_per_strip)?(height-y):rows_per_strip;
+		if(!depressMmrDecode(data+pos, strip_size, width, rows, depressBitmaskRow(mask, y), mask->stride))
+			return false;
+		pos += strip_size;
+	}
+
+	return pos == size;
+}
+
+static bool testMasksEqual(const depress_bitmask_type *a, const depress_bitmask_type *b)
+{
+	unsigned int y;
+
+	for(y = 0; y < a->height; y++)
+		if(memcmp(depressBitmaskRow(a, y), depressBitmaskRow(b, y), (a->width+7)/8)) return false;
+
+	return true;
+}
+
+static bool testRoundTrip(unsigned int width, unsigned int height, bool fill)
+{
+	depress_bitmask_type mask = { 0 }, decoded = { 0 };
+	unsigned char *data = 0;
+	size_t size = 0;
+	bool success = false;
+
+	if(!depressBitmaskCreate(&mask, width, height) || !depressBitmaskCreate(&decoded, width, height)) goto EXIT;
+
+	if(fill) {
+		unsigned int y;
+
+		for(y = 0; y < height; y++) {
+			unsigned int x;
+
+			for(x = 0; x < width; x++)
+				depressBitmaskRow(&mask, y)[x/8] |= (unsigned char)(0x80 >> (x%8));
+		}
+	} else
+		testMakePage(&mask);
+
+	if(!depressMmrEncode(&mask, &data, &size)) {
+		fprintf(stderr, "%ux%u: can't encode\n", width, height);
+		goto EXIT;
+	}
+	if(!testDecodeChunk(data, size, &decoded)) {
+		fprintf(stderr, "%ux%u: can't decode\n", width, height);
+		goto EXIT;
+	}
+	if(!testMasksEqual(&mask, &decoded)) {
+		fprintf(stderr, "%ux%u: decoded page differs\n", width, height);
+		goto EXIT;
+	}
+
+	success = true;
+
+EXIT:
+	if(data) free(data);
+	depressBitmaskDestroy(&mask);
+	depressBitmaskDestroy(&decoded);
+
+	return success;
+}
+
+// Single strip chunk keeps G4 data right after the header, bad strip counts are rejected
+static bool testMakeChunk(void)
+{
+	const unsigned char strip[3] = { 0x00, 0x10, 0x01 };
+	const unsigned char *strips[2] = { strip, strip };
+	const size_t strip_sizes[2] = { sizeof(strip), sizeof(strip) };
+	unsigned char *data = 0;
+	size_t size = 0;
+	bool success = false;
+
+	if(!depressMmrMakeChunk(100, 50, true, 50, strips, strip_sizes, 1, &data, &size)) goto EXIT;
+	if(size != 8+sizeof(strip) || testReadBE(data, 4) != 0x4d4d5201 || testReadBE(data+4, 2) != 100
+		|| testReadBE(data+6, 2) != 50 || memcmp(data+8, strip, sizeof(strip))) goto EXIT;
+	free(data);
+	data = 0;
+
+	if(depressMmrMakeChunk(100, 50, false, 10, strips, strip_sizes, 2, &data, &size)) goto EXIT;
+	if(depressMmrMakeChunk(0, 50, false, 50, strips, strip_sizes, 1, &data, &size)) goto EXIT;
+	if(depressMmrMakeChunk(70000, 50, false, 50, strips, strip_sizes, 1, &data, &size)) goto EXIT;
+
+	success = true;
+
+EXIT:
+	if(data) free(data);
+	if(!success) fprintf(stderr, "depressMmrMakeChunk failed\n");
+
+	return success;
+}
+
+// Truncated strips, invalid codes and runs past the end of row must fail without reading out of bounds
+static bool testMalformed(void)
+{
+	depress_bitmask_type mask = { 0 }, decoded = { 0 };
+	unsigned char *data = 0, zeros[16] = { 0 }, *garbage = 0;
+	// Horizontal mode, white run of 64 (11011 00110101) and black run of 0 (0000110111), wider than row
+	const unsigned char too_long[4] = { 0x3b, 0x35, 0x0d, 0xc0 };
+	size_t size = 0, strip_size, i;
+	bool success = false;
+
+	if(!depressBitmaskCreate(&mask, TEST_WIDTH, TEST_HEIGHT) || !depressBitmaskCreate(&decoded, TEST_WIDTH, TEST_HEIGHT)) goto EXIT;
+	testMakePage(&mask);
+	if(!depressMmrEncode(&mask, &data, &size)) goto EXIT;
+
+	strip_size = testReadBE(data+10, 4);
+	if(depressMmrDecode(data+14, strip_size/2, TEST_WIDTH, 512, depressBitmaskRow(&decoded, 0), decoded.stride)) {
+		fprintf(stderr, "truncated strip is decoded\n");
+		goto EXIT;
+	}
+	if(depressMmrDecode(zeros, sizeof(zeros), TEST_WIDTH, 4, depressBitmaskRow(&decoded, 0), decoded.stride)) {
+		fprintf(stderr, "invalid code is decoded\n");
+		goto EXIT;
+	}
+	if(depressMmrDecode(too_long, sizeof(too_long), 32, 1, depressBitmaskRow(&decoded, 0), decoded.stride)) {
+		fprintf(stderr, "run past the end of row is decoded\n");
+		goto EXIT;
+	}
+	if(depressMmrDecode(data+14, strip_size, 0, 512, depressBitmaskRow(&decoded, 0), decoded.stride)) {
+		fprintf(stderr, "zero width is decoded\n");
+		goto EXIT;
+	}
+
+	// Random data may decode or not, but must stay in bounds
+	garbage = malloc(4096);
+	if(!garbage) goto EXIT;
+	srand(2);
+	for(i = 0; i < 64; i++) {
+		size_t j;
+
+		for(j = 0; j < 4096; j++)
+			garbage[j] = (unsigned char)rand();
+		depressMmrDecode(garbage, 4096, TEST_WIDTH, 64, depressBitmaskRow(&decoded, 0), decoded.stride);
+	}
+
+	success = true;
+
+EXIT:
+	if(data) free(data);
+	if(garbage) free(garbage);
+	depressBitmaskDestroy(&mask);
+	depressBitmaskDestroy(&decoded);
+
+	return success;
+}
+
+int main(void)
+{
+	int failed = 0;
+
+	if(!testRoundTrip(TEST_WIDTH, TEST_HEIGHT, false)) failed++;
+	if(!testRoundTrip(1, 1, true)) failed++;
+	if(!testRoundTrip(64, 3, true)) failed++;
+	if(!testRoundTrip(17, 600, false)) failed++;
+	if(!testMakeChunk()) failed++;
+	if(!testMalformed()) failed++;
+
+	if(failed) {
+		fprintf(stderr, "%d checks failed\n", failed);
+		return 1;
+	}
+
+	printf("mmr: ok\n");
+
+	return 0;
+}
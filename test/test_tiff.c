@@ -0,0 +1,597 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Checks decoding of TIFF pages built in memory (every compression, byte orders,
+// orientations, padded strips, extracted and named pages) and rejection of damaged files
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "../include/depress_tiff.h"
+#include "../include/depress_bitmask.h"
+#include "../include/depress_mmr.h"
+#include "../include/depress_image.h"
+
+#define TEST_MAX_ENTRIES 16
+#define TEST_MAX_STRIPS 8
+#define TEST_MAX_PAGES 3
+#define TEST_FILE_SIZE (1 << 20)
+
+enum {
+	TEST_SHORT = 3,
+	TEST_LONG = 4
+};
+
+typedef struct {
+	unsigned int tag;
+	unsigned int type;
+	size_t count;
+	uint32_t values[4];
+} test_tiff_entry_type;
+
+// Strip offsets and sizes are added while writing
+typedef struct {
+	test_tiff_entry_type entries[TEST_MAX_ENTRIES];
+	size_t nof_entries;
+	const unsigned char *strips[TEST_MAX_STRIPS];
+	size_t strip_sizes[TEST_MAX_STRIPS];
+	size_t nof_strips;
+} test_tiff_page_type;
+
+static void testAddEntry(test_tiff_page_type *page, unsigned int tag, unsigned int type, size_t count, const uint32_t *values)
+{
+	test_tiff_entry_type *e = page->entries+page->nof_entries++;
+
+	e->tag = tag;
+	e->type = type;
+	e->count = count;
+	memcpy(e->values, values, count*sizeof(uint32_t));
+}
+
+static void testAddValue(test_tiff_page_type *page, unsigned int tag, uint32_t value)
+{
+	testAddEntry(page, tag, (value > 0xffff)?TEST_LONG:TEST_SHORT, 1, &value);
+}
+
+static void testAddStrip(test_tiff_page_type *page, const unsigned char *data, size_t size)
+{
+	page->strips[page->nof_strips] = data;
+	page->strip_sizes[page->nof_strips] = size;
+	page->nof_strips++;
+}
+
+// Basic page, strips go from the caller
+static void testInitPage(test_tiff_page_type *page, uint32_t width, uint32_t height, unsigned int bits, unsigned int samples, unsigned int compression, unsigned int photometric, uint32_t rows_per_strip)
+{
+	uint32_t bits_per_sample[4];
+	unsigned int i;
+
+	memset(page, 0, sizeof(test_tiff_page_type));
+
+	for(i = 0; i < samples; i++)
+		bits_per_sample[i] = bits;
+
+	testAddValue(page, 256, width);
+	testAddValue(page, 257, height);
+	testAddEntry(page, 258, TEST_SHORT, samples, bits_per_sample);
+	testAddValue(page, 259, compression);
+	testAddValue(page, 262, photometric);
+	testAddValue(page, 277, samples);
+	testAddValue(page, 278, rows_per_strip);
+}
+
+static void testPut(unsigned char *p, uint32_t v, unsigned int bytes, bool big_endian)
+{
+	unsigned int i;
+
+	for(i = 0; i < bytes; i++)
+		p[big_endian?(bytes-i-1):i] = (unsigned char)(v >> (8*i));
+}
+
+static int testCompareEntries(const void *a, const void *b)
+{
+	return (int)((const test_tiff_entry_type *)a)->tag-(int)((const test_tiff_entry_type *)b)->tag;
+}
+
+// Writes strips, arrays of values and IFD of every page, returns size of file
+static size_t testWriteTiff(unsigned char *out, bool big_endian, test_tiff_page_type *pages, size_t nof_pages)
+{
+	size_t pos = 8, next_pos = 4, p, i, e;
+
+	memset(out, 0, TEST_FILE_SIZE);
+	memcpy(out, big_endian?"MM\0*":"II*\0", 4);
+
+	for(p = 0; p < nof_pages; p++) {
+		test_tiff_page_type page = pages[p];
+		uint32_t offsets[TEST_MAX_STRIPS], sizes[TEST_MAX_STRIPS];
+
+		for(i = 0; i < page.nof_strips; i++) {
+			offsets[i] = (uint32_t)pos;
+			sizes[i] = (uint32_t)page.strip_sizes[i];
+			memcpy(out+pos, page.strips[i], page.strip_sizes[i]);
+			pos += (page.strip_sizes[i]+1) & ~(size_t)1;
+		}
+
+		// Offsets and sizes of more than one strip don't fit into entry
+		page.entries[page.nof_entries].tag = 273;
+		page.entries[page.nof_entries].type = TEST_LONG;
+		page.entries[page.nof_entries].count = page.nof_strips;
+		page.nof_entries++;
+		page.entries[page.nof_entries].tag = 279;
+		page.entries[page.nof_entries].type = TEST_LONG;
+		page.entries[page.nof_entries].count = page.nof_strips;
+		page.nof_entries++;
+		qsort(page.entries, page.nof_entries, sizeof(test_tiff_entry_type), testCompareEntries);
+
+		testPut(out+next_pos, (uint32_t)pos, 4, big_endian);
+		testPut(out+pos, (uint32_t)page.nof_entries, 2, big_endian);
+		next_pos = pos+2+12*page.nof_entries;
+
+		{
+			size_t values_pos = next_pos+4;
+
+			for(e = 0; e < page.nof_entries; e++) {
+				test_tiff_entry_type *entry = page.entries+e;
+				unsigned char *q = out+pos+2+12*e;
+				unsigned int type_size = (entry->type == TEST_SHORT)?2:4;
+				const uint32_t *values = entry->values;
+				unsigned char *v;
+
+				if(entry->tag == 273) values = offsets;
+				if(entry->tag == 279) values = sizes;
+
+				testPut(q, entry->tag, 2, big_endian);
+				testPut(q+2, entry->type, 2, big_endian);
+				testPut(q+4, (uint32_t)entry->count, 4, big_endian);
+
+				if(entry->count*type_size <= 4)
+					v = q+8;
+				else {
+					testPut(q+8, (uint32_t)values_pos, 4, big_endian);
+					v = out+values_pos;
+					values_pos += entry->count*type_size;
+				}
+				for(i = 0; i < entry->count; i++)
+					testPut(v+i*type_size, values[i], type_size, big_endian);
+			}
+
+			pos = (values_pos+1) & ~(size_t)1;
+		}
+	}
+
+	return pos;
+}
+
+static bool testDecode(const unsigned char *file, size_t size, size_t page, int width, int height, int channels, const unsigned char *expected)
+{
+	size_t *ifds = 0, nof_pages = 0;
+	unsigned char *buf = 0;
+	int sizex, sizey, nof_channels;
+	bool success = false;
+
+	if(!depressTiffGetPages(file, size, &ifds, &nof_pages) || page >= nof_pages) goto EXIT;
+	if(!depressTiffDecodePage(file, size, ifds[page], &sizex, &sizey, &nof_channels, &buf)) goto EXIT;
+	if(sizex != width || sizey != height || nof_channels != channels) goto EXIT;
+
+	success = !memcmp(buf, expected, (size_t)width*height*channels);
+
+EXIT:
+	if(ifds) free(ifds);
+	if(buf) free(buf);
+
+	return success;
+}
+
+// Gray page of 3 strips, the last one is short, in both byte orders
+static bool testUncompressed(unsigned char *file)
+{
+	unsigned char pixels[7*5];
+	test_tiff_page_type page;
+	size_t size, i;
+	int big_endian;
+
+	for(i = 0; i < sizeof(pixels); i++)
+		pixels[i] = (unsigned char)(i*7);
+
+	for(big_endian = 0; big_endian < 2; big_endian++) {
+		testInitPage(&page, 7, 5, 8, 1, 1, 1, 2);
+		testAddStrip(&page, pixels, 14);
+		testAddStrip(&page, pixels+14, 14);
+		testAddStrip(&page, pixels+28, 7);
+		size = testWriteTiff(file, big_endian, &page, 1);
+		if(!testDecode(file, size, 0, 7, 5, 1, pixels)) return false;
+	}
+
+	return true;
+}
+
+// RGB with 4 bits per sample is scaled to full 8 bit range
+static bool testRgb4Bits(unsigned char *file)
+{
+	// Pixels (15, 0, 8), (1, 2, 3) and padding
+	const unsigned char packed[5] = { 0xf0, 0x81, 0x23, 0x00, 0x00 };
+	const unsigned char expected[6] = { 255, 0, 136, 17, 34, 51 };
+	test_tiff_page_type page;
+	size_t size;
+
+	testInitPage(&page, 2, 1, 4, 3, 1, 2, 1);
+	testAddStrip(&page, packed, 3);
+	size = testWriteTiff(file, false, &page, 1);
+
+	return testDecode(file, size, 0, 2, 1, 3, expected);
+}
+
+// RGB with PackBits, runs and literals, in big endian file
+static bool testPackBits(unsigned char *file)
+{
+	// Two rows of 4 pixels: runs of 4 bytes and literal bytes, then literal row
+	const unsigned char packed[] = { 0xfd, 200, 0xfd, 10, 0x03, 7, 8, 9, 10,
+		0x0b, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+	const unsigned char expected[24] = { 200, 200, 200, 200, 10, 10, 10, 10, 7, 8, 9, 10,
+		1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+	test_tiff_page_type page;
+	size_t size;
+
+	testInitPage(&page, 4, 2, 8, 3, 32773, 2, 2);
+	testAddStrip(&page, packed, sizeof(packed));
+	size = testWriteTiff(file, true, &page, 1);
+
+	return testDecode(file, size, 0, 4, 2, 3, expected);
+}
+
+static uint32_t testAdler32(const unsigned char *data, size_t size)
+{
+	uint32_t a = 1, b = 0;
+	size_t i;
+
+	for(i = 0; i < size; i++) {
+		a = (a+data[i])%65521;
+		b = (b+a)%65521;
+	}
+
+	return (b << 16) | a;
+}
+
+// zlib stream with one stored block
+static size_t testZlibStore(const unsigned char *data, size_t size, unsigned char *out)
+{
+	uint32_t adler = testAdler32(data, size);
+
+	out[0] = 0x78;
+	out[1] = 0x01;
+	out[2] = 0x01; // Final stored block
+	out[3] = (unsigned char)size;
+	out[4] = (unsigned char)(size >> 8);
+	out[5] = (unsigned char)~size;
+	out[6] = (unsigned char)(~size >> 8);
+	memcpy(out+7, data, size);
+	testPut(out+7+size, adler, 4, true);
+
+	return size+11;
+}
+
+// The last strip of Deflate page is padded to full rows per strip
+static bool testDeflatePadded(unsigned char *file)
+{
+	unsigned char pixels[6*8] = { 0 }, strip1[64], strip2[64];
+	test_tiff_page_type page;
+	size_t size, size1, size2, i;
+
+	for(i = 0; i < 6*5; i++)
+		pixels[i] = (unsigned char)(255-i*3);
+
+	testInitPage(&page, 6, 5, 8, 1, 8, 1, 4);
+	size1 = testZlibStore(pixels, 24, strip1);
+	size2 = testZlibStore(pixels+24, 24, strip2); // 4 rows instead of 1
+	testAddStrip(&page, strip1, size1);
+	testAddStrip(&page, strip2, size2);
+	size = testWriteTiff(file, false, &page, 1);
+
+	return testDecode(file, size, 0, 6, 5, 1, pixels);
+}
+
+// LZW of literal codes only, cleared before codes grow to 10 bits, with horizontal predictor
+static bool testLzwPredictor(unsigned char *file)
+{
+	unsigned char pixels[16*4], diffs[16*4], lzw[128] = { 0 };
+	test_tiff_page_type page;
+	size_t size, i, bit = 0;
+	unsigned int codes[80], nof_codes = 0, c;
+
+	for(i = 0; i < sizeof(pixels); i++)
+		pixels[i] = (unsigned char)((i%16)*(i/16+1)*5);
+	for(i = 0; i < sizeof(pixels); i++)
+		diffs[i] = (unsigned char)((i%16)?(pixels[i]-pixels[i-1]):pixels[i]);
+
+	codes[nof_codes++] = 256;
+	for(i = 0; i < sizeof(diffs); i++)
+		codes[nof_codes++] = diffs[i];
+	codes[nof_codes++] = 257;
+
+	for(c = 0; c < nof_codes; c++) {
+		unsigned int b;
+
+		for(b = 0; b < 9; b++, bit++)
+			if(codes[c] & (0x100 >> b)) lzw[bit/8] |= (unsigned char)(0x80 >> (bit%8));
+	}
+
+	testInitPage(&page, 16, 4, 8, 1, 5, 1, 4);
+	testAddValue(&page, 317, 2);
+	testAddStrip(&page, lzw, (bit+7)/8);
+	size = testWriteTiff(file, false, &page, 1);
+
+	return testDecode(file, size, 0, 16, 4, 1, pixels);
+}
+
+// G4 bilevel page of two strips, made by G4 encoder
+static bool testG4(unsigned char *file)
+{
+	depress_bitmask_type mask = { 0 };
+	unsigned char *chunk = 0, *expected = 0;
+	test_tiff_page_type page;
+	size_t chunk_size, size, pos, s;
+	unsigned int x, y;
+	bool success = false;
+
+	if(!depressBitmaskCreate(&mask, 100, 600)) return false;
+	expected = malloc(100*600);
+	if(!expected) goto EXIT;
+
+	for(y = 0; y < 600; y++)
+		for(x = 0; x < 100; x++) {
+			bool black = ((x/10+y/7)%3 == 0);
+
+			if(black) depressBitmaskRow(&mask, y)[x/8] |= (unsigned char)(0x80 >> (x%8));
+			expected[y*100+x] = black?0:255;
+		}
+
+	if(!depressMmrEncode(&mask, &chunk, &chunk_size)) goto EXIT;
+
+	// Strips of Smmr chunk are prefixed by their sizes after 10 bytes of header
+	testInitPage(&page, 100, 600, 1, 1, 4, 0, (chunk[8] << 8) | chunk[9]);
+	for(pos = 10, s = 0; pos < chunk_size && s < TEST_MAX_STRIPS; s++) {
+		size_t strip_size = ((size_t)chunk[pos] << 24) | ((size_t)chunk[pos+1] << 16) | ((size_t)chunk[pos+2] << 8) | chunk[pos+3];
+
+		testAddStrip(&page, chunk+pos+4, strip_size);
+		pos += 4+strip_size;
+	}
+	size = testWriteTiff(file, false, &page, 1);
+
+	success = page.nof_strips == 2 && testDecode(file, size, 0, 100, 600, 1, expected);
+
+EXIT:
+	if(chunk) free(chunk);
+	if(expected) free(expected);
+	depressBitmaskDestroy(&mask);
+
+	return success;
+}
+
+// Every orientation of 3x2 page, expected pixels are as seen on screen
+static bool testOrientation(unsigned char *file)
+{
+	const unsigned char pixels[6] = { 1, 2, 3, 4, 5, 6 };
+	static const unsigned char expected[9][6] = {
+		{ 0 },
+		{ 1, 2, 3, 4, 5, 6 },
+		{ 3, 2, 1, 6, 5, 4 },
+		{ 6, 5, 4, 3, 2, 1 },
+		{ 4, 5, 6, 1, 2, 3 },
+		{ 1, 4, 2, 5, 3, 6 },
+		{ 4, 1, 5, 2, 6, 3 },
+		{ 6, 3, 5, 2, 4, 1 },
+		{ 3, 6, 2, 5, 1, 4 }
+	};
+	test_tiff_page_type page;
+	unsigned int orientation;
+	size_t size;
+
+	for(orientation = 1; orientation <= 8; orientation++) {
+		testInitPage(&page, 3, 2, 8, 1, 1, 1, 2);
+		testAddValue(&page, 274, orientation);
+		testAddStrip(&page, pixels, 6);
+		size = testWriteTiff(file, orientation%2, &page, 1);
+
+		if(!testDecode(file, size, 0, (orientation >= 5)?2:3, (orientation >= 5)?3:2, 1, expected[orientation])) {
+			fprintf(stderr, "orientation %u\n", orientation);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Page extracted from multi-page file decodes the same, with its orientation
+static bool testExtract(unsigned char *file)
+{
+	const unsigned char gray[6] = { 10, 20, 30, 40, 50, 60 };
+	const unsigned char turned[6] = { 40, 10, 50, 20, 60, 30 };
+	test_tiff_page_type pages[2];
+	unsigned char *extracted = 0;
+	size_t size, extracted_size, *ifds = 0, nof_pages;
+	bool success = false;
+
+	testInitPage(pages, 3, 2, 8, 1, 1, 1, 2);
+	testAddStrip(pages, gray, 6);
+	testInitPage(pages+1, 3, 2, 8, 1, 1, 1, 2);
+	testAddValue(pages+1, 274, 6);
+	testAddStrip(pages+1, gray, 6);
+	size = testWriteTiff(file, true, pages, 2);
+
+	if(!depressTiffGetPages(file, size, &ifds, &nof_pages) || nof_pages != 2) goto EXIT;
+	if(!depressTiffExtractPage(file, size, ifds[1], &extracted, &extracted_size)) goto EXIT;
+
+	success = testDecode(extracted, extracted_size, 0, 2, 3, 1, turned) && testDecode(file, size, 0, 3, 2, 1, gray);
+
+EXIT:
+	if(ifds) free(ifds);
+	if(extracted) free(extracted);
+
+	return success;
+}
+
+// Pages of multi-page file get names with page numbers
+static bool testNames(unsigned char *file)
+{
+	const unsigned char gray[4] = { 0, 85, 170, 255 };
+	test_tiff_page_type pages[TEST_MAX_PAGES];
+	const wchar_t *filename = L"test_tiff_pages.tif";
+	wchar_t expected[64];
+	void *ctx = 0;
+	FILE *f;
+	size_t size, nof_pages = 0, i;
+	bool success = false;
+
+	for(i = 0; i < TEST_MAX_PAGES; i++) {
+		testInitPage(pages+i, 2, 2, 8, 1, 1, 1, 2);
+		testAddStrip(pages+i, gray, 4);
+	}
+	size = testWriteTiff(file, false, pages, TEST_MAX_PAGES);
+
+	f = fopen("test_tiff_pages.tif", "wb");
+	if(!f) return false;
+	if(fwrite(file, 1, size, f) != size) {
+		fclose(f);
+		goto EXIT;
+	}
+	fclose(f);
+
+	ctx = depressImageTiffCreateCtx(filename, 5, &nof_pages);
+	if(!ctx || nof_pages != TEST_MAX_PAGES) goto EXIT;
+
+	for(i = 0; i < nof_pages; i++) {
+		swprintf(expected, 64, L"%ls/%u", filename, (unsigned int)(i+1));
+		if(wcscmp(depressImageTiffGetNameCtx(ctx, 5+i), expected)) goto EXIT;
+	}
+
+	success = true;
+
+EXIT:
+	if(ctx)
+		for(i = 0; i < nof_pages; i++)
+			depressImageTiffFreeCtx(ctx, 5+i);
+	remove("test_tiff_pages.tif");
+
+	return success;
+}
+
+// Damaged files, unsupported pages and every truncation of valid file
+static bool testMalformed(unsigned char *file)
+{
+	unsigned char pixels[16] = { 0 }, *copy, *buf = 0;
+	test_tiff_page_type page;
+	size_t size, ifd, *ifds = 0, nof_pages, cut;
+	int sizex, sizey, channels, failed = 0;
+
+	// Orientation out of range, JPEG compression, tiles, zero width
+	testInitPage(&page, 4, 4, 8, 1, 1, 1, 4);
+	testAddValue(&page, 274, 9);
+	testAddStrip(&page, pixels, 16);
+	size = testWriteTiff(file, false, &page, 1);
+	if(depressTiffDecodePage(file, size, depressTiffGetFirstPage(file, size), &sizex, &sizey, &channels, &buf)) failed++;
+
+	testInitPage(&page, 4, 4, 8, 1, 7, 1, 4);
+	testAddStrip(&page, pixels, 16);
+	size = testWriteTiff(file, false, &page, 1);
+	if(depressTiffDecodePage(file, size, depressTiffGetFirstPage(file, size), &sizex, &sizey, &channels, &buf)) failed++;
+
+	testInitPage(&page, 4, 4, 8, 1, 1, 1, 4);
+	testAddValue(&page, 322, 16);
+	testAddStrip(&page, pixels, 16);
+	size = testWriteTiff(file, false, &page, 1);
+	if(depressTiffDecodePage(file, size, depressTiffGetFirstPage(file, size), &sizex, &sizey, &channels, &buf)) failed++;
+
+	testInitPage(&page, 0, 4, 8, 1, 1, 1, 4);
+	testAddStrip(&page, pixels, 16);
+	size = testWriteTiff(file, false, &page, 1);
+	if(depressTiffDecodePage(file, size, depressTiffGetFirstPage(file, size), &sizex, &sizey, &channels, &buf)) failed++;
+
+	// Strip past the end of file, IFD past the end of file, not TIFF at all
+	testInitPage(&page, 4, 4, 8, 1, 1, 1, 4);
+	testAddStrip(&page, pixels, 16);
+	size = testWriteTiff(file, false, &page, 1);
+	ifd = depressTiffGetFirstPage(file, size);
+	if(!ifd) failed++;
+	if(depressTiffDecodePage(file, 8+15, ifd, &sizex, &sizey, &channels, &buf)) failed++;
+	testPut(file+4, (uint32_t)size, 4, false);
+	if(depressTiffGetPages(file, size, &ifds, &nof_pages)) failed++;
+	if(depressTiffIsTiff((const unsigned char *)"GIF89a\0\0", 8)) failed++;
+
+	// Every prefix of multi-strip file, decoding may fail but must stay in bounds
+	if(!testUncompressed(file)) failed++;
+	size = testWriteTiff(file, true, &page, 1);
+	copy = malloc(size);
+	if(!copy) return false;
+	for(cut = 0; cut < size; cut++) {
+		memcpy(copy, file, cut);
+		if(depressTiffGetPages(copy, cut, &ifds, &nof_pages)) {
+			if(depressTiffDecodePage(copy, cut, ifds[0], &sizex, &sizey, &channels, &buf)) free(buf);
+			free(ifds);
+		}
+	}
+	free(copy);
+
+	if(failed) fprintf(stderr, "%d malformed TIFF checks failed\n", failed);
+
+	return failed == 0;
+}
+
+int main(void)
+{
+	unsigned char *file;
+	int failed = 0;
+
+	file = malloc(TEST_FILE_SIZE);
+	if(!file) return 1;
+
+	if(!testUncompressed(file)) { fprintf(stderr, "uncompressed page\n"); failed++; }
+	if(!testRgb4Bits(file)) { fprintf(stderr, "RGB with 4 bits per sample\n"); failed++; }
+	if(!testPackBits(file)) { fprintf(stderr, "PackBits\n"); failed++; }
+	if(!testDeflatePadded(file)) { fprintf(stderr, "padded Deflate strip\n"); failed++; }
+	if(!testLzwPredictor(file)) { fprintf(stderr, "LZW with predictor\n"); failed++; }
+	if(!testG4(file)) { fprintf(stderr, "G4\n"); failed++; }
+	if(!testOrientation(file)) { fprintf(stderr, "orientation\n"); failed++; }
+	if(!testExtract(file)) { fprintf(stderr, "extracted page\n"); failed++; }
+	if(!testNames(file)) { fprintf(stderr, "page names\n"); failed++; }
+	if(!testMalformed(file)) failed++;
+
+	free(file);
+
+	if(failed) {
+		fprintf(stderr, "%d checks failed\n", failed);
+		return 1;
+	}
+
+	printf("tiff: ok\n");
+
+	return 0;
+}
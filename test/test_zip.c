@@ -0,0 +1,349 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2025, Mikhail Morozov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Checks listing and unpacking of ZIP archives built in memory (stored and deflated files,
+// CRC-32 mismatch, every truncation) and natural order of archive pages
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "../include/depress_zip.h"
+#include "../include/depress_image.h"
+
+#define TEST_MAX_FILES 8
+#define TEST_FILE_SIZE 4096
+
+typedef struct {
+	const char *name;
+	const unsigned char *data;
+	size_t size;
+	unsigned int method;
+	uint32_t crc32;
+} test_zip_file_type;
+
+static void testWrite(unsigned char *file, size_t *pos, uint32_t value, unsigned int bytes)
+{
+	unsigned int i;
+
+	for(i = 0; i < bytes; i++)
+		file[(*pos)++] = (unsigned char)(value >> (8*i));
+}
+
+// Reference CRC-32 computed bit by bit
+static uint32_t testCrc32(const unsigned char *data, size_t size)
+{
+	uint32_t crc = 0xffffffff;
+	size_t i;
+
+	for(i = 0; i < size; i++) {
+		unsigned int k;
+
+		crc ^= data[i];
+		for(k = 0; k < 8; k++)
+			crc = (crc & 1)?(0xedb88320 ^ (crc >> 1)):(crc >> 1);
+	}
+
+	return crc ^ 0xffffffff;
+}
+
+// Deflated files are written as one stored deflate block
+static size_t testWriteZip(unsigned char *file, const test_zip_file_type *files, size_t nof_files)
+{
+	size_t local_headers[TEST_MAX_FILES], pos = 0, cd_pos, i;
+
+	for(i = 0; i < nof_files; i++) {
+		size_t name_length = strlen(files[i].name);
+		size_t compressed_size = files[i].size+((files[i].method == 8)?5:0);
+
+		local_headers[i] = pos;
+		testWrite(file, &pos, 0x04034b50, 4);
+		testWrite(file, &pos, 20, 2);
+		testWrite(file, &pos, 0, 2);
+		testWrite(file, &pos, files[i].method, 2);
+		testWrite(file, &pos, 0, 4);
+		testWrite(file, &pos, files[i].crc32, 4);
+		testWrite(file, &pos, (uint32_t)compressed_size, 4);
+		testWrite(file, &pos, (uint32_t)files[i].size, 4);
+		testWrite(file, &pos, (uint32_t)name_length, 2);
+		testWrite(file, &pos, 0, 2);
+		memcpy(file+pos, files[i].name, name_length);
+		pos += name_length;
+
+		if(files[i].method == 8) {
+			file[pos++] = 0x01;
+			testWrite(file, &pos, (uint32_t)files[i].size, 2);
+			testWrite(file, &pos, (uint32_t)files[i].size ^ 0xffff, 2);
+		}
+		memcpy(file+pos, files[i].data, files[i].size);
+		pos += files[i].size;
+	}
+
+	cd_pos = pos;
+	for(i = 0; i < nof_files; i++) {
+		size_t name_length = strlen(files[i].name);
+		size_t compressed_size = files[i].size+((files[i].method == 8)?5:0);
+
+		testWrite(file, &pos, 0x02014b50, 4);
+		testWrite(file, &pos, 20, 2);
+		testWrite(file, &pos, 20, 2);
+		testWrite(file, &pos, 0, 2);
+		testWrite(file, &pos, files[i].method, 2);
+		testWrite(file, &pos, 0, 4);
+		testWrite(file, &pos, files[i].crc32, 4);
+		testWrite(file, &pos, (uint32_t)compressed_size, 4);
+		testWrite(file, &pos, (uint32_t)files[i].size, 4);
+		testWrite(file, &pos, (uint32_t)name_length, 2);
+		testWrite(file, &pos, 0, 2);
+		testWrite(file, &pos, 0, 2);
+		testWrite(file, &pos, 0, 2);
+		testWrite(file, &pos, 0, 2);
+		testWrite(file, &pos, 0, 4);
+		testWrite(file, &pos, (uint32_t)local_headers[i], 4);
+		memcpy(file+pos, files[i].name, name_length);
+		pos += name_length;
+	}
+
+	testWrite(file, &pos, 0x06054b50, 4);
+	testWrite(file, &pos, 0, 2);
+	testWrite(file, &pos, 0, 2);
+	testWrite(file, &pos, (uint32_t)nof_files, 2);
+	testWrite(file, &pos, (uint32_t)nof_files, 2);
+	testWrite(file, &pos, (uint32_t)(pos-cd_pos-12), 4);
+	testWrite(file, &pos, (uint32_t)cd_pos, 4);
+	testWrite(file, &pos, 0, 2);
+
+	return pos;
+}
+
+static bool testCrc(void)
+{
+	return testCrc32((const unsigned char *)"123456789", 9) == 0xcbf43926;
+}
+
+// Every file is listed with its name and unpacked to the same bytes
+static bool testRoundTrip(unsigned char *file)
+{
+	static const unsigned char text[] = "depress", digits[] = "0123456789";
+	test_zip_file_type files[2] = {
+		{ "dir/stored.txt", text, sizeof(text)-1, 0, 0 },
+		{ "deflated.txt", digits, sizeof(digits)-1, 8, 0 }
+	};
+	depress_zip_entry_type *entries = 0;
+	size_t size, nof_entries = 0, i;
+	bool success = false;
+
+	for(i = 0; i < 2; i++)
+		files[i].crc32 = testCrc32(files[i].data, files[i].size);
+	size = testWriteZip(file, files, 2);
+
+	if(!depressZipIsZip(file, size)) return false;
+	if(!depressZipGetEntries(file, size, &entries, &nof_entries) || nof_entries != 2) goto EXIT;
+
+	for(i = 0; i < 2; i++) {
+		wchar_t name[32];
+		unsigned char *data;
+		size_t data_size;
+		bool same;
+
+		swprintf(name, 32, L"%s", files[i].name);
+		if(wcscmp(entries[i].name, name) || entries[i].method != files[i].method || entries[i].crc32 != files[i].crc32) goto EXIT;
+
+		if(!depressZipReadEntry(file, size, entries+i, &data, &data_size)) goto EXIT;
+		same = data_size == files[i].size && !memcmp(data, files[i].data, data_size);
+		free(data);
+		if(!same) goto EXIT;
+	}
+
+	success = true;
+
+EXIT:
+	depressZipFreeEntries(entries, nof_entries);
+
+	return success;
+}
+
+// Damaged files are not returned as pages
+static bool testCrcMismatch(unsigned char *file)
+{
+	static const unsigned char text[] = "depress";
+	test_zip_file_type files[2] = {
+		{ "stored.txt", text, sizeof(text)-1, 0, 0 },
+		{ "deflated.txt", text, sizeof(text)-1, 8, 0 }
+	};
+	depress_zip_entry_type *entries = 0;
+	size_t size, nof_entries = 0, i;
+	bool success = false;
+
+	for(i = 0; i < 2; i++)
+		files[i].crc32 = testCrc32(text, sizeof(text)-1) ^ 0x1;
+	size = testWriteZip(file, files, 2);
+
+	if(!depressZipGetEntries(file, size, &entries, &nof_entries) || nof_entries != 2) goto EXIT;
+
+	for(i = 0; i < 2; i++) {
+		unsigned char *data;
+		size_t data_size;
+
+		if(depressZipReadEntry(file, size, entries+i, &data, &data_size)) {
+			free(data);
+			goto EXIT;
+		}
+		if(data || data_size) goto EXIT;
+	}
+
+	success = true;
+
+EXIT:
+	depressZipFreeEntries(entries, nof_entries);
+
+	return success;
+}
+
+// Every truncation of valid archive is rejected while listing or unpacking
+static bool testTruncated(unsigned char *file)
+{
+	static const unsigned char text[] = "depress";
+	test_zip_file_type files[2] = {
+		{ "stored.txt", text, sizeof(text)-1, 0, 0 },
+		{ "deflated.txt", text, sizeof(text)-1, 8, 0 }
+	};
+	size_t size, cut;
+	int failed = 0;
+
+	files[0].crc32 = files[1].crc32 = testCrc32(text, sizeof(text)-1);
+	size = testWriteZip(file, files, 2);
+
+	for(cut = 0; cut < size; cut++) {
+		depress_zip_entry_type *entries;
+		unsigned char *copy;
+		size_t nof_entries, i;
+		bool unpacked = false;
+
+		// Copy has exact size, so reads past the end are caught by sanitizers
+		copy = malloc(cut?cut:1);
+		if(!copy) return false;
+		memcpy(copy, file, cut);
+
+		if(depressZipGetEntries(copy, cut, &entries, &nof_entries)) {
+			for(i = 0; i < nof_entries; i++) {
+				unsigned char *data;
+				size_t data_size;
+
+				if(depressZipReadEntry(copy, cut, entries+i, &data, &data_size)) {
+					unpacked = true;
+					free(data);
+				}
+			}
+			depressZipFreeEntries(entries, nof_entries);
+		}
+		free(copy);
+
+		if(unpacked) {
+			fprintf(stderr, "archive cut to %u bytes is unpacked\n", (unsigned int)cut);
+			failed++;
+		}
+	}
+
+	return failed == 0;
+}
+
+// Pages are sorted by numbers in their names, other files are skipped
+static bool testPageOrder(unsigned char *file)
+{
+	static const unsigned char data[] = "x";
+	static const wchar_t *expected[] = {
+		L"test_zip_pages.zip/page1.png",
+		L"test_zip_pages.zip/page2.png",
+		L"test_zip_pages.zip/page10.png"
+	};
+	const test_zip_file_type files[4] = {
+		{ "page10.png", data, 1, 0, 0 },
+		{ "readme.txt", data, 1, 0, 0 },
+		{ "page2.png", data, 1, 0, 0 },
+		{ "page1.png", data, 1, 0, 0 }
+	};
+	void *ctx;
+	FILE *f;
+	size_t size, nof_pages = 0, i;
+	bool success = false;
+
+	size = testWriteZip(file, files, 4);
+
+	f = fopen("test_zip_pages.zip", "wb");
+	if(!f) return false;
+	if(fwrite(file, 1, size, f) != size) {
+		fclose(f);
+		goto EXIT;
+	}
+	fclose(f);
+
+	ctx = depressImageZipCreateCtx(L"test_zip_pages.zip", 3, &nof_pages);
+	if(!ctx) goto EXIT;
+
+	success = nof_pages == 3;
+	for(i = 0; i < nof_pages && success; i++)
+		if(wcscmp(depressImageZipGetNameCtx(ctx, 3+i), expected[i])) success = false;
+
+	for(i = 0; i < nof_pages; i++)
+		depressImageZipFreeCtx(ctx, 3+i);
+
+EXIT:
+	remove("test_zip_pages.zip");
+
+	return success;
+}
+
+int main(void)
+{
+	unsigned char *file;
+	int failed = 0;
+
+	file = malloc(TEST_FILE_SIZE);
+	if(!file) return 1;
+
+	if(!testCrc()) { fprintf(stderr, "CRC-32\n"); failed++; }
+	if(!testRoundTrip(file)) { fprintf(stderr, "round trip\n"); failed++; }
+	if(!testCrcMismatch(file)) { fprintf(stderr, "CRC-32 mismatch\n"); failed++; }
+	if(!testTruncated(file)) failed++;
+	if(!testPageOrder(file)) { fprintf(stderr, "page order\n"); failed++; }
+
+	free(file);
+
+	if(failed) {
+		fprintf(stderr, "%d checks failed\n", failed);
+		return 1;
+	}
+
+	printf("zip: ok\n");
+
+	return 0;
+}